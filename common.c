@@ -31,6 +31,7 @@
 #include "reed.h"
 #include <errno.h>
 #include <time.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* Put a 2-byte quantity to a file in little-endian order */
@@ -220,14 +221,49 @@ trs_disk_set_write_prot(FILE *f,
   }
 }
 
+/* Set the checksum in a hard disk header */
+static void
+reed_cksum(ReedHardHeader *rhh)
+{
+  Uchar *rhhp = (Uchar *) rhh;
+  int cksum = 0;
+  int i;
+
+  rhh->cksum = 0;
+  for (i=0; i<=31; i++) {
+    cksum += rhhp[i];
+  }
+  rhh->cksum = ((Uchar) cksum) ^ 0x4c;
+}
+
+/* Number of 256-byte header blocks taken by a sparse image's table */
+static int
+reed_sparse_blks(int ntracks)
+{
+  return (ntracks * 2 + 255) / 256;
+}
+
+/* Write n 256-byte blocks of zeros.  Returns -1 on error, 0 otherwise. */
+static int
+put_zero_blks(int n, FILE *f)
+{
+  int i;
+
+  for (i = 0; i < n * 256; i++) {
+    if (putc(0, f) == EOF) return -1;
+  }
+  return 0;
+}
+
 /*
  * Initialize a blank virtual hard disk with specified parameters.
- * -1 for a parameter chooses the default value.
+ * -1 for a parameter chooses the default value.  If sparse is set,
+ * make a sparse image (see reed.h).
  * Returns negative on error.  errno will have details.
  */
 int
 trs_hard_init_with(FILE *f,
-		   int cyl, int sec, int gran, int dir)
+		   int cyl, int sec, int gran, int dir, int sparse)
 {
   /* Blank hard disk */
   /* We don't care about most of this header, but we generate
@@ -237,10 +273,8 @@ trs_hard_init_with(FILE *f,
   */
   time_t tt = time(0);
   struct tm *lt = localtime(&tt);
-  Uchar *rhhp;
-  int cksum;
   ReedHardHeader rhh;
-  int i;
+  int tblks = 0;
 
   if (cyl == -1) cyl = 202;
   if (sec == -1) sec = 256;
@@ -312,17 +346,25 @@ trs_hard_init_with(FILE *f,
     errno = EINVAL;
     return -1;
   }
+  if (sparse) {
+    if (sec % REED_SPARSE_SECS != 0) {
+      error("sparse image needs (sec %% %d) == 0", REED_SPARSE_SECS);
+      errno = EINVAL;
+      return -1;
+    }
+    tblks = reed_sparse_blks(cyl * sec / REED_SPARSE_SECS);
+  }
 
   memset(&rhh, 0, sizeof(rhh));
   rhh.id1 = 0x56;
   rhh.id2 = 0xcb;
   rhh.ver = 0x10;
-  rhh.cksum = 0;  /* init for cksum computation */
-  rhh.blks = 1;
+  rhh.blks = 1 + tblks;
   rhh.mb4 = 4;
   rhh.media = 0;
   rhh.flag1 = 0;
-  rhh.flag2 = rhh.flag3 = 0;
+  rhh.flag2 = sparse ? REED_SPARSE : 0;
+  rhh.flag3 = 0;
   rhh.crtr = 0x42;
   rhh.dfmt = 0;
   rhh.mm = lt->tm_mon + 1;
@@ -334,15 +376,97 @@ trs_hard_init_with(FILE *f,
   rhh.gran = gran;
   rhh.dcyl = dir;
   strcpy(rhh.label, "xtrshard");
+  reed_cksum(&rhh);
 
-  cksum = 0;
-  rhhp = (Uchar *) &rhh;
-  for (i=0; i<=31; i++) {
-    cksum += rhhp[i];
+  if (fwrite(&rhh, sizeof(rhh), 1, f) != 1) return -1;
+  return put_zero_blks(tblks, f);
+}
+
+/*
+ * Copy hard disk image in to out, making out sparse if sparse is set
+ * or flat if not.  A sparse copy leaves out tracks that are all
+ * zeros, and a flat copy leaves out trailing ones, so copying a sparse
+ * image to a new sparse one compacts it.
+ * Returns negative on error.  errno will have details.
+ */
+int
+trs_hard_convert(FILE *in, FILE *out, int sparse)
+{
+  ReedHardHeader rhh;
+  Uchar buf[REED_SPARSE_TRACK];
+  Ushort *inmap = NULL, *outmap = NULL;
+  long inbase;
+  int insparse, ntracks, tblks, used = 0, res = -1;
+  int i, j;
+  size_t n;
+
+  if (fread(&rhh, sizeof(rhh), 1, in) != 1 ||
+      rhh.id1 != 0x56 || rhh.id2 != 0xcb) {
+    error("input is not a hard disk image");
+    errno = EINVAL;
+    return -1;
+  }
+  if ((rhh.sec ? rhh.sec : 256) % REED_SPARSE_SECS != 0) {
+    error("input has an unusable geometry");
+    errno = EINVAL;
+    return -1;
+  }
+  ntracks = (rhh.cyl ? rhh.cyl : 256) * (rhh.sec ? rhh.sec : 256)
+    / REED_SPARSE_SECS;
+  insparse = (rhh.flag2 & REED_SPARSE) != 0;
+  inmap = (Ushort *) calloc(ntracks, sizeof(Ushort));
+  outmap = (Ushort *) calloc(ntracks, sizeof(Ushort));
+  if (inmap == NULL || outmap == NULL) goto done;
+  if (insparse) {
+    for (i = 0; i < ntracks; i++) {
+      if (get_twobyte(&inmap[i], in) < 0) {
+	error("input has a truncated allocation table");
+	errno = EINVAL;
+	goto done;
+      }
+    }
+    inbase = rhh.blks * 256L;
+  } else {
+    inbase = sizeof(rhh);
+  }
+
+  tblks = sparse ? reed_sparse_blks(ntracks) : 0;
+  rhh.blks = 1 + tblks;
+  rhh.flag2 = (rhh.flag2 & ~REED_SPARSE) | (sparse ? REED_SPARSE : 0);
+  reed_cksum(&rhh);
+  if (fwrite(&rhh, sizeof(rhh), 1, out) != 1) goto done;
+  if (put_zero_blks(tblks, out) < 0) goto done;
+
+  for (i = 0; i < ntracks; i++) {
+    n = 0;
+    if (!insparse || inmap[i] != 0) {
+      fseek(in, inbase + (long) (insparse ? inmap[i] - 1 : i)
+	    * REED_SPARSE_TRACK, 0);
+      n = fread(buf, 1, sizeof(buf), in);
+    }
+    memset(buf + n, 0, sizeof(buf) - n);
+    for (j = 0; j < REED_SPARSE_TRACK && buf[j] == 0; j++) /**/;
+    if (j == REED_SPARSE_TRACK) continue;
+    if (sparse) {
+      outmap[i] = ++used;
+    } else {
+      fseek(out, sizeof(rhh) + (long) i * REED_SPARSE_TRACK, 0);
+    }
+    if (fwrite(buf, sizeof(buf), 1, out) != 1) goto done;
+  }
+
+  if (sparse) {
+    fseek(out, sizeof(rhh), 0);
+    for (i = 0; i < ntracks; i++) {
+      if (put_twobyte(outmap[i], out) < 0) goto done;
+    }
   }
-  rhh.cksum = ((Uchar) cksum) ^ 0x4c;
+  res = 0;
 
-  return fwrite(&rhh, sizeof(rhh), 1, f);
+ done:
+  free(inmap);
+  free(outmap);
+  return res;
 }
 
 /*
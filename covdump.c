@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Merge and list guest code coverage written by xtrs -coverage.
+ *
+ * Usage: covdump [-b bank] [-d] [-s] covfile...
+ * For each memory bank, lists the code in the pages where any of the
+ * files recorded execution.  Each instruction is shown with the number
+ * of files in which it was executed, or "-" if none; runs of unexecuted
+ * bytes longer than COV_GAP between executed instructions are elided.
+ *
+ * Flags: -b bank  list only the given bank
+ *        -d       list the address ranges read and written instead
+ *                   of the code (needs -coveragedata files)
+ *        -s       print only the summary for each bank
+ */
+
+#define _XOPEN_SOURCE /* unistd.h: getopt(), optarg, optind, opterr */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include "z80.h"
+#include "z80_coverage.h"
+
+#define ARGS "b:ds"
+
+#define COV_BANKS	5	/* MEM_BANKS in xtrs */
+#define COV_ROM_BANK	4
+#define COV_GAP		32	/* longest unexecuted run listed */
+
+/* Per bank, per address: number of files with the bit set */
+static unsigned short *counts[COV_CODE][COV_BANKS];
+static unsigned char *code[COV_BANKS];
+static unsigned char code_valid[COV_BANKS][COV_PAGES];
+static int bank;		/* being disassembled */
+
+int mem_read(int address)
+{
+  return code[bank] ? code[bank][address & 0xffff] : 0;
+}
+
+static unsigned short *get_counts(int kind, int b)
+{
+  if (counts[kind][b] == NULL) {
+    counts[kind][b] = calloc(Z80_ADDRESS_LIMIT, sizeof(unsigned short));
+    if (counts[kind][b] == NULL) {
+      fprintf(stderr, "covdump: out of memory\n");
+      exit(1);
+    }
+  }
+  return counts[kind][b];
+}
+
+static void bad_file(const char *name)
+{
+  fprintf(stderr, "%s: premature end of file or bad section\n", name);
+  exit(1);
+}
+
+/* Add one file's bitmaps into the counts; returns its trs_model */
+static int read_file(const char *name)
+{
+  FILE *f;
+  unsigned char header[COV_HEADER], mask[COV_MASK_BYTES];
+  unsigned char buf[256];
+  unsigned short *c;
+  int kind, b, page, i;
+
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    perror(name);
+    exit(1);
+  }
+  if (fread(header, COV_HEADER, 1, f) != 1 ||
+      memcmp(header, COV_MAGIC, 8) != 0) {
+    fprintf(stderr, "%s: not an xtrs coverage file\n", name);
+    exit(1);
+  }
+  while ((kind = getc(f)) != EOF) {
+    b = getc(f);
+    if (kind >= COV_KINDS || b < 0 || b >= COV_BANKS ||
+	fread(mask, sizeof(mask), 1, f) != 1) {
+      bad_file(name);
+    }
+    if (kind == COV_CODE && code[b] == NULL) {
+      code[b] = calloc(Z80_ADDRESS_LIMIT, 1);
+      if (code[b] == NULL) {
+	fprintf(stderr, "covdump: out of memory\n");
+	exit(1);
+      }
+    }
+    for (page = 0; page < COV_PAGES; page++) {
+      if (!(mask[page >> 3] & (1 << (page & 7)))) continue;
+      if (kind == COV_CODE) {
+	if (fread(buf, 256, 1, f) != 1) bad_file(name);
+	/* The first file that has the page supplies its contents */
+	if (!code_valid[b][page]) {
+	  memcpy(code[b] + (page << 8), buf, 256);
+	  code_valid[b][page] = TRUE;
+	}
+	continue;
+      }
+      if (fread(buf, COV_PAGE_BITS, 1, f) != 1) bad_file(name);
+      c = get_counts(kind, b) + (page << 8);
+      for (i = 0; i < 256; i++) {
+	if (buf[i >> 3] & (1 << (i & 7))) c[i]++;
+      }
+    }
+  }
+  fclose(f);
+  return header[8];
+}
+
+/* Next address at or after a that was executed, or Z80_ADDRESS_LIMIT */
+static int next_hit(const unsigned short *c, int a)
+{
+  while (a < Z80_ADDRESS_LIMIT && c[a] == 0) a++;
+  return a;
+}
+
+static int code_present(int start, int end)
+{
+  int page;
+
+  for (page = start >> 8; page <= (end - 1) >> 8; page++) {
+    if (!code_valid[bank][page]) return FALSE;
+  }
+  return TRUE;
+}
+
+static void list_code(const unsigned short *c)
+{
+  int a, next, hit;
+
+  a = next_hit(c, 0);
+  while (a < Z80_ADDRESS_LIMIT) {
+    if (c[a]) {
+      printf("%6u  ", c[a]);
+    } else {
+      printf("%6s  ", "-");
+    }
+    next = disassemble_to(stdout, a, mem_read);
+    if (next <= a) break;	/* wrapped around */
+    hit = next_hit(c, a + 1);
+    if (hit > next &&
+	(hit - next > COV_GAP || !code_present(next, hit))) {
+      /* Skip to the next executed instruction */
+      if (hit < Z80_ADDRESS_LIMIT) printf("\n");
+      a = hit;
+    } else if (hit < next) {
+      /* Resynchronize; this instruction overlaps an executed one */
+      a = hit;
+    } else {
+      a = next;
+    }
+  }
+}
+
+static void list_ranges(const char *what, const unsigned short *c)
+{
+  int a, start;
+
+  if (c == NULL) return;
+  printf("%s:\n", what);
+  for (a = 0; a < Z80_ADDRESS_LIMIT; a++) {
+    if (!c[a]) continue;
+    start = a;
+    while (a + 1 < Z80_ADDRESS_LIMIT && c[a + 1]) a++;
+    if (start == a) {
+      printf("  %04x\n", start);
+    } else {
+      printf("  %04x-%04x  %d bytes\n", start, a, a - start + 1);
+    }
+  }
+}
+
+static unsigned long used(const unsigned short *c)
+{
+  unsigned long n = 0;
+  int a;
+
+  if (c == NULL) return 0;
+  for (a = 0; a < Z80_ADDRESS_LIMIT; a++) {
+    if (c[a]) n++;
+  }
+  return n;
+}
+
+int
+main(int argc, char* argv[])
+{
+  int c, errflg = 0, only = -1, data = 0, summary = 0;
+  int i, model = -1;
+
+  optarg = NULL;
+  while (!errflg && (c = getopt(argc, argv, ARGS)) != -1) {
+    switch (c) {
+    case 'b':
+      only = strtol(optarg, NULL, 0);
+      break;
+    case 'd':
+      data = 1;
+      break;
+    case 's':
+      summary = 1;
+      break;
+    default:
+      errflg++;
+      break;
+    }
+  }
+
+  if (errflg || argc == optind) {
+    fprintf(stderr, "Usage: %s [-b bank] [-d] [-s] covfile...\n", argv[0]);
+    exit(1);
+  }
+
+  for (i = optind; i < argc; i++) {
+    c = read_file(argv[i]);
+    if (model >= 0 && c != model) {
+      fprintf(stderr, "%s: warning: recorded on a different model\n",
+	      argv[i]);
+    }
+    model = c;
+  }
+  if (model == 5) {
+    printf("Model 4P, %d file%s\n", argc - optind,
+	   argc - optind == 1 ? "" : "s");
+  } else {
+    printf("Model %d, %d file%s\n", model, argc - optind,
+	   argc - optind == 1 ? "" : "s");
+  }
+
+  for (bank = 0; bank < COV_BANKS; bank++) {
+    if (only >= 0 && bank != only) continue;
+    if (!counts[COV_EXEC][bank] && !counts[COV_READ][bank] &&
+	!counts[COV_WRITE][bank]) {
+      continue;
+    }
+    printf("\n%s %d: %lu instruction addresses executed, "
+	   "%lu bytes read, %lu written\n",
+	   bank == COV_ROM_BANK ? "ROM bank" : "Bank", bank,
+	   used(counts[COV_EXEC][bank]), used(counts[COV_READ][bank]),
+	   used(counts[COV_WRITE][bank]));
+    if (summary) continue;
+    if (data) {
+      list_ranges("Read", counts[COV_READ][bank]);
+      list_ranges("Written", counts[COV_WRITE][bank]);
+    } else if (counts[COV_EXEC][bank]) {
+      list_code(counts[COV_EXEC][bank]);
+    }
+  }
+  return 0;
+}
@@ -37,16 +37,20 @@
  * SOFTWARE.
  */
 
-#define _POSIX_C_SOURCE 200112L /* signal.h: sigemptyset(), ... */
+#define _POSIX_C_SOURCE 200809L /* signal.h: sigemptyset(), ...; string.h: strdup() */
 
 #include "z80.h"
 #include "trs.h"
+#include "trs_stats.h"
+#include "z80_trace.h"
+#include "trs_replay.h"
 
 #include <stdlib.h>
 #include <signal.h>
 #include <errno.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp() */
+#include <ctype.h>
 
 #ifdef READLINE
 #include <readline/readline.h>
@@ -57,7 +61,6 @@
 
 #define MAXLINE		(256)
 #define ADDRESS_SPACE	(0x10000)
-#define MAX_TRAPS	(100)
 
 #define BREAKPOINT_FLAG		(0x1)
 #define TRACE_FLAG		(0x2)
@@ -65,12 +68,42 @@
 #define DISASSEMBLE_OFF_FLAG	(0x8)
 #define BREAK_ONCE_FLAG		(0x10)
 #define WATCHPOINT_FLAG		(0x20)
+#define READ_WATCH_FLAG		(0x40)
+#define IN_WATCH_FLAG		(0x80)
+#define OUT_WATCH_FLAG		(0x100)
+#define WATCH_FLAGS \
+    (WATCHPOINT_FLAG | READ_WATCH_FLAG | IN_WATCH_FLAG | OUT_WATCH_FLAG)
+
+/*
+ * Execution traps by address, and the number of them in each 256-byte
+ * page.  z80_run() consults these so that breakpoints don't force
+ * single-stepping; watchpoints are not entered here.  The gdb stub
+ * (z80_gdb.c) sets DEBUG_GDB_FLAG here for its own breakpoints.
+ */
+Uchar debug_traps[ADDRESS_SPACE];
+int debug_trap_pages[ADDRESS_SPACE >> 8];
+
+/*
+ * Memory pages and I/O ports with watchpoints, as DEBUG_WATCH_READ and
+ * DEBUG_WATCH_WRITE bits.  mem_read(), mem_write(), z80_in(), and
+ * z80_out() call debug_watch_hit() when the bit is set.
+ */
+Uchar debug_watch_pages[ADDRESS_SPACE >> 8];
+Uchar debug_watch_ports[256];
 
-static Uchar *traps;
 static int num_traps;
 static int print_instructions;
 static int stop_signaled;
-static unsigned int num_watchpoints = 0;
+/*
+ * Watchpoints fire only while debug_watch_armed is set, so that the
+ * debugger's own memory accesses don't trigger them.  The last hit is
+ * recorded in debug_watch_hit_what and debug_watch_hit_address.
+ */
+int debug_watch_armed;
+int debug_watch_hit_what;
+int debug_watch_hit_address;
+static int watch_triggered;
+static int watch_hit_index, watch_hit_value;
 
 static char help_message[] =
 
@@ -118,6 +151,14 @@ Printing:\n\
         Disable tracing.\n\
     diskdump\n\
         Print the state of the floppy disk controller emulation.\n\
+    stats\n\
+    stats reset\n\
+        Print the emulator's own counters (memory accesses by region, I/O\n\
+        ports, events, display updates, disk activity, delay) since xtrs\n\
+        started or since the last \"stats reset\", or reset them.\n\
+    tracedump\n\
+        Write the instructions recorded by the -trace option to the trace\n\
+        file.  This is also done each time execution stops.\n\
 Traps:\n\
     status\n\
         Show all traps (breakpoints, tracepoints, watchpoints).\n\
@@ -135,8 +176,23 @@ Traps:\n\
         Set a trap to enable tracing at the specified hex address.\n\
     traceoff at <address>\n\
         Set a trap to disable tracing at the specified hex address.\n\
-    watch <address>\n\
-        Set a trap to watch specified hex address for changes.\n\
+    watch <address> [if <condition>]\n\
+    watch <start addr> , <end addr> [if <condition>]\n\
+        Set a trap to stop when the program writes to the specified hex\n\
+        address or range of addresses.\n\
+    rwatch <address> [if <condition>]\n\
+    rwatch <start addr> , <end addr> [if <condition>]\n\
+        Set a trap to stop when the program reads the specified hex address\n\
+        or range of addresses, including instruction fetches.\n\
+    watch in <port> [if <condition>]\n\
+    watch out <port> [if <condition>]\n\
+        Set a trap to stop on input from or output to the specified hex\n\
+        I/O port.\n\
+        A watchpoint condition is a C-style expression using hex numbers,\n\
+        registers written as $<reg>, \"value\" (the byte read or written),\n\
+        \"address\" (the address or port), [<addr>] (a memory byte), and\n\
+        the operators ( ) ! ~ - + & | ^ == != < <= > >= && ||, which\n\
+        bind as in C: $a & 0f == 3 means $a & (0f == 3).\n\
 Miscellaneous:\n\
     assign $<reg> = <value>\n\
     assign <addr> = <value>\n\
@@ -164,13 +220,15 @@ Miscellaneous:\n\
     quit\n\
         Exit from xtrs.\n";
 
-static struct
+static struct trap
 {
     int   valid;
     int   address;
     int   flag;
-    Uchar byte; /* used only by watchpoints */
-} trap_table[MAX_TRAPS];
+    int   end;  /* used only by watchpoints: last address in range */
+    char *cond; /* used only by watchpoints: condition or NULL */
+} *trap_table;
+static int trap_table_size;
 
 static char *trap_name(int flag)
 {
@@ -188,6 +246,12 @@ static char *trap_name(int flag)
 	return "temporary breakpoint";
       case WATCHPOINT_FLAG:
 	return "watchpoint";
+      case READ_WATCH_FLAG:
+	return "read watchpoint";
+      case IN_WATCH_FLAG:
+	return "input watchpoint";
+      case OUT_WATCH_FLAG:
+	return "output watchpoint";
       default:
 	return "unknown trap";
     }
@@ -198,7 +262,7 @@ static void show_zbxinfo(void)
     printf("zbx: Z80 debugger by David Gingold, Alex Wolman, and Timothy"
            " Mann\n");
     printf("\n");
-    printf("Traps set: %d (maximum %d)\n", num_traps, MAX_TRAPS);
+    printf("Traps set: %d\n", num_traps);
     printf("Size of address space: 0x%x\n", ADDRESS_SPACE);
     printf("Maximum length of command line: %d\n", MAXLINE);
 #ifdef READLINE
@@ -208,19 +272,327 @@ static void show_zbxinfo(void)
 #endif
 }
 
+/*
+ * Recompute the pages and ports that have watchpoints.
+ */
+static void update_watches(void)
+{
+    int i, a;
+
+    memset(debug_watch_pages, 0, sizeof(debug_watch_pages));
+    memset(debug_watch_ports, 0, sizeof(debug_watch_ports));
+    for(i = 0; i < trap_table_size; ++i)
+    {
+	if(!trap_table[i].valid) continue;
+	switch(trap_table[i].flag)
+	{
+	  case WATCHPOINT_FLAG:
+	  case READ_WATCH_FLAG:
+	    for(a = trap_table[i].address >> 8; a <= trap_table[i].end >> 8;
+		++a)
+	    {
+		debug_watch_pages[a] |=
+		    trap_table[i].flag == WATCHPOINT_FLAG ?
+		    DEBUG_WATCH_WRITE : DEBUG_WATCH_READ;
+	    }
+	    break;
+	  case IN_WATCH_FLAG:
+	    debug_watch_ports[trap_table[i].address] |= DEBUG_WATCH_READ;
+	    break;
+	  case OUT_WATCH_FLAG:
+	    debug_watch_ports[trap_table[i].address] |= DEBUG_WATCH_WRITE;
+	    break;
+	}
+    }
+    /* Translated code must not touch watched pages directly */
+    z80_jit_remap();
+}
+
+/*
+ * Watchpoint conditions.  A small recursive-descent evaluator; the
+ * condition is parsed again each time it is evaluated.
+ */
+static const char *cond_ptr;
+static int cond_error;
+static int cond_value, cond_address;
+
+static int cond_or(void);
+
+static void cond_skip(void)
+{
+    while(*cond_ptr == ' ' || *cond_ptr == '\t') cond_ptr++;
+}
+
+static int cond_match(const char *op)
+{
+    int n = strlen(op);
+
+    cond_skip();
+    if(strncmp(cond_ptr, op, n)) return 0;
+    /* Don't take "<" from "<=", "&" from "&&", and so on */
+    if(n == 1 && ((cond_ptr[1] == '=' && strchr("<>!", op[0])) ||
+		  (cond_ptr[1] == op[0] && strchr("&|", op[0]))))
+    {
+	return 0;
+    }
+    cond_ptr += n;
+    return 1;
+}
+
+static int reg_value(const char *name, int *value)
+{
+    static const struct { const char *name; int size; void *reg; } regs[] = {
+	{ "a", 1, &REG_A }, { "f", 1, &REG_F }, { "b", 1, &REG_B },
+	{ "c", 1, &REG_C }, { "d", 1, &REG_D }, { "e", 1, &REG_E },
+	{ "h", 1, &REG_H }, { "l", 1, &REG_L }, { "i", 1, &REG_I },
+	{ "af", 2, &REG_AF }, { "bc", 2, &REG_BC }, { "de", 2, &REG_DE },
+	{ "hl", 2, &REG_HL }, { "ix", 2, &REG_IX }, { "iy", 2, &REG_IY },
+	{ "sp", 2, &REG_SP }, { "pc", 2, &REG_PC },
+	{ "af'", 2, &REG_AF_PRIME }, { "bc'", 2, &REG_BC_PRIME },
+	{ "de'", 2, &REG_DE_PRIME }, { "hl'", 2, &REG_HL_PRIME },
+    };
+    int i;
+
+    for(i = 0; i < (int) (sizeof(regs) / sizeof(regs[0])); i++)
+    {
+	if(!strcasecmp(name, regs[i].name))
+	{
+	    *value = regs[i].size == 1 ?
+		*(Uchar *) regs[i].reg : *(Ushort *) regs[i].reg;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static int cond_primary(void)
+{
+    char name[8];
+    char *end;
+    int n, v = 0;
+
+    cond_skip();
+    if(cond_match("("))
+    {
+	v = cond_or();
+	if(!cond_match(")")) cond_error = 1;
+	return v;
+    }
+    if(cond_match("["))
+    {
+	v = cond_or();
+	if(!cond_match("]")) cond_error = 1;
+	return mem_read(v);
+    }
+    if(cond_match("!")) return !cond_primary();
+    if(cond_match("~")) return ~cond_primary();
+    if(cond_match("-")) return -cond_primary();
+    if(*cond_ptr == '$')
+    {
+	cond_ptr++;
+	for(n = 0; n < (int) sizeof(name) - 1 &&
+		(isalpha((unsigned char) *cond_ptr) || *cond_ptr == '\''); n++)
+	{
+	    name[n] = *cond_ptr++;
+	}
+	name[n] = '\0';
+	if(!reg_value(name, &v)) cond_error = 1;
+	return v;
+    }
+    if(!strncmp(cond_ptr, "value", 5))
+    {
+	cond_ptr += 5;
+	return cond_value;
+    }
+    if(!strncmp(cond_ptr, "address", 7))
+    {
+	cond_ptr += 7;
+	return cond_address;
+    }
+    v = strtol(cond_ptr, &end, 16);
+    if(end == cond_ptr) cond_error = 1;
+    cond_ptr = end;
+    return v;
+}
+
+/* Binary operators, from tightest to loosest binding as in C */
+static int cond_sum(void)
+{
+    int v = cond_primary();
+
+    for(;;)
+    {
+	if(cond_match("+")) v += cond_primary();
+	else if(cond_match("-")) v -= cond_primary();
+	else return v;
+    }
+}
+
+static int cond_compare(void)
+{
+    int v = cond_sum();
+
+    for(;;)
+    {
+	if(cond_match("<=")) v = v <= cond_sum();
+	else if(cond_match(">=")) v = v >= cond_sum();
+	else if(cond_match("<")) v = v < cond_sum();
+	else if(cond_match(">")) v = v > cond_sum();
+	else return v;
+    }
+}
+
+static int cond_equal(void)
+{
+    int v = cond_compare();
+
+    for(;;)
+    {
+	if(cond_match("==")) v = v == cond_compare();
+	else if(cond_match("!=")) v = v != cond_compare();
+	else return v;
+    }
+}
+
+static int cond_bitand(void)
+{
+    int v = cond_equal();
+
+    while(cond_match("&")) v &= cond_equal();
+    return v;
+}
+
+static int cond_bitxor(void)
+{
+    int v = cond_bitand();
+
+    while(cond_match("^")) v ^= cond_bitand();
+    return v;
+}
+
+static int cond_bitor(void)
+{
+    int v = cond_bitxor();
+
+    while(cond_match("|")) v |= cond_bitxor();
+    return v;
+}
+
+static int cond_and(void)
+{
+    int v = cond_bitor();
+
+    while(cond_match("&&")) v = cond_bitor() && v;
+    return v;
+}
+
+static int cond_or(void)
+{
+    int v = cond_and();
+
+    while(cond_match("||")) v = cond_and() || v;
+    return v;
+}
+
+/* Evaluate cond; returns -1 if it has a syntax error */
+static int eval_cond(const char *cond, int address, int value)
+{
+    int v;
+
+    cond_ptr = cond;
+    cond_error = 0;
+    cond_address = address;
+    cond_value = value;
+    v = cond_or();
+    cond_skip();
+    if(cond_error || *cond_ptr) return -1;
+    return v != 0;
+}
+
+static int watch_flag(int what)
+{
+    if(what & DEBUG_WATCH_PORT)
+    {
+	return (what & DEBUG_WATCH_READ) ? IN_WATCH_FLAG : OUT_WATCH_FLAG;
+    }
+    return (what & DEBUG_WATCH_READ) ? READ_WATCH_FLAG : WATCHPOINT_FLAG;
+}
+
+/*
+ * Called from the memory and I/O routines when a watched page or port
+ * is accessed.  what is DEBUG_WATCH_READ or DEBUG_WATCH_WRITE, plus
+ * DEBUG_WATCH_PORT for I/O.  A hit stops z80_run() after the current
+ * instruction.
+ */
+void debug_watch_hit(int what, int address, int value)
+{
+    int i, flag = watch_flag(what);
+
+    if(!debug_watch_armed) return;
+
+    debug_watch_armed = 0; /* conditions may read memory */
+    for(i = 0; i < trap_table_size; ++i)
+    {
+	if(trap_table[i].valid && trap_table[i].flag == flag &&
+	   address >= trap_table[i].address && address <= trap_table[i].end &&
+	   (trap_table[i].cond == NULL ||
+	    eval_cond(trap_table[i].cond, address, value) != 0))
+	{
+	    watch_triggered = 1;
+	    watch_hit_index = i;
+	    watch_hit_value = value;
+	    debug_watch_hit_what = what;
+	    debug_watch_hit_address = address;
+	    if (trs_continuous > 0) trs_continuous = 0;
+	    break;
+	}
+    }
+    debug_watch_armed = 1;
+}
+
+static void print_watch_hit(void)
+{
+    int i = watch_hit_index;
+
+    switch(trap_table[i].flag)
+    {
+      case WATCHPOINT_FLAG:
+	printf("Watchpoint [%d]: wrote 0x%.2x to 0x%.4x.\n",
+	       i, watch_hit_value, debug_watch_hit_address);
+	break;
+      case READ_WATCH_FLAG:
+	printf("Watchpoint [%d]: read 0x%.2x from 0x%.4x.\n",
+	       i, watch_hit_value, debug_watch_hit_address);
+	break;
+      case IN_WATCH_FLAG:
+	printf("Watchpoint [%d]: input 0x%.2x from port 0x%.2x.\n",
+	       i, watch_hit_value, debug_watch_hit_address);
+	break;
+      case OUT_WATCH_FLAG:
+	printf("Watchpoint [%d]: output 0x%.2x to port 0x%.2x.\n",
+	       i, watch_hit_value, debug_watch_hit_address);
+	break;
+    }
+}
+
 static void clear_all_traps(void)
 {
     int i;
-    for(i = 0; i < MAX_TRAPS; ++i)
+    for(i = 0; i < trap_table_size; ++i)
     {
 	if(trap_table[i].valid)
 	{
-	    traps[trap_table[i].address] &= ~(trap_table[i].flag);
+	    if(!(trap_table[i].flag & WATCH_FLAGS))
+	    {
+		debug_traps[trap_table[i].address] &= ~(trap_table[i].flag);
+		debug_trap_pages[trap_table[i].address >> 8]--;
+	    }
 	    trap_table[i].valid = 0;
+	    free(trap_table[i].cond);
 	}
     }
     num_traps = 0;
-    num_watchpoints = 0;
+    update_watches();
 }
 
 static void print_traps(void)
@@ -229,12 +601,21 @@ static void print_traps(void)
 
     if(num_traps)
     {
-	for(i = 0; i < MAX_TRAPS; ++i)
+	for(i = 0; i < trap_table_size; ++i)
 	{
 	    if(trap_table[i].valid)
 	    {
-		printf("[%d] %.4x (%s)\n", i, trap_table[i].address,
-		       trap_name(trap_table[i].flag));
+		printf("[%d] %.4x", i, trap_table[i].address);
+		if(trap_table[i].end != trap_table[i].address)
+		{
+		    printf("-%.4x", trap_table[i].end);
+		}
+		printf(" (%s)", trap_name(trap_table[i].flag));
+		if(trap_table[i].cond)
+		{
+		    printf(" if %s", trap_table[i].cond);
+		}
+		printf("\n");
 	    }
 	}
     }
@@ -244,48 +625,111 @@ static void print_traps(void)
     }
 }
 
-static void set_trap(int address, int flag)
+static int new_trap(void)
 {
     int i;
 
-    if(num_traps == MAX_TRAPS)
+    if(num_traps == trap_table_size)
     {
-	printf("Cannot set more than %d traps.\n", MAX_TRAPS);
+	/* Table is full; double its size */
+	i = trap_table_size ? trap_table_size * 2 : 64;
+	trap_table = (struct trap *)
+	    realloc(trap_table, i * sizeof(struct trap));
+	if(trap_table == NULL) fatal("out of memory for traps");
+	memset(trap_table + trap_table_size, 0,
+	       (i - trap_table_size) * sizeof(struct trap));
+	trap_table_size = i;
     }
-    else
+
+    i = 0;
+    while(trap_table[i].valid) ++i;
+    trap_table[i].valid = 1;
+    num_traps++;
+    return i;
+}
+
+static void set_trap(int address, int flag)
+{
+    int i = new_trap();
+
+    trap_table[i].address = trap_table[i].end = address;
+    trap_table[i].flag = flag;
+    trap_table[i].cond = NULL;
+    debug_traps[address] |= flag;
+    debug_trap_pages[address >> 8]++;
+
+    printf("Set %s [%d] at %.4x\n", trap_name(flag), i, address);
+}
+
+static int add_watch(int start, int end, int flag, char *cond)
+{
+    int i = new_trap();
+
+    trap_table[i].address = start;
+    trap_table[i].end = end;
+    trap_table[i].flag = flag;
+    trap_table[i].cond = cond ? strdup(cond) : NULL;
+    update_watches();
+    return i;
+}
+
+/*
+ * Quietly add or remove a watchpoint without a condition, for the gdb
+ * stub.  what is as for debug_watch_hit().
+ */
+void debug_set_watch(int start, int end, int what)
+{
+    add_watch(start, end, watch_flag(what), NULL);
+}
+
+void debug_clear_watch(int start, int end, int what)
+{
+    int i, flag = watch_flag(what);
+
+    for(i = 0; i < trap_table_size; ++i)
     {
-	i = 0;
-	while(trap_table[i].valid) ++i;
-	
-	trap_table[i].valid = 1;
-	trap_table[i].address = address;
-	trap_table[i].flag = flag;
-	if (trap_table[i].flag == WATCHPOINT_FLAG) {
-	    /* Initialize the byte field to current memory contents. */
-	    trap_table[i].byte = mem_read(address);
-	    /* Increment number of set watchpoints. */
-	    num_watchpoints++;
+	if(trap_table[i].valid && trap_table[i].flag == flag &&
+	   trap_table[i].address == start && trap_table[i].end == end &&
+	   trap_table[i].cond == NULL)
+	{
+	    trap_table[i].valid = 0;
+	    num_traps--;
+	    update_watches();
+	    return;
 	}
-	traps[address] |= flag;
-	num_traps++;
+    }
+}
 
-	printf("Set %s [%d] at %.4x\n", trap_name(flag), i, address);
+static void set_watch(int start, int end, int flag, char *cond)
+{
+    int i = add_watch(start, end, flag, cond);
+
+    if(start == end)
+    {
+	printf("Set %s [%d] at %.4x\n", trap_name(flag), i, start);
+    }
+    else
+    {
+	printf("Set %s [%d] at %.4x-%.4x\n", trap_name(flag), i, start, end);
     }
 }
 
 static void clear_trap(int i)
 {
-    if((i < 0) || (i >= MAX_TRAPS) || !trap_table[i].valid)
+    if((i < 0) || (i >= trap_table_size) || !trap_table[i].valid)
     {
 	printf("[%d] is not a valid trap.\n", i);
     }
     else
     {
-	traps[trap_table[i].address] &= ~(trap_table[i].flag);
 	trap_table[i].valid = 0;
-	if (trap_table[i].flag == WATCHPOINT_FLAG) {
-	    /* Decrement number of set watchpoints. */
-	    num_watchpoints--;
+	if (trap_table[i].flag & WATCH_FLAGS) {
+	    free(trap_table[i].cond);
+	    trap_table[i].cond = NULL;
+	    update_watches();
+	} else {
+	    debug_traps[trap_table[i].address] &= ~(trap_table[i].flag);
+	    debug_trap_pages[trap_table[i].address >> 8]--;
 	}
 	num_traps--;
 	printf("Cleared %s [%d] at %.4x\n",
@@ -296,7 +740,7 @@ static void clear_trap(int i)
 static void clear_trap_address(int address, int flag)
 {
     int i;
-    for(i = 0; i < MAX_TRAPS; ++i)
+    for(i = 0; i < trap_table_size; ++i)
     {
 	if(trap_table[i].valid && (trap_table[i].address == address)
 	   && ((flag == 0) || (trap_table[i].flag == flag)))
@@ -352,13 +796,6 @@ void trs_debug(void)
 
 void debug_init(void)
 {
-    int i;
-
-    traps = (Uchar *) malloc(ADDRESS_SPACE * sizeof(Uchar));
-    memset(traps, 0, ADDRESS_SPACE * sizeof(Uchar));
-
-    for(i = 0; i < MAX_TRAPS; ++i) trap_table[i].valid = 0;
-
     printf("Type \"help\" for a list of commands.\n");
 }
 
@@ -404,17 +841,15 @@ static void debug_run(void)
 {
     void (*old_signal_handler)();
     Uchar t;
-    Uchar byte;
     int continuous;
-    int i;
-    int watch_triggered = 0;
 
     /* catch control-c signal */
     old_signal_handler = signal(SIGINT, signal_handler);
 
     stop_signaled = 0;
+    watch_triggered = 0;
 
-    t = traps[REG_PC];
+    t = debug_traps[REG_PC];
     while(!stop_signaled)
     {
 	if(t)
@@ -436,13 +871,16 @@ static void debug_run(void)
 	
 	if(print_instructions) disassemble(REG_PC);
 	
-	continuous = (!print_instructions && num_traps == 0);
+	/* z80_run() stops by itself at traps and watchpoint hits */
+	continuous = !print_instructions;
+	debug_watch_armed = 1;
 	if (z80_run(continuous)) {
 	  printf("emt_debug instruction executed.\n");
 	  stop_signaled = 1;
 	}
+	debug_watch_armed = 0;
 
-	t = traps[REG_PC];
+	t = debug_traps[REG_PC];
 	if(t & BREAKPOINT_FLAG)
 	{
 	    stop_signaled = 1;
@@ -453,44 +891,71 @@ static void debug_run(void)
 	    clear_trap_address(REG_PC, BREAK_ONCE_FLAG);
 	}
 
-	/*
-	 * Iterate over the trap list looking for watchpoints only if we
-	 * know there are any to be found.
-	 */
-	if (num_watchpoints)
+	if (watch_triggered)
 	{
-	    for (i = 0; i < MAX_TRAPS; ++i)
-	    {
-		if (trap_table[i].valid &&
-		    trap_table[i].flag == WATCHPOINT_FLAG)
-		{
-		    byte = mem_read(trap_table[i].address);
-		    if (byte != trap_table[i].byte)
-		    {
-			/*
-			 * If a watched memory location has changed, report
-			 * it, update the watch entry in the trap table to
-			 * reflect the new value, and set the
-			 * watch_triggered flag so that we stop after all
-			 * watchpoints have been processed.
-			 */
-			printf("Memory location 0x%.4x changed value from "
-			       "0x%.2x to 0x%.2x.\n", trap_table[i].address,
-			       trap_table[i].byte, byte);
-			trap_table[i].byte = byte;
-			watch_triggered = 1;
-		    }
-		}
-	    }
-	    if (watch_triggered)
-	    {
-		stop_signaled = 1;
-	    }
+	    print_watch_hit();
+	    stop_signaled = 1;
 	}
-
     }
     signal(SIGINT, old_signal_handler);
     printf("Stopped at %.4x\n", REG_PC);
+    z80_trace_dump();
+}
+
+/*
+ * Parse the arguments of "watch" and "rwatch":
+ *   [in|out] <address> [, <end address>] [if <condition>]
+ */
+static void parse_watch(char *input, int reading)
+{
+    char *args, *cond;
+    int start, end, flag, n;
+
+    args = input + strspn(input, " \t");
+    args += strcspn(args, " \t");
+    args += strspn(args, " \t");
+
+    cond = strstr(args, " if ");
+    if(cond)
+    {
+	*cond = '\0';
+	cond += 4;
+	cond += strspn(cond, " \t");
+	cond[strcspn(cond, "\n")] = '\0';
+	if(eval_cond(cond, 0, 0) < 0)
+	{
+	    printf("Syntax error in condition.\n");
+	    return;
+	}
+    }
+
+    if(!reading && sscanf(args, "in %x", &start) == 1)
+    {
+	flag = IN_WATCH_FLAG;
+	start = end = start & 0xff;
+    }
+    else if(!reading && sscanf(args, "out %x", &start) == 1)
+    {
+	flag = OUT_WATCH_FLAG;
+	start = end = start & 0xff;
+    }
+    else if((n = sscanf(args, "%x , %x", &start, &end)) >= 1)
+    {
+	flag = reading ? READ_WATCH_FLAG : WATCHPOINT_FLAG;
+	start %= ADDRESS_SPACE;
+	end = (n == 2) ? end % ADDRESS_SPACE : start;
+	if(end < start)
+	{
+	    printf("End address is before start address.\n");
+	    return;
+	}
+    }
+    else
+    {
+	printf("An address must be specified.\n");
+	return;
+    }
+    set_watch(start, end, flag, cond);
 }
 
 void debug_shell(void)
@@ -498,7 +963,6 @@ void debug_shell(void)
     char input[MAXLINE];
     char command[MAXLINE];
     int done = 0;
-    sigset_t set, oldset;
 
 #ifdef READLINE
     char *line;
@@ -514,10 +978,6 @@ void debug_shell(void)
 	printf("\n");
 	disassemble(REG_PC);
 
-	sigemptyset(&set);
-	sigaddset(&set, SIGALRM);
-	sigprocmask(SIG_BLOCK, &set, &oldset);
-
 #ifdef READLINE
 	/*
 	 * Use the way cool gnu readline() utility.  Get completion,
@@ -546,8 +1006,6 @@ void debug_shell(void)
 	if (fgets(input, MAXLINE, stdin) == NULL) break;
 #endif
 
-	sigprocmask(SIG_SETMASK, &oldset, NULL);
-
 	if(sscanf(input, "%s", command))
 	{
 	    if(!strcmp(command, "help") || !strcmp(command, "?"))
@@ -724,17 +1182,17 @@ void debug_shell(void)
 	    else if(!strcmp(command, "reset"))
 	    {
 		printf("Performing hard reset.");
-		trs_reset(1);
+		trs_user_reset(1);
 	    }
 	    else if(!strcmp(command, "softreset"))
 	    {
 		printf("Pressing reset button.");
-		trs_reset(0);
+		trs_user_reset(0);
 	    }
 	    else if(!strcmp(command, "run"))
 	    {
 		printf("Performing hard reset and running.\n");
-		trs_reset(1);
+		trs_user_reset(1);
 		debug_run();
 	    }
 	    else if(!strcmp(command, "status"))
@@ -869,15 +1327,9 @@ void debug_shell(void)
 		    printf("Tracing disabled.\n");
 		}
 	    }
-	    else if(!strcmp(command, "watch"))
+	    else if(!strcmp(command, "watch") || !strcmp(command, "rwatch"))
 	    {
-		int address;
-
-		if(sscanf(input, "watch %x", &address) == 1)
-		{
-		    address %= ADDRESS_SPACE;
-		    set_trap(address, WATCHPOINT_FLAG);
-		}
+		parse_watch(input, !strcmp(command, "rwatch"));
 	    }
 	    else if(!strcmp(command, "timeroff"))
 	    {
@@ -893,6 +1345,27 @@ void debug_shell(void)
 	    {
 		trs_disk_debug();
 	    }
+	    else if(!strcmp(command, "tracedump"))
+	    {
+		if (z80_trace_enabled) {
+		    z80_trace_dump();
+		} else {
+		    printf("Tracing was not enabled with -trace.\n");
+		}
+	    }
+	    else if(!strcmp(command, "stats"))
+	    {
+		char arg[MAXLINE];
+
+		if(sscanf(input, "stats %s", arg) == 1 && !strcmp(arg, "reset"))
+		{
+		    trs_stats_reset();
+		}
+		else
+		{
+		    trs_stats_print(stdout);
+		}
+	    }
 	    else if(!strcmp(command, "diskdebug"))
 	    {
 		trs_disk_debug_flags = 0;
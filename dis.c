@@ -2093,24 +2093,28 @@ static struct opcode minor[6][256] = {
     }
 };
 
-int disassemble(unsigned short pc)
+/*
+ * Disassemble the instruction at pc onto fp, fetching its bytes with
+ * the given read function.
+ */
+int disassemble_to(FILE *fp, unsigned short pc, int (*read)(int address))
 {
     int	i, j;
     struct opcode	*code;
     int	addr;
     
     addr = pc;
-    i = mem_read(pc++);
+    i = read(pc++);
     if (!major[i].name)
     {
 	j = major[i].args;
-	i = mem_read(pc++);
+	i = read(pc++);
 	if (!minor[j][i].name)
 	{
 	    /* dd cb or fd cb; offset comes *before* instruction */
 	    j = minor[j][i].args;
             pc++; /* skip over offset */
-	    i = mem_read(pc++);
+	    i = read(pc++);
 	}
 	code = &minor[j][i];
     }
@@ -2118,34 +2122,39 @@ int disassemble(unsigned short pc)
     {
 	code = &major[i];
     }
-    printf ("%04x  ", addr);
+    fprintf (fp, "%04x  ", addr);
     for (i = 0; i < ((pc + arglen(code->args) - addr) & 0xffff); i++)
-        printf("%02x ", mem_read(addr + i));
+        fprintf(fp, "%02x ", read(addr + i));
     for (; i < 4; i++)
-	printf("   ");
-    printf(" ");
+	fprintf(fp, "   ");
+    fprintf(fp, " ");
     switch (code->args) {
       case A_16: /* 16-bit number */
-	printf (code->name, mem_read(pc + 1), mem_read(pc));
+	fprintf (fp, code->name, read(pc + 1), read(pc));
 	break;
       case A_8X2: /* Two 8-bit numbers */
-	printf (code->name, mem_read(pc), mem_read(pc + 1));
+	fprintf (fp, code->name, read(pc), read(pc + 1));
 	break;
       case A_8:  /* One 8-bit number */
-	printf (code->name, mem_read(pc));
+	fprintf (fp, code->name, read(pc));
 	break;
       case A_8P: /* One 8-bit number before last opcode byte */
-	printf (code->name, mem_read(pc - 2));
+	fprintf (fp, code->name, read(pc - 2));
 	break;
       case A_0:  /* No args */
       case A_0B: /* No args, backskip over last opcode byte */
-	fputs (code->name, stdout);
+	fputs (code->name, fp);
 	break;
       case A_8R: /* One 8-bit relative address */
-	printf (code->name, (pc + 1 + (signed char) mem_read(pc)) & 0xffff);
+	fprintf (fp, code->name, (pc + 1 + (signed char) read(pc)) & 0xffff);
 	break;
     }
-    putchar ('\n');
+    putc ('\n', fp);
     pc += arglen(code->args);
     return pc;  /* return the location of the next instruction */
 }
+
+int disassemble(unsigned short pc)
+{
+    return disassemble_to(stdout, pc, mem_read);
+}
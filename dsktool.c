@@ -0,0 +1,1231 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Check, describe, and convert a collection of emulated disk images.
+ *
+ * Usage: dsktool [-j jobs] [-q] [-t {jv1|jv3|dmk} -o outdir [-f]] path...
+ * Each path is an image file or a directory, which is searched
+ * recursively (skipping names that begin with ".").  For each image,
+ * prints a line giving its format and geometry, or what is wrong with
+ * it.  JV1, JV3, and DMK floppy images are read track by track; every
+ * DMK sector's ID and data CRCs are checked.  Reed hard disk images
+ * have their header and allocation table checked.
+ *
+ * Flags: -j jobs  number of images to work on at once (default: one
+ *                   per processor)
+ *        -q       print only images that have problems
+ *        -t type  also convert each floppy image to the given format,
+ *        -o dir     writing it under dir with the same relative path
+ *        -f       overwrite existing output files
+ *
+ * The exit status is 1 if any image had a problem.
+ */
+
+#define _XOPEN_SOURCE 500 /* unistd.h: getopt(), sysconf(); sys/stat.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "trs_disk.h"
+
+typedef unsigned char Uchar;
+#include "reed.h"
+
+#include "crc.c"
+
+#define ARGS "j:qt:o:f"
+
+#define REED 200		/* not a floppy emutype */
+
+/* File format details; see trs_disk.c */
+#define JV1_SECSIZE	256
+#define JV1_SECPERTRK	10
+#define JV3_DENSITY	0x80
+#define JV3_DAM		0x60
+#define JV3_SIDE	0x10
+#define JV3_ERROR	0x08
+#define JV3_SIZE	0x03
+#define JV3_FREE	0xff
+#define JV3_SECSTART	(34*256)
+#define JV3_SECSPERBLK	((int)(JV3_SECSTART/3))
+#define JV3_SECSMAX	(2*JV3_SECSPERBLK)
+#define DMK_HDR_SIZE	0x10
+#define DMK_TKHDR_SIZE	0x80
+#define DMK_TRACKLEN_MAX 0x4000
+#define DMK_SSIDE_OPT	0x10
+#define DMK_SDEN_OPT	0x40
+#define DMK_IGNDEN_OPT	0x80
+#define DMK_DDEN_FLAG	0x8000
+#define DMK_IDAMP_BITS	0x3fff
+
+#define MAXTRACKS	255
+#define MAXSECS		(DMK_TKHDR_SIZE/2)	/* per track */
+#define MSGLEN		512
+
+typedef struct {
+  int cyl, side, sec, size;	/* ID fields; size is the size code */
+  int dden;
+  int dam;			/* 0xf8 to 0xfb */
+  int crcerr;			/* data CRC error */
+  Uchar *data;
+} Sector;
+
+/* One physical track, as read from an image */
+typedef struct {
+  int track, side;
+  int nsecs;
+  Sector sec[MAXSECS];
+  Uchar buf[MAXSECS * 1024];
+} Track;
+
+/* An input image, read one track at a time */
+typedef struct {
+  const char *name;
+  FILE *f;
+  long size;
+  int type;
+  int writeprot;
+  int ntracks, nsides;
+  int sd, dd;			/* densities possibly present */
+  int tracklen;			/* DMK; for JV3, longest track as DMK */
+  int sden, ignden;		/* DMK */
+  int track, side;		/* next to read */
+  /* JV3 */
+  Uchar *ids;
+  long *ofs;
+  short *next;
+  short first[MAXTRACKS][2];
+  /* DMK */
+  Uchar *tkbuf;
+  char err[MSGLEN];
+} Image;
+
+/* An output image, written one track at a time */
+typedef struct {
+  FILE *f;
+  int type;
+  int nsides, tracklen, sden;	/* DMK */
+  int ntracks;
+  Uchar *ids;			/* JV3 */
+  int nids;
+  long id2pos;
+  Uchar *tkbuf;			/* DMK */
+  char err[MSGLEN];
+} Output;
+
+/* What was found on an image, for the report */
+typedef struct {
+  int tracks, sides, sd, dd, sizes, secs, idcrc, datacrc;
+} Summary;
+
+/* Images to work on, and their report lines */
+typedef struct {
+  char *path;
+  char *rel;			/* path below the argument it was found in */
+  char *line;
+  int bad;
+} Job;
+
+static Job *jobs;
+static int njobs, maxjobs;
+static int next_job, next_print;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int quiet, overwrite, outtype;
+static const char *outdir;
+static int any_bad;
+
+char *program_name;
+
+static void Usage(void)
+{
+  fprintf(stderr,
+	  "Usage: %s [-j jobs] [-q] [-t {jv1|jv3|dmk} -o outdir [-f]] "
+	  "path...\n", program_name);
+  exit(2);
+}
+
+static void *xmalloc(size_t n)
+{
+  void *p = malloc(n);
+  if (p == NULL) {
+    fprintf(stderr, "%s: out of memory\n", program_name);
+    exit(1);
+  }
+  return p;
+}
+
+static char *xstrdup(const char *s)
+{
+  return strcpy(xmalloc(strlen(s) + 1), s);
+}
+
+static int seterr(char *err, const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  vsnprintf(err, MSGLEN, fmt, args);
+  va_end(args);
+  return -1;
+}
+
+static const char *type_name(int type)
+{
+  switch (type) {
+  case JV1:  return "JV1";
+  case JV3:  return "JV3";
+  case DMK:  return "DMK";
+  default:   return "Reed";
+  }
+}
+
+/* Size code of a JV3 id, used or free (see id_index_to_size_code) */
+static int jv3_size_code(const Uchar *id)
+{
+  return (id[2] & JV3_SIZE) ^ (id[0] == JV3_FREE ? 2 : 1);
+}
+
+/* Data address mark of a JV3 id */
+static int jv3_dam(const Uchar *id)
+{
+  int dam = (id[2] & JV3_DAM) >> 5;
+  if (id[2] & JV3_DENSITY) {
+    return dam ? 0xf8 : 0xfb;
+  }
+  return 0xfb - dam;
+}
+
+/*
+ * Image reading
+ */
+
+/* Decide what format we have, as trs_disk_emutype() does */
+static int image_type(Image *im)
+{
+  Uchar hdr[DMK_HDR_SIZE];
+  int n, c;
+
+  n = fread(hdr, 1, sizeof(hdr), im->f);
+  if (n >= 2 && hdr[0] == 0x56 && hdr[1] == 0xcb) {
+    return REED;
+  }
+  if (n > 0 && (hdr[0] == 0 || hdr[0] == 0xff) && n == DMK_HDR_SIZE &&
+      hdr[12] == 0 && hdr[13] == 0 && hdr[14] == 0 && hdr[15] == 0) {
+    int len = hdr[2] + (hdr[3] << 8);
+    if (len >= 16 && len <= DMK_TRACKLEN_MAX) {
+      return DMK;
+    }
+  }
+  if (n >= 2 && hdr[0] == 0 && hdr[1] == 0xfe) {
+    return JV1;
+  }
+  fseek(im->f, JV3_SECSPERBLK * 3, 0);
+  c = getc(im->f);
+  if (c == 0 || c == 0xff) {
+    return JV3;
+  }
+  return JV1;
+}
+
+static int jv1_open(Image *im)
+{
+  if (im->size % JV1_SECSIZE != 0) {
+    return seterr(im->err, "JV1: size is not a multiple of %d",
+		  JV1_SECSIZE);
+  }
+  im->ntracks = (im->size + JV1_SECSIZE * JV1_SECPERTRK - 1) /
+    (JV1_SECSIZE * JV1_SECPERTRK);
+  if (im->ntracks > MAXTRACKS) {
+    return seterr(im->err, "JV1: too many tracks");
+  }
+  im->nsides = 1;
+  im->sd = 1;
+  im->tracklen = 0x1900;
+  fseek(im->f, 0, 0);
+  return 0;
+}
+
+static int jv1_read_track(Image *im, Track *t)
+{
+  int i, n;
+
+  n = fread(t->buf, JV1_SECSIZE, JV1_SECPERTRK, im->f);
+  for (i = 0; i < n; i++) {
+    Sector *s = &t->sec[i];
+    s->cyl = im->track;
+    s->side = 0;
+    s->sec = i;
+    s->size = 1;
+    s->dden = 0;
+    s->dam = im->track == 17 ? 0xfa : 0xfb;
+    s->crcerr = 0;
+    s->data = &t->buf[i * JV1_SECSIZE];
+  }
+  t->nsecs = n;
+  return 0;
+}
+
+/* Bytes a sector takes on a DMK track, with gap 3 of the given length */
+static int dmk_sector_bytes(int size, int dden, int gap3, int twice)
+{
+  int n = (128 << size) + gap3;
+  if (dden) {
+    return n + 12 + 3 + 1 + 4 + 2 + 22 + 12 + 3 + 1 + 2;
+  }
+  return (n + 6 + 1 + 4 + 2 + 11 + 6 + 1 + 2) * (twice ? 2 : 1);
+}
+
+#define DMK_GAP3_DD 24
+#define DMK_GAP3_SD 12
+#define DMK_GAP1    32		/* DD bytes; half as many SD */
+
+static int jv3_open(Image *im)
+{
+  int i, n, nids, track, side;
+  short last[MAXTRACKS][2];
+  long ofs;
+
+  im->ids = xmalloc(JV3_SECSMAX * 3);
+  im->ofs = xmalloc(JV3_SECSMAX * sizeof(long));
+  im->next = xmalloc(JV3_SECSMAX * sizeof(short));
+  memset(im->ids, JV3_FREE, JV3_SECSMAX * 3);
+
+  /* Read the id blocks and find each sector's offset */
+  fseek(im->f, 0, 0);
+  n = fread(im->ids, 3, JV3_SECSPERBLK, im->f);
+  if (n != JV3_SECSPERBLK) {
+    return seterr(im->err, "JV3: id block truncated");
+  }
+  im->writeprot = getc(im->f) == 0;
+  ofs = JV3_SECSTART;
+  for (i = 0; i < JV3_SECSPERBLK; i++) {
+    im->ofs[i] = ofs;
+    ofs += 128 << jv3_size_code(&im->ids[i * 3]);
+  }
+  nids = JV3_SECSPERBLK;
+  if (ofs < im->size) {
+    fseek(im->f, ofs, 0);
+    n = fread(&im->ids[JV3_SECSPERBLK * 3], 3, JV3_SECSPERBLK, im->f);
+    if (n > 0) {
+      nids = JV3_SECSMAX;
+      ofs += JV3_SECSTART;
+      for (i = JV3_SECSPERBLK; i < JV3_SECSMAX; i++) {
+	im->ofs[i] = ofs;
+	ofs += 128 << jv3_size_code(&im->ids[i * 3]);
+      }
+    }
+  }
+
+  /* Chain the used ids of each track and side in physical order */
+  for (track = 0; track < MAXTRACKS; track++) {
+    im->first[track][0] = im->first[track][1] = -1;
+    last[track][0] = last[track][1] = -1;
+  }
+  for (i = 0; i < nids; i++) {
+    Uchar *id = &im->ids[i * 3];
+    if (id[0] == JV3_FREE) continue;
+    if (im->ofs[i] + (128 << jv3_size_code(id)) > im->size) {
+      return seterr(im->err, "JV3: sector data truncated");
+    }
+    track = id[0];
+    side = (id[2] & JV3_SIDE) != 0;
+    im->next[i] = -1;
+    if (last[track][side] < 0) {
+      im->first[track][side] = i;
+    } else {
+      im->next[last[track][side]] = i;
+    }
+    last[track][side] = i;
+    if (track >= im->ntracks) im->ntracks = track + 1;
+    if (side) im->nsides = 2;
+    if (id[2] & JV3_DENSITY) {
+      im->dd = 1;
+    } else {
+      im->sd = 1;
+    }
+  }
+  if (im->nsides == 0) im->nsides = 1;
+
+  /* Longest track, if written as DMK with usual gaps */
+  im->tracklen = 0x1900;
+  for (track = 0; track < im->ntracks; track++) {
+    for (side = 0; side < 2; side++) {
+      int len = DMK_TKHDR_SIZE + DMK_GAP1;
+      for (i = im->first[track][side]; i >= 0; i = im->next[i]) {
+	Uchar *id = &im->ids[i * 3];
+	int dden = (id[2] & JV3_DENSITY) != 0;
+	len += dmk_sector_bytes(jv3_size_code(id), dden,
+				dden ? DMK_GAP3_DD : DMK_GAP3_SD, im->dd);
+      }
+      if (len > im->tracklen) im->tracklen = len;
+    }
+  }
+  if (im->tracklen > DMK_TRACKLEN_MAX) im->tracklen = DMK_TRACKLEN_MAX;
+  return 0;
+}
+
+static int jv3_read_track(Image *im, Track *t)
+{
+  int i, n = 0, used = 0;
+
+  for (i = im->first[im->track][im->side]; i >= 0; i = im->next[i]) {
+    Uchar *id = &im->ids[i * 3];
+    Sector *s = &t->sec[n];
+    if (n == MAXSECS) {
+      return seterr(im->err, "JV3: more than %d sectors on track %d",
+		    MAXSECS, im->track);
+    }
+    s->cyl = id[0];
+    s->side = im->side;
+    s->sec = id[1];
+    s->size = jv3_size_code(id);
+    s->dden = (id[2] & JV3_DENSITY) != 0;
+    s->dam = jv3_dam(id);
+    s->crcerr = (id[2] & JV3_ERROR) != 0;
+    if (used + (128 << s->size) > (int) sizeof(t->buf)) {
+      return seterr(im->err, "JV3: track %d too long", im->track);
+    }
+    s->data = &t->buf[used];
+    fseek(im->f, im->ofs[i], 0);
+    if (fread(s->data, 128 << s->size, 1, im->f) != 1) {
+      return seterr(im->err, "JV3: read error");
+    }
+    used += 128 << s->size;
+    n++;
+  }
+  t->nsecs = n;
+  return 0;
+}
+
+static int dmk_open(Image *im)
+{
+  Uchar hdr[DMK_HDR_SIZE];
+
+  fseek(im->f, 0, 0);
+  if (fread(hdr, sizeof(hdr), 1, im->f) != 1) {
+    return seterr(im->err, "DMK: header truncated");
+  }
+  im->writeprot = hdr[0] == 0xff;
+  im->ntracks = hdr[1];
+  im->tracklen = hdr[2] + (hdr[3] << 8);
+  im->nsides = (hdr[4] & DMK_SSIDE_OPT) ? 1 : 2;
+  im->sden = (hdr[4] & DMK_SDEN_OPT) != 0;
+  im->ignden = (hdr[4] & DMK_IGNDEN_OPT) != 0;
+  im->sd = 1;
+  im->dd = !im->sden;
+  if (im->tracklen <= DMK_TKHDR_SIZE) {
+    return seterr(im->err, "DMK: track length 0x%x too short",
+		  im->tracklen);
+  }
+  if (DMK_HDR_SIZE + (long) im->ntracks * im->nsides * im->tracklen >
+      im->size) {
+    return seterr(im->err, "DMK: file shorter than %d tracks",
+		  im->ntracks);
+  }
+  im->tkbuf = xmalloc(DMK_TRACKLEN_MAX);
+  return 0;
+}
+
+/* Gather n bytes of a DMK track starting at p, stepping incr bytes */
+static int dmk_get(Image *im, int p, int incr, Uchar *out, int n)
+{
+  int i;
+  if (p + (n - 1) * incr >= im->tracklen) return -1;
+  for (i = 0; i < n; i++) {
+    out[i] = im->tkbuf[p + i * incr];
+  }
+  return 0;
+}
+
+static int dmk_read_track(Image *im, Track *t, Summary *sum)
+{
+  int i, used = 0;
+
+  /* Tracks are stored in the order read, so no seek is needed */
+  if (fread(im->tkbuf, im->tracklen, 1, im->f) != 1) {
+    return seterr(im->err, "DMK: read error");
+  }
+  t->nsecs = 0;
+  for (i = 0; i < DMK_TKHDR_SIZE; i += 2) {
+    int idamp = im->tkbuf[i] + (im->tkbuf[i + 1] << 8);
+    int dden = (idamp & DMK_DDEN_FLAG) != 0;
+    int incr = (im->ignden || im->sden || dden) ? 1 : 2;
+    int p, damlimit, size;
+    unsigned short crc;
+    Uchar id[7];
+    Sector *s;
+
+    if (idamp == 0) break;
+    idamp &= DMK_IDAMP_BITS;
+    if (idamp < DMK_TKHDR_SIZE ||
+	dmk_get(im, idamp, incr, id, 7) < 0 || id[0] != 0xfe) {
+      return seterr(im->err, "DMK: bad IDAM pointer on track %d side %d",
+		    im->track, im->side);
+    }
+    crc = calc_crc(dden ? 0xcdb4 /* CRC of a1 a1 a1 */ : 0xffff, id, 7);
+    if (crc != 0) {
+      sum->idcrc++;
+      continue;
+    }
+
+    /* Find the DAM, within the distance a 1791 searches */
+    p = idamp + 7 * incr;
+    damlimit = dden ? 43 : 30;
+    while (--damlimit >= 0 && p < im->tracklen) {
+      if (im->tkbuf[p] >= 0xf8 && im->tkbuf[p] <= 0xfb) break;
+      p += incr;
+    }
+    if (damlimit < 0 || p >= im->tracklen) {
+      continue;			/* ID with no data; nothing to copy */
+    }
+    if (t->nsecs == MAXSECS) break;
+    s = &t->sec[t->nsecs++];
+    s->cyl = id[1];
+    s->side = id[2];
+    s->sec = id[3];
+    s->size = id[4] & 3;
+    s->dden = dden;
+    s->dam = im->tkbuf[p];
+    s->data = &t->buf[used];
+    size = 128 << s->size;
+    if (dmk_get(im, p + incr, incr, s->data, size) < 0) {
+      return seterr(im->err, "DMK: sector runs off end of track %d",
+		    im->track);
+    }
+    used += size;
+    crc = calc_crc1(dden ? 0xcdb4 : 0xffff, s->dam);
+    crc = calc_crc(crc, s->data, size);
+    if (dmk_get(im, p + (size + 1) * incr, incr, id, 2) < 0) {
+      return seterr(im->err, "DMK: sector runs off end of track %d",
+		    im->track);
+    }
+    s->crcerr = calc_crc(crc, id, 2) != 0;
+  }
+  return 0;
+}
+
+static int image_open(Image *im, const char *name)
+{
+  struct stat st;
+
+  memset(im, 0, sizeof(*im));
+  im->name = name;
+  im->f = fopen(name, "r");
+  if (im->f == NULL || fstat(fileno(im->f), &st) < 0) {
+    return seterr(im->err, "%s", strerror(errno));
+  }
+  im->size = st.st_size;
+  im->type = image_type(im);
+  switch (im->type) {
+  case JV1:
+    return jv1_open(im);
+  case JV3:
+    return jv3_open(im);
+  case DMK:
+    return dmk_open(im);
+  }
+  return 0;
+}
+
+/* Read the next physical track.  Returns 1 if one was read, 0 at the
+   end, -1 on error. */
+static int image_read_track(Image *im, Track *t, Summary *sum)
+{
+  int res;
+
+  if (im->track >= im->ntracks) return 0;
+  t->track = im->track;
+  t->side = im->side;
+  switch (im->type) {
+  case JV1:
+    res = jv1_read_track(im, t);
+    break;
+  case JV3:
+    res = jv3_read_track(im, t);
+    break;
+  default:
+    res = dmk_read_track(im, t, sum);
+    break;
+  }
+  if (++im->side == im->nsides) {
+    im->side = 0;
+    im->track++;
+  }
+  return res < 0 ? res : 1;
+}
+
+static void image_close(Image *im)
+{
+  if (im->f) fclose(im->f);
+  free(im->ids);
+  free(im->ofs);
+  free(im->next);
+  free(im->tkbuf);
+}
+
+/* Check a Reed hard disk image and describe it */
+static int reed_check(Image *im, char *line, int len)
+{
+  ReedHardHeader rhh;
+  Uchar *p = (Uchar *) &rhh;
+  int i, cksum = 0, cyls, heads, ntracks, used = 0;
+
+  fseek(im->f, 0, 0);
+  if (fread(&rhh, sizeof(rhh), 1, im->f) != 1) {
+    return seterr(im->err, "Reed: header truncated");
+  }
+  for (i = 0; i <= 31; i++) {
+    if (i != 3) cksum += p[i];
+  }
+  if (rhh.ver >= 0x1f) {
+    return seterr(im->err, "Reed: unknown version 0x%02x", rhh.ver);
+  }
+  if (((Uchar) cksum ^ 0x4c) != rhh.cksum) {
+    return seterr(im->err, "Reed: bad header checksum");
+  }
+  cyls = rhh.cyl ? rhh.cyl : 256;
+  heads = (rhh.sec ? rhh.sec : 256) / REED_SPARSE_SECS;
+  if (rhh.sec % REED_SPARSE_SECS != 0 || heads == 0) {
+    return seterr(im->err, "Reed: unusable geometry");
+  }
+  ntracks = cyls * heads;
+  if (rhh.flag2 & REED_SPARSE) {
+    if (rhh.blks * 256 < (int) sizeof(rhh) + 2 * ntracks) {
+      return seterr(im->err, "Reed: allocation table too short");
+    }
+    for (i = 0; i < ntracks; i++) {
+      int lo = getc(im->f), hi = getc(im->f);
+      int n = lo + (hi << 8);
+      if (hi == EOF) {
+	return seterr(im->err, "Reed: allocation table truncated");
+      }
+      if (n > used) used = n;
+    }
+    if (rhh.blks * 256L + (long) used * REED_SPARSE_TRACK > im->size) {
+      return seterr(im->err, "Reed: file shorter than allocated tracks");
+    }
+  }
+  snprintf(line, len, "Reed, %d cylinders, %d heads, 256-byte sectors, "
+	   "%d sectors", cyls, heads, ntracks * REED_SPARSE_SECS);
+  if (rhh.flag2 & REED_SPARSE) {
+    snprintf(line + strlen(line), len - strlen(line),
+	     ", sparse with %d of %d tracks allocated", used, ntracks);
+  }
+  if (rhh.flag1 & 0x80) {
+    snprintf(line + strlen(line), len - strlen(line), ", write protected");
+  }
+  return 0;
+}
+
+/*
+ * Image writing
+ */
+
+static void put_bytes(Output *o, int *p, int c, int n, int twice)
+{
+  n *= twice ? 2 : 1;
+  while (n-- > 0) {
+    o->tkbuf[(*p)++] = c;
+  }
+}
+
+static int jv1_write_track(Output *o, Track *t)
+{
+  int i, j;
+
+  if (t->nsecs == 0) {
+    return 0;
+  }
+  if (t->side != 0) {
+    return seterr(o->err, "JV1 cannot hold a second side");
+  }
+  if (t->track != o->ntracks) {
+    return seterr(o->err, "JV1 cannot hold empty track %d", o->ntracks);
+  }
+  if (t->nsecs != JV1_SECPERTRK) {
+    return seterr(o->err, "JV1 needs %d sectors on track %d",
+		  JV1_SECPERTRK, t->track);
+  }
+  for (i = 0; i < JV1_SECPERTRK; i++) {
+    for (j = 0; j < t->nsecs; j++) {
+      if (t->sec[j].sec == i) break;
+    }
+    if (j == t->nsecs) {
+      return seterr(o->err, "JV1 needs sectors 0-%d on track %d",
+		    JV1_SECPERTRK - 1, t->track);
+    }
+    if (t->sec[j].dden || t->sec[j].size != 1 ||
+	t->sec[j].cyl != t->track || t->sec[j].crcerr ||
+	t->sec[j].dam != (t->track == 17 ? 0xfa : 0xfb)) {
+      return seterr(o->err, "JV1 cannot hold sector %d on track %d",
+		    i, t->track);
+    }
+    if (fwrite(t->sec[j].data, JV1_SECSIZE, 1, o->f) != 1) {
+      return seterr(o->err, "%s", strerror(errno));
+    }
+  }
+  o->ntracks++;
+  return 0;
+}
+
+static int jv3_write_track(Output *o, Track *t)
+{
+  int i;
+
+  for (i = 0; i < t->nsecs; i++) {
+    Sector *s = &t->sec[i];
+    Uchar *id = &o->ids[o->nids * 3];
+    int size = 128 << s->size;
+
+    if (s->cyl != t->track) {
+      return seterr(o->err, "JV3 cannot hold track %d ID on track %d",
+		    s->cyl, t->track);
+    }
+    if (o->nids == JV3_SECSMAX) {
+      return seterr(o->err, "JV3 cannot hold more than %d sectors",
+		    JV3_SECSMAX);
+    }
+    if (o->nids == JV3_SECSPERBLK) {
+      /* Second block of ids goes after the first block's sectors */
+      int j;
+      o->id2pos = ftell(o->f);
+      for (j = 0; j < JV3_SECSTART; j++) putc(JV3_FREE, o->f);
+    }
+    id[0] = s->cyl;
+    id[1] = s->sec;
+    id[2] = (s->size ^ 1) | (t->side ? JV3_SIDE : 0) |
+      (s->crcerr ? JV3_ERROR : 0);
+    if (s->dden) {
+      id[2] |= JV3_DENSITY | ((s->dam == 0xf8 || s->dam == 0xf9) ? 0x20 : 0);
+    } else {
+      id[2] |= (0xfb - s->dam) << 5;
+    }
+    o->nids++;
+    if (fwrite(s->data, size, 1, o->f) != 1) {
+      return seterr(o->err, "%s", strerror(errno));
+    }
+  }
+  return 0;
+}
+
+static int dmk_write_track(Output *o, Track *t)
+{
+  int avail = o->tracklen - DMK_TKHDR_SIZE;
+  int twice = !o->sden;
+  int i, gap3, len, p, idam = 0;
+  Uchar fill = 0xff;
+
+  /* Shorten gap 3 if the sectors will not fit with the usual one */
+  for (gap3 = DMK_GAP3_DD; gap3 >= 0; gap3--) {
+    len = DMK_GAP1;
+    for (i = 0; i < t->nsecs; i++) {
+      Sector *s = &t->sec[i];
+      int g = s->dden ? gap3 : (gap3 < DMK_GAP3_SD ? gap3 : DMK_GAP3_SD);
+      if (s->dden && o->sden) {
+	return seterr(o->err, "double density sector in SD-only DMK");
+      }
+      len += dmk_sector_bytes(s->size, s->dden, g, twice);
+    }
+    if (len <= avail) break;
+  }
+  if (gap3 < 0) {
+    return seterr(o->err, "track %d too long for DMK track length 0x%x",
+		  t->track, o->tracklen);
+  }
+
+  memset(o->tkbuf, 0, o->tracklen);
+  p = DMK_TKHDR_SIZE;
+  if (t->nsecs > 0 && t->sec[0].dden) {
+    put_bytes(o, &p, 0x4e, DMK_GAP1, 0);
+  } else {
+    put_bytes(o, &p, 0xff, DMK_GAP1 / 2, twice);
+  }
+  for (i = 0; i < t->nsecs; i++) {
+    Sector *s = &t->sec[i];
+    int tw = s->dden ? 0 : twice;
+    int size = 128 << s->size;
+    int j, ptr;
+    unsigned short crc;
+    Uchar id[5];
+
+    id[0] = 0xfe;
+    id[1] = s->cyl;
+    id[2] = s->side;
+    id[3] = s->sec;
+    id[4] = s->size;
+    if (s->dden) {
+      put_bytes(o, &p, 0x00, 12, 0);
+      put_bytes(o, &p, 0xa1, 3, 0);
+      crc = 0xcdb4;  /* CRC of a1 a1 a1 */
+      fill = 0x4e;
+    } else {
+      put_bytes(o, &p, 0x00, 6, tw);
+      crc = 0xffff;
+      fill = 0xff;
+    }
+    ptr = p | (s->dden ? DMK_DDEN_FLAG : 0);
+    o->tkbuf[idam++] = ptr & 0xff;
+    o->tkbuf[idam++] = ptr >> 8;
+    for (j = 0; j < 5; j++) put_bytes(o, &p, id[j], 1, tw);
+    crc = calc_crc(crc, id, 5);
+    put_bytes(o, &p, crc >> 8, 1, tw);
+    put_bytes(o, &p, crc & 0xff, 1, tw);
+
+    if (s->dden) {
+      put_bytes(o, &p, 0x4e, 22, 0);
+      put_bytes(o, &p, 0x00, 12, 0);
+      put_bytes(o, &p, 0xa1, 3, 0);
+      crc = 0xcdb4;
+    } else {
+      put_bytes(o, &p, 0xff, 11, tw);
+      put_bytes(o, &p, 0x00, 6, tw);
+      crc = 0xffff;
+    }
+    put_bytes(o, &p, s->dam, 1, tw);
+    crc = calc_crc1(crc, s->dam);
+    for (j = 0; j < size; j++) put_bytes(o, &p, s->data[j], 1, tw);
+    crc = calc_crc(crc, s->data, size);
+    if (s->crcerr) crc ^= 0xffff;
+    put_bytes(o, &p, crc >> 8, 1, tw);
+    put_bytes(o, &p, crc & 0xff, 1, tw);
+    put_bytes(o, &p, fill,
+	      s->dden ? gap3 : (gap3 < DMK_GAP3_SD ? gap3 : DMK_GAP3_SD), tw);
+  }
+  while (p < o->tracklen) o->tkbuf[p++] = fill;
+
+  if (fwrite(o->tkbuf, o->tracklen, 1, o->f) != 1) {
+    return seterr(o->err, "%s", strerror(errno));
+  }
+  if (t->side == 0) o->ntracks++;
+  return 0;
+}
+
+/*
+ * If overwrite, create or truncate fname and open for writing.  If
+ * !overwrite, create and open fname only if it does not already
+ * exist.  (As in mkdisk.)
+ */
+static FILE *fopen_w(const char *fname)
+{
+  int fd;
+
+  fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC|(overwrite ? 0 : O_EXCL), 0666);
+  if (fd < 0) {
+    return NULL;
+  }
+  return fdopen(fd, "w");
+}
+
+/* Create the directories leading to path */
+static void make_dirs(const char *path)
+{
+  char *p, *dir = xstrdup(path);
+
+  for (p = strchr(dir + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+    *p = '\0';
+    mkdir(dir, 0777);
+    *p = '/';
+  }
+  free(dir);
+}
+
+static int output_open(Output *o, const char *name, Image *im)
+{
+  struct stat ist, ost;
+  Uchar hdr[DMK_HDR_SIZE];
+
+  memset(o, 0, sizeof(*o));
+  o->type = outtype;
+  if (stat(name, &ost) == 0 && fstat(fileno(im->f), &ist) == 0 &&
+      ost.st_dev == ist.st_dev && ost.st_ino == ist.st_ino) {
+    return seterr(o->err, "output would overwrite input");
+  }
+  make_dirs(name);
+  o->f = fopen_w(name);
+  if (o->f == NULL) {
+    return seterr(o->err, "%s: %s", name, strerror(errno));
+  }
+  switch (o->type) {
+  case JV3:
+    o->ids = xmalloc(JV3_SECSMAX * 3);
+    memset(o->ids, JV3_FREE, JV3_SECSMAX * 3);
+    fwrite(o->ids, 1, JV3_SECSTART, o->f);
+    break;
+  case DMK:
+    o->nsides = im->nsides;
+    o->sden = !im->dd;
+    o->tracklen = im->tracklen;
+    o->tkbuf = xmalloc(DMK_TRACKLEN_MAX);
+    memset(hdr, 0, sizeof(hdr));
+    hdr[0] = im->writeprot ? 0xff : 0;
+    hdr[2] = o->tracklen & 0xff;
+    hdr[3] = o->tracklen >> 8;
+    hdr[4] = (o->nsides == 1 ? DMK_SSIDE_OPT : 0) |
+      (o->sden ? DMK_SDEN_OPT : 0);
+    fwrite(hdr, 1, sizeof(hdr), o->f);
+    break;
+  }
+  return 0;
+}
+
+static int output_write_track(Output *o, Track *t)
+{
+  switch (o->type) {
+  case JV1:
+    return jv1_write_track(o, t);
+  case JV3:
+    return jv3_write_track(o, t);
+  default:
+    return dmk_write_track(o, t);
+  }
+}
+
+/* Finish the file: fill in the JV3 id blocks or DMK track count */
+static int output_close(Output *o, Image *im)
+{
+  int res = 0;
+
+  if (o->type == JV3) {
+    fseek(o->f, 0, 0);
+    fwrite(o->ids, 3, JV3_SECSPERBLK, o->f);
+    putc(im->writeprot ? 0 : 0xff, o->f);
+    if (o->id2pos) {
+      fseek(o->f, o->id2pos, 0);
+      fwrite(&o->ids[JV3_SECSPERBLK * 3], 3, JV3_SECSPERBLK, o->f);
+    }
+  } else if (o->type == DMK) {
+    fseek(o->f, 1, 0);
+    putc(o->ntracks, o->f);
+  }
+  if (ferror(o->f)) {
+    res = seterr(o->err, "%s", strerror(errno));
+  }
+  if (fclose(o->f) != 0) {
+    res = seterr(o->err, "%s", strerror(errno));
+  }
+  free(o->ids);
+  free(o->tkbuf);
+  return res;
+}
+
+/*
+ * Work on one image
+ */
+
+static void describe(Summary *sum, Image *im, char *line, int len)
+{
+  int n, i;
+
+  n = snprintf(line, len, "%s, %d track%s, %d side%s, ",
+	       type_name(im->type), sum->tracks, sum->tracks == 1 ? "" : "s",
+	       sum->sides, sum->sides == 1 ? "" : "s");
+  if (sum->secs == 0) {
+    n += snprintf(line + n, len - n, "unformatted");
+  } else {
+    n += snprintf(line + n, len - n, "%s, ",
+		  sum->sd ? (sum->dd ? "SD+DD" : "SD") : "DD");
+    for (i = 0; i < 4; i++) {
+      if (sum->sizes & (1 << i)) {
+	n += snprintf(line + n, len - n, "%s%d",
+		      (sum->sizes & ((1 << i) - 1)) ? "/" : "", 128 << i);
+      }
+    }
+    n += snprintf(line + n, len - n, "-byte sectors, %d sector%s",
+		  sum->secs, sum->secs == 1 ? "" : "s");
+  }
+  if (im->writeprot) {
+    n += snprintf(line + n, len - n, ", write protected");
+  }
+  if (sum->idcrc) {
+    n += snprintf(line + n, len - n, ", %d ID CRC error%s",
+		  sum->idcrc, sum->idcrc == 1 ? "" : "s");
+  }
+  if (sum->datacrc) {
+    snprintf(line + n, len - n, ", %d data CRC error%s",
+	     sum->datacrc, sum->datacrc == 1 ? "" : "s");
+  }
+}
+
+static void do_image(Job *job, Track *t)
+{
+  Image im;
+  Output o;
+  Summary sum;
+  char desc[MSGLEN], *outname = NULL, *line;
+  const char *err = NULL;
+  int i, res, bad;
+
+  memset(&sum, 0, sizeof(sum));
+  desc[0] = '\0';
+  if (image_open(&im, job->path) < 0) {
+    err = im.err;
+  } else if (im.type == REED) {
+    if (reed_check(&im, desc, sizeof(desc)) < 0) {
+      err = im.err;
+    } else if (outtype) {
+      strcat(desc, " (not converted)");
+    }
+  } else {
+    if (outtype) {
+      outname = xmalloc(strlen(outdir) + strlen(job->rel) + 2);
+      sprintf(outname, "%s/%s", outdir, job->rel);
+      if (output_open(&o, outname, &im) < 0) {
+	err = o.err;
+	free(outname);
+	outname = NULL;
+      }
+    }
+    while (err == NULL && (res = image_read_track(&im, t, &sum)) != 0) {
+      if (res < 0) {
+	err = im.err;
+	break;
+      }
+      if (t->nsecs > 0) {
+	if (t->track >= sum.tracks) sum.tracks = t->track + 1;
+	if (t->side >= sum.sides) sum.sides = t->side + 1;
+      }
+      for (i = 0; i < t->nsecs; i++) {
+	if (t->sec[i].dden) {
+	  sum.dd = 1;
+	} else {
+	  sum.sd = 1;
+	}
+	sum.sizes |= 1 << t->sec[i].size;
+	sum.secs++;
+	sum.datacrc += t->sec[i].crcerr;
+      }
+      if (outname && output_write_track(&o, t) < 0) {
+	err = o.err;
+      }
+    }
+    if (outname) {
+      if (output_close(&o, &im) < 0 && err == NULL) {
+	err = o.err;
+      }
+      if (err) {
+	unlink(outname);
+      }
+    }
+    if (err == NULL) {
+      if (sum.sides == 0) sum.sides = im.nsides;
+      describe(&sum, &im, desc, sizeof(desc));
+    }
+  }
+
+  i = strlen(job->path) + strlen(desc) + MSGLEN +
+    (outname ? strlen(outname) : 0);
+  line = xmalloc(i);
+  if (err) {
+    snprintf(line, i, "%s: %s", job->path, err);
+  } else if (outname) {
+    snprintf(line, i, "%s: %s -> %s", job->path, desc, outname);
+  } else {
+    snprintf(line, i, "%s: %s", job->path, desc);
+  }
+  bad = err != NULL || sum.idcrc != 0 || sum.datacrc != 0;
+  image_close(&im);
+  free(outname);
+
+  /* Publish the report; another worker may print and free the job as
+     soon as it sees line set, so that comes last */
+  pthread_mutex_lock(&job_lock);
+  job->bad = bad;
+  job->line = line;
+  pthread_mutex_unlock(&job_lock);
+}
+
+/* Worker thread: take images until there are none left, printing the
+   reports in the order the images were found */
+static void *worker(void *arg)
+{
+  Track *t = xmalloc(sizeof(Track));
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&job_lock);
+    i = next_job < njobs ? next_job++ : -1;
+    pthread_mutex_unlock(&job_lock);
+    if (i < 0) break;
+
+    do_image(&jobs[i], t);
+
+    pthread_mutex_lock(&job_lock);
+    while (next_print < njobs && jobs[next_print].line) {
+      Job *job = &jobs[next_print++];
+      if (job->bad) any_bad = 1;
+      if (!quiet || job->bad) puts(job->line);
+      free(job->line);
+      free(job->path);
+      free(job->rel);
+    }
+    pthread_mutex_unlock(&job_lock);
+  }
+  free(t);
+  return NULL;
+}
+
+/*
+ * Finding images
+ */
+
+static int compare_names(const void *a, const void *b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void add_path(const char *path, const char *rel)
+{
+  struct stat st;
+
+  if (stat(path, &st) < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    any_bad = 1;
+    return;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(path);
+    struct dirent *de;
+    char **names = NULL;
+    int n = 0, max = 0, i;
+
+    if (dir == NULL) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      any_bad = 1;
+      return;
+    }
+    while ((de = readdir(dir)) != NULL) {
+      if (de->d_name[0] == '.') continue;
+      if (n == max) {
+	max = max ? 2 * max : 64;
+	names = realloc(names, max * sizeof(char *));
+	if (names == NULL) xmalloc((size_t) -1);
+      }
+      names[n++] = xstrdup(de->d_name);
+    }
+    closedir(dir);
+    qsort(names, n, sizeof(char *), compare_names);
+    for (i = 0; i < n; i++) {
+      char *p = xmalloc(strlen(path) + strlen(names[i]) + 2);
+      char *r = xmalloc(strlen(rel) + strlen(names[i]) + 2);
+      sprintf(p, "%s/%s", path, names[i]);
+      sprintf(r, "%s%s%s", rel, rel[0] ? "/" : "", names[i]);
+      add_path(p, r);
+      free(p);
+      free(r);
+      free(names[i]);
+    }
+    free(names);
+  } else if (S_ISREG(st.st_mode)) {
+    if (njobs == maxjobs) {
+      maxjobs = maxjobs ? 2 * maxjobs : 1024;
+      jobs = realloc(jobs, maxjobs * sizeof(Job));
+      if (jobs == NULL) xmalloc((size_t) -1);
+    }
+    jobs[njobs].path = xstrdup(path);
+    jobs[njobs].rel = xstrdup(rel);
+    jobs[njobs].line = NULL;
+    jobs[njobs].bad = 0;
+    njobs++;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int c, i, nthreads = 0;
+  pthread_t *threads;
+
+  program_name = strrchr(argv[0], '/');
+  if (program_name == NULL) {
+    program_name = argv[0];
+  } else {
+    program_name++;
+  }
+
+  opterr = 0;
+  while ((c = getopt(argc, argv, ARGS)) != -1) {
+    switch (c) {
+    case 'j':
+      nthreads = atoi(optarg);
+      if (nthreads <= 0) Usage();
+      break;
+    case 'q':
+      quiet = 1;
+      break;
+    case 't':
+      if (strcmp(optarg, "jv1") == 0) {
+	outtype = JV1;
+      } else if (strcmp(optarg, "jv3") == 0) {
+	outtype = JV3;
+      } else if (strcmp(optarg, "dmk") == 0) {
+	outtype = DMK;
+      } else {
+	Usage();
+      }
+      break;
+    case 'o':
+      outdir = optarg;
+      break;
+    case 'f':
+      overwrite = 1;
+      break;
+    default:
+      Usage();
+    }
+  }
+  if (optind == argc || (outtype != 0) != (outdir != NULL)) Usage();
+
+  for (i = optind; i < argc; i++) {
+    const char *base = strrchr(argv[i], '/');
+    add_path(argv[i], base ? base + 1 : argv[i]);
+  }
+
+  crc_init();
+  if (nthreads == 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > njobs) nthreads = njobs;
+  if (nthreads < 1) nthreads = 1;
+  threads = xmalloc(nthreads * sizeof(pthread_t));
+  for (i = 1; i < nthreads; i++) {
+    if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+      nthreads = i;
+      break;
+    }
+  }
+  worker(NULL);
+  for (i = 1; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(jobs);
+  return any_bad;
+}
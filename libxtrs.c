@@ -0,0 +1,584 @@
+/* 
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * libxtrs.c -- emulator setup shared by all front ends, and the C
+ * interface for embedding the emulator in another program (see
+ * libxtrs.h).
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "z80.h"
+#include "trs.h"
+#include "trs_disk.h"
+#include "trs_hard.h"
+#include "load_cmd.h"
+#include "trs_stats.h"
+#include "trs_screentext.h"
+#include "z80_trace.h"
+#include "z80_coverage.h"
+#include "trs_replay.h"
+#include "libxtrs.h"
+
+int trs_model = 1;
+int trs_paused = 1;
+int trs_autodelay = 0;
+char *program_name;
+char *romfile1 = NULL;
+char *romfile1x = NULL;
+char *romfile3 = NULL;
+char *romfile4p = NULL;
+char *trs_run_name = NULL;	/* -run program */
+int trs_run_exit = FALSE;	/* -runexit */
+int trs_exit_status = 0;
+
+/*
+ * Stubs for -run.  The program returns to them instead of to DOS.
+ * On a Model 4, RST 28h (LS-DOS's SVC call, with the SVC number in
+ * A) goes to run_svc, which is followed by run_exit.
+ */
+static const Uchar run_svc[] = {
+  0xfe, 22,		/*        cp @EXIT */
+  0x28, 0x11,		/*        jr z,exit */
+  0xfe, 21,		/*        cp @ABORT */
+  0x28, 0x05,		/*        jr z,abort */
+  0x3e, 0x02,		/*        ld a,2 */
+  0xed, 0x3c,		/*        emt_misc ; no other SVCs: debugger */
+  0xc9,			/*        ret */
+};
+
+static const Uchar run_exit[] = {
+  0x21, 0xff, 0xff,	/* abort: ld hl,-1 */
+  0x18, 0x03,		/*        jr exit */
+  0x21, 0x00, 0x00,	/* done:  ld hl,0 ; program returned */
+  0x3e, 0x00,		/* exit:  ld a,func */
+  0xed, 0x3c,		/*        emt_misc ; exit or reset */
+  0x18, 0xfe,		/*        jr $ */
+};
+#define RUN_ABORT	0
+#define RUN_DONE	5
+#define RUN_EXIT	8
+#define RUN_FUNC	9
+
+#define RUN_STUBS_M4	0x0040	/* below LS-DOS's resident system */
+#define RUN_STACK_M4	0x3000	/* where LS-DOS programs start */
+#define RUN_STUBS_M13	0x4300	/* in the DOS area, unused without DOS */
+#define RUN_STACK_M13	0x4400
+
+static void check_endian(void)
+{
+    wordregister x;
+    x.byte.low = 1;
+    x.byte.high = 0;
+    if(x.word != 1)
+    {
+	fatal("Program compiled with wrong ENDIAN value -- adjust the Makefile.local, type \"rm *.o\", recompile, and try again.");
+    }
+}
+
+/*
+ * Although the ROM loading code supports multiple ROMs, xtrs has an
+ * overall assumeion that addresses from 0 up to the end of the
+ * highest-addressed ROM (if any) are all ROM space.  So we set
+ * trs_rom_size to the end of the highest-addressed ROM that has been
+ * seen.  We do now check for loading too large a Model 4P boot ROM,
+ * which can happen if someone tries to use a Model III/4 ROM in 4P mode.
+ *
+ * Moreover, we assume we know where the ROMs start -- address 0 for
+ * all except the Model I ESF extension ROM, which starts at 0x3000.
+ * We don't check if this assumption is violated, even in cases where
+ * it's possible to check because the ROM format carries a starting
+ * address, such as with Intel hex format or load module format.
+ */
+
+/*
+ * Load a ROM from an external file.
+ */
+void trs_load_rom(int address, char *filename)
+{
+    FILE *program;
+    int c;
+    int rom_end = 0;
+
+    if((program = fopen(filename, "r")) == NULL)
+    {
+	char message[100];
+	sprintf(message, "could not read %s", filename);
+	fatal(message);
+    }
+    c = getc(program);
+
+    if (c == ':') {
+        /* Assume Intel hex format */
+        rewind(program);
+        rom_end = load_hex(program);
+	goto done;
+    }
+
+    if (c == 1 || c == 5) {
+        /* Assume MODELA/III file (load module) */
+	int res;
+	extern Uchar *rom; /*!! fixme*/
+	Uchar loadmap[Z80_ADDRESS_LIMIT];
+	rewind(program);
+	res = load_cmd(program, rom, loadmap, 0, NULL, -1, NULL, NULL, 1);
+	if (res == LOAD_CMD_OK) {
+	    rom_end = Z80_ADDRESS_LIMIT;
+	    while (rom_end > 0) {
+		if (loadmap[--rom_end] != 0) {
+		    rom_end++;
+		    break;
+		}
+	    }
+	    goto done;
+	} else {
+	    /* Apparently it wasn't one; prepare to fall through to
+             * raw binary case. */
+	    rewind(program);
+	    c = getc(program);
+	}
+    }
+
+    /* Assume raw binary */
+    rom_end = address;
+    while (c != EOF) {
+        mem_write_rom(rom_end++, c);
+	c = getc(program);
+    }
+
+ done:
+    fclose(program);
+    if (rom_end > trs_rom_size) {
+       trs_rom_size = rom_end;
+    }
+}
+
+/*
+ * Load a compiled-in ROM.
+ */
+void trs_load_compiled_rom(int address, int size, unsigned char rom[])
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+	mem_write_rom(address + i, rom[i]);
+    }
+
+    if (address + size > trs_rom_size) {
+       trs_rom_size = address + size;
+    }
+}
+
+void
+trs_load_romfiles(void)
+{
+  struct stat statbuf;
+
+  switch (trs_model) {
+  case 1:
+#ifdef DEFAULT_ROM1
+    if (!romfile1) {
+      romfile1 = DEFAULT_ROM1;
+    }
+#endif
+    if (romfile1 != NULL && stat(romfile1, &statbuf) == 0) {
+      trs_load_rom(0, romfile1);
+    } else if (trs_rom1_size > 0) {
+      trs_load_compiled_rom(0, trs_rom1_size, trs_rom1);
+    } else {
+      fatal("ROM file not specified!");
+    }
+
+#ifdef DEFAULT_ROM1X
+    if (!romfile1x) {
+      romfile1x = DEFAULT_ROM1X;
+    }
+#endif
+    if (romfile1x != NULL && stat(romfile1x, &statbuf) == 0) {
+      trs_load_rom(0x3000, romfile1x);
+    } else if (trs_rom1x_size > 0) {
+      trs_load_compiled_rom(0x3000, trs_rom1x_size, trs_rom1x);
+    }
+    break;
+
+  case 3:
+  case 4:
+#ifdef DEFAULT_ROM3
+    if (!romfile3) {
+      romfile3 = DEFAULT_ROM3;
+    }
+#endif
+    if (romfile3 != NULL && stat(romfile3, &statbuf) == 0) {
+      trs_load_rom(0, romfile3);
+    } else if (trs_rom3_size > 0) {
+      trs_load_compiled_rom(0, trs_rom3_size, trs_rom3);
+    } else {
+      fatal("ROM file not specified!");
+    }
+    break;
+
+  default: /* 4P */
+#ifdef DEFAULT_ROM4P
+    if (!romfile4p) {
+      romfile4p = DEFAULT_ROM4P;
+    }
+#endif
+    if (romfile4p != NULL && stat(romfile4p, &statbuf) == 0) {
+      trs_load_rom(0, romfile4p);
+    } else if (trs_rom4p_size > 0) {
+      trs_load_compiled_rom(0, trs_rom4p_size, trs_rom4p);
+    } else {
+      fatal("ROM file not specified!");
+    }
+    if (trs_rom_size > 0x1000) {
+       fatal("Wrong type of ROM; a Model 4P boot ROM is at most 4KB");
+    }
+    break;
+  }
+}
+
+/*
+ * Load a /CMD or Intel hex program into RAM through the current
+ * memory map.  Returns its transfer address, -1 if it has none, or -2
+ * on error.
+ */
+static int load_program(const char *filename)
+{
+    FILE *f;
+    int res, xfer, i, c;
+    Uchar *buf, *loadmap;
+
+    f = fopen(filename, "r");
+    if (f == NULL) return -2;
+    c = getc(f);
+    rewind(f);
+    if (c == ':') {
+	xfer = mem_load_hex(f);
+	fclose(f);
+	return xfer;
+    }
+    buf = (Uchar *) malloc(Z80_ADDRESS_LIMIT);
+    loadmap = (Uchar *) calloc(Z80_ADDRESS_LIMIT, 1);
+    if (buf == NULL || loadmap == NULL) {
+	free(buf);
+	free(loadmap);
+	fclose(f);
+	return -2;
+    }
+    res = load_cmd(f, buf, loadmap, VERBOSITY_QUIET, NULL,
+		   ISAM_NONE, NULL, &xfer, 1);
+    fclose(f);
+    if (res == LOAD_CMD_OK) {
+	for (i = 0; i < Z80_ADDRESS_LIMIT; i++) {
+	    if (loadmap[i]) mem_write(i, buf[i]);
+	}
+    } else {
+	xfer = -2;
+    }
+    free(buf);
+    free(loadmap);
+    return xfer;
+}
+
+static void write_stub(int address, const Uchar *code, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+	mem_write(address + i, code[i]);
+    }
+}
+
+static void push_word(int value)
+{
+    REG_SP -= 2;
+    mem_write(REG_SP, value & 0xff);
+    mem_write(REG_SP + 1, value >> 8);
+}
+
+/*
+ * Start the -run program without booting a DOS.  The ROM is not run,
+ * so the program gets only the stub DOS exits set up here, plus
+ * whatever ROM entry points work without the ROM's RAM setup.
+ */
+static void trs_run_program(void)
+{
+    char message[256];
+    int xfer, stubs, exits;
+
+    if (trs_model >= 4) {
+	z80_out(0x84, 2);	/* all RAM except keyboard and video */
+    }
+    xfer = load_program(trs_run_name);
+    if (xfer < 0) {
+	snprintf(message, sizeof(message), "%s %s", xfer == -1 ?
+		 "no transfer address in" : "could not load", trs_run_name);
+	fatal(message);
+    }
+
+    if (trs_model >= 4) {
+	stubs = RUN_STUBS_M4;
+	exits = stubs + sizeof(run_svc);
+	mem_write(0x0028, 0xc3);		/* jp svc */
+	mem_write(0x0029, stubs & 0xff);
+	mem_write(0x002a, stubs >> 8);
+	write_stub(stubs, run_svc, sizeof(run_svc));
+	REG_SP = RUN_STACK_M4;
+    } else {
+	stubs = exits = RUN_STUBS_M13;
+	mem_write(0x402d, 0xc3);		/* @EXIT: jp exit */
+	mem_write(0x402e, (exits + RUN_EXIT) & 0xff);
+	mem_write(0x402f, (exits + RUN_EXIT) >> 8);
+	mem_write(0x4030, 0xc3);		/* @ABORT: jp abort */
+	mem_write(0x4031, (exits + RUN_ABORT) & 0xff);
+	mem_write(0x4032, (exits + RUN_ABORT) >> 8);
+	REG_SP = RUN_STACK_M13;
+    }
+    write_stub(exits, run_exit, sizeof(run_exit));
+    /* emt_misc 26 exits with status L; 3 presses the reset button */
+    mem_write(exits + RUN_FUNC, trs_run_exit ? 26 : 3);
+    push_word(exits + RUN_DONE);
+
+    z80_state.iff1 = z80_state.iff2 = 0;
+    REG_PC = xfer;
+}
+
+/*
+ * Initialize the emulated machine after the front end has parsed its
+ * options, and perform the initial power-on reset.
+ */
+void trs_init(void)
+{
+    check_endian();
+    mem_init();
+    trs_screen_init();
+    trs_replay_init();
+    trs_timer_init();
+    trs_disk_init();
+    trs_hard_init();
+    stringy_init();
+    trs_stats_init();
+    trs_screentext_init();
+    trs_kb_typein_init();
+    z80_trace_init();
+    z80_coverage_init();
+    z80_gdb_init();
+
+    trs_load_romfiles();
+    trs_reset(1);
+    if (trs_run_name != NULL) trs_run_program();
+}
+
+/*
+ * Embedding interface
+ */
+
+void (*trs_screen_hook)(int position, int char_index) = NULL;
+static int exit_requested;
+
+/* Called by the headless trs_exit() */
+void trs_exit_request(void)
+{
+    exit_requested = TRUE;
+    if (trs_continuous > 0) trs_continuous = 0;
+}
+
+int xtrs_create(int model, const char *romfile)
+{
+    if (program_name == NULL) program_name = "libxtrs";
+    trs_model = model;
+    if (romfile != NULL) {
+	switch (model) {
+	case 1:
+	    romfile1 = strdup(romfile);
+	    break;
+	case 3:
+	case 4:
+	    romfile3 = strdup(romfile);
+	    break;
+	default:
+	    romfile4p = strdup(romfile);
+	    break;
+	}
+    }
+    trs_init();
+    return 0;
+}
+
+void xtrs_reset(int poweron)
+{
+    trs_reset(poweron);
+}
+
+int xtrs_load_rom(int address, const char *filename)
+{
+    if (access(filename, R_OK) < 0) return -1;
+    trs_load_rom(address, (char *) filename);
+    return 0;
+}
+
+int xtrs_load_cmd(const char *filename)
+{
+    return load_program(filename);
+}
+
+int xtrs_attach_disk(int drive, const char *filename)
+{
+    return trs_disk_set_name(drive, filename) == 0 ? 0 : -1;
+}
+
+int xtrs_attach_hard(int drive, const char *filename)
+{
+    return trs_hard_set_name(drive, filename) == 0 ? 0 : -1;
+}
+
+int xtrs_run_for(tstate_t tstates)
+{
+    int ret;
+
+    exit_requested = FALSE;
+    z80_state.stop = z80_state.t_count + tstates;
+    if (z80_state.stop == 0) z80_state.stop--;
+    ret = z80_run(TRUE);
+    if (exit_requested) return XTRS_RUN_EXIT;
+    if (trs_screentext_stopped) {
+	trs_screentext_stopped = FALSE;
+	z80_state.stop = 0;
+	return XTRS_RUN_MATCH;
+    }
+    if (ret || z80_state.stop != 0) {
+	/* Stopped early by emt_debug or trs_debug() */
+	z80_state.stop = 0;
+	return XTRS_RUN_DEBUG;
+    }
+    return XTRS_RUN_DONE;
+}
+
+tstate_t xtrs_tstates(void)
+{
+    return z80_state.t_count;
+}
+
+int xtrs_read_mem(int address)
+{
+    return mem_read(address);
+}
+
+void xtrs_write_mem(int address, int value)
+{
+    mem_write(address, value);
+}
+
+int xtrs_get_reg(int reg)
+{
+    switch (reg) {
+    case XTRS_REG_AF: return REG_AF;
+    case XTRS_REG_BC: return REG_BC;
+    case XTRS_REG_DE: return REG_DE;
+    case XTRS_REG_HL: return REG_HL;
+    case XTRS_REG_IX: return REG_IX;
+    case XTRS_REG_IY: return REG_IY;
+    case XTRS_REG_SP: return REG_SP;
+    case XTRS_REG_PC: return REG_PC;
+    case XTRS_REG_AF_PRIME: return REG_AF_PRIME;
+    case XTRS_REG_BC_PRIME: return REG_BC_PRIME;
+    case XTRS_REG_DE_PRIME: return REG_DE_PRIME;
+    case XTRS_REG_HL_PRIME: return REG_HL_PRIME;
+    case XTRS_REG_I: return REG_I;
+    case XTRS_REG_R: return REG_R7 | (REG_R & 0x7f);
+    case XTRS_REG_IFF1: return z80_state.iff1;
+    case XTRS_REG_IFF2: return z80_state.iff2;
+    case XTRS_REG_IM: return z80_state.interrupt_mode;
+    }
+    return -1;
+}
+
+void xtrs_set_reg(int reg, int value)
+{
+    switch (reg) {
+    case XTRS_REG_AF: REG_AF = value; break;
+    case XTRS_REG_BC: REG_BC = value; break;
+    case XTRS_REG_DE: REG_DE = value; break;
+    case XTRS_REG_HL: REG_HL = value; break;
+    case XTRS_REG_IX: REG_IX = value; break;
+    case XTRS_REG_IY: REG_IY = value; break;
+    case XTRS_REG_SP: REG_SP = value; break;
+    case XTRS_REG_PC: REG_PC = value; break;
+    case XTRS_REG_AF_PRIME: REG_AF_PRIME = value; break;
+    case XTRS_REG_BC_PRIME: REG_BC_PRIME = value; break;
+    case XTRS_REG_DE_PRIME: REG_DE_PRIME = value; break;
+    case XTRS_REG_HL_PRIME: REG_HL_PRIME = value; break;
+    case XTRS_REG_I: REG_I = value; break;
+    case XTRS_REG_R: REG_R = value; REG_R7 = value & 0x80; break;
+    case XTRS_REG_IFF1: z80_state.iff1 = value; break;
+    case XTRS_REG_IFF2: z80_state.iff2 = value; break;
+    case XTRS_REG_IM: z80_state.interrupt_mode = value; break;
+    }
+}
+
+void xtrs_key_event(int keysym, int down)
+{
+    trs_xlate_keysym(down ? keysym : (0x10000 | keysym));
+}
+
+void xtrs_type_char(int ascii)
+{
+    xtrs_key_event(ascii, TRUE);
+    xtrs_key_event(ascii, FALSE);
+}
+
+int xtrs_screen_text(char *buf, int size)
+{
+    return trs_screentext_get(buf, size);
+}
+
+int xtrs_screen_match(const char *regex)
+{
+    return trs_screentext_set_match(regex, SCREENTEXT_STOP);
+}
+
+void xtrs_type_text(const char *text)
+{
+    trs_kb_typein(text, strlen(text));
+}
+
+void xtrs_set_video_callback(xtrs_video_func f)
+{
+    trs_screen_hook = f;
+}
+
+void xtrs_set_printer_callback(xtrs_printer_func f)
+{
+    trs_printer_hook = f;
+}
+
+void xtrs_set_emt_callback(xtrs_emt_func f)
+{
+    trs_emt_hook = f;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * libxtrs.h -- C interface for embedding the xtrs emulator in another
+ * program.  Link with libxtrs.a, which includes a headless display
+ * (trs_headless.c) in place of the X interface.
+ *
+ * The emulator keeps its state in global variables, so there can be
+ * only one emulated machine per process.  The emulated real time
+ * clock follows the host clock, checked as the emulator runs (see
+ * trs_timer_poll()); no signals are used.
+ */
+#ifndef _LIBXTRS_H
+#define _LIBXTRS_H
+
+#include "z80.h"
+
+/* Reasons returned by xtrs_run_for() */
+#define XTRS_RUN_DONE   0  /* ran the requested number of T-states */
+#define XTRS_RUN_DEBUG  1  /* emt_debug executed or debugger requested */
+#define XTRS_RUN_EXIT   2  /* emulated program asked xtrs to exit */
+#define XTRS_RUN_MATCH  3  /* screen matched xtrs_screen_match() pattern */
+
+/* Register numbers for xtrs_get_reg() and xtrs_set_reg() */
+#define XTRS_REG_AF   0
+#define XTRS_REG_BC   1
+#define XTRS_REG_DE   2
+#define XTRS_REG_HL   3
+#define XTRS_REG_IX   4
+#define XTRS_REG_IY   5
+#define XTRS_REG_SP   6
+#define XTRS_REG_PC   7
+#define XTRS_REG_AF_PRIME 8
+#define XTRS_REG_BC_PRIME 9
+#define XTRS_REG_DE_PRIME 10
+#define XTRS_REG_HL_PRIME 11
+#define XTRS_REG_I    12
+#define XTRS_REG_R    13
+#define XTRS_REG_IFF1 14
+#define XTRS_REG_IFF2 15
+#define XTRS_REG_IM   16
+
+/* Callbacks.  A video callback receives the offset of each changed
+ * byte of video memory and its new value.  A printer callback
+ * receives each byte sent to the printer port.  An emt callback is
+ * called with the second opcode byte of each emulator trap (0x28 to
+ * 0x3f) before xtrs handles it; it returns nonzero if it has handled
+ * the trap itself. */
+typedef void (*xtrs_video_func)(int position, int value);
+typedef void (*xtrs_printer_func)(int value);
+typedef int (*xtrs_emt_func)(int opcode);
+
+/* Create the emulated machine.  model is 1, 3, 4, or 5 (4P).  If
+ * romfile is NULL, the default or built-in ROM is used.  Returns 0. */
+int xtrs_create(int model, const char *romfile);
+void xtrs_reset(int poweron);
+
+/* Loading.  xtrs_load_rom loads a ROM image at the given address.
+ * xtrs_load_cmd loads a TRS-80 /CMD file (or an Intel hex file,
+ * detected by its leading ':') into memory and returns its transfer
+ * address, or -1 if it has none; it returns -2 if the file cannot be
+ * read or is not a valid /CMD file, or if memory runs out.  Disk attach returns 0
+ * if OK, -1 if the image could not be opened. */
+int xtrs_load_rom(int address, const char *filename);
+int xtrs_load_cmd(const char *filename);
+int xtrs_attach_disk(int drive, const char *filename);
+int xtrs_attach_hard(int drive, const char *filename);
+
+/* Run for at least the given number of T-states (the last instruction
+ * is completed), or until the emulator stops for another reason. */
+int xtrs_run_for(tstate_t tstates);
+tstate_t xtrs_tstates(void);
+
+/* Memory and registers.  Memory access goes through the current
+ * memory map, including memory-mapped devices. */
+int xtrs_read_mem(int address);
+void xtrs_write_mem(int address, int value);
+int xtrs_get_reg(int reg);
+void xtrs_set_reg(int reg, int value);
+
+/* Keyboard.  keysym is an X keysym value (ASCII for printing
+ * characters).  xtrs_type_text queues text to be typed in as for the
+ * -typein option, with newlines typed as ENTER. */
+void xtrs_key_event(int keysym, int down);
+void xtrs_type_char(int ascii);
+void xtrs_type_text(const char *text);
+
+/* Screen text.  xtrs_screen_text copies the visible text screen into
+ * buf as one line per row, decoded to ASCII as for -screenlog, and
+ * returns its length.  xtrs_screen_match makes xtrs_run_for() return
+ * XTRS_RUN_MATCH soon after the screen starts to match the given POSIX
+ * extended regular expression (each row is a line, so ^ and $ work),
+ * or stops matching if regex is NULL.  It returns -1 if the regex is
+ * not valid. */
+int xtrs_screen_text(char *buf, int size);
+int xtrs_screen_match(const char *regex);
+
+void xtrs_set_video_callback(xtrs_video_func f);
+void xtrs_set_printer_callback(xtrs_printer_func f);
+void xtrs_set_emt_callback(xtrs_emt_func f);
+
+#endif /*_LIBXTRS_H*/
@@ -37,198 +37,12 @@
  * SOFTWARE.
  */
 
-#include <string.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <string.h>
 
 #include "z80.h"
 #include "trs.h"
-#include "trs_disk.h"
-#include "trs_hard.h"
-#include "load_cmd.h"
-
-int trs_model = 1;
-int trs_paused = 1;
-int trs_autodelay = 0;
-char *program_name;
-char *romfile1 = NULL;
-char *romfile1x = NULL;
-char *romfile3 = NULL;
-char *romfile4p = NULL;
-
-static void check_endian(void)
-{
-    wordregister x;
-    x.byte.low = 1;
-    x.byte.high = 0;
-    if(x.word != 1)
-    {
-	fatal("Program compiled with wrong ENDIAN value -- adjust the Makefile.local, type \"rm *.o\", recompile, and try again.");
-    }
-}
-
-/*
- * Although the ROM loading code supports multiple ROMs, xtrs has an
- * overall assumeion that addresses from 0 up to the end of the
- * highest-addressed ROM (if any) are all ROM space.  So we set
- * trs_rom_size to the end of the highest-addressed ROM that has been
- * seen.  We do now check for loading too large a Model 4P boot ROM,
- * which can happen if someone tries to use a Model III/4 ROM in 4P mode.
- *
- * Moreover, we assume we know where the ROMs start -- address 0 for
- * all except the Model I ESF extension ROM, which starts at 0x3000.
- * We don't check if this assumption is violated, even in cases where
- * it's possible to check because the ROM format carries a starting
- * address, such as with Intel hex format or load module format.
- */
-
-/*
- * Load a ROM from an external file.
- */
-void trs_load_rom(int address, char *filename)
-{
-    FILE *program;
-    int c;
-    int rom_end = 0;
-
-    if((program = fopen(filename, "r")) == NULL)
-    {
-	char message[100];
-	sprintf(message, "could not read %s", filename);
-	fatal(message);
-    }
-    c = getc(program);
-
-    if (c == ':') {
-        /* Assume Intel hex format */
-        rewind(program);
-        rom_end = load_hex(program);
-	goto done;
-    }
-
-    if (c == 1 || c == 5) {
-        /* Assume MODELA/III file (load module) */
-	int res;
-	extern Uchar *rom; /*!! fixme*/
-	Uchar loadmap[Z80_ADDRESS_LIMIT];
-	rewind(program);
-	res = load_cmd(program, rom, loadmap, 0, NULL, -1, NULL, NULL, 1);
-	if (res == LOAD_CMD_OK) {
-	    rom_end = Z80_ADDRESS_LIMIT;
-	    while (rom_end > 0) {
-		if (loadmap[--rom_end] != 0) {
-		    rom_end++;
-		    break;
-		}
-	    }
-	    goto done;
-	} else {
-	    /* Apparently it wasn't one; prepare to fall through to
-             * raw binary case. */
-	    rewind(program);
-	    c = getc(program);
-	}
-    }
-
-    /* Assume raw binary */
-    rom_end = address;
-    while (c != EOF) {
-        mem_write_rom(rom_end++, c);
-	c = getc(program);
-    }
-
- done:
-    fclose(program);
-    if (rom_end > trs_rom_size) {
-       trs_rom_size = rom_end;
-    }
-}
-
-/*
- * Load a compiled-in ROM.
- */
-void trs_load_compiled_rom(int address, int size, unsigned char rom[])
-{
-    int i;
-
-    for (i = 0; i < size; i++) {
-	mem_write_rom(address + i, rom[i]);
-    }
-
-    if (address + size > trs_rom_size) {
-       trs_rom_size = address + size;
-    }
-}
-
-void
-trs_load_romfiles(void)
-{
-  struct stat statbuf;
-
-  switch (trs_model) {
-  case 1:
-#ifdef DEFAULT_ROM1
-    if (!romfile1) {
-      romfile1 = DEFAULT_ROM1;
-    }
-#endif
-    if (romfile1 != NULL && stat(romfile1, &statbuf) == 0) {
-      trs_load_rom(0, romfile1);
-    } else if (trs_rom1_size > 0) {
-      trs_load_compiled_rom(0, trs_rom1_size, trs_rom1);
-    } else {
-      fatal("ROM file not specified!");
-    }
-
-#ifdef DEFAULT_ROM1X
-    if (!romfile1x) {
-      romfile1x = DEFAULT_ROM1X;
-    }
-#endif
-    if (romfile1x != NULL && stat(romfile1x, &statbuf) == 0) {
-      trs_load_rom(0x3000, romfile1x);
-    } else if (trs_rom1x_size > 0) {
-      trs_load_compiled_rom(0x3000, trs_rom1x_size, trs_rom1x);
-    }
-    break;
-
-  case 3:
-  case 4:
-#ifdef DEFAULT_ROM3
-    if (!romfile3) {
-      romfile3 = DEFAULT_ROM3;
-    }
-#endif
-    if (romfile3 != NULL && stat(romfile3, &statbuf) == 0) {
-      trs_load_rom(0, romfile3);
-    } else if (trs_rom3_size > 0) {
-      trs_load_compiled_rom(0, trs_rom3_size, trs_rom3);
-    } else {
-      fatal("ROM file not specified!");
-    }
-    break;
-
-  default: /* 4P */
-#ifdef DEFAULT_ROM4P
-    if (!romfile4p) {
-      romfile4p = DEFAULT_ROM4P;
-    }
-#endif
-    if (romfile4p != NULL && stat(romfile4p, &statbuf) == 0) {
-      trs_load_rom(0, romfile4p);
-    } else if (trs_rom4p_size > 0) {
-      trs_load_compiled_rom(0, trs_rom4p_size, trs_rom4p);
-    } else {
-      fatal("ROM file not specified!");
-    }
-    if (trs_rom_size > 0x1000) {
-       fatal("Wrong type of ROM; a Model 4P boot ROM is at most 4KB");
-    }
-    break;
-  }
-}
+#include "z80_trace.h"
 
 int main(int argc, char *argv[])
 {
@@ -243,24 +57,18 @@ int main(int argc, char *argv[])
       program_name++;
     }
 
-    check_endian();
-
     argc = trs_parse_command_line(argc, argv, &debug);
     if (argc > 1) {
       fatal("erroneous argument %s", argv[1]);
     }
-    mem_init();
-    trs_screen_init();
-    trs_timer_init();
-    trs_disk_init();
-    trs_hard_init();
-    stringy_init();
-
-    trs_load_romfiles();
-    trs_reset(1);
+    trs_init();
     if (!debug) {
-      /* Run continuously until exit or request to enter debugger */
-      z80_run(TRUE);
+      /* Run continuously until exit or request to enter debugger.
+	 If gdb is attached, it handles the stops instead. */
+      do {
+	z80_run(TRUE);
+      } while (z80_gdb_stop());
+      z80_trace_dump();
     }
     printf("Entering debugger.\n");
     debug_init();
@@ -268,4 +76,3 @@ int main(int argc, char *argv[])
     printf("Quitting.\n");
     exit(0);
 }
-
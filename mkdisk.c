@@ -51,10 +51,12 @@ void Usage(char *progname)
 	  "Usage:\t%s -1 [-f] file\n"
 	  "\t%s [-3] [-f] file\n"
 	  "\t%s -k [-s sides] [-d density] [-8] [-i] [-f] file\n"
-	  "\t%s -h [-c cyl] [-s sec] [-g gran] [-d dcyl] [-f] file\n"
+	  "\t%s -h [-c cyl] [-s sec] [-g gran] [-d dcyl] [-z] [-f] file\n"
+	  "\t%s -h -x oldfile [-z] [-f] file\n"
 	  "\t%s -w [-s size] [-f] file\n"
 	  "\t%s {-p|-u} {-1|-3|-k|-h|-w} file\n",
-	  progname, progname, progname, progname, progname, progname);
+	  progname, progname, progname, progname, progname, progname,
+	  progname);
   exit(2);
 }
 
@@ -85,10 +87,10 @@ main(int argc, char *argv[])
 {
   int jv1 = 0, jv3 = 0, dmk = 0, hard = 0, wafer = 0;
   int cyl = -1, sec = -1, gran = -1, dir = -1, eight = 0, ignden = 0;
-  int writeprot = 0, unprot = 0, overwrite = 0;
+  int writeprot = 0, unprot = 0, overwrite = 0, sparse = 0;
   int c, oumask, res;
-  char *fname;
-  FILE *f;
+  char *fname, *oldname = NULL;
+  FILE *f, *oldf = NULL;
 
   /* program_name must be set first because the error
    * printing routines use it. */
@@ -101,7 +103,7 @@ main(int argc, char *argv[])
 
   opterr = 0;
   for (;;) {
-    c = getopt(argc, argv, "13khwc:s:g:d:8ipuf");
+    c = getopt(argc, argv, "13khwc:s:g:d:8ipufzx:");
     if (c == -1) break;
     switch (c) {
     case '1':
@@ -146,6 +148,12 @@ main(int argc, char *argv[])
     case 'f':
       overwrite = 1;
       break;
+    case 'z':
+      sparse = 1;
+      break;
+    case 'x':
+      oldname = optarg;
+      break;
     case '?':
     default:
       Usage(argv[0]);
@@ -262,6 +270,29 @@ main(int argc, char *argv[])
     exit(2);
   }
 
+  if (!hard && (sparse || oldname)) {
+    error("-z and -x are only meaningful with -h");
+    exit(2);
+  }
+
+  if (oldname) {
+    struct stat st, oldst;
+    if (cyl >= 0 || sec >= 0 || gran >= 0 || dir >= 0) {
+      error("-c, -s, -g, -d are not meaningful with -x");
+      exit(2);
+    }
+    oldf = fopen(oldname, "r");
+    if (oldf == NULL || fstat(fileno(oldf), &oldst) < 0) {
+      perror(oldname);
+      exit(1);
+    }
+    if (stat(fname, &st) == 0 &&
+	st.st_dev == oldst.st_dev && st.st_ino == oldst.st_ino) {
+      error("-x file must differ from the file being made");
+      exit(2);
+    }
+  }
+
   f = fopen_w(fname, overwrite);
   if (f == NULL) {
     perror(fname);
@@ -274,8 +305,12 @@ main(int argc, char *argv[])
 #define density dir
     res = trs_disk_init_with(f, jv1 ? JV1 : jv3 ? JV3 : DMK,
 			     sides, density, eight, ignden);
+  } else if (oldname) {
+    res = trs_hard_convert(oldf, f, sparse);
+    fclose(oldf);
+
   } else if (hard) {
-    res = trs_hard_init_with(f, cyl, sec, gran, dir);
+    res = trs_hard_init_with(f, cyl, sec, gran, dir, sparse);
 
   } else /* wafer */ {
     /* Reuse flag letter s */
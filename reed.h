@@ -14,7 +14,7 @@ typedef struct {
                          of header (excepting byte 3), then XOR
                          result with 4CH */
   Uchar blks;      /* 4: Number of 256 byte blocks in header:
-                         should be 1 */
+                         should be 1 (more in a sparse image) */
   Uchar mb4;       /* 5: Not used, but HDFORMAT sets to 4 */
   Uchar media;     /* 6: Media type: 0 for hard disk */
   Uchar flag1;     /* 7: Flags #1:
@@ -22,7 +22,9 @@ typedef struct {
                                 yes [xtrshard/dct ignores for now]
 		         bit 6: Must be 0
 		         bit 5 - 0: reserved */
-  Uchar flag2;     /* 8: Flags #2: reserved */
+  Uchar flag2;     /* 8: Flags #2:
+                         bit 0: Sparse image (xtrs only; see below)
+                         bit 7 - 1: reserved */
   Uchar flag3;     /* 9: Flags #3: reserved */
   Uchar crtr;      /* 10: Created by:
 		          14H = HDFORMAT
@@ -53,3 +55,15 @@ typedef struct {
   char label[32];  /* 32: Volume label: 31 bytes terminated by 0 */
   Uchar res2[192]; /* 64 - 255: reserved */
 } ReedHardHeader;
+
+/* xtrs sparse variant.  If flag2 has REED_SPARSE set, the first header
+   block is followed by a block allocation table with one 2-byte
+   little-endian entry per track (cylinder * heads + head), padded to a
+   whole number of 256-byte blocks; blks counts the table too.  An
+   entry of 0 means the track has never been written and reads as
+   zeros.  Entry n > 0 means the track's REED_SPARSE_TRACK bytes of
+   sectors are stored at offset blks*256 + (n-1)*REED_SPARSE_TRACK.
+   Tracks are numbered in the order they were first written. */
+#define REED_SPARSE 0x01
+#define REED_SPARSE_SECS 32  /* sectors per track */
+#define REED_SPARSE_TRACK (REED_SPARSE_SECS * 256)
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Decode a binary instruction trace written by xtrs -trace.
+ *
+ * Usage: tracedump [-n count] [-d] tracefile
+ * Prints one line per instruction, oldest first: the T-state count,
+ * the registers before the instruction, and its disassembly.
+ *
+ * Flags: -n count  print only the last count instructions
+ *        -d        print the T-states since the previous instruction
+ *                    instead of the T-state count
+ */
+
+#define _XOPEN_SOURCE /* unistd.h: getopt(), optarg, optind, opterr */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include "z80.h"
+#include "z80_trace.h"
+
+#define ARGS "n:d"
+
+/* The record being disassembled; dis.c reads its code through here */
+static unsigned char record[TRACE_RECORD];
+
+int mem_read(int address)
+{
+  int offset = (address - (record[TRACE_PC] | record[TRACE_PC + 1] << 8))
+    & 0xffff;
+  return offset < 4 ? record[TRACE_OP + offset] : 0;
+}
+
+static int get16(const unsigned char *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static unsigned long long get64(const unsigned char *p)
+{
+  unsigned long long v = 0;
+  int i;
+
+  for (i = 7; i >= 0; i--) v = v << 8 | p[i];
+  return v;
+}
+
+int
+main(int argc, char* argv[])
+{
+  FILE* f;
+  unsigned char header[TRACE_HEADER];
+  unsigned long count, skip = 0, last = 0, i;
+  unsigned long long t, prev_t = 0;
+  int size, delta = 0;
+  int c, errflg = 0;
+
+  optarg = NULL;
+  while (!errflg && (c = getopt(argc, argv, ARGS)) != -1) {
+    switch (c) {
+    case 'n':
+      last = strtoul(optarg, NULL, 0);
+      break;
+    case 'd':
+      delta = 1;
+      break;
+    default:
+      errflg++;
+      break;
+    }
+  }
+
+  if (errflg || argc != optind + 1) {
+    fprintf(stderr, "Usage: %s [-n count] [-d] tracefile\n", argv[0]);
+    exit(1);
+  }
+
+  f = fopen(argv[optind], "rb");
+  if (f == NULL) {
+    perror(argv[optind]);
+    exit(1);
+  }
+  if (fread(header, TRACE_HEADER, 1, f) != 1 ||
+      memcmp(header, TRACE_MAGIC, 8) != 0) {
+    fprintf(stderr, "%s: not an xtrs trace file\n", argv[optind]);
+    exit(1);
+  }
+  count = get16(header + 8) | (unsigned long) get16(header + 10) << 16;
+  size = get16(header + 12);
+  if (size < TRACE_RECORD) {
+    fprintf(stderr, "%s: bad record size %d\n", argv[optind], size);
+    exit(1);
+  }
+
+  if (last && last < count) {
+    skip = count - last;
+    if (fseek(f, (long) skip * size, SEEK_CUR) != 0) {
+      perror(argv[optind]);
+      exit(1);
+    }
+  }
+  if (header[14] == 5) {
+    printf("Model 4P, %lu instructions\n", count);
+  } else {
+    printf("Model %d, %lu instructions\n", header[14], count);
+  }
+  printf("%12s  AF   BC   DE   HL   SP    PC\n", delta ? "T-delta" : "T-count");
+
+  for (i = skip; i < count; i++) {
+    if (fread(record, TRACE_RECORD, 1, f) != 1 ||
+	(size > TRACE_RECORD && fseek(f, size - TRACE_RECORD, SEEK_CUR) != 0)) {
+      fprintf(stderr, "%s: premature end of file\n", argv[optind]);
+      exit(1);
+    }
+    t = get64(record + TRACE_T);
+    printf("%12llu  %04x %04x %04x %04x %04x  ",
+	   delta ? (i == skip ? 0 : t - prev_t) : t,
+	   get16(record + TRACE_AF), get16(record + TRACE_BC),
+	   get16(record + TRACE_DE), get16(record + TRACE_HL),
+	   get16(record + TRACE_SP));
+    disassemble_to(stdout, get16(record + TRACE_PC), mem_read);
+    prev_t = t;
+  }
+  fclose(f);
+  return 0;
+}
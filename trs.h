@@ -79,10 +79,21 @@ void trs_screen_80x24(int flag);
 void trs_screen_inverse(int flag);
 void trs_screen_scroll(void);
 void trs_screen_refresh(void);
+/* *rows_out gets the characters per row, *cols_out the rows */
+const unsigned char *trs_screen_contents(int *rows_out, int *cols_out,
+					 int *mode);
 extern int trs_lowercase;
 
+void trs_init(void);
+void trs_load_rom(int address, char *filename);
+void trs_load_compiled_rom(int address, int size, unsigned char rom[]);
+void trs_load_romfiles(void);
 void trs_reset(int poweron);
 void trs_exit(void);
+void trs_exit_request(void);
+extern int trs_exit_status;
+extern char *trs_run_name;
+extern int trs_run_exit;
 
 void trs_kb_reset(void);
 void trs_kb_bracket(int shifted);
@@ -94,14 +105,21 @@ void queue_key(int key);
 int dequeue_key(void);
 void clear_key_queue(void);
 void trs_skip_next_kbwait(void);
+void trs_kb_typein(const char *text, int len);
+void trs_kb_typein_init(void);
+int trs_kb_typein_fd(void);
+extern char *trs_kb_typein_name;
 extern int stretch_amount;
 extern int trs_keydelay;
 
 void trs_get_event(int wait);
-extern volatile int x_poll_count;
+extern int x_poll_count;
 
 void trs_printer_write(int value);
 int trs_printer_read(void);
+extern void (*trs_printer_hook)(int value);
+extern int (*trs_emt_hook)(int opcode);
+extern void (*trs_screen_hook)(int position, int char_index);
 
 void trs_cassette_motor(int value);
 void trs_cassette_out(int value);
@@ -137,12 +155,17 @@ void trs_timer_init(void);
 void trs_timer_off(void);
 void trs_timer_on(void);
 void trs_timer_speed(int flag);
+tstate_t trs_timer_tick(void);
+tstate_t trs_timer_poll(void);
+void trs_timer_wait(int fd);
 void trs_cassette_rise_interrupt(int dummy);
 void trs_cassette_fall_interrupt(int dummy);
 void trs_cassette_clear_interrupts(void);
 int trs_cassette_interrupts_enabled(void);
 void trs_cassette_update(int dummy);
 extern int cassette_default_sample_rate;
+extern int trs_cassette_fast;
+int trs_cassette_hook(void);
 void trs_orch90_out(int chan, int value);
 void trs_cassette_reset(void);
 
@@ -158,6 +181,7 @@ int trs_disk_motoroff(void);
 
 void trs_change_all(void);
 
+extern unsigned char *memory; /* emulated RAM, allocated by mem_init() */
 void mem_video_page(int which);
 void mem_bank(int which);
 void mem_map(int which);
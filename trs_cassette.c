@@ -216,6 +216,14 @@ struct {
 
 #define DETECT_250    1200.0 /* detect level 1 input routine */
 
+/* For -fastcassette: ROM cassette routines, at the same addresses in
+   the Model I Level II and Model III ROMs */
+int trs_cassette_fast = 0;
+#define ROM_CSIN      0x0235 /* read a byte into A */
+#define ROM_CSOUT     0x0264 /* write the byte in A */
+#define ROM_CSHIN     0x0296 /* find leader and sync byte */
+#define LEADER_KEEP   16     /* leader bytes left for ROM to sync on */
+
 /* Values for conversion to .wav on output */
 /* Values in comments are from Model I technical manual.  Model III/4 are
    close though not quite the same, as one resistor in the network was
@@ -507,13 +515,8 @@ static int assert_state(int state)
 
   if (cassette_state != CLOSE && cassette_state != FAILED) {
     if (cassette_format == DIRECT_FORMAT) {
-      sigset_t set, oldset;
-      sigemptyset(&set);
-      sigaddset(&set, SIGALRM);
-      sigprocmask(SIG_BLOCK, &set, &oldset);
       trs_paused = 1;  /* disable speed measurement for this round */
       fclose(cassette_file);
-      sigprocmask(SIG_SETMASK, &oldset, NULL);
       cassette_position = 0;
     } else {
       cassette_position = ftell(cassette_file);
@@ -661,15 +664,10 @@ transition_out(int value)
   long nsamples, delta_us;
   Ushort code;
   float ddelta_us;
-  sigset_t set, oldset;
 
   cassette_transitionsout++;
   if (value != FLUSH && value == cassette_value) return;
 
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
-
   ddelta_us = (z80_state.t_count - cassette_transition) / z80_state.clockMHz
     - cassette_roundoff_error;
 
@@ -851,7 +849,6 @@ transition_out(int value)
     break;
   }
 
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   if (cassette_value != value) last_sound = z80_state.t_count;
   cassette_transition = z80_state.t_count;
   cassette_value = value;
@@ -869,11 +866,6 @@ transition_in(void)
   int next, ret = 0;
   int c, cabs;
   float delta_ts;
-  sigset_t set, oldset;
-
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
 
   switch (cassette_format) {
   case DEBUG_FORMAT:
@@ -1020,7 +1012,6 @@ transition_in(void)
   if (ret == 0) {
     cassette_delta = (unsigned long) -1;
   }
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   return ret;
 }
 
@@ -1154,7 +1145,6 @@ trs_orch90_out(int channels, int value)
 #if HAVE_OSS
   long nsamples;
   float ddelta_us;
-  sigset_t set, oldset;
   int new_left, new_right;
   int v;
 
@@ -1177,10 +1167,6 @@ trs_orch90_out(int channels, int value)
   if (value != FLUSH &&
       new_left == orch90_left && new_right == orch90_right) return;
 
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
-
   ddelta_us = (z80_state.t_count - cassette_transition) / z80_state.clockMHz
     - cassette_roundoff_error;
   if (ddelta_us > 300000.0) {
@@ -1209,7 +1195,6 @@ trs_orch90_out(int channels, int value)
 		       (int)(250000 * z80_state.clockMHz));
   }
 
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   last_sound = z80_state.t_count;
   cassette_transition = z80_state.t_count;
   orch90_left = new_left;
@@ -1305,4 +1290,103 @@ void
 trs_cassette_reset(void)
 {
   assert_state(CLOSE);
+  z80_hook_pages[ROM_CSIN >> 8] = trs_cassette_fast && trs_model != 5;
+}
+
+/* Skip most of the leader in a .cas file, so that the ROM's search
+   for the sync byte finds it quickly. */
+static void
+fast_leader(void)
+{
+  long pos;
+  int c, n = 0;
+
+  if (assert_state(READ) < 0 || cassette_format != CAS_FORMAT ||
+      cassette_bitnumber != 0 || cassette_pulsestate != 0) return;
+  pos = ftell(cassette_file);
+  while ((c = getc(cassette_file)) == 0x00 || c == 0x55) n++;
+  if ((c == 0xa5 || c == 0x7f) && n > LEADER_KEEP) {
+    fseek(cassette_file, -1 - LEADER_KEEP, SEEK_CUR);
+  } else {
+    fseek(cassette_file, pos, SEEK_SET);
+  }
+}
+
+/* Read the next byte of a .cas file directly.  This works only between
+   bytes, since the file need not be byte-aligned with what the ROM
+   has already read; return -1 to read it bit by bit instead. */
+static int
+fast_read(void)
+{
+  int c;
+
+  if (assert_state(READ) < 0 || cassette_format != CAS_FORMAT ||
+      cassette_bitnumber != 0) return -1;
+  c = getc(cassette_file);
+  if (c == EOF) return -1;
+
+  /* Drop the rest of the last bit's pulses; the next transition
+     comes from the start of the following byte. */
+  if (trs_event_scheduled() == trs_cassette_update ||
+      trs_event_scheduled() == trs_cassette_rise_interrupt ||
+      trs_event_scheduled() == trs_cassette_fall_interrupt) {
+    trs_cancel_event();
+  }
+  cassette_byte = c;
+  cassette_pulsestate = 0;
+  cassette_next = cassette_value;
+  cassette_transition = z80_state.t_count;
+  cassette_delta = 0;
+  return c;
+}
+
+/* Write a byte to a .cas file directly, if no bits of a byte written
+   bit by bit are pending. */
+static int
+fast_write(int value)
+{
+  if (cassette_state == READ || assert_state(WRITE) < 0 ||
+      cassette_format != CAS_FORMAT || cassette_bitnumber != 0) return 0;
+  putc(value, cassette_file);
+  return 1;
+}
+
+/*
+ * With -fastcassette, perform the ROM's cassette byte read and write
+ * routines directly on a .cas file, and skip most of the leader when
+ * the ROM looks for it.  Called before each instruction in a page
+ * marked in z80_hook_pages.  Returns 1 if it performed the routine,
+ * including its return, or 0 to let the Z80 run it.
+ */
+int
+trs_cassette_hook(void)
+{
+  int c;
+
+  /* Level I's 4K ROM has no such routines */
+  if (!cassette_motor || REG_PC >= trs_rom_size || trs_rom_size <= 0x1000) {
+    return 0;
+  }
+  if (trs_model == 4 && mem_bank_number(REG_PC) != MEM_BANK_ROM) return 0;
+
+  switch (REG_PC) {
+  case ROM_CSHIN:
+    fast_leader();
+    return 0;
+  case ROM_CSIN:
+    c = fast_read();
+    if (c < 0) return 0;
+    REG_A = c;
+    break;
+  case ROM_CSOUT:
+    if (!fast_write(REG_A)) return 0;
+    break;
+  default:
+    return 0;
+  }
+
+  REG_PC = mem_read_word(REG_SP);	/* ret */
+  REG_SP += 2;
+  T_COUNT(10);
+  return 1;
 }
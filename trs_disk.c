@@ -48,6 +48,7 @@
 #include "trs.h"
 #include "trs_disk.h"
 #include "trs_hard.h"
+#include "trs_stats.h"
 #include <stdio.h>
 #include <sys/time.h>
 #include <time.h>
@@ -273,7 +274,7 @@ typedef struct {
 #define DMK_IDAMP_BITS    0x3fff
 
 #define dmk_incr(d) \
-  (((d)->u.dmk.ignden || (d)->u.dmk.sden || state.density) ? 1 : 2)
+  (((d)->u.dmk->ignden || (d)->u.dmk->sden || state.density) ? 1 : 2)
 
 typedef struct {
   int ntracks;                    /* max number of tracks formatted */
@@ -284,6 +285,7 @@ typedef struct {
   int curtrack, curside;          /* track/side in track buffer, or -1/-1 */
   int curbyte;                    /* index in buf for current op */
   int nextidam;                   /* index in buf to put next idam */
+  int crcstart;                   /* index in buf where CRC'd bytes start */
   unsigned char buf[DMK_TRACKLEN_MAX];
 } DMKState;
 
@@ -295,10 +297,12 @@ typedef struct {
   int real_step;                  /* 1=normal, 2=double-step if REAL */
   char *name;
   FILE* file;
+  int statetype;                  /* emutype that u was allocated for */
   union {
-    JV3State jv3;                 /* valid if emutype = JV3 */
-    RealState real;               /* valid if emutype = REAL */
-    DMKState dmk;                 /* valid if emutype = DMK */
+    void *any;
+    JV3State *jv3;                /* valid if emutype = JV3 */
+    RealState *real;              /* valid if emutype = REAL */
+    DMKState *dmk;                /* valid if emutype = DMK */
   } u;
 } DiskState;
 
@@ -354,23 +358,23 @@ trs_disk_debug(void)
       case JV3:
 	printf("JV3\n");
 	printf("  last used id %d, id blocks %d\n",
-	       d->u.jv3.last_used_id, d->u.jv3.nblocks);
+	       d->u.jv3->last_used_id, d->u.jv3->nblocks);
 	break;
       case DMK:
 	printf("DMK\n");
 	printf("  ntracks %d (0x%02x), tracklen 0x%04x, nsides %d, sden %d, "
-	       "ignden %d\n", d->u.dmk.ntracks, d->u.dmk.ntracks,
-	       d->u.dmk.tracklen, d->u.dmk.nsides, d->u.dmk.sden,
-	       d->u.dmk.ignden);
+	       "ignden %d\n", d->u.dmk->ntracks, d->u.dmk->ntracks,
+	       d->u.dmk->tracklen, d->u.dmk->nsides, d->u.dmk->sden,
+	       d->u.dmk->ignden);
 	printf("  buffered track %d, side %d, curbyte %d, nextidam %d\n",
-	       d->u.dmk.curtrack, d->u.dmk.curside, d->u.dmk.curbyte,
-	       d->u.dmk.nextidam);
+	       d->u.dmk->curtrack, d->u.dmk->curside, d->u.dmk->curbyte,
+	       d->u.dmk->nextidam);
 	break;
       case REAL:
 	printf("REAL\n");
 	printf("  rpm %d, empty %d, last size code %d, last fmt fill 0x%02x\n",
-	       d->u.real.rps * 60, d->u.real.empty, d->u.real.size_code,
-	       d->u.real.fmt_fill);
+	       d->u.real->rps * 60, d->u.real->empty, d->u.real->size_code,
+	       d->u.real->fmt_fill);
 	break;
       default:
 	printf("UNKNOWN\n");
@@ -524,9 +528,9 @@ jv3_id_compare(const void* p1, const void* p2)
   DiskState *d = &disk[state.curdrive];
   int i1 = *(short*)p1;
   int i2 = *(short*)p2;
-  int r = d->u.jv3.id[i1].track - d->u.jv3.id[i2].track;
+  int r = d->u.jv3->id[i1].track - d->u.jv3->id[i2].track;
   if (r != 0) return r;
-  r = (d->u.jv3.id[i1].flags & JV3_SIDE) - (d->u.jv3.id[i2].flags & JV3_SIDE);
+  r = (d->u.jv3->id[i1].flags & JV3_SIDE) - (d->u.jv3->id[i2].flags & JV3_SIDE);
   if (r != 0) return r;
   return i1 - i2;
 }
@@ -540,38 +544,38 @@ jv3_sort_ids(int drive)
   int i, track, side;
 
   for (i=0; i<=JV3_SECSMAX; i++) {
-    d->u.jv3.sorted_id[i] = i;
+    d->u.jv3->sorted_id[i] = i;
   }
   state.curdrive = drive;
-  qsort((void*) d->u.jv3.sorted_id, JV3_SECSMAX, sizeof(short),
+  qsort((void*) d->u.jv3->sorted_id, JV3_SECSMAX, sizeof(short),
 	jv3_id_compare);
   state.curdrive = olddrive;
 
   for (track=0; track<MAXTRACKS; track++) {
-    d->u.jv3.track_start[track][0] = -1;
-    d->u.jv3.track_start[track][1] = -1;
+    d->u.jv3->track_start[track][0] = -1;
+    d->u.jv3->track_start[track][1] = -1;
   }    
   track = side = -1;
   for (i=0; i<JV3_SECSMAX; i++) {
-    SectorId *sid = &d->u.jv3.id[d->u.jv3.sorted_id[i]];
+    SectorId *sid = &d->u.jv3->id[d->u.jv3->sorted_id[i]];
     if (sid->track != track ||
 	(sid->flags & JV3_SIDE ? 1 : 0) != side) {
       track = sid->track;
       if (track == JV3_FREE) break;
       side = sid->flags & JV3_SIDE ? 1 : 0;
-      d->u.jv3.track_start[track][side] = i;
+      d->u.jv3->track_start[track][side] = i;
     }
   }
 
-  d->u.jv3.sorted_valid = 1;  
+  d->u.jv3->sorted_valid = 1;  
 }
 
 /* JV3 only */
 int
 id_index_to_size_code(DiskState *d, int id_index)
 {
-  return (d->u.jv3.id[id_index].flags & JV3_SIZE) ^
-    ((d->u.jv3.id[id_index].track == JV3_FREE) ? 2 : 1);
+  return (d->u.jv3->id[id_index].flags & JV3_SIZE) ^
+    ((d->u.jv3->id[id_index].track == JV3_FREE) ? 2 : 1);
 }
 
 /* IBM formats only */
@@ -596,7 +600,7 @@ offset(DiskState *d, int id_index)
   if (d->emutype == JV1) {
     return id_index * JV1_SECSIZE;
   } else if (d->emutype == JV3) {
-    return d->u.jv3.offset[id_index];
+    return d->u.jv3->offset[id_index];
   } else {
     trs_disk_unimpl(state.currcommand, "DMK offset (internal error)");
     return 0;
@@ -615,18 +619,18 @@ idoffset(DiskState *d, int id_index)
     if (id_index < JV3_SECSPERBLK) {
       return JV3_IDSTART + id_index * sizeof(SectorId);
     } else {
-      int idstart2 = d->u.jv3.offset[JV3_SECSPERBLK-1] +
+      int idstart2 = d->u.jv3->offset[JV3_SECSPERBLK-1] +
 	id_index_to_size(d, JV3_SECSPERBLK-1);
 
-      if (d->u.jv3.nblocks == 1) {
+      if (d->u.jv3->nblocks == 1) {
         /* Initialize new block of ids */
 	int c;
 	fseek(d->file, idstart2, 0);
-        c = fwrite((void*)&d->u.jv3.id[JV3_SECSPERBLK], JV3_SECSTART, 1, d->file);
+        c = fwrite((void*)&d->u.jv3->id[JV3_SECSPERBLK], JV3_SECSTART, 1, d->file);
 	if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	c = fflush(d->file);
 	if (c == EOF) state.status |= TRSDISK_WRITEFLT;
-	d->u.jv3.nblocks = 2;
+	d->u.jv3->nblocks = 2;
       }	
       return idstart2 + (id_index - JV3_SECSPERBLK) * sizeof(SectorId);
     }
@@ -636,57 +640,57 @@ idoffset(DiskState *d, int id_index)
 int
 jv3_alloc_sector(DiskState *d, int size_code)
 {
-  int maybe = d->u.jv3.free_id[size_code];
-  d->u.jv3.sorted_valid = 0;
-  while (maybe <= d->u.jv3.last_used_id) {
-    if (d->u.jv3.id[maybe].track == JV3_FREE &&
+  int maybe = d->u.jv3->free_id[size_code];
+  d->u.jv3->sorted_valid = 0;
+  while (maybe <= d->u.jv3->last_used_id) {
+    if (d->u.jv3->id[maybe].track == JV3_FREE &&
 	id_index_to_size_code(d, maybe) == size_code) {
-      d->u.jv3.free_id[size_code] = maybe + 1;
+      d->u.jv3->free_id[size_code] = maybe + 1;
       return maybe;
     }
     maybe++;
   }
-  d->u.jv3.free_id[size_code] = JV3_SECSMAX; /* none are free */
-  if (d->u.jv3.last_used_id >= JV3_SECSMAX-1) {
+  d->u.jv3->free_id[size_code] = JV3_SECSMAX; /* none are free */
+  if (d->u.jv3->last_used_id >= JV3_SECSMAX-1) {
     return -1;
   }
-  d->u.jv3.last_used_id++;
-  d->u.jv3.offset[d->u.jv3.last_used_id + 1] =
-    d->u.jv3.offset[d->u.jv3.last_used_id] + size_code_to_size(size_code);
-  if (d->u.jv3.last_used_id + 1 == JV3_SECSPERBLK) {
-      d->u.jv3.offset[d->u.jv3.last_used_id + 1] += JV3_SECSTART;
+  d->u.jv3->last_used_id++;
+  d->u.jv3->offset[d->u.jv3->last_used_id + 1] =
+    d->u.jv3->offset[d->u.jv3->last_used_id] + size_code_to_size(size_code);
+  if (d->u.jv3->last_used_id + 1 == JV3_SECSPERBLK) {
+      d->u.jv3->offset[d->u.jv3->last_used_id + 1] += JV3_SECSTART;
   }
-  return d->u.jv3.last_used_id;
+  return d->u.jv3->last_used_id;
 }
 
 void
 jv3_free_sector(DiskState *d, int id_index)
 {
   int c;
-  int size_code = (d->u.jv3.id[id_index].flags & JV3_SIZE) ^ 1;
-  if (d->u.jv3.free_id[size_code] > id_index) {
-    d->u.jv3.free_id[size_code] = id_index;
-  }
-  d->u.jv3.sorted_valid = 0;
-  d->u.jv3.id[id_index].track = JV3_FREE;
-  d->u.jv3.id[id_index].sector = JV3_FREE;
-  d->u.jv3.id[id_index].flags =
-    (d->u.jv3.id[id_index].flags | JV3_FREEF) ^ JV3_SIZE;
+  int size_code = (d->u.jv3->id[id_index].flags & JV3_SIZE) ^ 1;
+  if (d->u.jv3->free_id[size_code] > id_index) {
+    d->u.jv3->free_id[size_code] = id_index;
+  }
+  d->u.jv3->sorted_valid = 0;
+  d->u.jv3->id[id_index].track = JV3_FREE;
+  d->u.jv3->id[id_index].sector = JV3_FREE;
+  d->u.jv3->id[id_index].flags =
+    (d->u.jv3->id[id_index].flags | JV3_FREEF) ^ JV3_SIZE;
   fseek(d->file, idoffset(d, id_index), 0);
-  c = fwrite(&d->u.jv3.id[id_index], sizeof(SectorId), 1, d->file);
+  c = fwrite(&d->u.jv3->id[id_index], sizeof(SectorId), 1, d->file);
   if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 
-  if (id_index == d->u.jv3.last_used_id) {
+  if (id_index == d->u.jv3->last_used_id) {
     int newlen;
-    while (d->u.jv3.id[d->u.jv3.last_used_id].track == JV3_FREE) {
-      d->u.jv3.last_used_id--;
+    while (d->u.jv3->id[d->u.jv3->last_used_id].track == JV3_FREE) {
+      d->u.jv3->last_used_id--;
     }
     c = fflush(d->file);
     if (c == EOF) state.status |= TRSDISK_WRITEFLT;
     rewind(d->file);
-    if (d->u.jv3.last_used_id >= 0) {
-      newlen = offset(d, d->u.jv3.last_used_id) +
-	id_index_to_size(d, d->u.jv3.last_used_id);
+    if (d->u.jv3->last_used_id >= 0) {
+      newlen = offset(d, d->u.jv3->last_used_id) +
+	id_index_to_size(d, d->u.jv3->last_used_id);
     } else {
       newlen = offset(d, 0);
     }
@@ -752,9 +756,65 @@ trs_disk_emutype(DiskState *d)
   d->emutype = JV1;
 }
 
+/* Bytes of per-format state needed for an emulation type */
+static size_t
+disk_state_size(int emutype)
+{
+  switch (emutype) {
+  case JV3:
+    return sizeof(JV3State);
+  case DMK:
+    return sizeof(DMKState);
+  case REAL:
+    return sizeof(RealState);
+  }
+  return 0;
+}
+
+/*
+ * Allocate the per-format state in d->u for the given emulation type,
+ * freeing any state held for another type.  The state is allocated
+ * when a disk is mounted and freed when it is removed, so empty drives
+ * and JV1 images carry none.
+ */
+static void
+disk_set_state(DiskState *d, int emutype)
+{
+  size_t size;
+
+  if (d->statetype == emutype) return;
+  free(d->u.any);
+  trs_stats.mem_bytes[STATS_MEM_DISK] -= disk_state_size(d->statetype);
+  d->u.any = NULL;
+  d->statetype = NONE;
+  size = disk_state_size(emutype);
+  if (size == 0) return;
+  d->u.any = calloc(1, size);
+  if (d->u.any == NULL) fatal("out of memory for disk state");
+  d->statetype = emutype;
+  trs_stats.mem_bytes[STATS_MEM_DISK] += size;
+}
+
+static int trs_disk_mount(int drive);
+
 /* Returns 0 if OK, -1 if invalid header, errno value otherwise. */
 static int
 trs_disk_change(int drive)
+{
+  DiskState *d = &disk[drive];
+  int res;
+
+  res = trs_disk_mount(drive);
+  if (d->file == NULL) {
+    /* Drive is empty; treat it as never mounted */
+    d->emutype = NONE;
+    disk_set_state(d, NONE);
+  }
+  return res;
+}
+
+static int
+trs_disk_mount(int drive)
 {
   DiskState *d = &disk[drive];  
   struct stat st;
@@ -791,9 +851,10 @@ trs_disk_change(int drive)
     d->writeprot = 0;
     ioctl(fileno(d->file), FDRESET, &reset_now);
     ioctl(fileno(d->file), FDGETDRVPRM, &fdp);
-    d->u.real.rps = fdp.rps;
-    d->u.real.size_code = 1; /* initial guess: 256 bytes */
-    d->u.real.empty_timeout = 0;
+    disk_set_state(d, REAL);
+    d->u.real->rps = fdp.rps;
+    d->u.real->size_code = 1; /* initial guess: 256 bytes */
+    d->u.real->empty_timeout = 0;
     if (d->emutype != REAL) {
       d->emutype = REAL;
       d->phytrack = 0;
@@ -801,6 +862,12 @@ trs_disk_change(int drive)
     }
   } else
 #endif
+  if (S_ISDIR(st.st_mode)) {
+    /* Host directory presented as a floppy; see trs_hostdir.c */
+    d->file = trs_hostdir_open(d->name, &d->writeprot);
+    if (d->file == NULL) return errno;
+    trs_disk_emutype(d);
+  } else
   {
     d->file = fopen(d->name, "r+");
     if (d->file == NULL) {
@@ -814,66 +881,67 @@ trs_disk_change(int drive)
     }
     trs_disk_emutype(d);
   }
+  disk_set_state(d, d->emutype);
   if (d->emutype == JV3) {
     int id_index, n;
     int ofst;
 
-    memset((void*)d->u.jv3.id, JV3_FREE, sizeof(d->u.jv3.id));
+    memset((void*)d->u.jv3->id, JV3_FREE, sizeof(d->u.jv3->id));
 
     /* Read first block of ids */
     fseek(d->file, JV3_IDSTART, 0);
-    n = fread((void*)&d->u.jv3.id[0], 3, JV3_SECSPERBLK, d->file);
+    n = fread((void*)&d->u.jv3->id[0], 3, JV3_SECSPERBLK, d->file);
 
     /* Scan to find their offsets */
     ofst = JV3_SECSTART;
     for (id_index=0; id_index<JV3_SECSPERBLK; id_index++) {
-      d->u.jv3.offset[id_index] = ofst;
+      d->u.jv3->offset[id_index] = ofst;
       ofst += id_index_to_size(d, id_index);
     }
 
     /* Read second block of ids, if any */
     fseek(d->file, ofst, 0);
-    n = fread((void*)&d->u.jv3.id[JV3_SECSPERBLK], 3, JV3_SECSPERBLK, d->file);
-    d->u.jv3.nblocks = n > 0 ? 2 : 1;
+    n = fread((void*)&d->u.jv3->id[JV3_SECSPERBLK], 3, JV3_SECSPERBLK, d->file);
+    d->u.jv3->nblocks = n > 0 ? 2 : 1;
 
     /* Scan to find their offsets */
     ofst += JV3_SECSTART;
     for (id_index=JV3_SECSPERBLK; id_index<JV3_SECSPERBLK*2; id_index++) {
-      d->u.jv3.offset[id_index] = ofst;
+      d->u.jv3->offset[id_index] = ofst;
       ofst += id_index_to_size(d, id_index);
     }
 
-    /* Find u.jv3.last_used_id value and u.jv3.free_id hints */
+    /* Find u.jv3->last_used_id value and u.jv3->free_id hints */
     for (n=0; n<4; n++) {
-      d->u.jv3.free_id[n] = JV3_SECSMAX;
+      d->u.jv3->free_id[n] = JV3_SECSMAX;
     }
-    d->u.jv3.last_used_id = -1;
+    d->u.jv3->last_used_id = -1;
     for (id_index=0; id_index<JV3_SECSMAX; id_index++) {
-     if (d->u.jv3.id[id_index].track == JV3_FREE) {
+     if (d->u.jv3->id[id_index].track == JV3_FREE) {
 	int size_code = id_index_to_size_code(d, id_index);
-	if (d->u.jv3.free_id[size_code] == JV3_SECSMAX) {
-	  d->u.jv3.free_id[size_code] = id_index;
+	if (d->u.jv3->free_id[size_code] == JV3_SECSMAX) {
+	  d->u.jv3->free_id[size_code] = id_index;
 	}
       } else {
-	d->u.jv3.last_used_id = id_index;
+	d->u.jv3->last_used_id = id_index;
       }
     }
     jv3_sort_ids(drive);
   } else if (d->emutype == DMK) {
     fseek(d->file, DMK_NTRACKS, 0);
-    d->u.dmk.ntracks = (unsigned char) getc(d->file);
-    d->u.dmk.tracklen = (unsigned char) getc(d->file);
-    d->u.dmk.tracklen += ((unsigned char) getc(d->file)) << 8;
+    d->u.dmk->ntracks = (unsigned char) getc(d->file);
+    d->u.dmk->tracklen = (unsigned char) getc(d->file);
+    d->u.dmk->tracklen += ((unsigned char) getc(d->file)) << 8;
     c = getc(d->file);
-    d->u.dmk.nsides = (c & DMK_SSIDE_OPT) ? 1 : 2;
-    d->u.dmk.sden = (c & DMK_SDEN_OPT) != 0;
-    d->u.dmk.ignden = (c & DMK_IGNDEN_OPT) != 0;
-    d->u.dmk.curtrack = d->u.dmk.curside = -1;
+    d->u.dmk->nsides = (c & DMK_SSIDE_OPT) ? 1 : 2;
+    d->u.dmk->sden = (c & DMK_SDEN_OPT) != 0;
+    d->u.dmk->ignden = (c & DMK_IGNDEN_OPT) != 0;
+    d->u.dmk->curtrack = d->u.dmk->curside = -1;
 
     if (trs_disk_debug_flags & DISKDEBUG_DMK) {
       debug("DMK drv=%d wp=%d #tk=%d tklen=0x%x nsides=%d sden=%d ignden=%d\n",
-	    drive, d->writeprot, d->u.dmk.ntracks, d->u.dmk.tracklen,
-	    d->u.dmk.nsides, d->u.dmk.sden, d->u.dmk.ignden);
+	    drive, d->writeprot, d->u.dmk->ntracks, d->u.dmk->tracklen,
+	    d->u.dmk->nsides, d->u.dmk->sden, d->u.dmk->ignden);
     }
   } else if (d->emutype == NONE) {
     return -1;
@@ -986,25 +1054,44 @@ void
 dmk_get_track(DiskState* d)
 {
   int res;
-  if (d->phytrack == d->u.dmk.curtrack &&
-      state.curside == d->u.dmk.curside) return;
-  d->u.dmk.curtrack = d->phytrack;
-  d->u.dmk.curside = state.curside;
-  if (d->u.dmk.curtrack >= d->u.dmk.ntracks ||
-      (d->u.dmk.curside && d->u.dmk.nsides == 1)) {
-    memset(d->u.dmk.buf, 0, sizeof(d->u.dmk.buf));
+  if (d->phytrack == d->u.dmk->curtrack &&
+      state.curside == d->u.dmk->curside) return;
+  d->u.dmk->curtrack = d->phytrack;
+  d->u.dmk->curside = state.curside;
+  if (d->u.dmk->curtrack >= d->u.dmk->ntracks ||
+      (d->u.dmk->curside && d->u.dmk->nsides == 1)) {
+    memset(d->u.dmk->buf, 0, sizeof(d->u.dmk->buf));
     return;
   }
   fseek(d->file, (DMK_HDR_SIZE +
-		  (d->u.dmk.curtrack * d->u.dmk.nsides + d->u.dmk.curside)
-		  * d->u.dmk.tracklen), 0);
-  res = fread(d->u.dmk.buf, d->u.dmk.tracklen, 1, d->file);
+		  (d->u.dmk->curtrack * d->u.dmk->nsides + d->u.dmk->curside)
+		  * d->u.dmk->tracklen), 0);
+  res = fread(d->u.dmk->buf, d->u.dmk->tracklen, 1, d->file);
   if (res != 1) {
-    memset(d->u.dmk.buf, 0, sizeof(d->u.dmk.buf));
+    memset(d->u.dmk->buf, 0, sizeof(d->u.dmk->buf));
     return;
   }    
 }
 
+/* Compute the CRC of n bytes of the track buffer, starting at index
+   start, preset to crc.  Bytes are doubled in single density unless
+   the image says not to.  A range that runs off the end of the buffer
+   gets a CRC that does not check. */
+static unsigned short
+dmk_crc(DiskState *d, int start, int n, unsigned short crc)
+{
+  int incr = dmk_incr(d);
+  unsigned char *p = &d->u.dmk->buf[start];
+
+  if (start < 0 || start + n * incr > DMK_TRACKLEN_MAX) return 1;
+  if (incr == 1) return calc_crc(crc, p, n);
+  while (n--) {
+    crc = calc_crc1(crc, *p);
+    p += incr;
+  }
+  return crc;
+}
+
 
 /* Search for a sector on the current physical track.  For JV1 or JV3,
    return its index within the emulated disk's array of sectors.  For
@@ -1039,16 +1126,16 @@ search(int sector, int side)
       state.status |= TRSDISK_NOTFOUND;
       return -1;
     }
-    if (!d->u.jv3.sorted_valid) jv3_sort_ids(state.curdrive);
-    i = d->u.jv3.track_start[d->phytrack][state.curside];
+    if (!d->u.jv3->sorted_valid) jv3_sort_ids(state.curdrive);
+    i = d->u.jv3->track_start[d->phytrack][state.curside];
     if (i != -1) {
       for (;;) {
-	sid = &d->u.jv3.id[d->u.jv3.sorted_id[i]];
+	sid = &d->u.jv3->id[d->u.jv3->sorted_id[i]];
 	if (sid->track != d->phytrack ||
 	    (sid->flags & JV3_SIDE ? 1 : 0) != state.curside) break;
 	if ((sector == -1 || sid->sector == sector) &&
 	    ((sid->flags & JV3_DENSITY) ? 1 : 0) == state.density) {
-	  return d->u.jv3.sorted_id[i];
+	  return d->u.jv3->sorted_id[i];
 	}
 	i++;
       }
@@ -1070,55 +1157,46 @@ search(int sector, int side)
       unsigned char *p;
 
       /* fetch index of next IDAM */
-      int idamp = d->u.dmk.buf[i] + (d->u.dmk.buf[i+1] << 8);
+      int idamp = d->u.dmk->buf[i] + (d->u.dmk->buf[i+1] << 8);
 
       /* fail if no more IDAMs */
       if (idamp == 0) break;
 
       /* skip IDAM if wrong density */
-      if (!d->u.dmk.ignden &&
+      if (!d->u.dmk->ignden &&
 	  state.density != ((idamp & DMK_DDEN_FLAG) != 0)) continue;
 
       /* point p to IDAM */
       idamp &= DMK_IDAMP_BITS;
-      p = &d->u.dmk.buf[idamp];
+      p = &d->u.dmk->buf[idamp];
 
       /* fail if IDAM out of range */
       if (idamp >= DMK_TRACKLEN_MAX) break;
 
-      /* initialize ID CRC */
-      state.crc = state.density ? 0xcdb4 /* CRC of a1 a1 a1 */ : 0xffff;
-
       /* sanity check; is this an IDAM at all? */
       if (*p != 0xfe) continue;
-      state.crc = calc_crc1(state.crc, *p);
       p += incr;
 
       /* compare track field of ID */
       if (*p != state.track) continue;
-      state.crc = calc_crc1(state.crc, *p);
       p += incr;
 
       /* compare side field of ID if desired */
       if ((*p & 1) != side && side != -1) continue;
-      state.crc = calc_crc1(state.crc, *p);
       p += incr;
 
       /* compare sector field of ID if desired */
       if (*p != sector && sector != -1) continue;
-      state.crc = calc_crc1(state.crc, *p);
       p += incr;
 
       /* save size code field of ID; caller converts to actual byte count */
       state.bytecount = *p;
-      state.crc = calc_crc1(state.crc, *p);
-      p += incr;
+      p += 3 * incr;
 
-      /* fold CRC field into computation; result should be 0 */
-      state.crc = calc_crc1(state.crc, *p);
-      p += incr;
-      state.crc = calc_crc1(state.crc, *p);
-      p += incr;
+      /* CRC the whole ID including its CRC field; result should be 0 */
+      state.crc = dmk_crc(d, idamp, 7, (state.density
+					? 0xcdb4 /* CRC of a1 a1 a1 */
+					: 0xffff));
 
       if (state.crc != 0) {
 	/* set CRC error flag and look for another ID that matches */
@@ -1130,8 +1208,8 @@ search(int sector, int side)
       }
 
       /* Found an ID that matches */
-      d->u.dmk.nextidam = i + 2; /* remember where the next one is */
-      return p - d->u.dmk.buf;
+      d->u.dmk->nextidam = i + 2; /* remember where the next one is */
+      return p - d->u.dmk->buf;
     }
     state.status |= TRSDISK_NOTFOUND;
     return -1;
@@ -1163,8 +1241,8 @@ search_adr(void)
 	state.curside >= JV3_SIDES || d->file == NULL) {
       return -1;
     }
-    if (!d->u.jv3.sorted_valid) jv3_sort_ids(state.curdrive);
-    return d->u.jv3.track_start[d->phytrack][state.curside];
+    if (!d->u.jv3->sorted_valid) jv3_sort_ids(state.curdrive);
+    return d->u.jv3->track_start[d->phytrack][state.curside];
   }
 }
 
@@ -1228,7 +1306,7 @@ type1_status(void)
     return;
   }
 
-  if (d->file == NULL || (d->emutype == REAL && d->u.real.empty)) {
+  if (d->file == NULL || (d->emutype == REAL && d->u.real->empty)) {
     state.status |= TRSDISK_INDEX;
   } else {
     if (angle() < trs_disk_holewidth) {
@@ -1440,18 +1518,19 @@ trs_disk_data_read(void)
 {
   DiskState *d = &disk[state.curdrive];
   SectorId *sid;
+
+  if (state.status & TRSDISK_DRQ) trs_stats.floppy_bytes[state.curdrive]++;
   switch (state.currcommand & TRSDISK_CMDMASK) {
 
   case TRSDISK_READ:
     if (state.bytecount > 0 && (state.status & TRSDISK_DRQ)) {
       int c;
       if (d->emutype == REAL) { 
-	c = d->u.real.buf[size_code_to_size(d->u.real.size_code)
+	c = d->u.real->buf[size_code_to_size(d->u.real->size_code)
 			 - state.bytecount];
       } else if (d->emutype == DMK) {
-	c = d->u.dmk.buf[d->u.dmk.curbyte];
-	state.crc = calc_crc1(state.crc, c);
-	d->u.dmk.curbyte += dmk_incr(d);
+	c = d->u.dmk->buf[d->u.dmk->curbyte];
+	d->u.dmk->curbyte += dmk_incr(d);
       } else {
 	c = getc(d->file);
 	if (c == EOF) {
@@ -1467,9 +1546,8 @@ trs_disk_data_read(void)
       state.bytecount--;
       if (state.bytecount <= 0) {
 	if (d->emutype == DMK) {
-	  state.crc = calc_crc1(state.crc, d->u.dmk.buf[d->u.dmk.curbyte]);
-	  d->u.dmk.curbyte += dmk_incr(d);
-	  state.crc = calc_crc1(state.crc, d->u.dmk.buf[d->u.dmk.curbyte]);
+	  /* CRC was computed over the whole field when the DAM was found */
+	  d->u.dmk->curbyte += dmk_incr(d);
 	  if (state.crc != 0) {
 	    state.status |= TRSDISK_CRCERR;
 	  }
@@ -1491,11 +1569,11 @@ trs_disk_data_read(void)
     }
 
     if (d->emutype == REAL) {
-      state.data = d->u.real.buf[6 - state.bytecount];
+      state.data = d->u.real->buf[6 - state.bytecount];
 
     } else if (d->emutype == DMK) {
-      state.data = d->u.dmk.buf[d->u.dmk.curbyte];
-      d->u.dmk.curbyte += dmk_incr(d);
+      state.data = d->u.dmk->buf[d->u.dmk->curbyte];
+      d->u.dmk->curbyte += dmk_incr(d);
 
     } else if (state.last_readadr >= 0) {
       if (d->emutype == JV1) {
@@ -1518,7 +1596,7 @@ trs_disk_data_read(void)
 	  break;
 	}
       } else if (d->emutype == JV3) {
-	sid = &d->u.jv3.id[d->u.jv3.sorted_id[state.last_readadr]];
+	sid = &d->u.jv3->id[d->u.jv3->sorted_id[state.last_readadr]];
 	switch (state.bytecount) {
 	case 6:
 	  state.data = sid->track;
@@ -1531,7 +1609,7 @@ trs_disk_data_read(void)
 	  break;
 	case 3:
 	  state.data =
-	    id_index_to_size_code(d, d->u.jv3.sorted_id[state.last_readadr]);
+	    id_index_to_size_code(d, d->u.jv3->sorted_id[state.last_readadr]);
 	  break;
 	case 2:
 	case 1:
@@ -1559,7 +1637,9 @@ trs_disk_data_read(void)
       state.sector = state.data;
     }
 
-    state.crc = calc_crc1(state.crc, state.data);
+    if (d->emutype != DMK) {
+      state.crc = calc_crc1(state.crc, state.data);
+    }
     state.bytecount--;
     if (state.bytecount <= 0) {
       if (d->emutype == DMK && state.crc != 0) {
@@ -1579,8 +1659,8 @@ trs_disk_data_read(void)
     /* assert(emutype == DMK) */
     if (!(state.status & TRSDISK_DRQ)) break;
     if (state.bytecount > 0) {
-      state.data = d->u.dmk.buf[d->u.dmk.curbyte];
-      d->u.dmk.curbyte += dmk_incr(d);
+      state.data = d->u.dmk->buf[d->u.dmk->curbyte];
+      d->u.dmk->curbyte += dmk_incr(d);
       state.bytecount = state.bytecount - 2 + state.density;
     }
     if (state.bytecount <= 0) {
@@ -1612,11 +1692,12 @@ trs_disk_data_write(unsigned char data)
   if (trs_disk_debug_flags & DISKDEBUG_FDCREG) {
     debug("data_write(0x%02x) pc 0x%04x\n", data, REG_PC);
   }
+  if (state.status & TRSDISK_DRQ) trs_stats.floppy_bytes[state.curdrive]++;
   switch (state.currcommand & TRSDISK_CMDMASK) {
   case TRSDISK_WRITE:
     if (state.bytecount > 0) {
       if (d->emutype == REAL) {
-	d->u.real.buf[size_code_to_size(d->u.real.size_code)
+	d->u.real->buf[size_code_to_size(d->u.real->size_code)
 		     - state.bytecount] = data;
 	state.bytecount--;
 	if (state.bytecount <= 0) {
@@ -1627,44 +1708,46 @@ trs_disk_data_write(unsigned char data)
       c = putc(data, d->file);
       if (c == EOF) state.status |= TRSDISK_WRITEFLT;
       if (d->emutype == DMK) {
-	d->u.dmk.buf[d->u.dmk.curbyte++] = data;
+	d->u.dmk->buf[d->u.dmk->curbyte++] = data;
 	if (dmk_incr(d) == 2) {
-	  d->u.dmk.buf[d->u.dmk.curbyte++] = data;
+	  d->u.dmk->buf[d->u.dmk->curbyte++] = data;
 	  c = putc(data, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	}
-	state.crc = calc_crc1(state.crc, data);
       }	
       state.bytecount--;
       if (state.bytecount <= 0) {
 	if (d->emutype == DMK) {
 	  int idamp, i, j;
+	  state.crc = dmk_crc(d, d->u.dmk->crcstart,
+			      (d->u.dmk->curbyte - d->u.dmk->crcstart) /
+			      dmk_incr(d), state.crc);
 	  c = state.crc >> 8;
-	  d->u.dmk.buf[d->u.dmk.curbyte++] = c;
+	  d->u.dmk->buf[d->u.dmk->curbyte++] = c;
 	  c = putc(c, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	  if (dmk_incr(d) == 2) {
-	    d->u.dmk.buf[d->u.dmk.curbyte++] = c;
+	    d->u.dmk->buf[d->u.dmk->curbyte++] = c;
 	    c = putc(c, d->file);
 	    if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	  }
 	  c = state.crc & 0xff;
-	  d->u.dmk.buf[d->u.dmk.curbyte++] = c;
+	  d->u.dmk->buf[d->u.dmk->curbyte++] = c;
 	  c = putc(c, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	  if (dmk_incr(d) == 2) {
-	    d->u.dmk.buf[d->u.dmk.curbyte++] = c;
+	    d->u.dmk->buf[d->u.dmk->curbyte++] = c;
 	    c = putc(c, d->file);
 	    if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	  }
 	  /* Check if we smashed one or more following IDAMs; can
 	     happen with weird "protected" formats */
-	  i = j = d->u.dmk.nextidam;
+	  i = j = d->u.dmk->nextidam;
 	  while (i < DMK_TKHDR_SIZE) {
-	    idamp = (d->u.dmk.buf[i] + (d->u.dmk.buf[i+1] << 8))
+	    idamp = (d->u.dmk->buf[i] + (d->u.dmk->buf[i+1] << 8))
 	      & DMK_IDAMP_BITS;
 	    if (idamp != 0 && idamp != DMK_IDAMP_BITS &&
-		d->u.dmk.curbyte /*!!+ erase shutoff slop?*/ > idamp) {
+		d->u.dmk->curbyte /*!!+ erase shutoff slop?*/ > idamp) {
 	      /* Yes, smashed this one */
 	      i += 2;
 	      if (trs_disk_debug_flags & DISKDEBUG_DMK) {
@@ -1673,19 +1756,19 @@ trs_disk_data_write(unsigned char data)
 	    } else {
 	      /* No, keep this one */
 	      if (j == i) break; /* none were smashed; early exit */
-	      d->u.dmk.buf[j++] = d->u.dmk.buf[i++];
-	      d->u.dmk.buf[j++] = d->u.dmk.buf[i++];
+	      d->u.dmk->buf[j++] = d->u.dmk->buf[i++];
+	      d->u.dmk->buf[j++] = d->u.dmk->buf[i++];
 	    }
 	  }
 	  if (j != i) {
 	    /* Smashed at least one; rewrite the track header */
 	    while (j < DMK_TKHDR_SIZE) {
-	      d->u.dmk.buf[j++] = 0;
+	      d->u.dmk->buf[j++] = 0;
 	    }
 	    fseek(d->file, DMK_HDR_SIZE +
-		  (d->phytrack * d->u.dmk.nsides + state.curside) *
-		  d->u.dmk.tracklen, 0);
-	    c = fwrite(d->u.dmk.buf, DMK_TKHDR_SIZE, 1, d->file);
+		  (d->phytrack * d->u.dmk->nsides + state.curside) *
+		  d->u.dmk->tracklen, 0);
+	    c = fwrite(d->u.dmk->buf, DMK_TKHDR_SIZE, 1, d->file);
 	    if (c != 1) state.status |= TRSDISK_WRITEFLT;
 	  }
 	}
@@ -1714,14 +1797,14 @@ trs_disk_data_write(unsigned char data)
 	  state.status &= ~TRSDISK_DRQ;
 	  /* Done: write modified track */
 	  fseek(d->file, DMK_HDR_SIZE +
-		(d->phytrack * d->u.dmk.nsides + state.curside) *
-		d->u.dmk.tracklen, 0);
-	  c = fwrite(d->u.dmk.buf, d->u.dmk.tracklen, 1, d->file);
+		(d->phytrack * d->u.dmk->nsides + state.curside) *
+		d->u.dmk->tracklen, 0);
+	  c = fwrite(d->u.dmk->buf, d->u.dmk->tracklen, 1, d->file);
 	  if (c != 1) state.status |= TRSDISK_WRITEFLT;
-	  if (d->phytrack >= d->u.dmk.ntracks) {
-	    d->u.dmk.ntracks = d->phytrack + 1;
+	  if (d->phytrack >= d->u.dmk->ntracks) {
+	    d->u.dmk->ntracks = d->phytrack + 1;
 	    fseek(d->file, DMK_NTRACKS, 0);
-	    putc(d->u.dmk.ntracks, d->file);
+	    putc(d->u.dmk->ntracks, d->file);
 	  }
 	  c = fflush(d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
@@ -1737,7 +1820,8 @@ trs_disk_data_write(unsigned char data)
 	  if (state.density) {
 	    data = 0xa1;
 	    state.format = FMT_PREAM;
-	    state.crc = 0x968b;  /* CRC of a1 a1 */
+	    state.crc = 0xcdb4;  /* CRC of a1 a1 a1 */
+	    d->u.dmk->crcstart = d->u.dmk->curbyte + 1;
 	  } else {
 	    state.format = FMT_DATA;
 	  }
@@ -1751,31 +1835,37 @@ trs_disk_data_write(unsigned char data)
 	  }
 	  break;
 	case 0xf7:
+	  state.crc = dmk_crc(d, d->u.dmk->crcstart,
+			      (d->u.dmk->curbyte - d->u.dmk->crcstart) /
+			      dmk_incr(d), state.crc);
 	  data = state.crc >> 8;
-	  d->u.dmk.buf[d->u.dmk.curbyte++] = data;
+	  d->u.dmk->buf[d->u.dmk->curbyte++] = data;
 	  if (dmk_incr(d) == 2) {
-	    d->u.dmk.buf[d->u.dmk.curbyte++] = data;
+	    d->u.dmk->buf[d->u.dmk->curbyte++] = data;
 	  }
 	  state.bytecount = state.bytecount - 2 + state.density;
 	  data = state.crc & 0xff;
+	  state.crc = calc_crc1(state.crc, data);
+	  d->u.dmk->crcstart = d->u.dmk->curbyte + dmk_incr(d);
 	  state.format = FMT_DATA;
 	  break;
 	case 0xfe:
 	  if (!state.density || state.format == FMT_PREAM) {
-	    unsigned short idamp = d->u.dmk.curbyte +
+	    unsigned short idamp = d->u.dmk->curbyte +
 	      (state.density ? DMK_DDEN_FLAG : 0);
-	    if (d->u.dmk.nextidam >= DMK_TKHDR_SIZE) {
+	    if (d->u.dmk->nextidam >= DMK_TKHDR_SIZE) {
 	      error("DMK formatting too many address marks on track");
-	    } else if (d->u.dmk.curbyte > d->u.dmk.tracklen) {
+	    } else if (d->u.dmk->curbyte > d->u.dmk->tracklen) {
 	      error("DMK address mark past end of track");
 	    } else {
-	      d->u.dmk.buf[d->u.dmk.nextidam++] = idamp & 0xff;
-	      d->u.dmk.buf[d->u.dmk.nextidam++] = idamp >> 8;
+	      d->u.dmk->buf[d->u.dmk->nextidam++] = idamp & 0xff;
+	      d->u.dmk->buf[d->u.dmk->nextidam++] = idamp >> 8;
 	    }
 	  }
 	  state.format = FMT_DATA;
 	  if (!state.density) {
 	    state.crc = 0xffff;
+	    d->u.dmk->crcstart = d->u.dmk->curbyte;
 	  }
 	  break;
 #if DMK_MARK_IAM
@@ -1785,15 +1875,15 @@ trs_disk_data_write(unsigned char data)
 	     xtrs 4.5a and earlier, so we disable it, at least for now. */
 	case 0xfc:
 	  if (!state.density || state.format == FMT_IPREAM) {
-	    unsigned short idamp = d->u.dmk.curbyte +
+	    unsigned short idamp = d->u.dmk->curbyte +
 	      (state.density ? DMK_DDEN_FLAG : 0);
-	    if (d->u.dmk.nextidam >= DMK_TKHDR_SIZE) {
+	    if (d->u.dmk->nextidam >= DMK_TKHDR_SIZE) {
 	      error("DMK formatting too many address marks on track");
-	    } else if (d->u.dmk.curbyte > d->u.dmk.tracklen) {
+	    } else if (d->u.dmk->curbyte > d->u.dmk->tracklen) {
 	      error("DMK address mark past end of track");
 	    } else {
-	      d->u.dmk.buf[d->u.dmk.nextidam++] = idamp & 0xff;
-	      d->u.dmk.buf[d->u.dmk.nextidam++] = idamp >> 8;
+	      d->u.dmk->buf[d->u.dmk->nextidam++] = idamp & 0xff;
+	      d->u.dmk->buf[d->u.dmk->nextidam++] = idamp >> 8;
 	    }
 	  }
 	  state.format = FMT_DATA;
@@ -1805,6 +1895,7 @@ trs_disk_data_write(unsigned char data)
 	case 0xfb:
 	  if (!state.density) {
 	    state.crc = 0xffff;
+	    d->u.dmk->crcstart = d->u.dmk->curbyte;
 	  }
 	  state.format = FMT_DATA;
 	  break;
@@ -1812,11 +1903,10 @@ trs_disk_data_write(unsigned char data)
 	  state.format = FMT_DATA;
 	  break;
 	}
-	d->u.dmk.buf[d->u.dmk.curbyte++] = data;
+	d->u.dmk->buf[d->u.dmk->curbyte++] = data;
 	if (dmk_incr(d) == 2) {
-	  d->u.dmk.buf[d->u.dmk.curbyte++] = data;
+	  d->u.dmk->buf[d->u.dmk->curbyte++] = data;
 	}
-	state.crc = calc_crc1(state.crc, data);
       }	
       break;
     }
@@ -1828,12 +1918,12 @@ trs_disk_data_write(unsigned char data)
 	  trs_disk_unimpl(state.currcommand, "false sector ID (no data)");
 	} else {
 	  /* We do not have a flag for this; try using CRC error */
-	  d->u.jv3.id[state.format_sec].flags |= JV3_ERROR;
+	  d->u.jv3->id[state.format_sec].flags |= JV3_ERROR;
 	  error("warning: recording false sector ID as CRC error");
 
 	  /* Write the sector id */
 	  fseek(d->file, idoffset(d, state.format_sec), 0);
-	  c = fwrite(&d->u.jv3.id[state.format_sec],
+	  c = fwrite(&d->u.jv3->id[state.format_sec],
 		     sizeof(SectorId), 1, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	}
@@ -1911,14 +2001,14 @@ trs_disk_data_write(unsigned char data)
       break;
     case FMT_TRACKID:
       if (d->emutype == REAL) {
-	if (d->u.real.fmt_nbytes >= (int)sizeof(d->u.real.buf)) {
+	if (d->u.real->fmt_nbytes >= (int)sizeof(d->u.real->buf)) {
 	  /* Data structure full */
 	  state.status |= TRSDISK_WRITEFLT;
 	  state.bytecount = 0;
 	  state.format_bytecount = 0;
 	  state.format = FMT_DONE;
 	} else {
-	  d->u.real.buf[d->u.real.fmt_nbytes++] = data;
+	  d->u.real->buf[d->u.real->fmt_nbytes++] = data;
 	  state.format = FMT_HEADID;
 	}
       } else {
@@ -1930,7 +2020,7 @@ trs_disk_data_write(unsigned char data)
       break;
     case FMT_HEADID:
       if (d->emutype == REAL) {
-	d->u.real.buf[d->u.real.fmt_nbytes++] = data;
+	d->u.real->buf[d->u.real->fmt_nbytes++] = data;
       } else if (d->emutype == JV1) {
 	if (data != 0) {
 	  trs_disk_unimpl(state.currcommand, "JV1 double sided");
@@ -1947,7 +2037,7 @@ trs_disk_data_write(unsigned char data)
       break;
     case FMT_SECID:
       if (d->emutype == REAL) {
-	d->u.real.buf[d->u.real.fmt_nbytes++] = data;
+	d->u.real->buf[d->u.real->fmt_nbytes++] = data;
       } else if (d->emutype == JV1) {
 	if (data >= JV1_SECPERTRK) {
 	  trs_disk_unimpl(state.currcommand, "JV1 sector number >= 10");
@@ -1972,21 +2062,21 @@ trs_disk_data_write(unsigned char data)
 	  state.format = FMT_DONE;
 	  break;
 	}
-	d->u.jv3.sorted_valid = 0;
-	d->u.jv3.id[id_index].track = d->phytrack;
-	d->u.jv3.id[id_index].sector = state.format_sec;
-	d->u.jv3.id[id_index].flags =
+	d->u.jv3->sorted_valid = 0;
+	d->u.jv3->id[id_index].track = d->phytrack;
+	d->u.jv3->id[id_index].sector = state.format_sec;
+	d->u.jv3->id[id_index].flags =
 	  (state.curside ? JV3_SIDE : 0) | (state.density ? JV3_DENSITY : 0) |
 	  ((data & 3) ^ 1);
 	state.format_sec = id_index;
 
       } else if (d->emutype == REAL) {
-	d->u.real.buf[d->u.real.fmt_nbytes++] = data;
-	if (d->u.real.size_code != -1 && d->u.real.size_code != data) {
+	d->u.real->buf[d->u.real->fmt_nbytes++] = data;
+	if (d->u.real->size_code != -1 && d->u.real->size_code != data) {
 	  trs_disk_unimpl(state.currcommand,
 			  "varying sector size on same track on real floppy");
 	}
-	d->u.real.size_code = data;
+	d->u.real->size_code = data;
       } else {
 	if (data != 0x01) {
 	  trs_disk_unimpl(state.currcommand, "sector size != 256");
@@ -2049,12 +2139,12 @@ trs_disk_data_write(unsigned char data)
 	    switch (data) {
 	    case 0xf8: /* Standard deleted DAM */
 	    case 0xf9: /* Illegal, probably never used; ignore error. */
-	      d->u.jv3.id[state.format_sec].flags |= JV3_DAMDDF8;
+	      d->u.jv3->id[state.format_sec].flags |= JV3_DAMDDF8;
 	      break;
 	    case 0xfb: /* Standard DAM */
 	    case 0xfa: /* Illegal, but SuperUtility uses it! */
 	    default:   /* Impossible */
-	      d->u.jv3.id[state.format_sec].flags |= JV3_DAMDDFB;
+	      d->u.jv3->id[state.format_sec].flags |= JV3_DAMDDFB;
 	      break;
 	    }
 	  } else {
@@ -2062,20 +2152,20 @@ trs_disk_data_write(unsigned char data)
 	    switch (data) {
 	    case 0xf8:
 	      if (trs_disk_truedam) {
-		d->u.jv3.id[state.format_sec].flags |= JV3_DAMSDF8;
+		d->u.jv3->id[state.format_sec].flags |= JV3_DAMSDF8;
 	      } else {
-		d->u.jv3.id[state.format_sec].flags |= JV3_DAMSDFA;
+		d->u.jv3->id[state.format_sec].flags |= JV3_DAMSDFA;
 	      }
 	      break;
 	    case 0xf9:
-	      d->u.jv3.id[state.format_sec].flags |= JV3_DAMSDF9;
+	      d->u.jv3->id[state.format_sec].flags |= JV3_DAMSDF9;
 	      break;
 	    case 0xfa:
-	      d->u.jv3.id[state.format_sec].flags |= JV3_DAMSDFA;
+	      d->u.jv3->id[state.format_sec].flags |= JV3_DAMSDFA;
 	      break;
 	    default: /* impossible */
 	    case 0xfb:
-	      d->u.jv3.id[state.format_sec].flags |= JV3_DAMDDFB;
+	      d->u.jv3->id[state.format_sec].flags |= JV3_DAMDDFB;
 	      break;
 	    }
 	  }
@@ -2087,7 +2177,7 @@ trs_disk_data_write(unsigned char data)
 	} else if (d->emutype == JV1) {
 	  state.format_bytecount = JV1_SECSIZE;
 	} else if (d->emutype == REAL) {
-	  state.format_bytecount = size_code_to_size(d->u.real.size_code);
+	  state.format_bytecount = size_code_to_size(d->u.real->size_code);
 	}
 	state.format_gap[2] = state.format_gapcnt;
 	state.format_gapcnt = 0;
@@ -2099,11 +2189,11 @@ trs_disk_data_write(unsigned char data)
 	} else {
 	  /* We do not have a flag for this; try using CRC error */
 	  error("warning: recording false sector ID as CRC error");
-	  d->u.jv3.id[state.format_sec].flags |= JV3_ERROR;
+	  d->u.jv3->id[state.format_sec].flags |= JV3_ERROR;
 
 	  /* Write the sector id */
 	  fseek(d->file, idoffset(d, state.format_sec), 0);
-	  c = fwrite(&d->u.jv3.id[state.format_sec], sizeof(SectorId), 1, d->file);
+	  c = fwrite(&d->u.jv3->id[state.format_sec], sizeof(SectorId), 1, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	}
 	goto got_idam2;
@@ -2115,17 +2205,17 @@ trs_disk_data_write(unsigned char data)
       if (data == 0xfe) {
 	/* Short sector with intentional CRC error */
 	if (d->emutype == JV3) {
-	  d->u.jv3.id[state.format_sec].flags |= JV3_NONIBM | JV3_ERROR;
+	  d->u.jv3->id[state.format_sec].flags |= JV3_NONIBM | JV3_ERROR;
 	  if (trs_disk_debug_flags & DISKDEBUG_VTOS3) {
 	    debug("non-IBM sector: drv 0x%02x, sid %d,"
 		  " trk 0x%02x, sec 0x%02x\n",
 		  state.curdrive, state.curside,
-		  d->u.jv3.id[state.format_sec].track, 
-		  d->u.jv3.id[state.format_sec].sector);
+		  d->u.jv3->id[state.format_sec].track, 
+		  d->u.jv3->id[state.format_sec].sector);
 	  }
 	  /* Write the sector id */
 	  fseek(d->file, idoffset(d, state.format_sec), 0);
-	  c = fwrite(&d->u.jv3.id[state.format_sec],
+	  c = fwrite(&d->u.jv3->id[state.format_sec],
 		     sizeof(SectorId), 1, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
 	  goto got_idam;
@@ -2137,7 +2227,7 @@ trs_disk_data_write(unsigned char data)
 	c = putc(data, d->file);
 	if (c == EOF) state.status |= TRSDISK_WRITEFLT;
       } else if (d->emutype == REAL) {
-	d->u.real.fmt_fill = data;
+	d->u.real->fmt_fill = data;
       }
       if (--state.format_bytecount <= 0) {
 	state.format = FMT_DCRC;
@@ -2151,13 +2241,13 @@ trs_disk_data_write(unsigned char data)
 	if (d->emutype != JV3) {
 	  trs_disk_unimpl(state.currcommand, "intentional CRC error");
 	} else {
-	  d->u.jv3.id[state.format_sec].flags |= JV3_ERROR;
+	  d->u.jv3->id[state.format_sec].flags |= JV3_ERROR;
 	}
       }
       if (d->emutype == JV3) {
 	/* Write the sector id */
 	fseek(d->file, idoffset(d, state.format_sec), 0);
-	c = fwrite(&d->u.jv3.id[state.format_sec], sizeof(SectorId), 1, d->file);
+	c = fwrite(&d->u.jv3->id[state.format_sec], sizeof(SectorId), 1, d->file);
 	if (c == EOF) state.status |= TRSDISK_WRITEFLT;
       }
       state.format = FMT_GAP3;
@@ -2247,17 +2337,17 @@ trs_disk_command_write(unsigned char cmd)
 
     /* Fetch old IDAM pointers if any */
     fseek(d->file, DMK_HDR_SIZE +
-	  (d->phytrack * d->u.dmk.nsides + state.curside) *
-	  d->u.dmk.tracklen, 0);
+	  (d->phytrack * d->u.dmk->nsides + state.curside) *
+	  d->u.dmk->tracklen, 0);
     c = fread(oldtkhdr, DMK_TKHDR_SIZE, 1, d->file);
     if (c == 1) {
       /* Copy any pointers to IDAMs that are not being overwritten */
       i = 0;
-      j = d->u.dmk.nextidam;
+      j = d->u.dmk->nextidam;
       while (i < DMK_TKHDR_SIZE) {
 	idamp = (oldtkhdr[i] + (oldtkhdr[i+1] << 8)) & DMK_IDAMP_BITS;
 	if (idamp == 0 || idamp == DMK_IDAMP_BITS) break;
-	if (idamp < d->u.dmk.curbyte) {
+	if (idamp < d->u.dmk->curbyte) {
 	  /* IDAM overwritten; don't copy */
 	  i += 2;
 	  if (trs_disk_debug_flags & DISKDEBUG_DMK) {
@@ -2270,8 +2360,8 @@ trs_disk_command_write(unsigned char cmd)
 	    error("DMK reformatting adds too many sectors to track");
 	    break;
 	  }
-	  d->u.dmk.buf[j++] = oldtkhdr[i++];
-	  d->u.dmk.buf[j++] = oldtkhdr[i++];
+	  d->u.dmk->buf[j++] = oldtkhdr[i++];
+	  d->u.dmk->buf[j++] = oldtkhdr[i++];
 	  if (trs_disk_debug_flags & DISKDEBUG_DMK) {
 	    debug("  preserving physec %d as %d\n", i, j);
 	  }
@@ -2284,18 +2374,18 @@ trs_disk_command_write(unsigned char cmd)
     }
     /* Write modified portion of track only */
     fseek(d->file, DMK_HDR_SIZE +
-	  (d->phytrack * d->u.dmk.nsides + state.curside) *
-	  d->u.dmk.tracklen, 0);
-    fwrite(d->u.dmk.buf, d->u.dmk.curbyte, 1, d->file);
-    if (d->phytrack >= d->u.dmk.ntracks) {
-      d->u.dmk.ntracks = d->phytrack + 1;
+	  (d->phytrack * d->u.dmk->nsides + state.curside) *
+	  d->u.dmk->tracklen, 0);
+    fwrite(d->u.dmk->buf, d->u.dmk->curbyte, 1, d->file);
+    if (d->phytrack >= d->u.dmk->ntracks) {
+      d->u.dmk->ntracks = d->phytrack + 1;
       fseek(d->file, DMK_NTRACKS, 0);
-      putc(d->u.dmk.ntracks, d->file);
+      putc(d->u.dmk->ntracks, d->file);
     }
     fflush(d->file);
 
     /* Invalidate buffer since not all data is here */
-    d->u.dmk.curtrack = d->u.dmk.curside = -1;
+    d->u.dmk->curtrack = d->u.dmk->curside = -1;
     state.format = FMT_DONE;
   }
 
@@ -2313,6 +2403,7 @@ trs_disk_command_write(unsigned char cmd)
     if (trs_disk_debug_flags & DISKDEBUG_FDCCMD) {
       debug("restore 0x%02x drv %d\n", cmd, state.curdrive);
     }
+    trs_stats.floppy_seeks[state.curdrive]++;
     state.last_readadr = -1;
     d->phytrack = 0;
     state.track = 0;
@@ -2328,6 +2419,7 @@ trs_disk_command_write(unsigned char cmd)
       debug("seek 0x%02x drv %d ptk %d otk %d ntk %d\n",
 	    cmd, state.curdrive, d->phytrack, state.track, state.data);
     }
+    trs_stats.floppy_seeks[state.curdrive]++;
     state.last_readadr = -1;
     d->phytrack += (state.data - state.track);
     state.track = state.data;
@@ -2352,6 +2444,7 @@ trs_disk_command_write(unsigned char cmd)
 	    (state.lastdirection < 0) ? "out" : "in", cmd,
 	    state.curdrive, d->phytrack, state.track);
     }      
+    trs_stats.floppy_seeks[state.curdrive]++;
     state.last_readadr = -1;
     d->phytrack += state.lastdirection;
     if (cmd & TRSDISK_UBIT) {
@@ -2436,7 +2529,7 @@ trs_disk_command_write(unsigned char cmd)
       } else if (d->emutype == JV3) {
 
 	if (state.controller == TRSDISK_P1771) {
-	  switch (d->u.jv3.id[id_index].flags & JV3_DAM) {
+	  switch (d->u.jv3->id[id_index].flags & JV3_DAM) {
 	  case JV3_DAMSDFB:
 	    new_status = TRSDISK_1771_FB;
 	    break;
@@ -2452,7 +2545,7 @@ trs_disk_command_write(unsigned char cmd)
 	  }
 	} else if (state.density == 0) {
 	  /* single density 179x */
-	  switch (d->u.jv3.id[id_index].flags & JV3_DAM) {
+	  switch (d->u.jv3->id[id_index].flags & JV3_DAM) {
 	  case JV3_DAMSDFB:
 	    new_status = TRSDISK_1791_FB;
 	    break;
@@ -2472,7 +2565,7 @@ trs_disk_command_write(unsigned char cmd)
 	  }
 	} else {
 	  /* double density 179x */
-	  switch (d->u.jv3.id[id_index].flags & JV3_DAM) {
+	  switch (d->u.jv3->id[id_index].flags & JV3_DAM) {
 	  default: /*impossible*/
 	  case JV3_DAMDDFB:
 	    new_status = TRSDISK_1791_FB;
@@ -2482,7 +2575,7 @@ trs_disk_command_write(unsigned char cmd)
 	    break;
 	  }
 	}
-	if (d->u.jv3.id[id_index].flags & JV3_ERROR) {
+	if (d->u.jv3->id[id_index].flags & JV3_ERROR) {
 	  new_status |= TRSDISK_CRCERR;
 	}
 	if (non_ibm) {
@@ -2508,7 +2601,7 @@ trs_disk_command_write(unsigned char cmd)
 
 	/* search for valid DAM */
 	while (--damlimit >= 0) {
-	  dam = d->u.dmk.buf[id_index];
+	  dam = d->u.dmk->buf[id_index];
 	  id_index += dmk_incr(d);
 	  if (0xf8 <= dam && dam <= 0xfb) {
 	    /* got one! */
@@ -2563,11 +2656,13 @@ trs_disk_command_write(unsigned char cmd)
 	    break;
 	  }
 	}
-	state.crc = calc_crc1((state.density
-			       ? 0xcdb4 /* CRC of a1 a1 a1 */
-			       : 0xffff), dam);
+	/* CRC the DAM, data, and CRC field at once; result should be 0 */
+	state.crc = dmk_crc(d, id_index - dmk_incr(d), state.bytecount + 3,
+			    (state.density
+			     ? 0xcdb4 /* CRC of a1 a1 a1 */
+			     : 0xffff));
 
-	d->u.dmk.curbyte = id_index;
+	d->u.dmk->curbyte = id_index;
 
       } /* end if (d->emutype == ...) */
 
@@ -2619,7 +2714,7 @@ trs_disk_command_write(unsigned char cmd)
       trs_disk_drq_interrupt(1);
       trs_schedule_event(trs_disk_lostdata, state.currcommand,
 			 500000 * z80_state.clockMHz);
-      state.bytecount = size_code_to_size(d->u.real.size_code);
+      state.bytecount = size_code_to_size(d->u.real->size_code);
       break;
     }
     if (d->writeprot) {
@@ -2698,7 +2793,7 @@ trs_disk_command_write(unsigned char cmd)
 	fseek(d->file, offset(d, id_index), 0);
 
       } else if (d->emutype == JV3) {
-	SectorId *sid = &d->u.jv3.id[id_index];
+	SectorId *sid = &d->u.jv3->id[id_index];
 	unsigned char newflags = sid->flags;
 	newflags &= ~(JV3_ERROR|JV3_DAM); /* clear CRC error and DAM */
 	newflags |= jv3dam;
@@ -2757,38 +2852,37 @@ trs_disk_command_write(unsigned char cmd)
 	/* Skip initial part of gap, per 1771 and 179x data sheets */
 	id_index += 11 * (state.density ? 2 : 1) * dmk_incr(d);
 	fseek(d->file, (DMK_HDR_SIZE +
-			(d->u.dmk.curtrack*d->u.dmk.nsides + d->u.dmk.curside)
-			* d->u.dmk.tracklen + id_index), 0);
+			(d->u.dmk->curtrack*d->u.dmk->nsides + d->u.dmk->curside)
+			* d->u.dmk->tracklen + id_index), 0);
 
 	/* Write remaining gap (per data sheets) and DAM */
 	nzeros = 6 * (state.density ? 2 : 1) * dmk_incr(d);
 	for (i=0; i<nzeros; i++) {
 	  c = putc(0, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
-	  d->u.dmk.buf[id_index++] = 0;
+	  d->u.dmk->buf[id_index++] = 0;
 	}
 	if (state.density) {
 	  for (i=0; i<3; i++) {
 	    c = putc(0xa1, d->file);
 	    if (c == EOF) state.status |= TRSDISK_WRITEFLT;
-	    d->u.dmk.buf[id_index++] = 0xa1;
+	    d->u.dmk->buf[id_index++] = 0xa1;
 	  }	    
 	}
+	d->u.dmk->crcstart = id_index;
 	c = putc(dam, d->file);
 	if (c == EOF) state.status |= TRSDISK_WRITEFLT;
-	d->u.dmk.buf[id_index++] = dam;
+	d->u.dmk->buf[id_index++] = dam;
 	if (dmk_incr(d) == 2) {
 	  c = putc(dam, d->file);
 	  if (c == EOF) state.status |= TRSDISK_WRITEFLT;
-	  d->u.dmk.buf[id_index++] = dam;
+	  d->u.dmk->buf[id_index++] = dam;
 	}
 
-	/* Initialize CRC */
-	state.crc = calc_crc1((state.density
-			       ? 0xcdb4 /* CRC of a1 a1 a1 */
-			       : 0xffff), dam);
+	/* Preset CRC; the DAM and data are CRC'd when the data is done */
+	state.crc = state.density ? 0xcdb4 /* CRC of a1 a1 a1 */ : 0xffff;
 
-	d->u.dmk.curbyte = id_index;
+	d->u.dmk->curbyte = id_index;
 
       } /* end if (d->emutype == ...) */
 
@@ -2866,12 +2960,12 @@ trs_disk_command_write(unsigned char cmd)
 	totbyt = 0;
 	denok = 0;
 	for (;;) {
-	  SectorId *sid = &d->u.jv3.id[d->u.jv3.sorted_id[i]];
+	  SectorId *sid = &d->u.jv3->id[d->u.jv3->sorted_id[i]];
 	  int dden = (sid->flags & JV3_DENSITY) != 0;
 	  if (sid->track != d->phytrack ||
 	      (sid->flags & JV3_SIDE ? 1 : 0) != state.curside) break;
 	  totbyt += (dden ? 1 : 2) *
-	    id_index_to_size(d, d->u.jv3.sorted_id[i]);
+	    id_index_to_size(d, d->u.jv3->sorted_id[i]);
 	  if (dden == state.density) denok = 1;
 	  i++;
 	}
@@ -2893,7 +2987,7 @@ trs_disk_command_write(unsigned char cmd)
 	bytlen = (1.0 - GAP1ANGLE - GAP4ANGLE)/((float)totbyt);
 	i = id_index;
 	for (;;) {
-	  SectorId *sid = &d->u.jv3.id[d->u.jv3.sorted_id[i]];
+	  SectorId *sid = &d->u.jv3->id[d->u.jv3->sorted_id[i]];
 	  if (sid->track != d->phytrack ||
 	      (sid->flags & JV3_SIDE ? 1 : 0) != state.curside) {
 	    /* Wrap around to start of track */
@@ -2905,7 +2999,7 @@ trs_disk_command_write(unsigned char cmd)
 	    break;
 	  }
 	  b += ((sid->flags & JV3_DENSITY) ? 1 : 2) *
-  	    id_index_to_size(d, d->u.jv3.sorted_id[i]) * bytlen;
+  	    id_index_to_size(d, d->u.jv3->sorted_id[i]) * bytlen;
 	  i++;
 	}
       }
@@ -2930,22 +3024,22 @@ trs_disk_command_write(unsigned char cmd)
       dmk_get_track(d);
 
       for (j = 0; j < 2; j++) {
-	idamp = d->u.dmk.buf[0] + (d->u.dmk.buf[1] << 8);
+	idamp = d->u.dmk->buf[0] + (d->u.dmk->buf[1] << 8);
 	dden = (idamp & DMK_DDEN_FLAG) != 0;
 	idamp = DMK_TKHDR_SIZE;
 
 	for (i = 0; i < DMK_TKHDR_SIZE; i+=2) {
 	  prev_idamp = idamp;
 	  prev_dden = dden;
-	  idamp = d->u.dmk.buf[i] + (d->u.dmk.buf[i+1] << 8);
+	  idamp = d->u.dmk->buf[i] + (d->u.dmk->buf[i+1] << 8);
 	  if (idamp == 0) break;
 	  dden = (idamp & DMK_DDEN_FLAG) != 0;
 	  idamp &= DMK_IDAMP_BITS;
 	  if (idamp >= DMK_TRACKLEN_MAX) break;
 	  ib += (idamp - prev_idamp) *
-	    ((!prev_dden && (d->u.dmk.sden || d->u.dmk.ignden)) ? 2 : 1);
+	    ((!prev_dden && (d->u.dmk->sden || d->u.dmk->ignden)) ? 2 : 1);
 	  if (ib > ia && dden == state.density &&
-	      d->u.dmk.buf[idamp] == 0xfe) goto found;
+	      d->u.dmk->buf[idamp] == 0xfe) goto found;
 	}
 	/* Next ID (if any) is past the index hole */
 	ib = (d->inches ? TRKSIZE_DD : TRKSIZE_8DD);
@@ -2964,11 +3058,10 @@ trs_disk_command_write(unsigned char cmd)
       state.status = TRSDISK_BUSY;
       state.last_readadr = i;
       state.bytecount = 6;
-      state.crc = calc_crc1((state.density
-			     ? 0xcdb4 /* CRC of a1 a1 a1 */
-			     : 0xffff),
-			    d->u.dmk.buf[idamp]);
-      d->u.dmk.curbyte = idamp + dmk_incr(d);
+      state.crc = dmk_crc(d, idamp, 7, (state.density
+					? 0xcdb4 /* CRC of a1 a1 a1 */
+					: 0xffff));
+      d->u.dmk->curbyte = idamp + dmk_incr(d);
       trs_schedule_event(trs_disk_firstdrq, 0, ts);
       if (trs_disk_debug_flags & DISKDEBUG_READADR) {
 	debug("readadr phytrack %d angle %f i %d ts %d\n",
@@ -2999,7 +3092,7 @@ trs_disk_command_write(unsigned char cmd)
       break;
     }
     dmk_get_track(d);
-    d->u.dmk.curbyte = DMK_TKHDR_SIZE;
+    d->u.dmk->curbyte = DMK_TKHDR_SIZE;
     if (disk[state.curdrive].inches == 5) {
       state.bytecount = TRKSIZE_DD;  /* decrement by 2's if SD */
     } else {
@@ -3043,29 +3136,30 @@ trs_disk_command_write(unsigned char cmd)
       if (d->emutype == JV3) {
 	/* Erase track if already formatted */
 	int i;
-	for (i=0; i<=d->u.jv3.last_used_id; i++) {
-	  if (d->u.jv3.id[i].track == d->phytrack &&
-	      ((d->u.jv3.id[i].flags & JV3_SIDE) != 0) == state.curside) {
+	for (i=0; i<=d->u.jv3->last_used_id; i++) {
+	  if (d->u.jv3->id[i].track == d->phytrack &&
+	      ((d->u.jv3->id[i].flags & JV3_SIDE) != 0) == state.curside) {
 	    jv3_free_sector(d, i);
 	  }
 	}
       } else if (d->emutype == REAL) {
-	d->u.real.size_code = -1; /* watch for first, then check others match*/
-	d->u.real.fmt_nbytes = 0; /* size of PC formatting command buffer */
+	d->u.real->size_code = -1; /* watch for first, then check others match*/
+	d->u.real->fmt_nbytes = 0; /* size of PC formatting command buffer */
       } else if (d->emutype == DMK) {
-	if (state.density && d->u.dmk.sden) {
+	if (state.density && d->u.dmk->sden) {
 	  error("DMK disk created as single density only");
 	  state.status |= TRSDISK_WRITEFLT;
 	}
-	if (state.curside && d->u.dmk.nsides == 1) {
+	if (state.curside && d->u.dmk->nsides == 1) {
 	  error("DMK disk created as single sided only");
 	  state.status |= TRSDISK_WRITEFLT;
 	}
-	d->u.dmk.curtrack = d->phytrack;
-	d->u.dmk.curside = state.curside;
-	memset(d->u.dmk.buf, 0, sizeof(d->u.dmk.buf));
-	d->u.dmk.curbyte = DMK_TKHDR_SIZE;
-	d->u.dmk.nextidam = 0;
+	d->u.dmk->curtrack = d->phytrack;
+	d->u.dmk->curside = state.curside;
+	memset(d->u.dmk->buf, 0, sizeof(d->u.dmk->buf));
+	d->u.dmk->curbyte = DMK_TKHDR_SIZE;
+	d->u.dmk->crcstart = DMK_TKHDR_SIZE;
+	d->u.dmk->nextidam = 0;
       }
       state.status |= TRSDISK_BUSY|TRSDISK_DRQ;
       trs_disk_drq_interrupt(1);
@@ -3107,9 +3201,9 @@ int
 real_rate(DiskState *d)
 {
   if (d->inches == 5) {
-    if (d->u.real.rps == 5) {
+    if (d->u.real->rps == 5) {
       return 2;
-    } else if (d->u.real.rps == 6) {
+    } else if (d->u.real->rps == 6) {
       return 1;
     }
   } else if (d->inches == 8) {
@@ -3123,9 +3217,9 @@ void
 real_error(DiskState *d, unsigned int flags, char *msg)
 {
   time_t now = time(NULL);
-  if (now > d->u.real.empty_timeout) {
-    d->u.real.empty_timeout = time(NULL) + EMPTY_TIMEOUT;
-    d->u.real.empty = 1;
+  if (now > d->u.real->empty_timeout) {
+    d->u.real->empty_timeout = time(NULL) + EMPTY_TIMEOUT;
+    d->u.real->empty = 1;
   }
   if (trs_disk_debug_flags & DISKDEBUG_REALERR) {
     debug("error on real_%s\n", msg);
@@ -3135,8 +3229,8 @@ real_error(DiskState *d, unsigned int flags, char *msg)
 void
 real_ok(DiskState *d)
 {
-  d->u.real.empty_timeout = time(NULL) + EMPTY_TIMEOUT;
-  d->u.real.empty = 0;
+  d->u.real->empty_timeout = time(NULL) + EMPTY_TIMEOUT;
+  d->u.real->empty = 0;
 }
 
 int
@@ -3146,12 +3240,11 @@ real_check_empty(DiskState *d)
   int reset_now = 0;
   struct floppy_raw_cmd raw_cmd;
   int res, i = 0;
-  sigset_t set, oldset;
 
-  if (time(NULL) <= d->u.real.empty_timeout) return d->u.real.empty;
+  if (time(NULL) <= d->u.real->empty_timeout) return d->u.real->empty;
   
   if (d->file == NULL) {
-    d->u.real.empty = 1;
+    d->u.real->empty = 1;
     return 1;
   }
 
@@ -3167,12 +3260,8 @@ real_check_empty(DiskState *d)
   raw_cmd.cmd_count = i;
   raw_cmd.data = NULL;
   raw_cmd.length = 0;
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
   trs_paused = 1;
   res = ioctl(fileno(d->file), FDRAWCMD, &raw_cmd);
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   if (res < 0) {
     real_error(d, raw_cmd.flags, "check_empty");
   } else {
@@ -3181,7 +3270,7 @@ real_check_empty(DiskState *d)
 #else
   trs_disk_unimpl(state.currcommand, "check for empty on real floppy");
 #endif
-  return d->u.real.empty;
+  return d->u.real->empty;
 }
 
 void
@@ -3198,18 +3287,13 @@ real_restore(int curdrive)
   DiskState *d = &disk[curdrive];
   struct floppy_raw_cmd raw_cmd;
   int res, i = 0;
-  sigset_t set, oldset;
 
   raw_cmd.flags = FD_RAW_INTR;
   raw_cmd.cmd[i++] = FD_RECALIBRATE;
   raw_cmd.cmd[i++] = 0;
   raw_cmd.cmd_count = i;
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
   trs_paused = 1;
   res = ioctl(fileno(d->file), FDRAWCMD, &raw_cmd);
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   if (res < 0) {
     real_error(d, raw_cmd.flags, "restore");
     state.status |= TRSDISK_SEEKERR;
@@ -3227,7 +3311,6 @@ real_seek(void)
   DiskState *d = &disk[state.curdrive];
   struct floppy_raw_cmd raw_cmd;
   int res, i = 0;
-  sigset_t set, oldset;
 
   /* Always use a recal if going to track 0.  This should help us
      recover from confusion about what track the disk is really on.
@@ -3247,12 +3330,8 @@ real_seek(void)
   raw_cmd.cmd[i++] = 0;
   raw_cmd.cmd[i++] = d->phytrack * d->real_step;
   raw_cmd.cmd_count = i;
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
   trs_paused = 1;
   res = ioctl(fileno(d->file), FDRAWCMD, &raw_cmd);
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   if (res < 0) {
     real_error(d, raw_cmd.flags, "seek");
     state.status |= TRSDISK_SEEKERR;
@@ -3270,7 +3349,6 @@ real_read(void)
   DiskState *d = &disk[state.curdrive];
   struct floppy_raw_cmd raw_cmd;
   int res, i, retry, new_status;
-  sigset_t set, oldset;
 
   /* Try once at each supported sector size */
   retry = 0;
@@ -3286,19 +3364,15 @@ real_read(void)
     raw_cmd.cmd[i++] = state.track;
     raw_cmd.cmd[i++] = state.curside;
     raw_cmd.cmd[i++] = state.sector;
-    raw_cmd.cmd[i++] = d->u.real.size_code;
+    raw_cmd.cmd[i++] = d->u.real->size_code;
     raw_cmd.cmd[i++] = 255;
     raw_cmd.cmd[i++] = 0x0a;
     raw_cmd.cmd[i++] = 0xff; /* unused */
     raw_cmd.cmd_count = i;
-    raw_cmd.data = (void*) d->u.real.buf;
-    raw_cmd.length = 128 << d->u.real.size_code;
-    sigemptyset(&set);
-    sigaddset(&set, SIGALRM);
-    sigprocmask(SIG_BLOCK, &set, &oldset);
+    raw_cmd.data = (void*) d->u.real->buf;
+    raw_cmd.length = 128 << d->u.real->size_code;
     trs_paused = 1;
     res = ioctl(fileno(d->file), FDRAWCMD, &raw_cmd);
-    sigprocmask(SIG_SETMASK, &oldset, NULL);
     if (res < 0) {
       real_error(d, raw_cmd.flags, "read");
       new_status |= TRSDISK_NOTFOUND;
@@ -3309,11 +3383,11 @@ real_read(void)
 	   internally in each other size before returning an error. */
 	if (trs_disk_debug_flags & DISKDEBUG_REALSIZE) {
 	  debug("real_read not fnd: side %d tk %d sec %d size 0%d phytk %d\n",
-		state.curside, state.track, state.sector, d->u.real.size_code,
+		state.curside, state.track, state.sector, d->u.real->size_code,
 		d->phytrack*d->real_step);
 	}
 #if SIZERETRY
-	d->u.real.size_code = (d->u.real.size_code + 1) % 4;
+	d->u.real->size_code = (d->u.real->size_code + 1) % 4;
 	if (++retry < 4) {
 	  continue; /* retry */
 	}
@@ -3343,7 +3417,7 @@ real_read(void)
 	/* Start read */
 	state.status = TRSDISK_BUSY;
 	trs_schedule_event(trs_disk_firstdrq, new_status, 64);
-	state.bytecount = size_code_to_size(d->u.real.size_code);
+	state.bytecount = size_code_to_size(d->u.real->size_code);
 	return;
       }
     }
@@ -3364,7 +3438,6 @@ real_write(void)
   DiskState *d = &disk[state.curdrive];
   struct floppy_raw_cmd raw_cmd;
   int res, i = 0;
-  sigset_t set, oldset;
 
   state.status = 0;
   memset(&raw_cmd, 0, sizeof(raw_cmd));
@@ -3391,19 +3464,15 @@ real_write(void)
   raw_cmd.cmd[i++] = state.track;
   raw_cmd.cmd[i++] = state.curside;
   raw_cmd.cmd[i++] = state.sector;
-  raw_cmd.cmd[i++] = d->u.real.size_code;
+  raw_cmd.cmd[i++] = d->u.real->size_code;
   raw_cmd.cmd[i++] = 255;
   raw_cmd.cmd[i++] = 0x0a;
   raw_cmd.cmd[i++] = 0xff; /* 256 */
   raw_cmd.cmd_count = i;
-  raw_cmd.data = (void*) d->u.real.buf;
-  raw_cmd.length = 128 << d->u.real.size_code;
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
+  raw_cmd.data = (void*) d->u.real->buf;
+  raw_cmd.length = 128 << d->u.real->size_code;
   trs_paused = 1;
   res = ioctl(fileno(d->file), FDRAWCMD, &raw_cmd);
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   if (res < 0) {
     real_error(d, raw_cmd.flags, "write");
     state.status |= TRSDISK_NOTFOUND;
@@ -3416,11 +3485,11 @@ real_write(void)
          it to try the next sector size next time. */
       if (trs_disk_debug_flags & DISKDEBUG_REALSIZE) {
 	debug("real_write not found: side %d tk %d sec %d size 0%d phytk %d\n",
-	      state.curside, state.track, state.sector, d->u.real.size_code,
+	      state.curside, state.track, state.sector, d->u.real->size_code,
 	      d->phytrack*d->real_step);
       }
 #if SIZERETRY
-      d->u.real.size_code = (d->u.real.size_code + 1) % 4;
+      d->u.real->size_code = (d->u.real->size_code + 1) % 4;
 #endif
     }
     if (raw_cmd.reply[1] & 0x81) state.status |= TRSDISK_NOTFOUND;
@@ -3457,7 +3526,6 @@ real_readadr(void)
   DiskState *d = &disk[state.curdrive];
   struct floppy_raw_cmd raw_cmd;
   int res, i, new_status;
-  sigset_t set, oldset;
 
   state.status = 0;
   new_status = 0;
@@ -3470,12 +3538,8 @@ real_readadr(void)
   raw_cmd.cmd_count = i;
   raw_cmd.data = NULL;
   raw_cmd.length = 0;
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
   trs_paused = 1;
   res = ioctl(fileno(d->file), FDRAWCMD, &raw_cmd);
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   state.bytecount = 0;
   if (res < 0) {
     real_error(d, raw_cmd.flags, "readadr");
@@ -3497,10 +3561,10 @@ real_readadr(void)
     if ((new_status & TRSDISK_NOTFOUND) == 0) {
       state.status = TRSDISK_BUSY;
       trs_schedule_event(trs_disk_firstdrq, new_status, 64);
-      memcpy(d->u.real.buf, &raw_cmd.reply[3], 4);
-      d->u.real.buf[4] = d->u.real.buf[5] = 0; /* CRC not emulated */
+      memcpy(d->u.real->buf, &raw_cmd.reply[3], 4);
+      d->u.real->buf[4] = d->u.real->buf[5] = 0; /* CRC not emulated */
       state.bytecount = 6;
-      d->u.real.size_code = d->u.real.buf[3]; /* update hint */
+      d->u.real->size_code = d->u.real->buf[3]; /* update hint */
       return;
     }
   }
@@ -3526,7 +3590,6 @@ real_writetrk(void)
   DiskState *d = &disk[state.curdrive];
   struct floppy_raw_cmd raw_cmd;
   int res, i, gap3;
-  sigset_t set, oldset;
   state.status = 0;
 
   /* Compute a usable gap3 */
@@ -3538,23 +3601,23 @@ real_writetrk(void)
     /* MFM recording */
     if (d->inches == 5) {
       /* 5" DD = 250 kHz MFM */
-      gap3 = (TRKSIZE_DD - 161 - /*slop*/16)/(d->u.real.fmt_nbytes / 4)
-	- 62 - (128 << d->u.real.size_code) - /*slop*/2;
+      gap3 = (TRKSIZE_DD - 161 - /*slop*/16)/(d->u.real->fmt_nbytes / 4)
+	- 62 - (128 << d->u.real->size_code) - /*slop*/2;
     } else {
       /* 8" DD = 5" HD = 500 kHz MFM */
-      gap3 = (TRKSIZE_8DD - 161 - /*slop*/16)/(d->u.real.fmt_nbytes / 4)
-	- 62 - (128 << d->u.real.size_code) - /*slop*/2;
+      gap3 = (TRKSIZE_8DD - 161 - /*slop*/16)/(d->u.real->fmt_nbytes / 4)
+	- 62 - (128 << d->u.real->size_code) - /*slop*/2;
     }
   } else {
     /* FM recording */
     if (d->inches == 5) {
       /* 5" SD = 250 kHz FM (125 kbps) */
-      gap3 = (TRKSIZE_SD - 99 - /*slop*/16)/(d->u.real.fmt_nbytes / 4)
-	- 33 - (128 << d->u.real.size_code) - /*slop*/2;
+      gap3 = (TRKSIZE_SD - 99 - /*slop*/16)/(d->u.real->fmt_nbytes / 4)
+	- 33 - (128 << d->u.real->size_code) - /*slop*/2;
     } else {
       /* 8" SD = 5" HD operated in FM = 500 kHz FM (250 kbps) */
-      gap3 = (TRKSIZE_8SD - 99 - /*slop*/16)/(d->u.real.fmt_nbytes / 4)
-	- 33 - (128 << d->u.real.size_code) - /*slop*/2;
+      gap3 = (TRKSIZE_8SD - 99 - /*slop*/16)/(d->u.real->fmt_nbytes / 4)
+	- 33 - (128 << d->u.real->size_code) - /*slop*/2;
     }
   }
   if (gap3 < 1) {
@@ -3571,31 +3634,27 @@ real_writetrk(void)
   i = 0;
   raw_cmd.cmd[i++] = 0x0d | (state.density ? 0x40 : 0x00);
   raw_cmd.cmd[i++] = state.curside ? 4 : 0;
-  raw_cmd.cmd[i++] = d->u.real.size_code;
-  raw_cmd.cmd[i++] = d->u.real.fmt_nbytes / 4;
+  raw_cmd.cmd[i++] = d->u.real->size_code;
+  raw_cmd.cmd[i++] = d->u.real->fmt_nbytes / 4;
   raw_cmd.cmd[i++] = gap3;
-  raw_cmd.cmd[i++] = d->u.real.fmt_fill;
+  raw_cmd.cmd[i++] = d->u.real->fmt_fill;
   raw_cmd.cmd_count = i;
-  raw_cmd.data = (void*) d->u.real.buf;
-  raw_cmd.length = d->u.real.fmt_nbytes;
+  raw_cmd.data = (void*) d->u.real->buf;
+  raw_cmd.length = d->u.real->fmt_nbytes;
   
   if (trs_disk_debug_flags & DISKDEBUG_GAPS) {
     debug("real_writetrk size 0%d secs %d gap3 %d fill 0x%02x hex data ",
-	  d->u.real.size_code, d->u.real.fmt_nbytes/4, gap3,
-	  d->u.real.fmt_fill);
-    for (i=0; i<d->u.real.fmt_nbytes; i+=4) {
-      debug("%02x%02x%02x%02x ", d->u.real.buf[i], d->u.real.buf[i+1],
-	    d->u.real.buf[i+2], d->u.real.buf[i+3]);
+	  d->u.real->size_code, d->u.real->fmt_nbytes/4, gap3,
+	  d->u.real->fmt_fill);
+    for (i=0; i<d->u.real->fmt_nbytes; i+=4) {
+      debug("%02x%02x%02x%02x ", d->u.real->buf[i], d->u.real->buf[i+1],
+	    d->u.real->buf[i+2], d->u.real->buf[i+3]);
     }
     debug("\n");
   }
 
-  sigemptyset(&set);
-  sigaddset(&set, SIGALRM);
-  sigprocmask(SIG_BLOCK, &set, &oldset);
   trs_paused = 1;
   res = ioctl(fileno(d->file), FDRAWCMD, &raw_cmd);
-  sigprocmask(SIG_SETMASK, &oldset, NULL);
   if (res < 0) {
     real_error(d, raw_cmd.flags, "writetrk");
     state.status |= TRSDISK_WRITEFLT;
@@ -48,6 +48,7 @@ int trs_disk_getsize(int unit);
 int trs_disk_init_with(FILE *f, int emutype,
 		       int sides, int density, int eight, int ignden);
 int trs_disk_set_write_prot(FILE *f, int emutype, int writeprot);
+FILE *trs_hostdir_open(const char *dirname, int *writeprot);
 
 extern int trs_disk_doubler;
 extern char* trs_disk_dir;
@@ -51,6 +51,11 @@
 #include "trs_disk.h"
 #include "trs_uart.h"
 #include "keyrepeat.h"
+#include "trs_stats.h"
+#include "z80_trace.h"
+#include "z80_coverage.h"
+#include "trs_replay.h"
+#include "trs_screentext.h"
 
 /*#define MOUSEDEBUG 6*/
 /*#define KDEBUG 1*/
@@ -99,7 +104,9 @@ static GdkPixmap *trs_box[2][64];
 /* True size of graphics memory -- some is offscreen */
 #define G_XSIZE 128
 #define G_YSIZE 256
-unsigned char grafyx_unscaled[G_YSIZE][G_XSIZE];
+/* Allocated by grafyx_init() when the emulated program first uses
+   the card */
+unsigned char (*grafyx_unscaled)[G_XSIZE];
 GdkImage *grafyx_image;
 
 int grafyx_microlabs = 0;
@@ -128,7 +135,7 @@ unsigned char grafyx_xoffset = 0, grafyx_yoffset = 0;
 void grafyx_init(void);
 
 #define HRG_MEMSIZE (1024 * 12)	/* 12k * 8 bit graphics memory */
-static unsigned char hrg_screen[HRG_MEMSIZE];
+static unsigned char *hrg_screen; /* allocated by hrg_alloc() */
 static int hrg_pixel_x[2][6+1];
 static int hrg_pixel_y[12+1];
 static int hrg_pixel_width[2][6];
@@ -298,6 +305,8 @@ char *opt_scale = NULL;
 int opt_stepdefault = 1;
 char *opt_stepmap = NULL;
 char *opt_sizemap = NULL;
+char *opt_profile = NULL;
+char *opt_profilesyms = NULL;
 
 struct option options[] = {
   /* Name, takes argument?, store int value at, value to store */
@@ -335,6 +344,7 @@ struct option options[] = {
   {"noautodelay",    FALSE, &trs_autodelay,    FALSE },
   {"keystretch",     TRUE,  NULL,              0     },
   {"keydelay",       TRUE,  NULL,              0     },
+  {"typein",         TRUE,  NULL,              0     },
   {"shiftbracket",   FALSE, &opt_shiftbracket, TRUE  },
   {"noshiftbracket", FALSE, &opt_shiftbracket, FALSE },
   {"diskdir",        TRUE,  NULL,              0     },
@@ -346,8 +356,32 @@ struct option options[] = {
   {"truedam",        FALSE, &trs_disk_truedam, TRUE  },
   {"notruedam",      FALSE, &trs_disk_truedam, FALSE },
   {"samplerate",     TRUE,  NULL,              0     },
+  {"fastcassette",   FALSE, &trs_cassette_fast, TRUE },
+  {"nofastcassette", FALSE, &trs_cassette_fast, FALSE },
   {"serial",         TRUE,  NULL,              0     },
   {"switches",       TRUE,  NULL,              0     },
+  {"fastserial",     FALSE, &trs_uart_fast,    TRUE  },
+  {"nofastserial",   FALSE, &trs_uart_fast,    FALSE },
+  {"jit",            FALSE, &z80_jit_enabled,  TRUE  },
+  {"nojit",          FALSE, &z80_jit_enabled,  FALSE },
+  {"profile",        TRUE,  NULL,              0     },
+  {"profilesyms",    TRUE,  NULL,              0     },
+  {"trace",          TRUE,  NULL,              0     },
+  {"tracesize",      TRUE,  NULL,              0     },
+  {"coverage",       TRUE,  NULL,              0     },
+  {"coveragedata",   FALSE, &z80_coverage_data, TRUE },
+  {"nocoveragedata", FALSE, &z80_coverage_data, FALSE },
+  {"run",            TRUE,  NULL,              0     },
+  {"runexit",        FALSE, &trs_run_exit,     TRUE  },
+  {"norunexit",      FALSE, &trs_run_exit,     FALSE },
+  {"gdb",            TRUE,  NULL,              0     },
+  {"record",         TRUE,  NULL,              0     },
+  {"replay",         TRUE,  NULL,              0     },
+  {"stats",          TRUE,  NULL,              0     },
+  {"statsinterval",  TRUE,  NULL,              0     },
+  {"screenlog",      TRUE,  NULL,              0     },
+  {"screenmatch",    TRUE,  NULL,              0     },
+  {"screenmatchaction", TRUE, NULL,            0     },
   {"emtsafe",        FALSE, &trs_emtsafe,      TRUE  },
   {"noemtsafe",      FALSE, &trs_emtsafe,      FALSE },
   {"lowercase",      FALSE, &trs_lowercase,    TRUE  },
@@ -419,6 +453,8 @@ trs_parse_command_line(int argc, char **argv, int *debug)
       z80_state.delay = strtol(optarg, NULL, 0);
     } else if (strcmp(name, "keydelay") == 0) {
       trs_keydelay = strtol(optarg, NULL, 0);
+    } else if (strcmp(name, "typein") == 0) {
+      trs_kb_typein_name = strdup(optarg);
     } else if (strcmp(name, "keystretch") == 0) {
       stretch_amount = strtol(optarg, NULL, 0);
     } else if (strcmp(name, "diskdir") == 0) {
@@ -467,6 +503,34 @@ trs_parse_command_line(int argc, char **argv, int *debug)
       trs_uart_switches = strtol(optarg, NULL, 0);
     } else if (strcmp(name, "year") == 0) {
       trs_inityear(strtol(optarg, NULL, 0));
+    } else if (strcmp(name, "profile") == 0) {
+      opt_profile = optarg;
+    } else if (strcmp(name, "profilesyms") == 0) {
+      opt_profilesyms = optarg;
+    } else if (strcmp(name, "trace") == 0) {
+      z80_trace_name = strdup(optarg);
+    } else if (strcmp(name, "tracesize") == 0) {
+      z80_trace_size = strtol(optarg, NULL, 0);
+    } else if (strcmp(name, "coverage") == 0) {
+      z80_coverage_name = strdup(optarg);
+    } else if (strcmp(name, "run") == 0) {
+      trs_run_name = strdup(optarg);
+    } else if (strcmp(name, "gdb") == 0) {
+      z80_gdb_name = strdup(optarg);
+    } else if (strcmp(name, "record") == 0) {
+      trs_record_name = strdup(optarg);
+    } else if (strcmp(name, "replay") == 0) {
+      trs_replay_name = strdup(optarg);
+    } else if (strcmp(name, "stats") == 0) {
+      trs_stats_name = strdup(optarg);
+    } else if (strcmp(name, "statsinterval") == 0) {
+      trs_stats_interval = strtol(optarg, NULL, 0);
+    } else if (strcmp(name, "screenlog") == 0) {
+      trs_screentext_name = strdup(optarg);
+    } else if (strcmp(name, "screenmatch") == 0) {
+      trs_screentext_match = strdup(optarg);
+    } else if (strcmp(name, "screenmatchaction") == 0) {
+      trs_screentext_action = strdup(optarg);
     }
   }
   if (optind != argc) {
@@ -479,6 +543,8 @@ trs_parse_command_line(int argc, char **argv, int *debug)
    */
   *debug = opt_debug;
 
+  z80_profile_init(opt_profile, opt_profilesyms);
+
   if (resize == -1) {
     resize = (trs_model == 3);
   }
@@ -583,7 +649,7 @@ trs_parse_command_line(int argc, char **argv, int *debug)
 
 void trs_exit(void)
 {
-  gtk_exit(0);
+  gtk_exit(trs_exit_status);
 }
 
 
@@ -715,8 +781,6 @@ trs_screen_init(void)
   boxes_init(cur_char_width, TRS_CHAR_HEIGHT * scale_y, 0);
   boxes_init(cur_char_width * 2, TRS_CHAR_HEIGHT * scale_y, 1);
 
-  grafyx_init();
-
   gtk_settings_set_string_property (gtk_settings_get_default (),
 				    "gtk-menu-bar-accel", "F12", NULL);
 
@@ -733,6 +797,7 @@ trs_screen_write_char(int position, int char_index)
   if (position >= screen_chars) {
     return;
   }
+  trs_stats.display_chars++;
   if ((currentmode & EXPANDED) && (position & 1)) {
     return;
   }
@@ -808,6 +873,8 @@ trs_screen_refresh(void)
   int i;
   int srcx, srcy, dunx, duny;
 
+  trs_stats.display_refreshes++;
+
   if (grafyx_enable && !grafyx_overlay) {
     srcx = cur_char_width * grafyx_xoffset;
     srcy = scale_y * grafyx_yoffset;
@@ -878,6 +945,16 @@ void trs_screen_scroll(void)
   }
 }
 
+/* The text screen, for trs_screentext */
+const unsigned char *trs_screen_contents(int *rows_out, int *cols_out,
+					 int *mode)
+{
+  *rows_out = row_chars;
+  *cols_out = col_chars;
+  *mode = currentmode;
+  return trs_screen;
+}
+
 
 void trs_screen_expanded(int flag)
 {
@@ -966,28 +1043,24 @@ void trs_screen_80x24(int flag)
  *   If wait is true, we think there's nothing to do right now and
  *   want to give up the CPU until there is something to do.
  *   Unfortunately we can't simply call gtk_main_iteration_do in
- *   blocking mode, because (currently) we don't timer ticks via GTK.
- *   Instead, trs_interrupt.c uses an itimer and gets a SIGALRM
- *   callback, and that doesn't cause gtk_main_iteration_do to
- *   unblock.  So instead we pause() and then call
- *   gtk_main_iteration_do in nonblocking mode.
+ *   blocking mode, because (currently) we don't get timer ticks via
+ *   GTK.  Instead we wait in trs_timer_wait() for the next heartbeat
+ *   (or serial input) and then call gtk_main_iteration_do in
+ *   nonblocking mode.  GTK input is seen within one heartbeat.
  *
  *   If wait is false we definitely don't want to block for events.
  *
- * Handle interrupt-driven uart input here too.
- *
  */ 
 void trs_get_event(int wait)
 {
-  if (trs_model > 1) {
-    (void)trs_uart_check_avail();
-  }
-  if (wait) {
-    pause();
+  trs_stats.display_polls++;
+  if (wait && !gtk_events_pending()) {
+    trs_timer_wait(-1);
     trs_paused = 1;
   }
   do {
     gtk_main_iteration_do(FALSE);
+    trs_stats.display_events++;
   } while (gtk_events_pending());
 }
 
@@ -996,14 +1069,14 @@ void
 on_reset_menu_item_activate(GtkMenuItem *menuitem,
 			    gpointer user_data)
 {
-  trs_reset(0);
+  trs_user_reset(0);
 }
 
 void
 on_hard_reset_menu_item_activate(GtkMenuItem *menuitem,
 				 gpointer user_data)
 {
-  trs_reset(1);
+  trs_user_reset(1);
 }
 
 void
@@ -1324,6 +1397,8 @@ void grafyx_write_byte(int x, int y, char byte)
   int on_screen = screen_x < row_chars &&
     screen_y < col_chars*cur_char_height/scale_y;
 
+  trs_stats.display_graphics++;
+  grafyx_init();
   if (grafyx_enable && grafyx_overlay && on_screen) {
     /* Erase old byte, preserving text */
     gdk_draw_image(trs_screen_pixmap, gc_xor, grafyx_image,
@@ -1375,9 +1450,9 @@ void grafyx_write_byte(int x, int y, char byte)
 
 void grafyx_init(void)
 {
-  int x, y;
   gpointer data;
 
+  if (grafyx_image != NULL) return;
   /*
    * The "deprecated" and "broken" function gdk_image_new_bitmap is
    * the only way I can find to create a GdkImage with depth 1.
@@ -1386,15 +1461,15 @@ void grafyx_init(void)
    * gdk_draw_image (like XPutImage) colorizes them while drawing,
    * using the colors from the supplied gc.
    */
-  data = malloc(G_XSIZE * scale_x * G_YSIZE * scale_y); //not g_malloc()!
+  data = calloc(G_XSIZE * scale_x, G_YSIZE * scale_y); //not g_malloc()!
+  grafyx_unscaled = calloc(G_YSIZE, sizeof(grafyx_unscaled[0]));
+  if (data == NULL || grafyx_unscaled == NULL) {
+    fatal("out of memory for graphics screen");
+  }
   grafyx_image = gdk_image_new_bitmap(gdk_visual_get_system(), data, 
 				      G_XSIZE * 8 * scale_x, G_YSIZE * scale_y);
-
-  for (x = 0; x < G_XSIZE; x++) {
-    for (y = 0; y < G_YSIZE; y++) {
-      grafyx_write_byte(x, y, 0);
-    }
-  }
+  trs_stats.mem_bytes[STATS_MEM_GRAPHICS] +=
+    G_XSIZE * scale_x * G_YSIZE * scale_y + G_YSIZE * G_XSIZE;
 }
 
 void grafyx_write_x(int value)
@@ -1428,7 +1503,9 @@ void grafyx_write_data(int value)
 
 int grafyx_read_data(void)
 {
-  int value = grafyx_unscaled[grafyx_y][grafyx_x % G_XSIZE];
+  int value = 0;
+
+  if (grafyx_unscaled) value = grafyx_unscaled[grafyx_y][grafyx_x % G_XSIZE];
   if (!(grafyx_mode & G_XNOCLKR)) {
     if (grafyx_mode & G_XDEC) {
       grafyx_x--;
@@ -1452,6 +1529,7 @@ void grafyx_write_mode(int value)
   unsigned char old_overlay = grafyx_overlay;
 
   grafyx_enable = value & G_ENABLE;
+  if (grafyx_enable) grafyx_init();
   if (grafyx_microlabs) {
     grafyx_overlay = (value & G_UL_NOTEXT) == 0;
   }
@@ -1512,6 +1590,7 @@ void grafyx_m3_write_mode(int value)
 {
   int enable = (value & G3_ENABLE) != 0;
   int changed = (enable != grafyx_enable);
+  if (enable) grafyx_init();
   grafyx_enable = enable;
   grafyx_overlay = enable;
   grafyx_mode = value;
@@ -1536,7 +1615,7 @@ unsigned char grafyx_m3_read_byte(int position)
   if (grafyx_microlabs && (grafyx_mode & G3_COORD)) {
     int x = (position % 64);
     int y = (position / 64) * 12 + grafyx_y;
-    return grafyx_unscaled[y][x];
+    return grafyx_unscaled ? grafyx_unscaled[y][x] : 0;
   } else {
     return trs_screen[position];
   }
@@ -1626,6 +1705,16 @@ hrg_init(void)
 	  cur_char_width, cur_char_height);
 }
 
+/* Allocate the HRG memory when it is first used. */
+static void
+hrg_alloc(void)
+{
+  if (hrg_screen != NULL) return;
+  hrg_screen = calloc(HRG_MEMSIZE, 1);
+  if (hrg_screen == NULL) fatal("out of memory for HRG screen");
+  trs_stats.mem_bytes[STATS_MEM_GRAPHICS] += HRG_MEMSIZE;
+}
+
 /* Switch HRG on (1) or off (0). */
 void
 hrg_onoff(int enable)
@@ -1638,6 +1727,7 @@ hrg_onoff(int enable)
     hrg_init();
     init = 1;
   }
+  if (enable) hrg_alloc();
   hrg_enable = enable;
   trs_screen_refresh();
 }
@@ -1658,6 +1748,7 @@ hrg_write_data(int data)
   int bits0, bits1;
 
   if (hrg_addr >= HRG_MEMSIZE) return; /* nonexistent address */
+  hrg_alloc();
   old_data = hrg_screen[hrg_addr];
   hrg_screen[hrg_addr] = data;
 
@@ -1745,7 +1836,7 @@ int
 hrg_read_data(void)
 {
   if (hrg_addr >= HRG_MEMSIZE) return 0xff; /* nonexistent address */
-  return hrg_screen[hrg_addr];
+  return hrg_screen ? hrg_screen[hrg_addr] : 0;
 }
 
 /* Update graphics at given screen position.
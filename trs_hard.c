@@ -33,8 +33,10 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "trs.h"
 #include "trs_hard.h"
+#include "trs_stats.h"
 #include "reed.h"
 
 /*#define HARDDEBUG1 1*/  /* show detail on all port i/o */
@@ -52,6 +54,10 @@ typedef struct {
   int cyls;  /* cyls per drive */
   int heads; /* tracks per cyl */
   int secs;  /* secs per track */
+  /* Sparse image track allocation table (see reed.h), or NULL if flat */
+  Ushort *map;
+  int used;  /* tracks allocated so far */
+  long base; /* file offset of the first sector */
 } Drive;
 
 /* Structure describing controller state */
@@ -74,6 +80,9 @@ typedef struct {
   /* Number of bytes already done in current read/write */
   int bytesdone;
 
+  /* Current sector is in a sparse image track not yet allocated */
+  int hole;
+
   /* Drive geometries and files */
   Drive d[TRS_HARD_MAXDRIVES];
 } State;
@@ -93,6 +102,7 @@ static void hard_seek(int cmd);
 static int open_drive(int drive);
 static int reopen_drive(int drive);
 static int find_sector(int newstatus);
+static int sparse_alloc(Drive *d);
 static void set_dir_cyl(int cyl);
 
 /* xtrs one-time initialization */
@@ -147,7 +157,7 @@ trs_hard_create(const char *name)
   /*
    * Default parameters
    */
-  ires = trs_hard_init_with(f, -1, -1, -1, -1);
+  ires = trs_hard_init_with(f, -1, -1, -1, -1, 0);
   if (ires < 0) return errno;
 
   ires = fclose(f);
@@ -200,6 +210,7 @@ int trs_hard_in(int port)
       v = state.control;
       break;
     case TRS_HARD_DATA:
+      trs_stats.hard_bytes[state.drive]++;
       v = hard_data_in();
       break;
     case TRS_HARD_ERROR:
@@ -256,6 +267,7 @@ void trs_hard_out(int port, int value)
     state.control = value;
     break;
   case TRS_HARD_DATA:
+    trs_stats.hard_bytes[state.drive]++;
     hard_data_out(value);
     break;
   case TRS_HARD_PRECOMP:
@@ -330,6 +342,7 @@ static void hard_restore(int cmd)
 #if HARDDEBUG2
   debug("hard_restore drive %d\n", state.drive);
 #endif
+  trs_stats.hard_seeks[state.drive]++;
   state.cyl = 0;
   /*!! should anything else be zeroed? */
   state.status = TRS_HARD_READY | TRS_HARD_SEEKDONE;
@@ -409,6 +422,7 @@ static void hard_seek(int cmd)
   debug("hard_seek drive %d cyl %d hd %d sec %d\n",
 	state.drive, state.cyl, state.head, state.secnum);
 #endif
+  trs_stats.hard_seeks[state.drive]++;
   find_sector(TRS_HARD_READY | TRS_HARD_SEEKDONE);
 }
 
@@ -427,6 +441,8 @@ static int reopen_drive(int drive)
     fclose(d->file);
     d->file = NULL;
   }
+  free(d->map);
+  d->map = NULL;
 
   return open_drive(drive);
 }
@@ -497,12 +513,40 @@ static int open_drive(int drive)
     goto fail;
   }
 
+  d->base = sizeof(rhh);
+  if (rhh.flag2 & REED_SPARSE) {
+    /* Read the track allocation table that follows the header */
+    int i, ntracks = d->cyls * d->heads;
+    if (rhh.blks * 256 < (int) sizeof(rhh) + 2 * ntracks) {
+      error("trs_hard: allocation table too short in image %s", d->name);
+      err = -1;
+      goto fail;
+    }
+    d->map = (Ushort *) malloc(ntracks * sizeof(Ushort));
+    if (d->map == NULL) {
+      err = ENOMEM;
+      goto fail;
+    }
+    d->used = 0;
+    for (i = 0; i < ntracks; i++) {
+      if (get_twobyte(&d->map[i], d->file) < 0) {
+	error("trs_hard: allocation table truncated in image %s", d->name);
+	err = -1;
+	goto fail;
+      }
+      if (d->map[i] > d->used) d->used = d->map[i];
+    }
+    d->base = rhh.blks * 256L;
+  }
+
   state.status = TRS_HARD_READY | TRS_HARD_SEEKDONE;
   return 0;
 
  fail:
   if (d->file) fclose(d->file);
   d->file = NULL;
+  free(d->map);
+  d->map = NULL;
   state.status = TRS_HARD_READY | TRS_HARD_SEEKDONE | TRS_HARD_ERR;
   state.error = TRS_HARD_NFERR;
   return err;
@@ -512,13 +556,18 @@ static int open_drive(int drive)
  * Check whether the current position is in bounds for the geometry.
  * If not, return 0 and set the controller error status.  If so, fseek
  * the file to the start of the current sector, return 1, and set
- * the controller status to newstatus.
+ * the controller status to newstatus.  In a sparse image, a sector
+ * whose track has not been written yet is a hole: it reads as zeros,
+ * and the track is allocated when the sector is written.
  */
 static int find_sector(int newstatus)
 {
   Drive *d = &state.d[state.drive];
+  int track;
+
   if (open_drive(state.drive) < 0) return 0;
   if (/**state.cyl >= d->cyls ||**/ /* ignore this limit */
+      (d->map != NULL && state.cyl >= d->cyls) || /* unless sparse */
       state.head >= d->heads ||
       state.secnum > d->secs /* allow 0-origin or 1-origin */ ) {
     error("trs_hard: requested cyl %d hd %d sec %d; max cyl %d hd %d sec %d\n",
@@ -527,23 +576,52 @@ static int find_sector(int newstatus)
     state.error = TRS_HARD_NFERR;
     return 0;
   }
-  fseek(d->file,
-	sizeof(ReedHardHeader) +
-	TRS_HARD_SECSIZE * (state.cyl * d->heads * d->secs +
-			    state.head * d->secs +
-			    (state.secnum % d->secs)),
-	0);
+  track = state.cyl * d->heads + state.head;
+  state.hole = 0;
+  if (d->map == NULL) {
+    fseek(d->file, d->base +
+	  TRS_HARD_SECSIZE * ((long) track * d->secs +
+			      (state.secnum % d->secs)),
+	  0);
+  } else if (d->map[track] == 0) {
+    state.hole = 1;
+  } else {
+    fseek(d->file, d->base +
+	  (long) (d->map[track] - 1) * REED_SPARSE_TRACK +
+	  TRS_HARD_SECSIZE * (state.secnum % d->secs),
+	  0);
+  }
   state.status = newstatus;
   return 1;
 }
 
+/*
+ * Give the current track of a sparse image space at the end of the
+ * file and record it in the allocation table, then fseek to the
+ * current sector.  Returns EOF on error.
+ */
+static int sparse_alloc(Drive *d)
+{
+  int track = state.cyl * d->heads + state.head;
+  long where = d->base + (long) d->used * REED_SPARSE_TRACK;
+
+  if (fflush(d->file) == EOF) return EOF;
+  if (ftruncate(fileno(d->file), where + REED_SPARSE_TRACK) < 0) return EOF;
+  fseek(d->file, sizeof(ReedHardHeader) + 2 * track, 0);
+  if (put_twobyte(d->used + 1, d->file) < 0) return EOF;
+  d->map[track] = ++d->used;
+  state.hole = 0;
+  return fseek(d->file, where + TRS_HARD_SECSIZE * (state.secnum % d->secs),
+	       0);
+}
+
 static int hard_data_in(void)
 {
   Drive *d = &state.d[state.drive];
   if ((state.command & TRS_HARD_CMDMASK) == TRS_HARD_READ &&
       (state.status & TRS_HARD_ERR) == 0) {
     if (state.bytesdone < TRS_HARD_SECSIZE) {
-      state.data = getc(d->file);
+      state.data = state.hole ? 0 : getc(d->file);
       state.bytesdone++;
     }
   }
@@ -558,11 +636,14 @@ static void hard_data_out(int value)
   if ((state.command & TRS_HARD_CMDMASK) == TRS_HARD_WRITE &&
       (state.status & TRS_HARD_ERR) == 0) {
     if (state.bytesdone < TRS_HARD_SECSIZE) {
+      if (state.hole) {
+	res = sparse_alloc(d);
+      }
       if (state.cyl == 0 && state.head == 0 &&
 	  state.secnum == 0 && state.bytesdone == 2) {
 	set_dir_cyl(value);
       }
-      res = putc(state.data, d->file);
+      if (res != EOF) res = putc(state.data, d->file);
       state.bytesdone++;
       if (res != EOF && state.bytesdone == TRS_HARD_SECSIZE) {
 	res = fflush(d->file);
@@ -0,0 +1,343 @@
+/* 
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * trs_headless.c -- display, keyboard, and mouse interface for running
+ * the emulator without a window, as used by libxtrs.  It implements
+ * the same entry points as trs_xinterface.c.  Video memory changes
+ * are passed to the embedding program through trs_screen_hook, and
+ * graphics card memory is kept so that it can be read back.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trs.h"
+#include "trs_stats.h"
+
+/* Private data */
+static unsigned char trs_screen[2048];
+static int screen_chars = 1024;
+static int currentmode = NORMAL;
+static int text80x24 = 0;
+
+/* Grafyx Solution and Radio Shack hi-res card */
+#define G_XSIZE 128
+#define G_YSIZE 256
+#define G_ENABLE    1
+#define G_UL_NOTEXT 2   /* Micro Labs only */
+#define G_XDEC      4
+#define G_YDEC      8
+#define G_XNOCLKR   16
+#define G_YNOCLKR   32
+#define G_XNOCLKW   64
+#define G_YNOCLKW   128
+#define G3_COORD    0x80
+#define G3_ENABLE   0x40
+#define G3_YLOW(v)  (((v)&0x1e)>>1)
+
+static unsigned char (*grafyx_unscaled)[G_XSIZE]; /* see grafyx_alloc() */
+static unsigned char grafyx_microlabs = 0;
+static unsigned char grafyx_x = 0, grafyx_y = 0, grafyx_mode = 0;
+static unsigned char grafyx_enable = 0;
+static unsigned char grafyx_overlay = 0;
+
+/* HRG1B */
+#define HRG_MEMSIZE (1024 * 12)
+static unsigned char *hrg_screen; /* allocated on first write */
+static int hrg_addr = 0;
+
+void trs_exit(void)
+{
+  trs_exit_request();
+}
+
+void trs_screen_init(void)
+{
+  memset(trs_screen, ' ', sizeof(trs_screen));
+  clear_key_queue();
+}
+
+/*
+ * There is no window to service, so never block: when the emulator
+ * would wait for input, it just keeps running.
+ */
+void trs_get_event(int wait)
+{
+  if (wait) {
+    trs_paused = 1;
+    trs_skip_next_kbwait();
+  }
+}
+
+void trs_screen_write_char(int position, int char_index)
+{
+  trs_screen[position] = char_index;
+  if (trs_screen_hook && position < screen_chars) {
+    trs_screen_hook(position, char_index);
+  }
+}
+
+void trs_screen_refresh(void)
+{
+  int i;
+  if (trs_screen_hook == NULL) return;
+  for (i = 0; i < screen_chars; i++) {
+    trs_screen_hook(i, trs_screen[i]);
+  }
+}
+
+void trs_screen_scroll(void)
+{
+  int i;
+  for (i = 64; i < 1024; i++) {
+    trs_screen_write_char(i - 64, trs_screen[i]);
+  }
+}
+
+const unsigned char *trs_screen_contents(int *rows_out, int *cols_out,
+					 int *mode)
+{
+  *rows_out = text80x24 ? 80 : 64;
+  *cols_out = text80x24 ? 24 : 16;
+  *mode = currentmode;
+  return trs_screen;
+}
+
+void trs_screen_expanded(int flag)
+{
+  currentmode = (currentmode & ~EXPANDED) | (flag ? EXPANDED : 0);
+}
+
+void trs_screen_inverse(int flag)
+{
+  currentmode = (currentmode & ~INVERSE) | (flag ? INVERSE : 0);
+}
+
+void trs_screen_alternate(int flag)
+{
+  currentmode = (currentmode & ~ALTERNATE) | (flag ? ALTERNATE : 0);
+}
+
+void trs_screen_80x24(int flag)
+{
+  text80x24 = flag;
+  screen_chars = flag ? 80*24 : 64*16;
+}
+
+void grafyx_write_x(int value)
+{
+  grafyx_x = value;
+}
+
+void grafyx_write_y(int value)
+{
+  grafyx_y = value;
+}
+
+/* Graphics memory is allocated when the emulated program first
+   writes to it; until then it reads as zero. */
+static void grafyx_alloc(void)
+{
+  if (grafyx_unscaled != NULL) return;
+  grafyx_unscaled = calloc(G_YSIZE, sizeof(grafyx_unscaled[0]));
+  if (grafyx_unscaled == NULL) fatal("out of memory for graphics screen");
+  trs_stats.mem_bytes[STATS_MEM_GRAPHICS] += G_YSIZE * G_XSIZE;
+}
+
+void grafyx_write_data(int value)
+{
+  grafyx_alloc();
+  grafyx_unscaled[grafyx_y][grafyx_x % G_XSIZE] = value;
+  if (!(grafyx_mode & G_XNOCLKW)) {
+    if (grafyx_mode & G_XDEC) {
+      grafyx_x--;
+    } else {
+      grafyx_x++;
+    }
+  }
+  if (!(grafyx_mode & G_YNOCLKW)) {
+    if (grafyx_mode & G_YDEC) {
+      grafyx_y--;
+    } else {
+      grafyx_y++;
+    }
+  }
+}
+
+int grafyx_read_data(void)
+{
+  int value = 0;
+
+  if (grafyx_unscaled) value = grafyx_unscaled[grafyx_y][grafyx_x % G_XSIZE];
+  if (!(grafyx_mode & G_XNOCLKR)) {
+    if (grafyx_mode & G_XDEC) {
+      grafyx_x--;
+    } else {
+      grafyx_x++;
+    }
+  }
+  if (!(grafyx_mode & G_YNOCLKR)) {
+    if (grafyx_mode & G_YDEC) {
+      grafyx_y--;
+    } else {
+      grafyx_y++;
+    }
+  }
+  return value;
+}
+
+void grafyx_write_mode(int value)
+{
+  grafyx_enable = value & G_ENABLE;
+  if (grafyx_microlabs) {
+    grafyx_overlay = (value & G_UL_NOTEXT) == 0;
+  }
+  grafyx_mode = value;
+}
+
+void grafyx_write_xoffset(int value)
+{
+}
+
+void grafyx_write_yoffset(int value)
+{
+}
+
+void grafyx_write_overlay(int value)
+{
+  grafyx_overlay = value & 1;
+}
+
+int grafyx_get_microlabs(void)
+{
+  return grafyx_microlabs;
+}
+
+void grafyx_set_microlabs(int on_off)
+{
+  grafyx_microlabs = on_off;
+}
+
+void grafyx_m3_reset(void)
+{
+  if (grafyx_microlabs) grafyx_m3_write_mode(0);
+}
+
+void grafyx_m3_write_mode(int value)
+{
+  grafyx_enable = (value & G3_ENABLE) != 0;
+  grafyx_overlay = grafyx_enable;
+  grafyx_mode = value;
+  grafyx_y = G3_YLOW(value);
+}
+
+int grafyx_m3_write_byte(int position, int byte)
+{
+  if (grafyx_microlabs && (grafyx_mode & G3_COORD)) {
+    int x = (position % 64);
+    int y = (position / 64) * 12 + grafyx_y;
+    grafyx_alloc();
+    grafyx_unscaled[y][x] = byte;
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+unsigned char grafyx_m3_read_byte(int position)
+{
+  if (grafyx_microlabs && (grafyx_mode & G3_COORD)) {
+    int x = (position % 64);
+    int y = (position / 64) * 12 + grafyx_y;
+    return grafyx_unscaled ? grafyx_unscaled[y][x] : 0;
+  } else {
+    return trs_screen[position];
+  }
+}
+
+int grafyx_m3_active(void)
+{
+  return (trs_model == 3 && grafyx_microlabs && (grafyx_mode & G3_COORD));
+}
+
+void hrg_onoff(int enable)
+{
+}
+
+void hrg_write_addr(int addr, int mask)
+{
+  hrg_addr = (hrg_addr & ~mask) | (addr & mask);
+}
+
+void hrg_write_data(int data)
+{
+  if (hrg_addr >= HRG_MEMSIZE) return; /* nonexistent address */
+  if (hrg_screen == NULL) {
+    hrg_screen = calloc(HRG_MEMSIZE, 1);
+    if (hrg_screen == NULL) fatal("out of memory for HRG screen");
+    trs_stats.mem_bytes[STATS_MEM_GRAPHICS] += HRG_MEMSIZE;
+  }
+  hrg_screen[hrg_addr] = data;
+}
+
+int hrg_read_data(void)
+{
+  if (hrg_addr >= HRG_MEMSIZE) return 0xff; /* nonexistent address */
+  return hrg_screen ? hrg_screen[hrg_addr] : 0;
+}
+
+/* No mouse; report it as parked at the origin with no buttons down. */
+static int mouse_x_size = 640, mouse_y_size = 240;
+static unsigned int mouse_sens = 3;
+
+void trs_get_mouse_pos(int *x, int *y, unsigned int *buttons)
+{
+  *x = 0;
+  *y = 0;
+  *buttons = 7;
+}
+
+void trs_set_mouse_pos(int x, int y)
+{
+}
+
+void trs_get_mouse_max(int *x, int *y, unsigned int *sens)
+{
+  *x = mouse_x_size - 1;
+  *y = mouse_y_size - 1;
+  *sens = mouse_sens;
+}
+
+void trs_set_mouse_max(int x, int y, unsigned int sens)
+{
+  mouse_x_size = x + 1;
+  mouse_y_size = y + 1;
+  mouse_sens = sens;
+}
+
+int trs_get_mouse_type(void)
+{
+  return 1;
+}
@@ -0,0 +1,859 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * trs_hostdir.c -- present a host directory as an LDOS/TRSDOS 6 floppy.
+ *
+ * When a floppy drive's image name is a directory, trs_disk_change()
+ * opens it with trs_hostdir_open() instead of fopen().  That returns
+ * a stdio stream that reads and writes a JV3 image synthesized from
+ * the directory, so the floppy controller emulation sees an ordinary
+ * JV3 disk.
+ *
+ * The disk is single density with 10 sectors per track (2 granules
+ * of 5) in Model I mode, or double density with 18 sectors per track
+ * (3 granules of 6) otherwise, and has 40 to 80 cylinders.  The
+ * first granule holds a boot sector that only names the directory
+ * cylinder, which is in the middle of the disk.  At open, host files
+ * whose names fit the TRS-80's NAME/EXT form are laid out contiguously
+ * after it, and the GAT, HIT, and directory entries are built.  No
+ * file data is copied: a sector read is served from the host file.
+ *
+ * A guest write to a sector within a file's length goes straight to
+ * the host file.  Other sector writes are kept in memory.  When the
+ * guest writes a directory sector, each entry is compared with the
+ * host file it stands for.  New entries create host files, changed
+ * extents or lengths rewrite them from the disk's contents, renamed
+ * entries rename them, and freed entries delete them.
+ */
+
+#if __linux
+#define _GNU_SOURCE /* fopencookie(), pread(), scandir() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "z80.h"
+#include "trs.h"
+#include "trs_disk.h"
+
+#define HD_SECSIZE   256
+#define HD_IDS       2901	  /* JV3 sector ids in the header */
+#define HD_WPROT     (HD_IDS*3)	  /* JV3 write-protect byte */
+#define HD_SECSTART  (34*256)	  /* JV3 sector data follows the header */
+#define HD_MINCYL    40
+#define HD_MAXCYL    80
+#define HD_SLOTS     256	  /* directory entry codes (DECs) */
+#define HD_EXTENTS   4		  /* extents in a primary directory entry */
+#define HD_MAXRUN    32		  /* granules in one extent */
+
+/* Directory entry layout */
+#define DE_ATTR      0
+#define DE_EOF       3
+#define DE_LRL       4
+#define DE_NAME      5		  /* 8 bytes of name, 3 of extension */
+#define DE_UPDPW     16
+#define DE_ACCPW     18
+#define DE_ERN       20
+#define DE_EXTENT    22		  /* 5 pairs; 0xfe links, 0xff ends */
+#define DE_SIZE      32
+
+#define DA_FXDE      0x80	  /* extended entry */
+#define DA_SYS       0x40
+#define DA_INUSE     0x10
+#define DA_INVIS     0x08
+
+/* GAT layout */
+#define GAT_LOCKOUT  0x60
+#define GAT_VERSION  0xcb
+#define GAT_CYLS     0xcc	  /* cylinders beyond 35 */
+#define GAT_CONFIG   0xcd
+#define GAT_MASTERPW 0xce
+#define GAT_NAME     0xd0
+#define GAT_DATE     0xd8
+
+#define BLANK_PW     0x4296	  /* password hash of 8 blanks */
+#define MASTER_PW    0x42e0	  /* password hash of "PASSWORD" */
+
+typedef struct {
+  char *name;			  /* host file name, or NULL */
+  Uchar gname[11];		  /* TRS-80 name and extension */
+  int size;
+  int nsecs;
+  int *secs;			  /* disk sector of each file sector */
+} HostFile;
+
+typedef struct {
+  char *dir;
+  int writeprot;
+  int spt, gpt, spg;		  /* sectors/track, granules/track, sectors/gran */
+  int ncyl, dircyl, nsecs;
+  off_t pos;
+  Uchar header[HD_SECSTART];
+  Uchar **over;			  /* sector contents held in memory, or NULL */
+  int *owner;			  /* DEC of the file owning a sector, or -1 */
+  int *ownidx;			  /* which sector of that file it is */
+  int fd, fdslot;		  /* host file open for reading, or -1 */
+  HostFile file[HD_SLOTS];
+} HostDir;
+
+/* Hash a NAME/EXT for the HIT, as LDOS does */
+static int
+hd_hash(const Uchar *gname)
+{
+  int i, h = 0;
+
+  for (i = 0; i < 11; i++) {
+    h ^= gname[i];
+    h = ((h << 1) | (h >> 7)) & 0xff;
+  }
+  return h ? h : 1;
+}
+
+/* Convert a host file name to blank-padded NAME/EXT; 0 if it won't fit */
+static int
+hd_guest_name(const char *name, Uchar *gname)
+{
+  const char *dot = strrchr(name, '.');
+  int n = dot ? (int) (dot - name) : (int) strlen(name);
+  int e = dot ? (int) strlen(dot + 1) : 0;
+  int i;
+
+  if (n < 1 || n > 8 || e > 3 || (dot && e == 0)) return 0;
+  if (!isalpha((Uchar) name[0]) || (e && !isalpha((Uchar) dot[1]))) return 0;
+  memset(gname, ' ', 11);
+  for (i = 0; i < n; i++) {
+    if (!isalnum((Uchar) name[i])) return 0;
+    gname[i] = toupper((Uchar) name[i]);
+  }
+  for (i = 0; i < e; i++) {
+    if (!isalnum((Uchar) dot[1 + i])) return 0;
+    gname[8 + i] = toupper((Uchar) dot[1 + i]);
+  }
+  return 1;
+}
+
+/* Convert NAME/EXT to a new host file name; NULL if it isn't valid */
+static char *
+hd_host_name(const Uchar *gname)
+{
+  char buf[13], *p = buf, *name;
+  Uchar check[11];
+  int i;
+
+  for (i = 0; i < 8 && gname[i] != ' '; i++) *p++ = tolower(gname[i]);
+  if (gname[8] != ' ') {
+    *p++ = '.';
+    for (i = 8; i < 11 && gname[i] != ' '; i++) *p++ = tolower(gname[i]);
+  }
+  *p = '\0';
+  if (!hd_guest_name(buf, check) || memcmp(check, gname, 11) != 0) {
+    return NULL;
+  }
+  name = strdup(buf);
+  if (name == NULL) fatal("out of memory for host file name");
+  return name;
+}
+
+static const char *
+hd_path(HostDir *h, const char *name, char *buf)
+{
+  snprintf(buf, FILENAME_MAX, "%s/%s", h->dir, name);
+  return buf;
+}
+
+static int
+hd_valid_dec(HostDir *h, int dec)
+{
+  return (dec & 0x1f) < h->spt - 2;
+}
+
+static Uchar *
+hd_entry(HostDir *h, int dec)
+{
+  return h->over[h->dircyl * h->spt + 2 + (dec & 0x1f)] + (dec >> 5) * DE_SIZE;
+}
+
+static void
+hd_close_fd(HostDir *h)
+{
+  if (h->fd >= 0) close(h->fd);
+  h->fd = h->fdslot = -1;
+}
+
+static void
+hd_read_sector(HostDir *h, int n, Uchar *buf)
+{
+  char path[FILENAME_MAX];
+  int slot = h->owner[n];
+  ssize_t got = 0;
+
+  if (h->over[n]) {
+    memcpy(buf, h->over[n], HD_SECSIZE);
+    return;
+  }
+  if (slot < 0) {
+    memset(buf, 0xe5, HD_SECSIZE);
+    return;
+  }
+  if (h->fdslot != slot) {
+    hd_close_fd(h);
+    h->fd = open(hd_path(h, h->file[slot].name, path), O_RDONLY);
+    h->fdslot = slot;
+  }
+  if (h->fd >= 0) {
+    got = pread(h->fd, buf, HD_SECSIZE, (off_t) h->ownidx[n] * HD_SECSIZE);
+    if (got < 0) got = 0;
+  }
+  memset(buf + got, 0, HD_SECSIZE - got);
+}
+
+/* Find the disk sectors, in order, of the file with the given DEC */
+static int
+hd_extents(HostDir *h, int dec, int *secs)
+{
+  Uchar *e = hd_entry(h, dec);
+  int i, g, s, count, n = 0, links = 0;
+
+  for (i = 0; i < HD_EXTENTS + 1; i++) {
+    int b0 = e[DE_EXTENT + 2*i], b1 = e[DE_EXTENT + 2*i + 1];
+    if (b0 == 0xff) break;
+    if (b0 == 0xfe) {
+      if (!hd_valid_dec(h, b1) || ++links > HD_SLOTS) break;
+      e = hd_entry(h, b1);
+      i = -1;
+      continue;
+    }
+    if ((b1 >> 5) >= h->gpt) break;
+    g = b0 * h->gpt + (b1 >> 5);
+    for (count = (b1 & 0x1f) + 1; count > 0; count--, g++) {
+      if (g >= h->ncyl * h->gpt) return n;
+      for (s = 0; s < h->spg; s++) {
+	if (n == h->nsecs) return n;
+	secs[n++] = (g / h->gpt) * h->spt + (g % h->gpt) * h->spg + s;
+      }
+    }
+  }
+  return n;
+}
+
+/* Forget the host file behind a DEC */
+static void
+hd_forget(HostDir *h, int dec)
+{
+  HostFile *f = &h->file[dec];
+  int i;
+
+  if (h->fdslot == dec) hd_close_fd(h);
+  for (i = 0; i < f->nsecs; i++) {
+    if (h->owner[f->secs[i]] == dec) h->owner[f->secs[i]] = -1;
+  }
+  free(f->secs);
+  free(f->name);
+  memset(f, 0, sizeof(HostFile));
+}
+
+/* Rewrite a host file from its sectors on the disk, and take them over */
+static void
+hd_rewrite(HostDir *h, int dec, int *secs, int n, int size)
+{
+  char path[FILENAME_MAX];
+  HostFile *f = &h->file[dec];
+  Uchar *data = malloc(n * HD_SECSIZE + 1);
+  int i, fd;
+
+  if (data == NULL) fatal("out of memory for host file");
+  for (i = 0; i < n; i++) hd_read_sector(h, secs[i], data + i * HD_SECSIZE);
+  hd_close_fd(h);
+  hd_path(h, f->name, path);
+  fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+  if (fd < 0 || write(fd, data, size) != size) {
+    error("can't write %s: %s", path, strerror(errno));
+  }
+  if (fd >= 0) close(fd);
+  free(data);
+
+  for (i = 0; i < f->nsecs; i++) {
+    if (h->owner[f->secs[i]] == dec) h->owner[f->secs[i]] = -1;
+  }
+  f->secs = realloc(f->secs, (n + 1) * sizeof(int));
+  if (f->secs == NULL) fatal("out of memory for host file");
+  memcpy(f->secs, secs, n * sizeof(int));
+  f->nsecs = n;
+  f->size = size;
+  for (i = 0; i < n; i++) {
+    h->owner[secs[i]] = dec;
+    h->ownidx[secs[i]] = i;
+    free(h->over[secs[i]]);
+    h->over[secs[i]] = NULL;
+  }
+}
+
+/* The guest wrote the directory; bring the host files up to date */
+static void
+hd_sync(HostDir *h)
+{
+  char path[FILENAME_MAX], newpath[FILENAME_MAX];
+  struct stat st;
+  int *secs = malloc(h->nsecs * sizeof(int));
+  int dec, n, size;
+
+  if (secs == NULL) fatal("out of memory for host directory");
+  for (dec = 0; dec < HD_SLOTS; dec++) {
+    HostFile *f = &h->file[dec];
+    Uchar *e;
+    char *name;
+
+    /* BOOT/SYS and DIR/SYS are not host files */
+    if (!hd_valid_dec(h, dec) || dec == 0x00 || dec == 0x20) continue;
+    e = hd_entry(h, dec);
+    if (!(e[DE_ATTR] & DA_INUSE) || (e[DE_ATTR] & DA_FXDE)) {
+      if (f->name) {
+	if (unlink(hd_path(h, f->name, path)) < 0) {
+	  error("can't delete %s: %s", path, strerror(errno));
+	}
+	hd_forget(h, dec);
+      }
+      continue;
+    }
+    if (f->name == NULL || memcmp(f->gname, e + DE_NAME, 11) != 0) {
+      name = hd_host_name(e + DE_NAME);
+      if (name == NULL) continue;
+      if (f->name == NULL) {
+	f->size = -1;
+      } else {
+	hd_close_fd(h);
+	hd_path(h, f->name, path);
+	hd_path(h, name, newpath);
+	/* Never clobber another host file; keep the old name instead */
+	if (strcmp(name, f->name) != 0 && lstat(newpath, &st) == 0) {
+	  error("can't rename %s: %s already exists", path, newpath);
+	  free(name);
+	  name = f->name;
+	} else if (rename(path, newpath) < 0) {
+	  error("can't rename %s: %s", path, strerror(errno));
+	  free(name);
+	  name = f->name;
+	} else {
+	  free(f->name);
+	}
+      }
+      f->name = name;
+      memcpy(f->gname, e + DE_NAME, 11);
+    }
+
+    n = hd_extents(h, dec, secs);
+    size = (e[DE_ERN] + (e[DE_ERN + 1] << 8)) * HD_SECSIZE;
+    if (size > 0 && e[DE_EOF] != 0) size -= HD_SECSIZE - e[DE_EOF];
+    if (size > n * HD_SECSIZE) size = n * HD_SECSIZE;
+    n = (size + HD_SECSIZE - 1) / HD_SECSIZE;
+    if (size != f->size || n != f->nsecs ||
+	memcmp(secs, f->secs, n * sizeof(int)) != 0) {
+      hd_rewrite(h, dec, secs, n, size);
+    }
+  }
+  free(secs);
+}
+
+static int
+hd_write_sector(HostDir *h, int n, const Uchar *buf)
+{
+  char path[FILENAME_MAX];
+  int slot = h->owner[n];
+  int fd, len = 0;
+
+  if (slot >= 0) {
+    /* Write through the part that lies within the host file */
+    off_t off = (off_t) h->ownidx[n] * HD_SECSIZE;
+    len = h->file[slot].size - off;
+    if (len > HD_SECSIZE) len = HD_SECSIZE;
+    if (len > 0) {
+      fd = open(hd_path(h, h->file[slot].name, path), O_WRONLY);
+      if (fd < 0 || pwrite(fd, buf, len, off) != len) {
+	error("can't write %s: %s", path, strerror(errno));
+	if (fd >= 0) close(fd);
+	return -1;
+      }
+      close(fd);
+    }
+  }
+  if (len == HD_SECSIZE) {
+    free(h->over[n]);
+    h->over[n] = NULL;
+  } else {
+    if (h->over[n] == NULL) {
+      h->over[n] = malloc(HD_SECSIZE);
+      if (h->over[n] == NULL) fatal("out of memory for host directory");
+    }
+    memcpy(h->over[n], buf, HD_SECSIZE);
+    if (n / h->spt == h->dircyl) hd_sync(h);
+  }
+  return 0;
+}
+
+static ssize_t
+hd_read(HostDir *h, Uchar *buf, size_t size)
+{
+  Uchar sec[HD_SECSIZE];
+  size_t done = 0;
+  off_t end = HD_SECSTART + (off_t) h->nsecs * HD_SECSIZE;
+  int n, off, len;
+
+  while (done < size && h->pos < end) {
+    if (h->pos < HD_SECSTART) {
+      len = HD_SECSTART - h->pos;
+      if ((size_t) len > size - done) len = size - done;
+      memcpy(buf + done, h->header + h->pos, len);
+    } else {
+      n = (h->pos - HD_SECSTART) / HD_SECSIZE;
+      off = (h->pos - HD_SECSTART) % HD_SECSIZE;
+      len = HD_SECSIZE - off;
+      if ((size_t) len > size - done) len = size - done;
+      hd_read_sector(h, n, sec);
+      memcpy(buf + done, sec + off, len);
+    }
+    done += len;
+    h->pos += len;
+  }
+  return done;
+}
+
+static ssize_t
+hd_write(HostDir *h, const Uchar *buf, size_t size)
+{
+  Uchar sec[HD_SECSIZE];
+  size_t done = 0;
+  off_t end = HD_SECSTART + (off_t) h->nsecs * HD_SECSIZE;
+  int n, off, len;
+
+  if (h->writeprot) {
+    errno = EROFS;
+    return -1;
+  }
+  while (done < size) {
+    if (h->pos >= end) {
+      errno = ENOSPC;
+      return done ? (ssize_t) done : -1;
+    }
+    if (h->pos < HD_SECSTART) {
+      /* Only the data address marks in the sector ids can change */
+      if (h->pos % 3 != 2 && h->header[h->pos] != buf[done]) {
+	errno = EINVAL;
+	return done ? (ssize_t) done : -1;
+      }
+      h->header[h->pos] = buf[done];
+      len = 1;
+    } else {
+      n = (h->pos - HD_SECSTART) / HD_SECSIZE;
+      off = (h->pos - HD_SECSTART) % HD_SECSIZE;
+      len = HD_SECSIZE - off;
+      if ((size_t) len > size - done) len = size - done;
+      hd_read_sector(h, n, sec);
+      memcpy(sec + off, buf + done, len);
+      if (hd_write_sector(h, n, sec) < 0) {
+	errno = EIO;
+	return done ? (ssize_t) done : -1;
+      }
+    }
+    done += len;
+    h->pos += len;
+  }
+  return done;
+}
+
+static int
+hd_seek(HostDir *h, off_t *offset, int whence)
+{
+  off_t pos = *offset;
+
+  if (whence == SEEK_CUR) {
+    pos += h->pos;
+  } else if (whence == SEEK_END) {
+    pos += HD_SECSTART + (off_t) h->nsecs * HD_SECSIZE;
+  }
+  if (pos < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  *offset = h->pos = pos;
+  return 0;
+}
+
+static int
+hd_close(HostDir *h)
+{
+  int i;
+
+  hd_close_fd(h);
+  for (i = 0; i < HD_SLOTS; i++) {
+    free(h->file[i].name);
+    free(h->file[i].secs);
+  }
+  for (i = 0; i < h->nsecs; i++) free(h->over[i]);
+  free(h->over);
+  free(h->owner);
+  free(h->ownidx);
+  free(h->dir);
+  free(h);
+  return 0;
+}
+
+#if __linux
+static ssize_t
+hd_cookie_read(void *cookie, char *buf, size_t size)
+{
+  return hd_read(cookie, (Uchar *) buf, size);
+}
+
+static ssize_t
+hd_cookie_write(void *cookie, const char *buf, size_t size)
+{
+  ssize_t n = hd_write(cookie, (const Uchar *) buf, size);
+  return n < 0 ? 0 : n;
+}
+
+static int
+hd_cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+  off_t pos = *offset;
+  int res = hd_seek(cookie, &pos, whence);
+  *offset = pos;
+  return res;
+}
+
+static int
+hd_cookie_close(void *cookie)
+{
+  return hd_close(cookie);
+}
+
+static FILE *
+hd_fopen(HostDir *h)
+{
+  cookie_io_functions_t io = {
+    hd_cookie_read, hd_cookie_write, hd_cookie_seek, hd_cookie_close
+  };
+  return fopencookie(h, "r+", io);
+}
+#else
+static int
+hd_cookie_read(void *cookie, char *buf, int size)
+{
+  return hd_read(cookie, (Uchar *) buf, size);
+}
+
+static int
+hd_cookie_write(void *cookie, const char *buf, int size)
+{
+  return hd_write(cookie, (const Uchar *) buf, size);
+}
+
+static fpos_t
+hd_cookie_seek(void *cookie, fpos_t offset, int whence)
+{
+  off_t pos = offset;
+  return hd_seek(cookie, &pos, whence) < 0 ? -1 : pos;
+}
+
+static int
+hd_cookie_close(void *cookie)
+{
+  return hd_close(cookie);
+}
+
+static FILE *
+hd_fopen(HostDir *h)
+{
+  return funopen(h, hd_cookie_read, hd_cookie_write,
+		 hd_cookie_seek, hd_cookie_close);
+}
+#endif
+
+/*
+ * Step through the DECs for host files, filling entries 2-7 of each
+ * directory sector before entries 0-1 as LDOS does.  seq runs from
+ * 0x40 to 0x13f; the DEC is its low byte.  Returns -1 at the end.
+ */
+static int
+hd_next_seq(HostDir *h, int seq)
+{
+  while (++seq < 0x140) {
+    int dec = seq & 0xff;
+    if (dec != 0x00 && dec != 0x20 && hd_valid_dec(h, dec)) return seq;
+  }
+  return -1;
+}
+
+static void
+hd_set_entry(Uchar *e, int attr, const Uchar *gname, int size)
+{
+  memset(e, 0, DE_SIZE);
+  e[DE_ATTR] = attr;
+  e[DE_EOF] = size % HD_SECSIZE;	  /* ERN counts a partial last sector */
+  e[DE_LRL] = 0;
+  memcpy(e + DE_NAME, gname, 11);
+  e[DE_UPDPW] = e[DE_ACCPW] = BLANK_PW & 0xff;
+  e[DE_UPDPW + 1] = e[DE_ACCPW + 1] = BLANK_PW >> 8;
+  e[DE_ERN] = ((size + HD_SECSIZE - 1) / HD_SECSIZE) & 0xff;
+  e[DE_ERN + 1] = ((size + HD_SECSIZE - 1) / HD_SECSIZE) >> 8;
+  memset(e + DE_EXTENT, 0xff, 2 * (HD_EXTENTS + 1));
+}
+
+/*
+ * Lay out ngran granules from *next, skipping the directory cylinder,
+ * as at most HD_EXTENTS extents in entry e, and mark them in the GAT.
+ * Returns 0 if they don't fit.
+ */
+static int
+hd_allocate(HostDir *h, Uchar *e, int *next, int ngran, Uchar *gat)
+{
+  int dirg = h->dircyl * h->gpt, end = h->ncyl * h->gpt;
+  int g = *next, x, run;
+
+  if (ngran > end - g - (g < dirg ? h->gpt : 0)) return 0;
+  for (x = 0; ngran > 0; x++) {
+    if (g == dirg) g += h->gpt;
+    if (x == HD_EXTENTS) return 0;
+    run = (g < dirg ? dirg : end) - g;
+    if (run > ngran) run = ngran;
+    if (run > HD_MAXRUN) run = HD_MAXRUN;
+    e[DE_EXTENT + 2*x] = g / h->gpt;
+    e[DE_EXTENT + 2*x + 1] = ((g % h->gpt) << 5) | (run - 1);
+    ngran -= run;
+    g += run;
+  }
+  /* The directory cylinder is already marked in use */
+  for (x = *next; x < g; x++) gat[x / h->gpt] |= 1 << (x % h->gpt);
+  *next = g;
+  return 1;
+}
+
+/*
+ * Open a host directory as an emulated floppy.  Returns NULL, with
+ * errno set, if it can't be read.
+ */
+FILE *
+trs_hostdir_open(const char *dirname, int *writeprot)
+{
+  static const Uchar boot[11] = "BOOT    SYS", dirsys[11] = "DIR     SYS";
+  char path[FILENAME_MAX];
+  struct dirent **names;
+  struct stat st;
+  HostDir *h;
+  Uchar *gat, *hit, gname[11];
+  Uchar (*gnames)[11];
+  int *sizes;
+  int count, nfiles, total, i, j, n, dec, seq, next, skipped, dirsec;
+  const char *base;
+  time_t now;
+  struct tm *tm;
+  FILE *f;
+
+  count = scandir(dirname, &names, NULL, alphasort);
+  if (count < 0) return NULL;
+
+  h = (HostDir *) calloc(1, sizeof(HostDir));
+  if (h == NULL || (h->dir = strdup(dirname)) == NULL) {
+    fatal("out of memory for host directory");
+  }
+  h->writeprot = access(dirname, W_OK) != 0;
+  h->fd = h->fdslot = -1;
+  if (trs_model == 1) {
+    h->spt = 10;
+    h->gpt = 2;
+  } else {
+    h->spt = 18;
+    h->gpt = 3;
+  }
+  h->spg = h->spt / h->gpt;
+
+  /* Find the host files that have TRS-80 names */
+  gnames = malloc((count + 1) * sizeof(*gnames));
+  sizes = malloc((count + 1) * sizeof(int));
+  if (gnames == NULL || sizes == NULL) {
+    fatal("out of memory for host directory");
+  }
+  nfiles = total = 0;
+  for (i = 0; i < count; i++) {
+    if (hd_guest_name(names[i]->d_name, gname) &&
+	stat(hd_path(h, names[i]->d_name, path), &st) == 0 &&
+	S_ISREG(st.st_mode) && st.st_size <= 0xffff * HD_SECSIZE) {
+      for (j = 0; j < nfiles; j++) {
+	if (memcmp(gnames[j], gname, 11) == 0) break;
+      }
+      if (j == nfiles) {
+	struct dirent *de = names[i];
+	names[i] = NULL;
+	names[nfiles] = de;
+	memcpy(gnames[nfiles], gname, 11);
+	sizes[nfiles] = st.st_size;
+	total += (st.st_size + h->spg * HD_SECSIZE - 1) / (h->spg * HD_SECSIZE);
+	nfiles++;
+	continue;
+      }
+    }
+    free(names[i]);
+  }
+
+  /* Leave a quarter of the disk free for the guest, if possible */
+  h->ncyl = HD_MINCYL;
+  while (h->ncyl < HD_MAXCYL && (h->ncyl - 2) * h->gpt * 3 < total * 4) {
+    h->ncyl++;
+  }
+  h->dircyl = h->ncyl / 2;
+  h->nsecs = h->ncyl * h->spt;
+  h->over = (Uchar **) calloc(h->nsecs, sizeof(Uchar *));
+  h->owner = (int *) malloc(h->nsecs * sizeof(int));
+  h->ownidx = (int *) calloc(h->nsecs, sizeof(int));
+  if (h->over == NULL || h->owner == NULL || h->ownidx == NULL) {
+    fatal("out of memory for host directory");
+  }
+  for (i = 0; i < h->nsecs; i++) h->owner[i] = -1;
+
+  /* Boot sector and directory cylinder live in memory */
+  h->over[0] = (Uchar *) calloc(1, HD_SECSIZE);
+  if (h->over[0] == NULL) fatal("out of memory for host directory");
+  h->over[0][1] = 0xfe;
+  h->over[0][2] = h->dircyl;
+  dirsec = h->dircyl * h->spt;
+  for (i = 0; i < h->spt; i++) {
+    h->over[dirsec + i] = (Uchar *) calloc(1, HD_SECSIZE);
+    if (h->over[dirsec + i] == NULL) {
+      fatal("out of memory for host directory");
+    }
+  }
+  gat = h->over[dirsec];
+  hit = h->over[dirsec + 1];
+
+  /* GAT: all but the existing granules are in use and locked out */
+  memset(gat, 0xff, GAT_VERSION);
+  for (i = 0; i < h->ncyl; i++) {
+    gat[i] = gat[GAT_LOCKOUT + i] = (0xff << h->gpt) & 0xff;
+  }
+  gat[0] |= 1;
+  gat[h->dircyl] = 0xff;
+  gat[GAT_VERSION] = trs_model >= 4 ? 0x62 : 0x51;
+  gat[GAT_CYLS] = h->ncyl - 35;
+  gat[GAT_CONFIG] = 0x80 | (trs_model == 1 ? 0 : 0x40) | (h->gpt - 1);
+  gat[GAT_MASTERPW] = MASTER_PW & 0xff;
+  gat[GAT_MASTERPW + 1] = MASTER_PW >> 8;
+  base = strrchr(dirname, '/');
+  base = (base && base[1]) ? base + 1 : dirname;
+  memset(gat + GAT_NAME, ' ', 8);
+  for (i = j = 0; base[i] && j < 8; i++) {
+    if (isalnum((Uchar) base[i])) gat[GAT_NAME + j++] = toupper((Uchar) base[i]);
+  }
+  now = time(NULL);
+  tm = localtime(&now);
+  snprintf(path, sizeof(path), "%02d/%02d/%02d",
+	   tm->tm_mon + 1, tm->tm_mday, tm->tm_year % 100);
+  memcpy(gat + GAT_DATE, path, 8);
+
+  /* System entries for the boot granule and directory cylinder */
+  hd_set_entry(hd_entry(h, 0x00), DA_SYS|DA_INUSE|DA_INVIS|6, boot,
+	       h->spg * HD_SECSIZE);
+  hd_entry(h, 0x00)[DE_EXTENT] = 0;
+  hd_entry(h, 0x00)[DE_EXTENT + 1] = 0;
+  hit[0x00] = hd_hash(boot);
+  hd_set_entry(hd_entry(h, 0x20), DA_SYS|DA_INUSE|DA_INVIS|5, dirsys,
+	       h->spt * HD_SECSIZE);
+  hd_entry(h, 0x20)[DE_EXTENT] = h->dircyl;
+  hd_entry(h, 0x20)[DE_EXTENT + 1] = h->gpt - 1;
+  hit[0x20] = hd_hash(dirsys);
+
+  /* Lay out the host files */
+  next = 1;
+  seq = 0x3f;
+  skipped = 0;
+  for (i = 0; i < nfiles; i++) {
+    int ngran = (sizes[i] + h->spg * HD_SECSIZE - 1) / (h->spg * HD_SECSIZE);
+    Uchar *e;
+    int *secs;
+
+    j = hd_next_seq(h, seq);
+    if (j < 0) {
+      skipped += nfiles - i;
+      break;
+    }
+    dec = j & 0xff;
+    e = hd_entry(h, dec);
+    hd_set_entry(e, DA_INUSE, gnames[i], sizes[i]);
+    if (!hd_allocate(h, e, &next, ngran, gat)) {
+      memset(e, 0, DE_SIZE);
+      skipped++;
+      continue;
+    }
+    seq = j;
+    hit[dec] = hd_hash(gnames[i]);
+    secs = (int *) malloc((ngran * h->spg + 1) * sizeof(int));
+    if (secs == NULL) fatal("out of memory for host directory");
+    hd_extents(h, dec, secs);
+    n = (sizes[i] + HD_SECSIZE - 1) / HD_SECSIZE;
+    h->file[dec].name = strdup(names[i]->d_name);
+    if (h->file[dec].name == NULL) fatal("out of memory for host directory");
+    memcpy(h->file[dec].gname, gnames[i], 11);
+    h->file[dec].size = sizes[i];
+    h->file[dec].nsecs = n;
+    h->file[dec].secs = secs;
+    for (j = 0; j < n; j++) {
+      h->owner[secs[j]] = dec;
+      h->ownidx[secs[j]] = j;
+    }
+  }
+  if (skipped) {
+    error("%d files in %s do not fit on the emulated disk", skipped, dirname);
+  }
+  for (i = 0; i < nfiles; i++) free(names[i]);
+  free(names);
+  free(gnames);
+  free(sizes);
+
+  /* JV3 header: every sector 256 bytes; directory with the deleted DAM */
+  memset(h->header, 0xff, HD_SECSTART);
+  for (i = 0; i < h->nsecs; i++) {
+    int cyl = i / h->spt;
+    h->header[3*i] = cyl;
+    h->header[3*i + 1] = i % h->spt;
+    if (trs_model == 1) {
+      h->header[3*i + 2] = cyl == h->dircyl ? 0x20 : 0x00; /* 0xFA : 0xFB */
+    } else {
+      h->header[3*i + 2] = cyl == h->dircyl ? 0xa0 : 0x80; /* 0xF8 : 0xFB */
+    }
+  }
+  h->header[HD_WPROT] = h->writeprot ? 0 : 0xff;
+  *writeprot = h->writeprot;
+
+  f = hd_fopen(h);
+  if (f == NULL) hd_close(h);
+  return f;
+}
@@ -45,6 +45,7 @@
 #include "trs.h"
 #include "trs_disk.h"
 #include "trs_hard.h"
+#include "trs_replay.h"
 
 /*
    If the following option is set, potentially dangerous emulator traps
@@ -329,7 +330,7 @@ void do_emt_strerror(void)
 
 void do_emt_time(void)
 {
-  time_t now = time(0) + trs_timeoffset;
+  time_t now = trs_replay_time() + trs_timeoffset;
   if (REG_A == 1) {
 #if __alpha
     struct tm *loctm = localtime(&now);
@@ -570,6 +571,10 @@ void do_emt_misc(void)
   case 25:
     trs_lowercase = REG_HL;
     break;
+  case 26:
+    trs_exit_status = REG_L;
+    trs_exit();
+    break;
   default:
     error("unsupported function code to emt_misc");
     break;
@@ -232,6 +232,8 @@
  *         After,  HL = 0 or 1
  *    25 = disable/enable lowercase (meaningful only for Model I)
  *         Before,  HL = 0 or 1
+ *    26 = exit emulator with status
+ *         Before,  L = exit status
  *
  * ED3D emt_ftruncate
  *         Before, DE =  fd
@@ -26,14 +26,16 @@
  * Emulate interrupts
  */
 
-#define _XOPEN_SOURCE 500 /* signal.h: SA_RESTART */
+#define _XOPEN_SOURCE 500 /* time.h: clock_gettime(), localtime_r() */
 
 #include "z80.h"
 #include "trs.h"
+#include "trs_stats.h"
+#include "trs_replay.h"
+#include "trs_uart.h"
 #include <stdio.h>
-#include <sys/time.h>
 #include <time.h>
-#include <signal.h>
+#include <poll.h>
 
 /*#define IDEBUG 1*/
 /*#define IDEBUG2 1*/
@@ -63,6 +65,7 @@ static unsigned char nmi_mask = M3_RESET_BIT;
 #define TIMER_HZ_3 30
 #define TIMER_HZ_4 60
 static int timer_hz;
+static long long timer_next;  /* host time of the next heartbeat, in us */
 
 #define CLOCK_MHZ_1 1.77408
 #define CLOCK_MHZ_3 2.02752
@@ -368,15 +371,25 @@ void trs_restore_delay(void) { }
 #define UP_F   1.50
 #define DOWN_F 0.50 
 
-void
-trs_timer_event(int signo)
+/* Host monotonic time in microseconds */
+static long long
+timer_usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* The host heartbeat: autodelay, statistics, and the real time clock */
+static void
+trs_timer_event(void)
 {
-  struct timeval tv;
-  struct itimerval it;
+  long long now = timer_usec();
+  long period = 1000000 / timer_hz;
 
-  gettimeofday(&tv, NULL);
   if (trs_autodelay) {
-      static struct timeval oldtv;
+      static long long oldnow;
       static int increment = 1;
       static int oldtoofast = 0;
 #if __GNUC__
@@ -386,8 +399,7 @@ trs_timer_event(int signo)
 #endif
       if (!trs_paused) {
 	int toofast = (z80_state.t_count - oldtcount) >
-	  ((tv.tv_sec*1000000 + tv.tv_usec) -
-	   (oldtv.tv_sec*1000000 + oldtv.tv_usec))*z80_state.clockMHz;
+	  (now - oldnow)*z80_state.clockMHz;
 	if (toofast == oldtoofast) {
 	  increment = (int)(increment * UP_F + 0.5);
 	} else {
@@ -406,29 +418,89 @@ trs_timer_event(int signo)
 	}
       }
       trs_paused = 0;
-      oldtv = tv;
+      oldnow = now;
       oldtcount = z80_state.t_count;
   }
+  trs_stats_tick();
+
+  /* Run every tick that has come due since the last one, scheduling
+     each on the next multiple of the period so that lateness does not
+     accumulate.  A forced event (timer_next still in the future) runs
+     one tick now; after a long stall, such as the process having been
+     stopped, we resynchronize instead of running a burst of ticks. */
+  if (timer_next > now || now - timer_next >= 1000000) timer_next = now;
+  do {
+    /* With -record or -replay, ticks come from emulated time instead */
+    if (trs_replay_mode == REPLAY_OFF) trs_timer_tick();
+    timer_next += period - timer_next % period;
+  } while (timer_next <= now);
+}
 
+/*
+ * Called at each event poll: run the heartbeat if it is due, and
+ * check for interrupt-driven serial input.  With -record or -replay,
+ * serial input is checked at every poll, so that it arrives at the
+ * same emulated time on replay; otherwise once per heartbeat.
+ * Returns the number of T-states in half a heartbeat period; the
+ * caller polls again within that many, so that when the emulator runs
+ * at or near real speed no two ticks fall between polls.
+ */
+tstate_t
+trs_timer_poll(void)
+{
+  int tick = timer_usec() >= timer_next;
+
+  if (tick) trs_timer_event();
+  if (trs_model > 1 && (tick || trs_replay_mode != REPLAY_OFF)) {
+    (void)trs_uart_check_avail();
+  }
+  return (tstate_t) (z80_state.clockMHz * 1000000.0 / timer_hz / 2);
+}
+
+/*
+ * Give up the CPU until the next heartbeat is due, until fd (if not
+ * -1), the -typein file, or the serial port has input, or until the
+ * serial port can take more output, then poll as above.
+ */
+void
+trs_timer_wait(int fd)
+{
+  struct pollfd fds[3];
+  int nfds = 0, events;
+  long long wait = timer_next - timer_usec();
+
+  if (fd >= 0) {
+    fds[nfds].fd = fd;
+    fds[nfds++].events = POLLIN;
+  }
+  if ((fds[nfds].fd = trs_kb_typein_fd()) >= 0) {
+    fds[nfds++].events = POLLIN;
+  }
+  if (trs_model > 1 && (fds[nfds].fd = trs_uart_fd(&events)) >= 0) {
+    fds[nfds++].events = events;
+  }
+  if (wait > 0) {
+    poll(fds, nfds, (int) ((wait + 999) / 1000));
+  }
+  if (timer_usec() >= timer_next) trs_timer_event();
+  if (trs_model > 1 && trs_replay_mode == REPLAY_OFF) {
+    (void)trs_uart_check_avail();
+  }
+}
+
+/*
+ * One tick of the real time clock.  Returns the number of T-states
+ * until the next one, for trs_replay_event().
+ */
+tstate_t
+trs_timer_tick(void)
+{
   if (timer_on) {
     trs_timer_interrupt(1); /* generate */
     trs_disk_motoroff_interrupt(trs_disk_motoroff());
     trs_kb_heartbeat(); /* part of keyboard stretch kludge */
   }
-  x_poll_count = 0; /* be sure to flush and check for X events */
-
-  /* Schedule next tick.  We do it this way because the host system
-     probably didn't wake us up at exactly the right time.  For
-     instance, on Linux i386 the real clock ticks at 10ms, but we want
-     to tick at 25ms.  If we ask setitimer to wake us up in 25ms, it
-     will really wake us up in 30ms.  The algorithm below compensates
-     for such an error by making the next tick shorter. */
-  it.it_value.tv_sec = 0;
-  it.it_value.tv_usec =
-    (1000000/timer_hz) - (tv.tv_usec % (1000000/timer_hz));
-  it.it_interval.tv_sec = 0;
-  it.it_interval.tv_usec = 1000000/timer_hz;  /* fail-safe */
-  setitimer(ITIMER_REAL, &it, NULL);
+  return (tstate_t) (z80_state.clockMHz * 1000000.0 / timer_hz);
 }
 
 /*
@@ -455,7 +527,6 @@ trs_inityear(int year)
 void
 trs_timer_init(void)
 {
-  struct sigaction sa;
   struct tm *lt;
   time_t tt;
 
@@ -468,16 +539,10 @@ trs_timer_init(void)
       z80_state.clockMHz = CLOCK_MHZ_3;
   }
 
-  sa.sa_handler = trs_timer_event;
-  sigemptyset(&sa.sa_mask);
-  sigaddset(&sa.sa_mask, SIGALRM);
-  sa.sa_flags = SA_RESTART;
-  sigaction(SIGALRM, &sa, NULL);
-
-  trs_timer_event(SIGALRM);
+  trs_timer_event();
 
   /* Also initialize the clock in memory - hack */
-  tt = time(NULL) + trs_timeoffset;
+  tt = trs_replay_time() + trs_timeoffset;
   lt = localtime(&tt);
   if (trs_model == 1) {
       mem_write(LDOS_MONTH, (lt->tm_mon + 1) ^ 0x50);
@@ -505,7 +570,7 @@ trs_timer_init(void)
       mem_write(NEWDOS3_SEC, lt->tm_sec);
 
       if (trs_model >= 4) {
-        extern Uchar memory[];
+	/* Low RAM, under the ROM in the current map, so not mem_write() */
 	memory[LDOS4_MONTH] = lt->tm_mon + 1;
 	memory[LDOS4_DAY] = lt->tm_mday;
 	memory[LDOS4_YEAR] = lt->tm_year;
@@ -524,7 +589,7 @@ trs_timer_on(void)
 {
   if (!timer_on) {
     timer_on = 1;
-    trs_timer_event(SIGALRM);
+    trs_timer_event();
   }
 }
 
@@ -560,8 +625,10 @@ trs_schedule_event(trs_event_func f, int arg, int countdown)
 #if EDEBUG	
 	error("warning: trying to schedule two events");
 #endif
+	trs_stats.events_forced++;
 	trs_do_event();
     }
+    trs_stats.events_scheduled++;
     event_func = f;
     event_arg = arg;
     z80_state.sched = z80_state.t_count + (tstate_t) countdown;
@@ -577,6 +644,7 @@ trs_do_event(void)
 {
     trs_event_func f = event_func;
     if (f) {
+	trs_stats.events_fired++;
 	event_func = NULL;
 	z80_state.sched = 0;
 	f(event_arg);    
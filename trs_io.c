@@ -50,6 +50,8 @@
 #include "trs_disk.h"
 #include "trs_hard.h"
 #include "trs_uart.h"
+#include "trs_stats.h"
+#include "trs_replay.h"
 
 static int modesel = 0;     /* Model I */
 static int modeimage = 0x8; /* Model III/4/4p */
@@ -60,6 +62,10 @@ int trs_io_debug_flags = 0;
 /*ARGSUSED*/
 void z80_out(int port, int value)
 {
+  trs_stats.port_out[port & 0xff]++;
+  if (debug_watch_ports[port & 0xff] & DEBUG_WATCH_WRITE) {
+    debug_watch_hit(DEBUG_WATCH_WRITE | DEBUG_WATCH_PORT, port & 0xff, value);
+  }
   if (trs_io_debug_flags & IODEBUG_OUT) {
     debug("out (0x%02x), 0x%02x; pc 0x%04x\n", port, value, z80_state.pc.word);
   }
@@ -282,6 +288,8 @@ int z80_in(int port)
 {
   int value = 0xff; // value returned for nonexistent ports
 
+  trs_stats.port_in[port & 0xff]++;
+
   /* First, ports common to all models */
 
   /* Support for a special HW real-time clock (TimeDate80?)
@@ -308,7 +316,7 @@ int z80_in(int port)
     struct tm *time_info;
     time_t time_secs;
 
-    time_secs = time(NULL) + trs_timeoffset;
+    time_secs = trs_replay_time() + trs_timeoffset;
     time_info = localtime(&time_secs);
 
     switch (port & 0x0F) {
@@ -463,6 +471,9 @@ int z80_in(int port)
   }
 
  done:
+  if (debug_watch_ports[port & 0xff] & DEBUG_WATCH_READ) {
+    debug_watch_hit(DEBUG_WATCH_READ | DEBUG_WATCH_PORT, port & 0xff, value);
+  }
   if (trs_io_debug_flags & IODEBUG_IN) {
     debug("in (0x%02x) => 0x%02x; pc %04x\n", port, value, z80_state.pc.word);
   }
@@ -47,7 +47,13 @@
 
 #include "z80.h"
 #include "trs.h"
+#include "trs_replay.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 /*
  * Key event queue
@@ -58,6 +64,16 @@ static int key_queue_head;
 static int key_queue_entries;
 static int skip_next_kbwait;
 
+/*
+ * Text to be typed in, from -typein or xtrs_type_text()
+ */
+char *trs_kb_typein_name = NULL;
+static int typein_fd = -1;
+static char *typein_buf;
+static int typein_len, typein_pos, typein_size;
+static int typein_fifo;
+static int typein_last;
+
 /*
  * TRS-80 key matrix
  */
@@ -139,6 +155,7 @@ static int skip_next_kbwait;
 #define TK_ForceShiftPersistent TK(8, 4)
 #define TK_AllKeysUp            TK(8, 5)
 #define TK_Joystick             TK(10,  0)
+#define TK_SHIFT_ACTION(tk) ((tk) >= TK_Neutral && (tk) <= TK_ForceShiftPersistent)
 #define TK_North                TK(10,  1)
 #define TK_Northeast            TK(10,  9)
 #define TK_East                 TK(10,  8)
@@ -735,7 +752,9 @@ static int keys_down = 0;
 
 /* Avoid changing state too fast so keystrokes aren't lost. */
 #define STRETCH_AMOUNT 4000
+#define FAST_READS 8	/* a scan of rows 0-6 and then some */
 static tstate_t key_stretch_timeout;
+static int fast_reads;
 int stretch_amount = STRETCH_AMOUNT;
 int trs_keydelay = 0;
 
@@ -837,6 +856,7 @@ static void change_keystate(int action)
 #ifdef KBDEBUG
     debug("change_keystate: action 0x%x\n", action);
 #endif
+    fast_reads = 0;
 
     switch (action) {
       case TK_AllKeysUp:
@@ -905,10 +925,53 @@ static int kb_mem_value(int address)
     return data;
 }
 
+/* Check if we are in the system keyboard driver, called from the
+   wait-for-input routine.  The test works on both Model I and III and
+   is insensitive to what keyboard driver is being used, as long as it
+   is called through the wait-for-key routine at ROM address 0x0049 and
+   has not pushed too much on the stack yet when it first reads from
+   the key matrix.  The search is needed (at least) for NEWDOS80, which
+   pushes 2 extra bytes on the stack. */
+static int kb_wait_path(void)
+{
+    int i, wait = 0;
+
+    for (i=0; i<=4; i+=2) {
+	if (mem_read_word(REG_SP + 2 + i) == 0x4015) {
+	    wait = mem_read_word(REG_SP + 10 + i) == 0x004c;
+	    break;
+	}
+    }
+    return wait;
+}
+
+/* Check if the ROM keyboard driver's copy of key matrix rows 0-6 at
+   0x4036 matches the current state, meaning that it has seen the last
+   change to them. */
+static int kb_image_current(void)
+{
+    int i;
+
+    for (i=0; i<7; i++) {
+	if (mem_read(0x4036 + i) != keystate[i]) return 0;
+    }
+    return 1;
+}
+
+/* Check if there is input to deliver.  When replaying, the recording
+   holds the input and says when it is due.  A pipe is not read until
+   the stretch runs out, to keep an idle one from costing a system call
+   on every matrix read. */
+static int kb_input_pending(void)
+{
+    return key_queue_entries > 0 || typein_pos < typein_len ||
+	(typein_fd >= 0 && !typein_fifo) || trs_replay_mode == REPLAY_PLAY;
+}
+
 int trs_kb_mem_read(int address)
 {
     int key = -1;
-    int i, wait;
+    int wait, ready;
     static int recursion = 0;
     static int timesseen;
 
@@ -933,33 +996,40 @@ int trs_kb_mem_read(int address)
        drivers that strike if two keys change simultaneously */
     if (key_stretch_timeout - z80_state.t_count > TSTATE_T_MID) {
 
-	/* Check if we are in the system keyboard driver, called from
-	   the wait-for-input routine.  If so, and there are no
-	   keystrokes queued, and the current state has been seen by
-	   at least 16 such reads, then trs_next_key will pause the
-	   process to avoid burning host CPU needlessly.
-
-	   The test below works on both Model I and III and is
-	   insensitive to what keyboard driver is being used, as long
-	   as it is called through the wait-for-key routine at ROM
-	   address 0x0049 and has not pushed too much on the stack yet
-	   when it first reads from the key matrix.  The search is
-	   needed (at least) for NEWDOS80, which pushes 2 extra bytes
-	   on the stack.  */
+	/* If we are in the system keyboard driver, called from the
+	   wait-for-input routine, and there are no keystrokes queued,
+	   and the current state has been seen by at least 16 such
+	   reads, then trs_next_key will pause the process to avoid
+	   burning host CPU needlessly. */
 	wait = 0;
 	if (timesseen++ >= 16) {
 	  recursion = 1;
-	  for (i=0; i<=4; i+=2) {
-	    if (mem_read_word(REG_SP + 2 + i) == 0x4015) {
-	      wait = mem_read_word(REG_SP + 10 + i) == 0x004c;
-	      break;
-	    }
-	  }
+	  wait = kb_wait_path();
 	  recursion = 0;
 	}
 	/* Get the next key */
 	key = trs_next_key(wait);
 	key_stretch_timeout = z80_state.t_count + stretch_amount;
+
+    } else if (kb_input_pending()) {
+	/* The wait-for-key routine takes a key as soon as its driver
+	   has seen it, so there is no need to wait out the stretch
+	   there.  Once the driver has stored the current state in its
+	   image and scanned the matrix again without finding a change,
+	   it is back waiting for the next key.  Shift changes go along
+	   with the key change that follows them. */
+	recursion = 1;
+	ready = kb_wait_path() && kb_image_current();
+	recursion = 0;
+	fast_reads = ready ? fast_reads + 1 : 0;
+	if (fast_reads >= FAST_READS) {
+	  while ((key = trs_next_key(0)) >= 0 && TK_SHIFT_ACTION(key)) {
+	    change_keystate(key);
+	  }
+	  if (key >= 0) {
+	    key_stretch_timeout = z80_state.t_count + stretch_amount;
+	  }
+	}
     }
 
     if (key >= 0) {
@@ -994,10 +1064,107 @@ void queue_key(int state)
   }
 }
 
+/* Add text to be typed in */
+void trs_kb_typein(const char *text, int len)
+{
+  if (typein_pos > 0) {
+    memmove(typein_buf, typein_buf + typein_pos, typein_len - typein_pos);
+    typein_len -= typein_pos;
+    typein_pos = 0;
+  }
+  if (typein_len + len > typein_size) {
+    typein_size = typein_len + len + 4096;
+    typein_buf = realloc(typein_buf, typein_size);
+    if (typein_buf == NULL) fatal("out of memory for typed-in text");
+  }
+  memcpy(typein_buf + typein_len, text, len);
+  typein_len += len;
+}
+
+void trs_kb_typein_init(void)
+{
+  struct stat st;
+  int mode = O_RDONLY;
+
+  if (trs_kb_typein_name == NULL || typein_fd >= 0) return;
+  /* Hold a named pipe open for writing too, so that between writers
+     it is never at end of file and poll() waits for more input */
+  if (stat(trs_kb_typein_name, &st) == 0 && S_ISFIFO(st.st_mode)) {
+    mode = O_RDWR;
+  }
+  typein_fd = open(trs_kb_typein_name, mode | O_NONBLOCK);
+  if (typein_fd < 0) {
+    error("can't read typein file %s: %s",
+	  trs_kb_typein_name, strerror(errno));
+    return;
+  }
+  typein_fifo = fstat(typein_fd, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+/* The -typein descriptor for trs_timer_wait() to wake up on, or -1 */
+int trs_kb_typein_fd(void)
+{
+  return typein_fd;
+}
+
+/* Read more of the -typein file.  A pipe stays open at end of file,
+   in case another writer comes along. */
+static void typein_read(void)
+{
+  char buf[4096];
+  int n;
+
+  n = read(typein_fd, buf, sizeof(buf));
+  if (n > 0) {
+    trs_kb_typein(buf, n);
+  } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+    error("can't read typein file %s: %s",
+	  trs_kb_typein_name, strerror(errno));
+    close(typein_fd);
+    typein_fd = -1;
+  } else if (n == 0 && !typein_fifo) {
+    close(typein_fd);
+    typein_fd = -1;
+  }
+}
+
+/* Queue the key presses for the next character of typed-in text.
+   A newline or carriage return (or both) is typed as Enter. */
+static void typein_next(void)
+{
+  int c, keysym;
+
+  while (key_queue_entries == 0) {
+    if (typein_pos == typein_len) {
+      if (typein_fd < 0) return;
+      typein_read();
+      if (typein_pos == typein_len) return;
+    }
+    c = (unsigned char) typein_buf[typein_pos++];
+    if (c == '\n' && typein_last == '\r') {
+      typein_last = c;
+      continue;
+    }
+    typein_last = c;
+    if (c == '\n' || c == '\r') {
+      keysym = 0xff0d; /* XK_Return */
+    } else if (c == '\t') {
+      keysym = 0xff09; /* XK_Tab */
+    } else {
+      keysym = c;
+    }
+    trs_xlate_keysym(keysym);
+    trs_xlate_keysym(0x10000 | keysym);
+  }
+}
+
 int dequeue_key(void)
 {
   int rval = -1;
 
+  if (key_queue_entries == 0 && trs_replay_mode != REPLAY_PLAY) {
+    typein_next();
+  }
   if(key_queue_entries > 0)
     {
       rval = key_queue[key_queue_head];
@@ -1007,6 +1174,7 @@ int dequeue_key(void)
       debug("dequeue_key 0x%x\n", rval);
 #endif
     }
+  if (trs_replay_mode != REPLAY_OFF) rval = trs_replay_key(rval);
   return rval;
 }
 
@@ -1019,7 +1187,9 @@ trs_skip_next_kbwait(void)
 int trs_next_key(int wait)
 {
 #if KBWAIT
-  if (wait) {
+  /* Waiting for a key would stop emulated time while recording.
+     The wait also ends when the -typein file has input. */
+  if (wait && trs_replay_mode == REPLAY_OFF) {
     int rval;
     for (;;) {
       if ((rval = dequeue_key()) >= 0) break;
@@ -50,6 +50,8 @@
 #include <stdlib.h>
 #include "trs_disk.h"
 #include "trs_hard.h"
+#include "trs_stats.h"
+#include "z80_coverage.h"
 
 #define MAX_ROM_SIZE	(0x3800)
 #define MAX_VIDEO_SIZE	(0x0800)
@@ -71,7 +73,9 @@
 /* Interrupt latch register in EI (Model 1) */
 #define TRS_INTLATCH(addr) (((addr)&~3) == 0x37e0)
 
-Uchar memory[0x20001]; /* +1 so strings from mem_pointer are NUL-terminated */
+/* 64K for Model I/III or 128K for Model 4/4P, allocated by mem_init();
+   +1 so strings from mem_pointer are NUL-terminated */
+Uchar *memory;
 Uchar *rom;
 int trs_rom_size;
 Uchar *video;
@@ -86,6 +90,11 @@ int trs_lowercase = 1; /* Model I, has lowercase mod */
 int romin = 0; /* Model 4p */
 unsigned short trs_changecount = 0;
 
+/* Region of each page for reading and writing, for trs_stats */
+static Uchar mem_region[2][256];
+static void mem_stats_remap(void);
+static int mem_read_unwatched(int address);
+
 /*SUPPRESS 53*/
 /*SUPPRESS 112*/
 
@@ -121,6 +130,8 @@ void mem_bank(int command)
 	error("unknown mem_bank command %d", command);
 	break;
     }
+    z80_jit_remap();
+    z80_coverage_remap();
 }
 
 /* Check for changes in all floppy, hard, and stringy drives. */
@@ -138,6 +149,9 @@ trs_change_all(void)
 void trs_reset(int poweron)
 {
     /* Reset devices (Model I SYSRES, Model III/4 RESET) */
+    z80_jit_flush();
+    mem_stats_remap(); /* in case the ROM size changed */
+    z80_coverage_remap();
     trs_cassette_reset();
     trs_timer_speed(0);
     trs_disk_reset();
@@ -201,19 +215,96 @@ void trs_reset(int poweron)
     trs_skip_next_kbwait();
 }
 
+/*
+ * Classify the page at the given address for the statistics counters,
+ * following the cases in mem_read() (writing = 0) and mem_write()
+ * (writing = 1) for the current memory map.
+ */
+static int mem_stats_region(int address, int writing)
+{
+    switch (memory_map + (writing << 3)) {
+      case 0x10: /* Model I reading */
+      case 0x18: /* Model I writing */
+	if (address >= RAM_START) return STATS_RAM;
+	if (address >= VIDEO_START) return STATS_VIDEO;
+	if (address >= KEYBOARD_START) return STATS_KEYBOARD;
+	if (address < trs_rom_size) return STATS_ROM;
+	return STATS_MMIO;
+
+      case 0x30: /* Model III reading */
+      case 0x38: /* Model III writing */
+      case 0x40: /* Model 4 map 0 reading */
+      case 0x48: /* Model 4 map 0 writing */
+      case 0x58: /* Model 4P map 0, boot ROM out, writing */
+      case 0x5c: /* Model 4P map 0, boot ROM in, writing */
+	if (address >= RAM_START) return STATS_RAM;
+	if (address >= VIDEO_START) return STATS_VIDEO;
+	if (address >= KEYBOARD_START) return STATS_KEYBOARD;
+	if (PRINTER_3(address | 0xe8)) return STATS_MMIO;
+	if (address < trs_rom_size) return STATS_ROM;
+	return STATS_MMIO;
+
+      case 0x54: /* Model 4P map 0, boot ROM in, reading */
+      case 0x55: /* Model 4P map 1, boot ROM in, reading */
+	if (address < trs_rom_size) return STATS_ROM;
+	/* else fall thru */
+      case 0x41: /* Model 4 map 1 reading */
+      case 0x49: /* Model 4 map 1 writing */
+      case 0x50: /* Model 4P map 0, boot ROM out, reading */
+      case 0x51: /* Model 4P map 1, boot ROM out, reading */
+      case 0x59: /* Model 4P map 1, boot ROM out, writing */
+      case 0x5d: /* Model 4P map 1, boot ROM in, writing */
+	if (address >= RAM_START || address < KEYBOARD_START) return STATS_RAM;
+	if (address >= VIDEO_START) return STATS_VIDEO;
+	return STATS_KEYBOARD;
+
+      case 0x42: /* Model 4 map 2, reading */
+      case 0x4a: /* Model 4 map 2, writing */
+      case 0x52: /* Model 4P map 2, boot ROM out, reading */
+      case 0x5a: /* Model 4P map 2, boot ROM out, writing */
+      case 0x56: /* Model 4P map 2, boot ROM in, reading */
+      case 0x5e: /* Model 4P map 2, boot ROM in, writing */
+	if (address < 0xf400) return STATS_RAM;
+	if (address >= 0xf800) return STATS_VIDEO;
+	return STATS_KEYBOARD;
+    }
+    return STATS_RAM;
+}
+
+static void mem_stats_remap(void)
+{
+    int page;
+
+    for (page = 0; page < 256; page++) {
+	mem_region[0][page] = mem_stats_region(page << 8, 0);
+	mem_region[1][page] = mem_stats_region(page << 8, 1);
+    }
+}
+
 void mem_map(int which)
 {
     memory_map = which + (trs_model << 4) + (romin << 2);
+    z80_jit_remap();
+    mem_stats_remap();
+    z80_coverage_remap();
 }
 
 void mem_romin(int state)
 {
     romin = (state & 1);
     memory_map = (memory_map & ~4) + (romin << 2);
+    z80_jit_remap();
+    mem_stats_remap();
+    z80_coverage_remap();
 }
 
 void mem_init(void)
 {
+    int size = trs_model <= 3 ? 0x10000 : 0x20000;
+
+    memory = (Uchar *) calloc(size+1, 1);
+    if (memory == NULL) fatal("out of memory for emulated RAM");
+    trs_stats.mem_bytes[STATS_MEM_RAM] = size+1;
     if (trs_model <= 3) {
 	rom = &memory[ROM_START];
 	video = &memory[VIDEO_START];
@@ -222,7 +313,12 @@ void mem_init(void)
 	/* +1 so strings from mem_pointer are NUL-terminated */
 	rom = (Uchar *) calloc(MAX_ROM_SIZE+1, 1);
 	video = (Uchar *) calloc(MAX_VIDEO_SIZE+1, 1);
+	if (rom == NULL || video == NULL) {
+	    fatal("out of memory for emulated RAM");
+	}
 	trs_video_size = MAX_VIDEO_SIZE;
+	trs_stats.mem_bytes[STATS_MEM_RAM] +=
+	  (MAX_ROM_SIZE+1) + (MAX_VIDEO_SIZE+1);
     }
     mem_map(0);
     mem_bank(0);
@@ -240,24 +336,61 @@ void mem_write_rom(int address, int value)
     address &= 0xffff;
 
     rom[address] = value;
+    z80_jit_invalidate(address);
 }
 
+/* Set while mem_load_hex() loads a program into RAM */
+static int hex_to_ram = FALSE;
+static int hex_low, hex_xfer;
+
 /* Called by load_hex */
 void hex_data(int address, int value)
 {
-    mem_write_rom(address, value);
+    if (hex_to_ram) {
+	if (hex_low < 0 || address < hex_low) hex_low = address;
+	mem_write(address, value);
+    } else {
+	mem_write_rom(address, value);
+    }
 }
 
-/* Called by load_hex */
+/* Called by load_hex; ignored when loading a ROM */
 void hex_transfer_address(int address)
 {
-    /* Ignore */
+    hex_xfer = address;
+}
+
+/*
+ * Load an Intel hex program through the current memory map.  Returns
+ * its transfer address, or if it has none the lowest address loaded,
+ * or -1 if nothing was loaded.  A transfer address of 0 counts as
+ * none, since that is what the usual end record (:00000001FF) holds.
+ */
+int mem_load_hex(FILE *file)
+{
+    hex_to_ram = TRUE;
+    hex_low = hex_xfer = -1;
+    load_hex(file);
+    hex_to_ram = FALSE;
+    return hex_xfer > 0 ? hex_xfer : hex_low;
 }
 
 int mem_read(int address)
 {
     address &= 0xffff; /* allow callers to be sloppy */
+    trs_stats.mem_read[mem_region[0][address >> 8]]++;
+    if (z80_coverage_data_enabled) COVERAGE_MARK(z80_coverage_read, address);
 
+    if (debug_watch_pages[address >> 8] & DEBUG_WATCH_READ) {
+	int value = mem_read_unwatched(address);
+	debug_watch_hit(DEBUG_WATCH_READ, address, value);
+	return value;
+    }
+    return mem_read_unwatched(address);
+}
+
+static int mem_read_unwatched(int address)
+{
     switch (memory_map) {
       case 0x10: /* Model I */
 	if (address >= VIDEO_START) return memory[address];
@@ -330,6 +463,14 @@ int mem_read(int address)
 void mem_write(int address, int value)
 {
     address &= 0xffff;
+    trs_stats.mem_write[mem_region[1][address >> 8]]++;
+    if (z80_coverage_data_enabled) COVERAGE_MARK(z80_coverage_write, address);
+
+    if (debug_watch_pages[address >> 8] & DEBUG_WATCH_WRITE) {
+	debug_watch_hit(DEBUG_WATCH_WRITE, address, value);
+    }
+
+    if (z80_jit_code_page[address >> 8]) z80_jit_invalidate(address);
 
     switch (memory_map) {
       case 0x10: /* Model I */
@@ -459,6 +600,9 @@ Uchar *mem_pointer(int address, int writing)
 {
     address &= 0xffff;
 
+    /* The caller may write any amount; discard all translated code */
+    if (writing) z80_jit_flush();
+
     switch (memory_map + (writing << 3)) {
       case 0x10: /* Model I reading */
       case 0x30: /* Model III reading */
@@ -534,6 +678,135 @@ Uchar *mem_pointer(int address, int writing)
     return NULL;
 }
 
+/*
+ * Get a pointer to the 256-byte page containing the given address if
+ * mem_read() (writing = 0) or mem_write() (writing = 1) simply loads or
+ * stores memory throughout that page in the current memory map, else
+ * NULL.  Video memory and memory-mapped I/O are never plain.  Used by
+ * the dynamic translator.
+ */
+Uchar *mem_plain_page(int address, int writing)
+{
+    address &= 0xff00;
+    if (debug_watch_pages[address >> 8]) return NULL;
+
+    switch (memory_map + (writing << 3)) {
+      case 0x10: /* Model I reading */
+      case 0x30: /* Model III reading */
+	if (address >= RAM_START) return &memory[address];
+	if (address + 0xff < trs_rom_size && !PRINTER_3(address | 0xe8)) {
+	    return &rom[address];
+	}
+	return NULL;
+
+      case 0x18: /* Model I writing */
+      case 0x38: /* Model III writing */
+	if (address >= RAM_START) return &memory[address];
+	return NULL;
+
+      case 0x40: /* Model 4 map 0 reading */
+	if (address >= RAM_START) {
+	    return &memory[address + bank_offset[address>>15]];
+	}
+	if (address + 0xff < trs_rom_size && !PRINTER_3(address | 0xe8)) {
+	    return &rom[address];
+	}
+	return NULL;
+
+      case 0x48: /* Model 4 map 0 writing */
+      case 0x58: /* Model 4P map 0, boot ROM out, writing */
+      case 0x5c: /* Model 4P map 0, boot ROM in, writing */
+	if (address >= RAM_START) {
+	    return &memory[address + bank_offset[address>>15]];
+	}
+	return NULL;
+
+      case 0x54: /* Model 4P map 0, boot ROM in, reading */
+      case 0x55: /* Model 4P map 1, boot ROM in, reading */
+	if (address + 0xff < trs_rom_size) return &rom[address];
+	if (address < trs_rom_size) return NULL;
+	/* else fall thru */
+      case 0x41: /* Model 4 map 1 reading */
+      case 0x49: /* Model 4 map 1 writing */
+      case 0x50: /* Model 4P map 0, boot ROM out, reading */
+      case 0x51: /* Model 4P map 1, boot ROM out, reading */
+      case 0x59: /* Model 4P map 1, boot ROM out, writing */
+      case 0x5d: /* Model 4P map 1, boot ROM in, writing */
+	if (address >= RAM_START || address < KEYBOARD_START) {
+	    return &memory[address + bank_offset[address>>15]];
+	}
+	return NULL;
+
+      case 0x42: /* Model 4 map 2, reading */
+      case 0x4a: /* Model 4 map 2, writing */
+      case 0x52: /* Model 4P map 2, boot ROM out, reading */
+      case 0x5a: /* Model 4P map 2, boot ROM out, writing */
+      case 0x56: /* Model 4P map 2, boot ROM in, reading */
+      case 0x5e: /* Model 4P map 2, boot ROM in, writing */
+	if (address < 0xf400) {
+	    return &memory[address + bank_offset[address>>15]];
+	}
+	return NULL;
+
+      case 0x43: /* Model 4 map 3, reading */
+      case 0x4b: /* Model 4 map 3, writing */
+      case 0x53: /* Model 4P map 3, boot ROM out, reading */
+      case 0x5b: /* Model 4P map 3, boot ROM out, writing */
+      case 0x57: /* Model 4P map 3, boot ROM in, reading */
+      case 0x5f: /* Model 4P map 3, boot ROM in, writing */
+	return &memory[address + bank_offset[address>>15]];
+    }
+    return NULL;
+}
+
+/*
+ * Identify the memory that the current map places at the given address:
+ * MEM_BANK_ROM for the Model 4/4P ROM, else the number of the physical
+ * 32K bank of RAM, the same wherever mem_bank() maps it.  Models I and
+ * III have only bank 0.  Used by the profiler.
+ */
+int mem_bank_number(int address)
+{
+    address &= 0xffff;
+    if (address < trs_rom_size &&
+	(memory_map == 0x40 || memory_map == 0x54 || memory_map == 0x55)) {
+	return MEM_BANK_ROM;
+    }
+    if (trs_model < 4) return 0;
+    return ((address & 0x8000) + bank_offset[address >> 15]) >> 15;
+}
+
+/*
+ * Read a byte from the given bank, as numbered by mem_bank_number(),
+ * without side effects on memory-mapped devices.  For a RAM bank on
+ * the Model 4/4P, only the low 15 bits of the address count.
+ */
+int mem_read_bank(int bank, int address)
+{
+    address &= 0xffff;
+    if (bank == MEM_BANK_ROM) {
+	return address < trs_rom_size ? rom[address] : 0xff;
+    }
+    if (trs_model < 4) return memory[address];
+    return memory[(bank << 15) + (address & 0x7fff)];
+}
+
+/*
+ * Write a byte of RAM in the given bank, bypassing the memory map.
+ * ROM can't be written this way.  The caller must discard any
+ * translated code that the write may affect (z80_jit_flush()).
+ */
+void mem_write_bank(int bank, int address, int value)
+{
+    address &= 0xffff;
+    if (bank == MEM_BANK_ROM) return;
+    if (trs_model < 4) {
+	memory[address] = value;
+    } else {
+	memory[(bank << 15) + (address & 0x7fff)] = value;
+    }
+}
+
 /*
  * Block move instructions, for LDIR and LDDR instructions.
  *
@@ -551,7 +824,11 @@ mem_block_transfer(Ushort dest, Ushort source, int direction, Ushort count)
     /* special case for screen scroll */
     if((trs_model <= 3 || (memory_map & 3) < 2) &&
        (dest == VIDEO_START) && (source == VIDEO_START + 0x40) &&
-       (count == 0x3c0) && (direction > 0) && !grafyx_m3_active())
+       (count == 0x3c0) && (direction > 0) && !grafyx_m3_active() &&
+       !(debug_watch_pages[VIDEO_START >> 8] |
+	 debug_watch_pages[(VIDEO_START >> 8) + 1] |
+	 debug_watch_pages[(VIDEO_START >> 8) + 2] |
+	 debug_watch_pages[(VIDEO_START >> 8) + 3]))
     {
 	/* scroll screen one line */
         unsigned char *p = video, *q = video + 0x40;
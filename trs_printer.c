@@ -40,8 +40,15 @@
 #include "z80.h"
 #include "trs.h"
 
+/* If set, printer output goes here instead of to stdout. */
+void (*trs_printer_hook)(int value) = NULL;
+
 void trs_printer_write(int value)
 {
+    if (trs_printer_hook) {
+	trs_printer_hook(value);
+	return;
+    }
     if(value == 0x0D)
     {
 	putchar('\n');
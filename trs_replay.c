@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * trs_replay.c -- record external input, and replay it exactly.
+ *
+ * With -record, each input the emulated machine observes from the
+ * outside world is logged with the T-state count at which it was
+ * seen: keys as the keyboard matrix picks them up from the key queue,
+ * bytes as the UART reads them from the serial port, and resets from
+ * the user interface or the debugger.  With -replay, live input is
+ * ignored and the logged inputs are fed back at the same T-states.
+ *
+ * In both modes the real time clock interrupt is generated from
+ * emulated time rather than from the host clock, keyboard waits do not
+ * block, and the host clock reads as the recording's start time plus
+ * emulated time, so the machine sees identical input in both runs.
+ * Replay also turns off speed control and runs as fast as possible;
+ * when it reaches the end of the recording it reports the elapsed
+ * time and exits.
+ *
+ * The replay must start from the same state as the recording: same
+ * model, ROM, disks, and options.  Changes made in the debugger are
+ * not recorded.
+ *
+ * File format, all numbers little-endian:
+ *   header:  "XTRSREC1", 1-byte trs_model, 3 bytes reserved,
+ *            8-byte start time (seconds since 1970)
+ *   records: 1-byte type, T-states since the previous record, then
+ *            a type-dependent payload.  Variable-length numbers
+ *            hold 7 bits per byte, low bits first, with the top bit
+ *            set in all but the last byte.
+ *     REC_KEY     key queue entry (variable-length)
+ *     REC_UART    1-byte count minus 1, then the bytes
+ *     REC_RESET   reset button, no payload
+ *     REC_POWERON hard reset, no payload
+ *     REC_END     end of recording, no payload
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "trs.h"
+#include "trs_replay.h"
+
+#define REPLAY_MAGIC	"XTRSREC1"
+#define REPLAY_HEADER	20
+
+#define REC_KEY		1
+#define REC_UART	2
+#define REC_RESET	3
+#define REC_POWERON	4
+#define REC_END		5
+
+int trs_replay_mode = REPLAY_OFF;
+char *trs_record_name = NULL;
+char *trs_replay_name = NULL;
+
+static FILE *replay_file;
+static time_t replay_start;		/* host time at start of recording */
+static tstate_t replay_last;		/* T-state of the previous record */
+static tstate_t next_tick;		/* next real time clock interrupt */
+static int diverged;
+
+/* Next record to replay */
+static struct {
+  int type;				/* 0 at end of file */
+  tstate_t t;
+  int value;				/* key, or byte count */
+  Uchar data[256];
+} next;
+
+static struct timeval replay_tv;	/* host time when replay began */
+static tstate_t replay_t0;
+
+/*
+ * Recording
+ */
+
+static void put_number(unsigned long long v)
+{
+  while (v >= 0x80) {
+    putc((int) (v & 0x7f) | 0x80, replay_file);
+    v >>= 7;
+  }
+  putc((int) v, replay_file);
+}
+
+static void put_record(int type)
+{
+  putc(type, replay_file);
+  put_number(z80_state.t_count - replay_last);
+  replay_last = z80_state.t_count;
+}
+
+static void record_end(void)
+{
+  put_record(REC_END);
+  if (fclose(replay_file) != 0) {
+    error("can't write record file %s: %s", trs_record_name, strerror(errno));
+  }
+  replay_file = NULL;
+}
+
+/*
+ * Replay
+ */
+
+static int get_number(unsigned long long *v)
+{
+  int c, shift = 0;
+
+  *v = 0;
+  do {
+    c = getc(replay_file);
+    if (c == EOF || shift > 63) return -1;
+    *v |= (unsigned long long) (c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return 0;
+}
+
+/* Read the next record into next; a truncated file ends the replay */
+static void get_record(void)
+{
+  unsigned long long v;
+  int c;
+
+  c = getc(replay_file);
+  if (c == EOF || get_number(&v) < 0) goto end;
+  next.type = c;
+  next.t += v;
+  switch (c) {
+  case REC_KEY:
+    if (get_number(&v) < 0) goto end;
+    next.value = (int) v;
+    break;
+  case REC_UART:
+    if ((c = getc(replay_file)) == EOF) goto end;
+    next.value = c + 1;
+    if (fread(next.data, 1, next.value, replay_file) != (size_t) next.value) {
+      goto end;
+    }
+    break;
+  case REC_RESET:
+  case REC_POWERON:
+  case REC_END:
+    break;
+  default:
+    error("replay file %s is corrupt", trs_replay_name);
+    goto end;
+  }
+  return;
+ end:
+  next.type = REC_END;
+}
+
+/* Is the next record of this type, and due now? */
+static int due(int type)
+{
+  tstate_t late;
+
+  if (next.type != type) return FALSE;
+  late = z80_state.t_count - next.t;
+  if (late > TSTATE_T_MID) return FALSE;
+  if (late != 0 && !diverged) {
+    error("warning: replay diverged from recording at T-state %llu",
+	  (unsigned long long) next.t);
+    diverged = TRUE;
+  }
+  return TRUE;
+}
+
+static void replay_finish(void)
+{
+  struct timeval tv;
+  double secs;
+  tstate_t t = z80_state.t_count - replay_t0;
+
+  gettimeofday(&tv, NULL);
+  secs = (tv.tv_sec - replay_tv.tv_sec) +
+    (tv.tv_usec - replay_tv.tv_usec) / 1000000.0;
+  fprintf(stderr, "%s: replayed %llu T-states in %.3f s (%.3f MHz)\n",
+	  program_name, (unsigned long long) t, secs,
+	  secs > 0 ? t / secs / 1000000.0 : 0.0);
+  fclose(replay_file);
+  replay_file = NULL;
+  next.type = 0;
+  trs_exit();
+}
+
+/*
+ * Set z80_state.replay to whichever comes first, the next clock tick
+ * or the next replayed reset or end.
+ */
+static void schedule(void)
+{
+  tstate_t when = next_tick;
+
+  if (replay_file != NULL &&
+      (next.type == REC_RESET || next.type == REC_POWERON ||
+       next.type == REC_END) &&
+      next.t - z80_state.t_count < when - z80_state.t_count) {
+    when = next.t;
+  }
+  z80_state.replay = when ? when : when - 1;
+}
+
+/* Called from z80_run() when t_count reaches z80_state.replay */
+void trs_replay_event(void)
+{
+  if (z80_state.t_count - next_tick < TSTATE_T_MID) {
+    next_tick += trs_timer_tick();
+  }
+  if (trs_replay_mode == REPLAY_PLAY) {
+    while (due(REC_RESET) || due(REC_POWERON)) {
+      trs_reset(next.type == REC_POWERON);
+      get_record();
+    }
+    if (due(REC_END)) replay_finish();
+  }
+  schedule();
+}
+
+/*
+ * Hooks for the input sources
+ */
+
+/* Filter each result of dequeue_key() */
+int trs_replay_key(int key)
+{
+  switch (trs_replay_mode) {
+  case REPLAY_RECORD:
+    if (key >= 0) {
+      put_record(REC_KEY);
+      put_number(key);
+    }
+    break;
+  case REPLAY_PLAY:
+    key = -1;
+    if (due(REC_KEY)) {
+      key = next.value;
+      get_record();
+    }
+    break;
+  }
+  return key;
+}
+
+/* Filter the bytes read from the serial port into buf */
+int trs_replay_uart(Uchar *buf, int count)
+{
+  switch (trs_replay_mode) {
+  case REPLAY_RECORD:
+    if (count > 0) {
+      put_record(REC_UART);
+      putc(count - 1, replay_file);
+      fwrite(buf, 1, count, replay_file);
+    }
+    break;
+  case REPLAY_PLAY:
+    count = 0;
+    if (due(REC_UART)) {
+      count = next.value;
+      memcpy(buf, next.data, count);
+      get_record();
+    }
+    break;
+  }
+  return count;
+}
+
+/* Reset requested by the user rather than by the emulated machine */
+void trs_user_reset(int poweron)
+{
+  switch (trs_replay_mode) {
+  case REPLAY_RECORD:
+    put_record(poweron ? REC_POWERON : REC_RESET);
+    break;
+  case REPLAY_PLAY:
+    return;
+  }
+  trs_reset(poweron);
+}
+
+/* Host time, as the emulated machine should see it */
+time_t trs_replay_time(void)
+{
+  if (trs_replay_mode == REPLAY_OFF) return time(NULL);
+  return replay_start +
+    (time_t) (z80_state.t_count / (z80_state.clockMHz * 1000000.0));
+}
+
+/*
+ * Open the -record or -replay file.  Called from trs_init() before
+ * the timer is started.
+ */
+void trs_replay_init(void)
+{
+  Uchar header[REPLAY_HEADER];
+  unsigned long long start;
+  int i;
+
+  if (trs_record_name != NULL && trs_replay_name != NULL) {
+    fatal("-record and -replay cannot be used together");
+  }
+  if (trs_record_name != NULL) {
+    replay_file = fopen(trs_record_name, "wb");
+    if (replay_file == NULL) {
+      fatal("can't write record file %s: %s", trs_record_name,
+	    strerror(errno));
+    }
+    replay_start = time(NULL);
+    memset(header, 0, sizeof(header));
+    memcpy(header, REPLAY_MAGIC, 8);
+    header[8] = trs_model;
+    for (i = 0; i < 8; i++) {
+      header[12 + i] = (Uchar) ((unsigned long long) replay_start >> (8 * i));
+    }
+    fwrite(header, 1, REPLAY_HEADER, replay_file);
+    trs_replay_mode = REPLAY_RECORD;
+    atexit(record_end);
+
+  } else if (trs_replay_name != NULL) {
+    replay_file = fopen(trs_replay_name, "rb");
+    if (replay_file == NULL) {
+      fatal("can't read replay file %s: %s", trs_replay_name,
+	    strerror(errno));
+    }
+    if (fread(header, 1, REPLAY_HEADER, replay_file) != REPLAY_HEADER ||
+	memcmp(header, REPLAY_MAGIC, 8) != 0) {
+      fatal("%s is not an xtrs record file", trs_replay_name);
+    }
+    if (header[8] != trs_model) {
+      fatal("%s was recorded on model %d", trs_replay_name,
+	    header[8] == 5 ? 4 : header[8]);
+    }
+    start = 0;
+    for (i = 7; i >= 0; i--) start = (start << 8) | header[12 + i];
+    replay_start = (time_t) start;
+    trs_replay_mode = REPLAY_PLAY;
+    trs_autodelay = 0;
+    trs_keydelay = 0;
+    z80_state.delay = 0;
+    gettimeofday(&replay_tv, NULL);
+    next.t = replay_t0 = z80_state.t_count;
+    get_record();
+
+  } else {
+    return;
+  }
+
+  replay_last = z80_state.t_count;
+  next_tick = z80_state.t_count;
+  schedule();
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Input recording and replay (-record, -replay), for reproducible
+ * benchmark runs and bug reports.
+ */
+
+#ifndef _TRS_REPLAY_H
+#define _TRS_REPLAY_H
+
+#include <time.h>
+#include "z80.h"
+
+#define REPLAY_OFF	0
+#define REPLAY_RECORD	1
+#define REPLAY_PLAY	2
+
+extern int trs_replay_mode;
+extern char *trs_record_name;	/* -record file */
+extern char *trs_replay_name;	/* -replay file */
+
+extern void trs_replay_init(void);
+extern void trs_replay_event(void);
+extern int trs_replay_key(int key);
+extern int trs_replay_uart(Uchar *buf, int count);
+extern void trs_user_reset(int poweron);
+extern time_t trs_replay_time(void);
+
+#endif /*_TRS_REPLAY_H*/
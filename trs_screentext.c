@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * trs_screentext.c -- the visible screen as text.
+ *
+ * Every time the emulator polls for display events, the front end's
+ * copy of video memory is compared with the last one seen.  When the
+ * text it shows has changed, the changed rows are appended to the
+ * -screenlog file, and the whole screen is matched against the
+ * -screenmatch pattern.  A log entry looks like
+ *
+ *   @<T-states> <columns>x<rows>
+ *   <row>|<text>
+ *   ...
+ *
+ * with one line for each row whose text changed (all rows after a
+ * change of screen size).  Trailing blanks are trimmed.  Graphics
+ * characters show as '#' (or a blank if no pixels are set), and
+ * characters with no ASCII equivalent as '.'.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <regex.h>
+#include "trs.h"
+#include "trs_screentext.h"
+
+#define MAX_COLS 80
+#define MAX_ROWS 24
+
+char *trs_screentext_name = NULL;	/* -screenlog file */
+char *trs_screentext_match = NULL;	/* -screenmatch pattern */
+char *trs_screentext_action = NULL;	/* -screenmatchaction */
+int trs_screentext_active = FALSE;	/* poll from the Z80 loop */
+int trs_screentext_stopped = FALSE;	/* SCREENTEXT_STOP has fired */
+
+static FILE *screentext_file;
+static regex_t match_re;
+static int match_set = FALSE;
+static int match_action = SCREENTEXT_EXIT;
+static int matched = FALSE;	/* the screen matched at the last check */
+static int check_due = FALSE;	/* check even if the text has not changed */
+
+/* The screen as of the last poll */
+static unsigned char last_screen[MAX_COLS * MAX_ROWS];
+static int last_cols, last_rows, last_mode;
+static char lines[MAX_ROWS][MAX_COLS + 1];
+
+/* Indexed by SCREENTEXT_EXIT etc.; SCREENTEXT_STOP is library only */
+static const char *action_names[] = { "exit", "debug", "snapshot" };
+#define NUM_ACTIONS (sizeof(action_names) / sizeof(action_names[0]))
+
+/* Map a character code to ASCII the way the display shows it */
+static int screentext_char(int c, int mode)
+{
+  if (trs_model == 1) {
+    /* 0xc0-0xff is another copy of the graphics characters, and the
+       lowercase mod shows 0x00-0x1f as uppercase */
+    if (c >= 0xc0) c -= 0x40;
+    else if (c < 0x20) c += 0x40;
+  } else if (c >= 0xc0 && (mode & (ALTERNATE+INVERSE)) == 0) {
+    c -= 0x40;
+  }
+  if (mode & INVERSE) {
+    c &= 0x7f;
+  } else if (c >= 0x80 && c <= 0xbf) {
+    return c == 0x80 ? ' ' : '#';
+  }
+  if (c >= 0x20 && c < 0x7f) return c;
+  return '.';
+}
+
+static void screentext_row(const unsigned char *screen, int cols, int mode,
+			   char *text)
+{
+  int col, len = 0;
+
+  for (col = 0; col < cols; col++) {
+    if ((mode & EXPANDED) && (col & 1)) continue;
+    text[len++] = screentext_char(screen[col], mode);
+  }
+  while (len > 0 && text[len - 1] == ' ') len--;
+  text[len] = '\0';
+}
+
+static void screentext_dump(FILE *fp, const char *what)
+{
+  int row;
+
+  fprintf(fp, "@%llu %s\n", (unsigned long long) z80_state.t_count, what);
+  for (row = 0; row < last_rows; row++) {
+    fprintf(fp, "%02d|%s\n", row, lines[row]);
+  }
+  fflush(fp);
+}
+
+/* Bring lines[] up to date with the screen.  Returns TRUE if the
+   text has changed, after logging the rows that did. */
+static int screentext_update(void)
+{
+  const unsigned char *screen;
+  int cols, rows, mode, row, resized, changed = FALSE;
+  char text[MAX_COLS + 1];
+
+  screen = trs_screen_contents(&cols, &rows, &mode);
+  if (cols > MAX_COLS) cols = MAX_COLS;
+  if (rows > MAX_ROWS) rows = MAX_ROWS;
+  resized = (cols != last_cols || rows != last_rows);
+  if (!resized && mode == last_mode &&
+      memcmp(screen, last_screen, cols * rows) == 0) {
+    return FALSE;
+  }
+  memcpy(last_screen, screen, cols * rows);
+  last_cols = cols;
+  last_rows = rows;
+  last_mode = mode;
+
+  for (row = 0; row < rows; row++) {
+    screentext_row(screen + row * cols, cols, mode, text);
+    if (!resized && strcmp(text, lines[row]) == 0) continue;
+    strcpy(lines[row], text);
+    if (screentext_file) {
+      if (!changed) {
+	fprintf(screentext_file, "@%llu %dx%d\n",
+		(unsigned long long) z80_state.t_count, cols, rows);
+      }
+      fprintf(screentext_file, "%02d|%s\n", row, text);
+    }
+    changed = TRUE;
+  }
+  return changed;
+}
+
+/* Match the screen against the pattern, acting when it starts to
+   match.  A pattern that stays matched fires only once. */
+static void screentext_check(void)
+{
+  char text[MAX_ROWS * (MAX_COLS + 1) + 1];
+  int row, len = 0;
+
+  for (row = 0; row < last_rows; row++) {
+    strcpy(text + len, lines[row]);
+    len += strlen(lines[row]);
+    text[len++] = '\n';
+  }
+  text[len] = '\0';
+
+  if (regexec(&match_re, text, 0, NULL, 0) != 0) {
+    matched = FALSE;
+    return;
+  }
+  if (matched) return;
+  matched = TRUE;
+
+  if (screentext_file) {
+    fprintf(screentext_file, "@%llu match\n",
+	    (unsigned long long) z80_state.t_count);
+    fflush(screentext_file);
+  }
+  switch (match_action) {
+  case SCREENTEXT_EXIT:
+    trs_exit();
+    break;
+  case SCREENTEXT_DEBUG:
+    trs_debug();
+    break;
+  case SCREENTEXT_SNAPSHOT:
+    screentext_dump(screentext_file ? screentext_file : stdout, "snapshot");
+    break;
+  case SCREENTEXT_STOP:
+    trs_screentext_stopped = TRUE;
+    if (trs_continuous > 0) trs_continuous = 0;
+    break;
+  }
+}
+
+void trs_screentext_poll(void)
+{
+  if (screentext_update() || check_due) {
+    check_due = FALSE;
+    if (match_set) screentext_check();
+  }
+}
+
+/* Set the pattern to match and the action to take, or clear it if
+   pattern is NULL.  Returns 0, or -1 if the pattern is not a valid
+   extended regular expression. */
+int trs_screentext_set_match(const char *pattern, int action)
+{
+  char msg[256];
+  int err;
+
+  if (match_set) {
+    regfree(&match_re);
+    match_set = FALSE;
+  }
+  if (pattern != NULL) {
+    err = regcomp(&match_re, pattern, REG_EXTENDED | REG_NOSUB | REG_NEWLINE);
+    if (err != 0) {
+      regerror(err, &match_re, msg, sizeof(msg));
+      error("bad screen match pattern %s: %s", pattern, msg);
+      return -1;
+    }
+    match_set = TRUE;
+    match_action = action;
+    matched = FALSE;
+    check_due = TRUE;
+  }
+  trs_screentext_active = (screentext_file != NULL || match_set);
+  return 0;
+}
+
+/* Copy the screen text, one line per row, into buf.  Returns the
+   length of the text, which is truncated to fit in size bytes. */
+int trs_screentext_get(char *buf, int size)
+{
+  const unsigned char *screen;
+  int cols, rows, mode, row, n, len = 0;
+  char text[MAX_COLS + 1];
+
+  if (size <= 0) return 0;
+  screen = trs_screen_contents(&cols, &rows, &mode);
+  if (cols > MAX_COLS) cols = MAX_COLS;
+  if (rows > MAX_ROWS) rows = MAX_ROWS;
+  buf[0] = '\0';
+  for (row = 0; row < rows; row++) {
+    screentext_row(screen + row * cols, cols, mode, text);
+    n = strlen(text);
+    if (len + n + 1 >= size) break;
+    memcpy(buf + len, text, n);
+    len += n;
+    buf[len++] = '\n';
+    buf[len] = '\0';
+  }
+  return len;
+}
+
+void trs_screentext_init(void)
+{
+  int action = SCREENTEXT_EXIT;
+  unsigned i;
+
+  if (trs_screentext_name != NULL && screentext_file == NULL) {
+    screentext_file = fopen(trs_screentext_name, "w");
+    if (screentext_file == NULL) {
+      error("can't write screen log %s: %s",
+	    trs_screentext_name, strerror(errno));
+    } else {
+      setvbuf(screentext_file, NULL, _IOLBF, 0);
+    }
+  }
+  if (trs_screentext_action != NULL) {
+    for (i = 0; i < NUM_ACTIONS; i++) {
+      if (strcmp(trs_screentext_action, action_names[i]) == 0) break;
+    }
+    if (i < NUM_ACTIONS) {
+      action = i;
+    } else {
+      error("unknown screen match action %s", trs_screentext_action);
+    }
+  }
+  trs_screentext_set_match(trs_screentext_match, action);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Decode the visible text screen, log its changes, and act when it
+ * matches a pattern, so that scripted jobs can tell when the emulated
+ * program has printed what they are waiting for.
+ */
+
+#ifndef _TRS_SCREENTEXT_H
+#define _TRS_SCREENTEXT_H
+
+/* What to do when the screen matches -screenmatch */
+#define SCREENTEXT_EXIT		0	/* leave the emulator */
+#define SCREENTEXT_DEBUG	1	/* enter the debugger */
+#define SCREENTEXT_SNAPSHOT	2	/* log the whole screen and go on */
+#define SCREENTEXT_STOP		3	/* return from xtrs_run_for() */
+
+extern char *trs_screentext_name;
+extern char *trs_screentext_match;
+extern char *trs_screentext_action;
+extern int trs_screentext_active;
+extern int trs_screentext_stopped;
+
+extern void trs_screentext_init(void);
+extern void trs_screentext_poll(void);
+extern int trs_screentext_set_match(const char *pattern, int action);
+extern int trs_screentext_get(char *buf, int size);
+
+#endif /*_TRS_SCREENTEXT_H*/
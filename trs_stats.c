@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * trs_stats.c -- report the emulator's self-instrumentation counters.
+ *
+ * The counters in trs_stats are bumped directly by the modules that
+ * own the hot paths.  This file prints them, either on request (the
+ * debugger's "stats" command) or every few seconds into the -stats
+ * file.  Each periodic report covers only the interval since the
+ * previous one.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "trs.h"
+#include "trs_stats.h"
+
+struct trs_stats trs_stats;
+volatile int trs_stats_dump_due;
+char *trs_stats_name = NULL;	/* -stats file */
+int trs_stats_interval = 10;	/* seconds between reports to the file */
+
+/* Host time and emulated time when a report interval began */
+struct stats_time {
+  double real, user, sys;
+  tstate_t t_count;
+};
+
+static struct trs_stats stats_base, stats_last;
+static struct stats_time time_base, time_last;
+static FILE *stats_file;
+static time_t stats_next_dump;
+
+static const char *region_names[STATS_REGIONS] = {
+  "RAM", "ROM", "video", "keyboard", "mem I/O"
+};
+
+static const char *mem_names[STATS_MEMS] = {
+  "RAM", "disks", "graphics", "JIT"
+};
+
+static void stats_now(struct stats_time *st)
+{
+  struct timeval tv;
+  struct rusage ru;
+
+  gettimeofday(&tv, NULL);
+  getrusage(RUSAGE_SELF, &ru);
+  st->real = tv.tv_sec + tv.tv_usec / 1000000.0;
+  st->user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0;
+  st->sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+  st->t_count = z80_state.t_count;
+}
+
+/*
+ * Resident set size of the whole process in KB, or -1 if unknown.
+ * Only Linux reports the current value; elsewhere this is the peak.
+ */
+static long stats_resident(void)
+{
+  struct rusage ru;
+#if __linux
+  FILE *f;
+  long pages, resident;
+
+  f = fopen("/proc/self/statm", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = -1;
+    fclose(f);
+    if (resident >= 0) return resident * (sysconf(_SC_PAGESIZE) / 1024);
+  }
+#endif
+  if (getrusage(RUSAGE_SELF, &ru) < 0) return -1;
+#if __APPLE__
+  return ru.ru_maxrss / 1024;
+#else
+  return ru.ru_maxrss;
+#endif
+}
+
+/* Print the counts accumulated since the snapshot (s0, t0) */
+static void stats_report(FILE *fp, const struct trs_stats *s0,
+			 const struct stats_time *t0)
+{
+  const struct trs_stats *s = &trs_stats;
+  struct stats_time t;
+  double real;
+  unsigned long ticks;
+  int i;
+
+  stats_now(&t);
+  real = t.real - t0->real;
+  fprintf(fp, "%.2f s real, %.2f s user, %.2f s system; "
+	  "%llu T-states (%.3f MHz)\n", real, t.user - t0->user,
+	  t.sys - t0->sys, (unsigned long long) (t.t_count - t0->t_count),
+	  real > 0 ? (t.t_count - t0->t_count) / real / 1000000.0 : 0.0);
+  fprintf(fp, "%lu instructions (%.3f MIPS)\n",
+	  s->instructions - s0->instructions,
+	  real > 0 ? (s->instructions - s0->instructions) / real / 1000000.0
+	  : 0.0);
+
+  fprintf(fp, "memory      %12s %12s\n", "reads", "writes");
+  for (i = 0; i < STATS_REGIONS; i++) {
+    fprintf(fp, "  %-9s %12lu %12lu\n", region_names[i],
+	    s->mem_read[i] - s0->mem_read[i],
+	    s->mem_write[i] - s0->mem_write[i]);
+  }
+
+  fprintf(fp, "ports       %12s %12s\n", "in", "out");
+  for (i = 0; i < 256; i++) {
+    if (s->port_in[i] == s0->port_in[i] &&
+	s->port_out[i] == s0->port_out[i]) continue;
+    fprintf(fp, "  0x%02x      %12lu %12lu\n", i,
+	    s->port_in[i] - s0->port_in[i],
+	    s->port_out[i] - s0->port_out[i]);
+  }
+
+  fprintf(fp, "events: %lu scheduled, %lu fired, %lu forced early\n",
+	  s->events_scheduled - s0->events_scheduled,
+	  s->events_fired - s0->events_fired,
+	  s->events_forced - s0->events_forced);
+  fprintf(fp, "display: %lu polls, %lu events, %lu chars, %lu refreshes, "
+	  "%lu graphics bytes\n",
+	  s->display_polls - s0->display_polls,
+	  s->display_events - s0->display_events,
+	  s->display_chars - s0->display_chars,
+	  s->display_refreshes - s0->display_refreshes,
+	  s->display_graphics - s0->display_graphics);
+
+  for (i = 0; i < STATS_FLOPPIES; i++) {
+    if (s->floppy_bytes[i] == s0->floppy_bytes[i] &&
+	s->floppy_seeks[i] == s0->floppy_seeks[i]) continue;
+    fprintf(fp, "floppy %d: %lu bytes, %lu seeks\n", i,
+	    s->floppy_bytes[i] - s0->floppy_bytes[i],
+	    s->floppy_seeks[i] - s0->floppy_seeks[i]);
+  }
+  for (i = 0; i < STATS_HARD; i++) {
+    if (s->hard_bytes[i] == s0->hard_bytes[i] &&
+	s->hard_seeks[i] == s0->hard_seeks[i]) continue;
+    fprintf(fp, "hard %d: %lu bytes, %lu seeks\n", i,
+	    s->hard_bytes[i] - s0->hard_bytes[i],
+	    s->hard_seeks[i] - s0->hard_seeks[i]);
+  }
+
+  fprintf(fp, "resident: %ld KB;", stats_resident());
+  for (i = 0; i < STATS_MEMS; i++) {
+    fprintf(fp, " %s %lu KB%s", mem_names[i], (s->mem_bytes[i] + 1023) / 1024,
+	    i < STATS_MEMS - 1 ? "," : "\n");
+  }
+
+  ticks = s->delay_ticks - s0->delay_ticks;
+  fprintf(fp, "delay: %lu average, %d now (autodelay %s)\n",
+	  ticks ? (s->delay_sum - s0->delay_sum) / ticks : 0,
+	  z80_state.delay, trs_autodelay ? "on" : "off");
+}
+
+/*
+ * Start counting.  If trs_stats_name is set, append a report covering
+ * each trs_stats_interval seconds to that file.
+ */
+void trs_stats_init(void)
+{
+  trs_stats_reset();
+  time_last = time_base;
+  if (trs_stats_name == NULL) return;
+  stats_file = fopen(trs_stats_name, "a");
+  if (stats_file == NULL) {
+    error("can't write stats file %s: %s", trs_stats_name, strerror(errno));
+    return;
+  }
+  if (trs_stats_interval <= 0) trs_stats_interval = 10;
+  stats_next_dump = time(NULL) + trs_stats_interval;
+}
+
+/* Called at each heartbeat, from trs_timer_event() */
+void trs_stats_tick(void)
+{
+  trs_stats.delay_ticks++;
+  trs_stats.delay_sum += z80_state.delay;
+  if (stats_file != NULL && time(NULL) >= stats_next_dump) {
+    trs_stats_dump_due = TRUE;
+  }
+}
+
+/* Called from z80_run() when trs_stats_dump_due is set */
+void trs_stats_dump(void)
+{
+  time_t now = time(NULL);
+
+  trs_stats_dump_due = FALSE;
+  if (stats_file == NULL) return;
+  fprintf(stats_file, "\n--- %s", ctime(&now));
+  stats_report(stats_file, &stats_last, &time_last);
+  fflush(stats_file);
+  stats_last = trs_stats;
+  stats_now(&time_last);
+  stats_next_dump = now + trs_stats_interval;
+}
+
+/* Print the counts since startup or the last trs_stats_reset() */
+void trs_stats_print(FILE *fp)
+{
+  stats_report(fp, &stats_base, &time_base);
+}
+
+void trs_stats_reset(void)
+{
+  stats_base = trs_stats;
+  stats_now(&time_base);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Counters for the emulator's own hot paths, to help tell whether a
+ * slow job is limited by Z80 emulation, by I/O, or by the display.
+ */
+
+#ifndef _TRS_STATS_H
+#define _TRS_STATS_H
+
+#include <stdio.h>
+#include "z80.h"
+
+/* Memory regions, for counting mem_read() and mem_write() calls */
+#define STATS_RAM	0
+#define STATS_ROM	1
+#define STATS_VIDEO	2
+#define STATS_KEYBOARD	3
+#define STATS_MMIO	4	/* Model I FDC, printer, cassette, etc. */
+#define STATS_REGIONS	5
+
+#define STATS_FLOPPIES	8
+#define STATS_HARD	4
+
+/* Subsystems whose buffers are allocated on demand, for mem_bytes[] */
+#define STATS_MEM_RAM		0	/* emulated RAM, ROM and video */
+#define STATS_MEM_DISK		1	/* per-drive floppy image state */
+#define STATS_MEM_GRAPHICS	2	/* Grafyx and HRG screens */
+#define STATS_MEM_JIT		3	/* translated code and its tables */
+#define STATS_MEMS		4
+
+struct trs_stats {
+  unsigned long instructions;	/* Z80 instructions executed */
+  unsigned long mem_read[STATS_REGIONS];
+  unsigned long mem_write[STATS_REGIONS];
+  unsigned long port_in[256];
+  unsigned long port_out[256];
+  unsigned long events_scheduled;
+  unsigned long events_fired;
+  unsigned long events_forced;	/* fired early to make room for another */
+  unsigned long display_polls;	/* calls to trs_get_event() */
+  unsigned long display_events;	/* window system events handled */
+  unsigned long display_chars;	/* characters written */
+  unsigned long display_refreshes; /* full screen redraws */
+  unsigned long display_graphics;	/* hi-res graphics bytes written */
+  unsigned long floppy_bytes[STATS_FLOPPIES];
+  unsigned long floppy_seeks[STATS_FLOPPIES];
+  unsigned long hard_bytes[STATS_HARD];
+  unsigned long hard_seeks[STATS_HARD];
+  unsigned long delay_ticks;	/* timer ticks, for averaging delay */
+  unsigned long delay_sum;	/* sum of z80_state.delay at each tick */
+  unsigned long mem_bytes[STATS_MEMS]; /* now allocated; not a count */
+};
+
+extern struct trs_stats trs_stats;
+extern volatile int trs_stats_dump_due;
+extern char *trs_stats_name;
+extern int trs_stats_interval;
+
+extern void trs_stats_init(void);
+extern void trs_stats_tick(void);
+extern void trs_stats_dump(void);
+extern void trs_stats_print(FILE *fp);
+extern void trs_stats_reset(void);
+
+#endif /*_TRS_STATS_H*/
@@ -80,6 +80,9 @@ typedef struct {
   long esf_bytepos;
   Uchar esf_bytebuf;
   Uchar esf_bitpos;
+  Uchar *esf_data;    /* whole wafer, esf_bytelen bytes */
+  long esf_dirty_lo;  /* range of esf_data not yet written back */
+  long esf_dirty_hi;
 #if STRINGYDEBUG_IN
   int prev_in_port;
 #endif
@@ -200,6 +203,48 @@ stringy_read_header(stringy_info_t *s)
   return ires;
 }
 
+/*
+ * Read the whole of an esf wafer into memory.  Bytes past the end of
+ * a short file read as 0, as they did when read from the file.
+ */
+static void
+stringy_load_esf(stringy_info_t *s)
+{
+  s->esf_data = (Uchar *) calloc(s->esf_bytelen ? s->esf_bytelen : 1, 1);
+  if (s->esf_data == NULL) fatal("out of memory for stringy wafer");
+  fseek(s->file, stringy_esf_header_length, SEEK_SET);
+  if (fread(s->esf_data, 1, s->esf_bytelen, s->file) == 0 &&
+      ferror(s->file)) {
+    error("reading stringy wafer %s: %s", s->name, strerror(errno));
+  }
+  s->esf_dirty_lo = s->esf_bytelen;
+  s->esf_dirty_hi = 0;
+}
+
+/* Write back the part of an esf wafer that has changed in memory. */
+static void
+stringy_write_back(stringy_info_t *s)
+{
+  if (s->esf_data == NULL || s->esf_dirty_lo >= s->esf_dirty_hi) return;
+  fseek(s->file, stringy_esf_header_length + s->esf_dirty_lo, SEEK_SET);
+  if (fwrite(s->esf_data + s->esf_dirty_lo, 1,
+	     s->esf_dirty_hi - s->esf_dirty_lo, s->file) !=
+      (size_t) (s->esf_dirty_hi - s->esf_dirty_lo) || fflush(s->file) != 0) {
+    error("writing stringy wafer %s: %s", s->name, strerror(errno));
+  }
+  s->esf_dirty_lo = s->esf_bytelen;
+  s->esf_dirty_hi = 0;
+}
+
+static void
+stringy_write_back_all(void)
+{
+  int i;
+  for (i = 0; i < STRINGY_MAX_UNITS; i++) {
+    stringy_write_back(&stringy_info[i]);
+  }
+}
+
 /* Returns 0 if OK, -1 if invalid header, errno value otherwise. */
 static int
 stringy_change(int unit)
@@ -208,9 +253,12 @@ stringy_change(int unit)
   int ires;
 
   if (s->file) {
+    stringy_write_back(s);
     fclose(s->file);
     s->file = NULL;
   }
+  free(s->esf_data);
+  s->esf_data = NULL;
   if (s->name == NULL) {
     s->in_port = STRINGY_NO_WAFER;
     return 0;
@@ -232,6 +280,9 @@ stringy_change(int unit)
   s->out_port = 0;
 
   ires = stringy_read_header(s);
+  if (ires == 0 && s->format == STRINGY_FMT_ESF) {
+    stringy_load_esf(s);
+  }
 
   s->pos = 0;
   s->pos_time = z80_state.t_count;
@@ -285,35 +336,41 @@ stringy_init(void)
 	      trs_disk_dir, trs_model, i);
     }
   }
+  atexit(stringy_write_back_all);
 }
 
 /* Stringy controller hardware reset */
 void
 stringy_reset(void)
 {
-  /* Nothing to do (?) */
+  stringy_write_back_all();
+}
+
+/* Store a byte of an esf wafer at esf_bytepos, in memory only */
+static void
+stringy_byte_store(stringy_info_t *s, Uchar value)
+{
+  long pos = s->esf_bytepos;
+
+  if (pos >= s->esf_bytelen) return;
+  s->esf_data[pos] = value;
+  if (pos < s->esf_dirty_lo) s->esf_dirty_lo = pos;
+  if (pos >= s->esf_dirty_hi) s->esf_dirty_hi = pos + 1;
 }
 
 static void
 stringy_byte_flush(stringy_info_t *s)
 {
-  int ires;
   Uchar mask;
 
   if (s->format != STRINGY_FMT_ESF ||
       stringy_state(s->out_port) != STRINGY_WRITING ||
-      s->esf_bitpos == 0) return;
+      s->esf_bitpos == 0 || s->esf_bytepos >= s->esf_bytelen) return;
 
-  fseek(s->file, 0, SEEK_CUR);
-  ires = fgetc(s->file);
-  if (ires == EOF) {
-    ires = 0;
-  }
-  fseek(s->file, -1, SEEK_CUR);
   mask = 0xff << s->esf_bitpos;
-  s->esf_bytebuf = (ires & mask) | (s->esf_bytebuf & ~mask);
-  fputc(s->esf_bytebuf, s->file); //XXX handle errors
-  fseek(s->file, -1, SEEK_CUR);
+  s->esf_bytebuf = (s->esf_data[s->esf_bytepos] & mask) |
+    (s->esf_bytebuf & ~mask);
+  stringy_byte_store(s, s->esf_bytebuf);
 }
 
 static void
@@ -323,9 +380,8 @@ stringy_bit_write(stringy_info_t *s, int flux)
   s->esf_bytebuf |= flux << s->esf_bitpos;
   s->esf_bitpos++;
   if (s->esf_bitpos == 8) {
-    fputc(s->esf_bytebuf, s->file); //XXX handle errors
+    stringy_byte_store(s, s->esf_bytebuf);
     if (++s->esf_bytepos >= s->esf_bytelen) {
-      fseek(s->file, stringy_esf_header_length, SEEK_SET);
       s->esf_bytepos = 0;
     }
     s->esf_bitpos = 0;
@@ -378,18 +434,11 @@ stringy_flux_write(stringy_info_t *s, int flux, stringy_pos_t delta)
 static int
 stringy_bit_read(stringy_info_t *s, int *bit)
 {
-  int ires;
-
   if (s->esf_bitpos == 0) {
-    if (s->esf_bytepos++ >= s->esf_bytelen) {
-      fseek(s->file, stringy_esf_header_length, SEEK_SET);
+    if (s->esf_bytepos >= s->esf_bytelen) {
       s->esf_bytepos = 0;
     }
-    ires = fgetc(s->file); //XXX handle errors (but do ignore EOF)
-    if (ires < 0) {
-      ires = 0;
-    }
-    s->esf_bytebuf = ires;
+    s->esf_bytebuf = s->esf_data[s->esf_bytepos++];
   }
   *bit = (s->esf_bytebuf & (1 << s->esf_bitpos)) != 0;
   s->esf_bitpos = (s->esf_bitpos + 1) % 8;
@@ -555,8 +604,8 @@ stringy_out(int unit, int value)
       fflush(s->file);
       res = ftruncate(fileno(s->file), ftell(s->file));
       assert(res == 0);
+      fseek(s->file, 0, SEEK_CUR);
     }
-    fseek(s->file, 0, SEEK_CUR);
     stringy_flux_write(s, 1, 0); //XXX needed?  bad?
   }
 
@@ -570,7 +619,7 @@ stringy_out(int unit, int value)
 
     if (new_state != STRINGY_WRITING) {
       stringy_byte_flush(s);
-      fflush(s->file);
+      if (s->format == STRINGY_FMT_DEBUG) fflush(s->file);
     }
   }
 
@@ -24,30 +24,50 @@
 
 /*
  * Emulation of the Radio Shack TRS-80 Model I/III/4/4P serial port.
+ *
+ * The host end of the serial line is a terminal device, a pty that
+ * xtrs creates ("-serial pty"), or a Unix or loopback TCP socket that
+ * xtrs listens on ("-serial unix:path" or "-serial tcp:port").  Host
+ * i/o never blocks: input is read when trs_timer_wait() or the event
+ * poll finds it ready, and output goes through a ring buffer that is
+ * drained whenever the host will take more.  The UART's status bits
+ * are paced at the selected baud rate unless -fastserial is given.
  */
 
-#define _POSIX_C_SOURCE 200112L /* signal.h: sigemptyset(), ... */
+#define _XOPEN_SOURCE 600 /* posix_openpt(), grantpt(), ... */
 
 #include <errno.h>
 #include <termios.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
 #include <string.h>
-#include <signal.h>
 #include "trs.h"
 #include "trs_uart.h"
+#include "trs_replay.h"
 
-#ifndef FNONBLOCK
-#define FNONBLOCK O_NONBLOCK
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
 #endif
 
-#define BUFSIZE 256
+#define BUFSIZE 256	/* input; at most 256 for trs_replay_uart() */
+#define OBUFSIZE 4096	/* output ring */
 /*#define UARTDEBUG 1*/
 /*#define UARTDEBUG2 1*/
 
+/* Kinds of host endpoint */
+#define UART_TTY 0
+#define UART_PTY 1
+#define UART_SOCKET 2
+
 #if __linux
 char *trs_uart_name = "/dev/ttyS0";
 #else
@@ -55,6 +75,7 @@ char *trs_uart_name = "/dev/tty00";
 #endif
 int trs_uart_switches =
   0x7 | TRS_UART_NOPAR | TRS_UART_WORD8; /* Default: 9600 8N1 */
+int trs_uart_fast = 0;
 
 static int initialized = 0;
 
@@ -72,8 +93,15 @@ static struct {
   int bufleft;
   int tstates;
 
-  int fd;
-  int fdflags;
+  Uchar obuf[OBUFSIZE];
+  int ohead;		/* next byte to write to the host */
+  int ocount;		/* bytes waiting in obuf */
+  int oblocked;		/* obuf was full; set SENT when it drains */
+
+  int kind;
+  int fd;		/* -1 if no socket client is connected */
+  int listenfd;		/* UART_SOCKET only */
+  int slavefd;		/* UART_PTY only; keeps the master from hanging up */
   struct termios t;
 } uart;
 
@@ -133,6 +161,104 @@ xlate_baud(int trs_baud)
   return B0;  /* not reached */
 }
 
+/* Create a pty and tell the user the name of its slave end */
+static int
+uart_open_pty(void)
+{
+  char *name;
+  struct termios t;
+
+  uart.fd = posix_openpt(O_RDWR|O_NOCTTY);
+  if (uart.fd == -1 || grantpt(uart.fd) == -1 || unlockpt(uart.fd) == -1 ||
+      (name = ptsname(uart.fd)) == NULL) {
+    error("can't create serial pty: %s", strerror(errno));
+    return -1;
+  }
+  uart.slavefd = open(name, O_RDWR|O_NOCTTY);
+  if (uart.slavefd == -1) {
+    error("can't open %s: %s", name, strerror(errno));
+    return -1;
+  }
+  /* Raw mode on the slave side, until a program there changes it */
+  if (tcgetattr(uart.slavefd, &t) == 0) {
+    t.c_iflag = 0;
+    t.c_oflag = 0;
+    t.c_lflag = 0;
+    t.c_cflag = CS8|CREAD|CLOCAL;
+    memset(t.c_cc, 0, sizeof(t.c_cc));
+    t.c_cc[VMIN] = 1;
+    tcsetattr(uart.slavefd, TCSANOW, &t);
+  }
+  fcntl(uart.fd, F_SETFL, fcntl(uart.fd, F_GETFL) | O_NONBLOCK);
+  fprintf(stderr, "%s: serial port is %s\n", program_name, name);
+  return 0;
+}
+
+/* Listen on "unix:path" or on loopback "tcp:port" */
+static int
+uart_open_socket(void)
+{
+  struct sockaddr_in in;
+  struct sockaddr_un un;
+  struct stat st;
+  char *arg = strchr(trs_uart_name, ':') + 1;
+  int fd, one = 1;
+
+  if (trs_uart_name[0] == 'u') {
+    /* Remove a stale socket left by an earlier run, but nothing else */
+    if (lstat(arg, &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+	error("can't use %s as serial socket: file exists", arg);
+	return -1;
+      }
+      unlink(arg);
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, arg, sizeof(un.sun_path) - 1);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &un, sizeof(un)) < 0) {
+      error("can't bind serial socket %s: %s", arg, strerror(errno));
+      if (fd >= 0) close(fd);
+      return -1;
+    }
+  } else {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons(atoi(arg));
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (struct sockaddr *) &in, sizeof(in)) < 0) {
+      error("can't bind serial port %s: %s", arg, strerror(errno));
+      if (fd >= 0) close(fd);
+      return -1;
+    }
+  }
+  if (listen(fd, 1) < 0) {
+    error("can't listen on serial socket: %s", strerror(errno));
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  uart.listenfd = fd;
+  return 0;
+}
+
+/* Drop the socket client, if any, and go back to listening */
+static void
+uart_hangup(void)
+{
+  if (uart.kind == UART_SOCKET && uart.fd != -1) {
+#if UARTDEBUG
+    debug("trs_uart client hung up\n");
+#endif
+    close(uart.fd);
+    uart.fd = -1;
+  }
+  uart.ocount = 0;
+}
+
 void
 trs_uart_init(int reset_button)
 {
@@ -147,21 +273,34 @@ trs_uart_init(int reset_button)
     return;
   }
   initialized = 1;
-  uart.fd = open(trs_uart_name, O_RDWR|O_NOCTTY|O_NONBLOCK);
-  if (uart.fd == -1) {
-    error("can't open %s: %s", trs_uart_name, strerror(errno));
-    initialized = -1;
-    return;
+  uart.fd = uart.listenfd = uart.slavefd = -1;
+  if (strcmp(trs_uart_name, "pty") == 0) {
+    uart.kind = UART_PTY;
+    err = uart_open_pty();
+  } else if (strncmp(trs_uart_name, "unix:", 5) == 0 ||
+	     strncmp(trs_uart_name, "tcp:", 4) == 0) {
+    uart.kind = UART_SOCKET;
+    err = uart_open_socket();
   } else {
-    uart.fdflags = FNONBLOCK;
-    err = tcgetattr(uart.fd, &uart.t);
-    if (err < 0) {
-      error("can't get attributes of %s: %s", trs_uart_name, strerror(errno));
-      close(uart.fd);
-      initialized = uart.fd = -1;
-      return;
+    uart.kind = UART_TTY;
+    uart.fd = open(trs_uart_name, O_RDWR|O_NOCTTY|O_NONBLOCK);
+    if (uart.fd == -1) {
+      error("can't open %s: %s", trs_uart_name, strerror(errno));
+      err = -1;
+    } else {
+      err = tcgetattr(uart.fd, &uart.t);
+      if (err < 0) {
+	error("can't get attributes of %s: %s",
+	      trs_uart_name, strerror(errno));
+      }
     }
   }
+  if (err < 0) {
+    if (uart.fd != -1) close(uart.fd);
+    if (uart.slavefd != -1) close(uart.slavefd);
+    initialized = uart.fd = uart.slavefd = -1;
+    return;
+  }
 
   uart.t.c_iflag = 0;
   uart.t.c_oflag = 0;
@@ -187,6 +326,7 @@ trs_uart_init(int reset_button)
 
   uart.bufp = uart.buf;
   uart.bufleft = 0;
+  uart.ohead = uart.ocount = uart.oblocked = 0;
 }
 
 int
@@ -251,7 +391,7 @@ trs_uart_baud_out(int value)
   debug("total bits %d; tstates per word %d\n", bits, uart.tstates);
 #endif
 
-  if (uart.fd != -1) {
+  if (uart.kind == UART_TTY) {
     err = tcsetattr(uart.fd, TCSADRAIN, &uart.t);
     if (err == -1) {
       error("can't set attributes of %s: %s", trs_uart_name, strerror(errno));
@@ -269,43 +409,106 @@ trs_uart_set_avail(int dummy)
 void
 trs_uart_set_empty(int dummy)
 {
+  if (uart.ocount == OBUFSIZE) {
+    /* Host isn't keeping up; wait for uart_flush() to make room */
+    uart.oblocked = 1;
+    return;
+  }
   uart.status |= TRS_UART_SENT;
   trs_uart_snd_interrupt(1);
 }
 
-int
-trs_uart_check_avail(void)
+/* Write as much of the output ring as the host will take */
+static void
+uart_flush(void)
 {
-  if (initialized == 1 && uart.bufleft == 0 && uart.fd != -1) {
-    /* check for data available */
-    int rc;
-    if (!(uart.fdflags & FNONBLOCK)) {
+  int n, rc;
+
+  if (uart.fd == -1) {
+    /* No socket client to send to */
+    uart.ocount = 0;
+  }
+  while (uart.ocount > 0) {
+    n = OBUFSIZE - uart.ohead;
+    if (n > uart.ocount) n = uart.ocount;
+    if (uart.kind == UART_SOCKET) {
+      rc = send(uart.fd, &uart.obuf[uart.ohead], n, MSG_NOSIGNAL);
+    } else {
+      rc = write(uart.fd, &uart.obuf[uart.ohead], n);
+    }
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      if (uart.kind != UART_SOCKET) {
+	error("can't write to %s: %s", trs_uart_name, strerror(errno));
+      }
+      uart_hangup();
+      break;
+    }
+    uart.ohead = (uart.ohead + rc) % OBUFSIZE;
+    uart.ocount -= rc;
+  }
+  if (uart.oblocked && uart.ocount < OBUFSIZE) {
+    uart.oblocked = 0;
+    trs_uart_set_empty(0);
+  }
+}
+
+/* Read whatever host input is ready into buf; return the count */
+static int
+uart_read(void)
+{
+  int rc;
+
+  if (uart.fd == -1) {
+    /* Accept a socket client, if one is waiting */
+    uart.fd = accept(uart.listenfd, NULL, NULL);
+    if (uart.fd == -1) return 0;
+    fcntl(uart.fd, F_SETFL, fcntl(uart.fd, F_GETFL) | O_NONBLOCK);
 #if UARTDEBUG
-      debug("trs_uart nonblocking\n");
+    debug("trs_uart client connected\n");
 #endif
-      uart.fdflags |= FNONBLOCK;
-      fcntl(uart.fd, F_SETFL, uart.fdflags);
-    }
-    do {
-      rc = read(uart.fd, uart.buf, BUFSIZE);
-    } while (rc < 0 && errno == EINTR);
+  }
+  do {
+    rc = read(uart.fd, uart.buf, BUFSIZE);
+  } while (rc < 0 && errno == EINTR);
 #if UARTDEBUG
 #if !UARTDEBUG2
-    if (rc >= 0 || errno != EAGAIN)
+  if (rc >= 0 || errno != EAGAIN)
 #endif
-      debug("trs_uart read returns %d, errno %d\n", rc, errno);
+    debug("trs_uart read returns %d, errno %d\n", rc, errno);
 #endif
-    if (rc < 0) {
-      if (errno != EAGAIN) {
+  if (rc == 0 && uart.kind == UART_SOCKET) {
+    uart_hangup();
+  } else if (rc < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      if (uart.kind != UART_SOCKET) {
 	error("can't read from %s: %s", trs_uart_name, strerror(errno));
       }
-      rc = 0;
+      uart_hangup();
     }
+    rc = 0;
+  }
+  return rc;
+}
+
+int
+trs_uart_check_avail(void)
+{
+  if (initialized == 1) uart_flush();
+  if (initialized == 1 && uart.bufleft == 0) {
+    /* check for data available */
+    int rc = uart_read();
+    if (trs_replay_mode != REPLAY_OFF) rc = trs_replay_uart(uart.buf, rc);
     uart.bufp = uart.buf;
     uart.bufleft = rc;
     if (rc > 0) {
       /* be sure events don't happen too fast */
-      trs_schedule_event(trs_uart_set_avail, 1, uart.tstates);
+      if (trs_uart_fast) {
+	trs_uart_set_avail(1);
+      } else {
+	trs_schedule_event(trs_uart_set_avail, 1, uart.tstates);
+      }
     }
   }
 #if UARTDEBUG2
@@ -314,6 +517,22 @@ trs_uart_check_avail(void)
   return uart.bufleft;
 }
 
+/*
+ * The host fd to wait on, or -1 if there is no need.  *events is set
+ * to POLLIN and/or POLLOUT.
+ */
+int
+trs_uart_fd(int *events)
+{
+  if (initialized != 1) return -1;
+  if (uart.fd == -1) {
+    *events = POLLIN;
+    return uart.listenfd;
+  }
+  *events = (uart.bufleft == 0 ? POLLIN : 0) | (uart.ocount > 0 ? POLLOUT : 0);
+  return *events ? uart.fd : -1;
+}
+
 int
 trs_uart_status_in(void)
 {
@@ -362,20 +581,15 @@ trs_uart_control_out(int value)
   if (value & TRS_UART_STOP2) cflag |= CSTOPB;
   if (!(value & TRS_UART_NOPAR)) cflag |= PARENB;
   uart.t.c_cflag = cflag;
-  if (uart.fd != -1) {
+  if (uart.kind == UART_TTY) {
     err = tcsetattr(uart.fd, TCSADRAIN, &uart.t);
     if (err == -1) {
       error("can't set attributes of %s: %s", trs_uart_name, strerror(errno));
     }
   }
 
-  if (!(value & TRS_UART_NOTBREAK) && uart.fd != -1) {
-    sigset_t set, oldset;
-    sigemptyset(&set);
-    sigaddset(&set, SIGALRM);
-    sigprocmask(SIG_BLOCK, &set, &oldset);
+  if (!(value & TRS_UART_NOTBREAK) && uart.kind == UART_TTY) {
     err = tcsendbreak(uart.fd, 0);
-    sigprocmask(SIG_SETMASK, &oldset, NULL);
     if (err == -1) {
       error("can't send break on %s: %s", trs_uart_name, strerror(errno));
     }
@@ -394,7 +608,11 @@ trs_uart_data_in(void)
     uart.bufleft--;
     uart.idata = *uart.bufp++;
     if (uart.bufleft) {
-      trs_schedule_event(trs_uart_set_avail, 1, uart.tstates);
+      if (trs_uart_fast) {
+	trs_uart_set_avail(1);
+      } else {
+	trs_schedule_event(trs_uart_set_avail, 1, uart.tstates);
+      }
     }
   }
 #if UARTDEBUG
@@ -406,30 +624,25 @@ trs_uart_data_in(void)
 void
 trs_uart_data_out(int value)
 {
-  int err;
-
 #if UARTDEBUG
   debug("trs_uart_data_out 0x%02x\n", value);
 #endif
   if (initialized == 0) trs_uart_init(0);
   if (initialized == -1) return;
   uart.odata = value;
-  if (uart.fd != -1) {
-    for (;;) {
-      err = write(uart.fd, &uart.odata, 1);
-      if (err >= 0) return;
-      if (errno != EAGAIN) {
-	error("can't read from %s: %s", trs_uart_name, strerror(errno));
-	return;
-      }
-      /* Oops, here we didn't really want nonblocking i/o */
-#if UARTDEBUG
-      debug("trs_uart blocking\n");
-#endif
-      uart.fdflags &= ~FNONBLOCK;
-      fcntl(uart.fd, F_SETFL, uart.fdflags);
-    }
-    trs_uart_snd_interrupt(0);
+  if (uart.ocount == OBUFSIZE) {
+    /* Guest didn't wait for SENT; the byte is lost */
+    return;
+  }
+  uart.obuf[(uart.ohead + uart.ocount) % OBUFSIZE] = value;
+  uart.ocount++;
+  uart_flush();
+
+  uart.status &= ~TRS_UART_SENT;
+  trs_uart_snd_interrupt(0);
+  if (trs_uart_fast) {
+    trs_uart_set_empty(1);
+  } else {
     trs_schedule_event(trs_uart_set_empty, 1, uart.tstates);
-  }    
+  }
 }
@@ -32,6 +32,7 @@
 
 extern void trs_uart_init(int reset_button);
 extern int trs_uart_check_avail();
+extern int trs_uart_fd(int *events);
 extern int trs_uart_modem_in();
 extern void trs_uart_reset_out(int value);
 extern int trs_uart_switches_in();
@@ -42,6 +43,7 @@ extern int trs_uart_data_in();
 extern void trs_uart_data_out(int value);
 extern char *trs_uart_name;
 extern int trs_uart_switches;
+extern int trs_uart_fast;
 
 #define TRS_UART_MODEM    0xE8 /* in */
 #define TRS_UART_RESET    0xE8 /* out */
@@ -58,6 +58,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
@@ -72,6 +74,11 @@
 #include "trs_disk.h"
 #include "trs_uart.h"
 #include "trs_imp_exp.h"
+#include "trs_stats.h"
+#include "z80_trace.h"
+#include "z80_coverage.h"
+#include "trs_replay.h"
+#include "trs_screentext.h"
 
 #define DEF_FONT1	"-misc-fixed-medium-r-normal--20-200-75-75-*-100-iso8859-1"
 #define DEF_WIDEFONT1	"-misc-fixed-medium-r-normal--20-200-75-75-*-200-iso8859-1"
@@ -139,6 +146,8 @@ static XrmOptionDescRec opts[] = {
 {"-romfile4p",	"*romfile4p",	XrmoptionSepArg,	(XPointer)NULL},
 {"-resize",	"*resize",	XrmoptionNoArg,		(XPointer)"on"},
 {"-noresize",	"*resize",	XrmoptionNoArg,		(XPointer)"off"},
+{"-renderthread","*renderthread",XrmoptionNoArg,	(XPointer)"on"},
+{"-norenderthread","*renderthread",XrmoptionNoArg,	(XPointer)"off"},
 {"-doublestep", "*doublestep",  XrmoptionNoArg,         (XPointer)"on"},
 {"-nodoublestep","*doublestep", XrmoptionNoArg,         (XPointer)"off"},
 {"-model",      "*model",       XrmoptionSepArg,	(XPointer)NULL},
@@ -152,6 +161,7 @@ static XrmOptionDescRec opts[] = {
 {"-noautodelay","*autodelay",   XrmoptionNoArg,         (XPointer)"off"},
 {"-keystretch", "*keystretch",  XrmoptionSepArg,        (XPointer)NULL},
 {"-keydelay",   "*keydelay",    XrmoptionSepArg,        (XPointer)NULL},
+{"-typein",     "*typein",      XrmoptionSepArg,        (XPointer)NULL},
 {"-microlabs",  "*microlabs",   XrmoptionNoArg,         (XPointer)"on"},
 {"-nomicrolabs","*microlabs",   XrmoptionNoArg,         (XPointer)"off"},
 {"-doubler",    "*doubler",     XrmoptionSepArg,        (XPointer)NULL},
@@ -161,6 +171,8 @@ static XrmOptionDescRec opts[] = {
 {"-truedam",    "*truedam",     XrmoptionNoArg,         (XPointer)"on"},
 {"-notruedam",  "*truedam",     XrmoptionNoArg,         (XPointer)"off"},
 {"-samplerate", "*samplerate",  XrmoptionSepArg,        (XPointer)NULL},
+{"-fastcassette","*fastcassette",XrmoptionNoArg,        (XPointer)"on"},
+{"-nofastcassette","*fastcassette",XrmoptionNoArg,      (XPointer)"off"},
 {"-title",      "*title",       XrmoptionSepArg,        (XPointer)NULL},
 {"-scale",      "*scale",       XrmoptionSepArg,        (XPointer)NULL},
 {"-scale1",     "*scale",       XrmoptionNoArg,         (XPointer)"1"},
@@ -169,8 +181,30 @@ static XrmOptionDescRec opts[] = {
 {"-scale4",     "*scale",       XrmoptionNoArg,         (XPointer)"4"},
 {"-serial",     "*serial",      XrmoptionSepArg,        (XPointer)NULL},
 {"-switches",   "*switches",    XrmoptionSepArg,        (XPointer)NULL},
+{"-fastserial", "*fastserial",  XrmoptionNoArg,         (XPointer)"on"},
+{"-nofastserial","*fastserial", XrmoptionNoArg,         (XPointer)"off"},
 {"-shiftbracket","*shiftbracket",XrmoptionNoArg,        (XPointer)"on"},
 {"-noshiftbracket","*shiftbracket",XrmoptionNoArg,      (XPointer)"off"},
+{"-jit",        "*jit",         XrmoptionNoArg,         (XPointer)"on"},
+{"-nojit",      "*jit",         XrmoptionNoArg,         (XPointer)"off"},
+{"-profile",    "*profile",     XrmoptionSepArg,        (XPointer)NULL},
+{"-profilesyms","*profilesyms", XrmoptionSepArg,        (XPointer)NULL},
+{"-trace",      "*trace",       XrmoptionSepArg,        (XPointer)NULL},
+{"-tracesize",  "*tracesize",   XrmoptionSepArg,        (XPointer)NULL},
+{"-coverage",   "*coverage",    XrmoptionSepArg,        (XPointer)NULL},
+{"-coveragedata","*coveragedata",XrmoptionNoArg,        (XPointer)"on"},
+{"-nocoveragedata","*coveragedata",XrmoptionNoArg,      (XPointer)"off"},
+{"-run",        "*run",         XrmoptionSepArg,        (XPointer)NULL},
+{"-runexit",    "*runexit",     XrmoptionNoArg,         (XPointer)"on"},
+{"-norunexit",  "*runexit",     XrmoptionNoArg,         (XPointer)"off"},
+{"-gdb",        "*gdb",         XrmoptionSepArg,        (XPointer)NULL},
+{"-record",     "*record",      XrmoptionSepArg,        (XPointer)NULL},
+{"-replay",     "*replay",      XrmoptionSepArg,        (XPointer)NULL},
+{"-stats",      "*stats",       XrmoptionSepArg,        (XPointer)NULL},
+{"-statsinterval","*statsinterval",XrmoptionSepArg,     (XPointer)NULL},
+{"-screenlog",  "*screenlog",   XrmoptionSepArg,        (XPointer)NULL},
+{"-screenmatch","*screenmatch", XrmoptionSepArg,        (XPointer)NULL},
+{"-screenmatchaction","*screenmatchaction",XrmoptionSepArg,(XPointer)NULL},
 {"-emtsafe",    "*emtsafe",     XrmoptionNoArg,         (XPointer)"on"},
 {"-noemtsafe",  "*emtsafe",     XrmoptionNoArg,         (XPointer)"off"},
 {"-lowercase",  "*lowercase",   XrmoptionNoArg,         (XPointer)"on"},
@@ -185,8 +219,10 @@ static int num_opts = (sizeof opts / sizeof opts[0]);
 /* True size of graphics memory -- some is offscreen */
 #define G_XSIZE 128
 #define G_YSIZE 256
-char grafyx[(2*G_YSIZE*MAX_SCALE) * (G_XSIZE*MAX_SCALE)];
-unsigned char grafyx_unscaled[G_YSIZE][G_XSIZE];
+/* Allocated by grafyx_alloc() when the emulated program first uses
+   the card; grafyx holds the image scaled for display */
+char *grafyx;
+unsigned char (*grafyx_unscaled)[G_XSIZE];
 
 unsigned char grafyx_microlabs = 0;
 unsigned char grafyx_x = 0, grafyx_y = 0, grafyx_mode = 0;
@@ -215,7 +251,7 @@ XImage image = {
   /*width, height*/    8*G_XSIZE, 2*G_YSIZE,  /* if scale_x=1, scale_y=2 */
   /*xoffset*/          0,
   /*format*/           XYBitmap,
-  /*data*/             (char*)grafyx,
+  /*data*/             NULL,  /* grafyx, once allocated */
   /*byte_order*/       LSBFirst,
   /*bitmap_unit*/      8,
   /*bitmap_bit_order*/ MSBFirst,
@@ -231,7 +267,7 @@ XImage image = {
 };
 
 #define HRG_MEMSIZE (1024 * 12)	/* 12k * 8 bit graphics memory */
-static unsigned char hrg_screen[HRG_MEMSIZE];
+static unsigned char *hrg_screen; /* allocated by hrg_alloc() */
 static int hrg_pixel_x[2][6+1];
 static int hrg_pixel_y[12+1];
 static int hrg_pixel_width[2][6];
@@ -240,6 +276,79 @@ static int hrg_enable = 0;
 static int hrg_addr = 0;
 static void hrg_update_char(int position);
 
+/*
+ * Drawing is done by a render thread with its own connection to the X
+ * server, so that a slow server or compositor never holds up the
+ * emulated CPU.  The emulator only updates the screen state above and
+ * marks changed character cells and graphics bytes in dirty bitmaps.
+ * Each time it polls for events it publishes a copy of that state as a
+ * VideoFrame, and the render thread draws the latest frame, at most
+ * RENDER_HZ times a second.  While nothing changes, the render thread
+ * sleeps on frame_cond and costs no host wakeups.
+ *
+ * Frames pass through three slots without locking: the emulator fills
+ * frame_back and swaps it into frame_ready, and the render thread swaps
+ * frame_ready with its frame_front.  A new frame is published only after
+ * the last one has been taken, so no dirty bits are lost; changes made
+ * meanwhile go into the next frame.  frame_lock only guards the wakeup.
+ * With -norenderthread each frame is drawn on the emulator thread as
+ * soon as it is published.
+ */
+#define RENDER_HZ 60
+#define FRAME_NEW 4		/* flag in frame_ready: not taken yet */
+#define G_DIRTY_WORDS (G_YSIZE * G_XSIZE / 32)
+
+typedef struct {
+  unsigned char screen[2048];
+  unsigned int dirty[2048 / 32];	/* character cells to redraw */
+  int grafyx_changed;
+  unsigned int *grafyx_dirty;		/* graphics bytes to redraw */
+  unsigned char (*grafyx)[G_XSIZE];	/* valid only where dirty */
+  unsigned char *hrg;			/* valid if hrg_enable */
+  int refresh;				/* redraw everything */
+  int clear;				/* clear the window first */
+  int mode;
+  int row_chars, col_chars, screen_chars;
+  int char_height;
+  int left_margin, top_margin;
+  int width, height;			/* window size */
+  int grafyx_enable, grafyx_overlay;
+  int grafyx_xoffset, grafyx_yoffset;
+  int hrg_enable;
+} VideoFrame;
+
+static VideoFrame frames[3];
+static int frame_back = 0;
+static int frame_ready = 1;
+static int frame_front = 2;
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_cond = PTHREAD_COND_INITIALIZER;
+static VideoFrame *vf = &frames[2];	/* frame being drawn */
+
+/* Changes not yet published */
+static unsigned int screen_dirty[2048 / 32];
+static unsigned int *grafyx_dirty;
+static int grafyx_changed = 0;
+static int screen_changed = 0;
+static int refresh_pending = 0;
+static int clear_pending = 0;
+
+static Display *rdisplay;		/* used for drawing */
+static int render_thread = 1;
+static int window_width, window_height;	/* as last drawn */
+static void trs_screen_publish(void);
+static void trs_screen_render(void);
+static void *render_main(void *arg);
+static void draw_char(int position);
+static void draw_grafyx_byte(int x, int y, int draw);
+
+static void
+mark_char(int position)
+{
+  screen_dirty[position >> 5] |= 1U << (position & 31);
+  screen_changed = 1;
+}
+
 /* Private routines */
 void bitmap_init(unsigned long foreground, unsigned long background);
 void screen_init(void);
@@ -251,7 +360,7 @@ char *title;
 
 void trs_exit(void)
 {
-    exit(0);
+    exit(trs_exit_status);
 }
 
 
@@ -265,6 +374,8 @@ int trs_parse_command_line(int argc, char **argv, int *debug)
 
   title = program_name; /* default */
 
+  /* The render thread makes Xlib calls too */
+  XInitThreads();
   XrmInitialize();
 
   /* parse command line options */
@@ -315,6 +426,27 @@ int trs_parse_command_line(int argc, char **argv, int *debug)
   image.height = image.height * scale_y / 2;
   image.bytes_per_line *= scale_x;
 
+  (void) sprintf(option, "%s%s", program_name, ".jit");
+  if (XrmGetResource(x_db, option, "Xtrs.Jit", &type, &value)) {
+    if (strcmp(value.addr,"on") == 0) {
+      z80_jit_enabled = True;
+    } else if (strcmp(value.addr,"off") == 0) {
+      z80_jit_enabled = False;
+    }
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".profile");
+  if (XrmGetResource(x_db, option, "Xtrs.Profile", &type, &value)) {
+    char *report = strdup(value.addr);
+    (void) sprintf(option, "%s%s", program_name, ".profilesyms");
+    if (XrmGetResource(x_db, option, "Xtrs.Profilesyms", &type, &value)) {
+      z80_profile_init(report, value.addr);
+    } else {
+      z80_profile_init(report, NULL);
+    }
+    free(report);
+  }
+
   (void) sprintf(option, "%s%s", program_name, ".emtsafe");
   if (XrmGetResource(x_db, option, "Xtrs.Emtsafe", &type, &value)) {
     if (strcmp(value.addr,"on") == 0) {
@@ -453,6 +585,11 @@ int trs_parse_command_line(int argc, char **argv, int *debug)
     stretch_amount = strtol(value.addr, NULL, 0);
   }
 
+  (void) sprintf(option, "%s%s", program_name, ".typein");
+  if (XrmGetResource(x_db, option, "Xtrs.Typein", &type, &value)) {
+    trs_kb_typein_name = strdup(value.addr);
+  }
+
   (void) sprintf(option, "%s%s", program_name, ".microlabs");
   if (XrmGetResource(x_db, option, "Xtrs.Microlabs", &type, &value)) {
     if (strcmp(value.addr,"on") == 0) {
@@ -559,6 +696,15 @@ int trs_parse_command_line(int argc, char **argv, int *debug)
     cassette_default_sample_rate = strtol(value.addr, NULL, 0);
   }
 
+  (void) sprintf(option, "%s%s", program_name, ".fastcassette");
+  if (XrmGetResource(x_db, option, "Xtrs.Fastcassette", &type, &value)) {
+    if (strcmp(value.addr,"on") == 0) {
+      trs_cassette_fast = True;
+    } else if (strcmp(value.addr,"off") == 0) {
+      trs_cassette_fast = False;
+    }
+  }
+
   (void) sprintf(option, "%s%s", program_name, ".title");
   if (XrmGetResource(x_db, option, "Xtrs.title", &type, &value)) {
       title = strdup(value.addr);
@@ -569,6 +715,93 @@ int trs_parse_command_line(int argc, char **argv, int *debug)
       trs_uart_name = strdup(value.addr);
   }
 
+  (void) sprintf(option, "%s%s", program_name, ".fastserial");
+  if (XrmGetResource(x_db, option, "Xtrs.Fastserial", &type, &value)) {
+    if (strcmp(value.addr,"on") == 0) {
+      trs_uart_fast = True;
+    } else if (strcmp(value.addr,"off") == 0) {
+      trs_uart_fast = False;
+    }
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".stats");
+  if (XrmGetResource(x_db, option, "Xtrs.Stats", &type, &value)) {
+      trs_stats_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".trace");
+  if (XrmGetResource(x_db, option, "Xtrs.Trace", &type, &value)) {
+      z80_trace_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".tracesize");
+  if (XrmGetResource(x_db, option, "Xtrs.Tracesize", &type, &value)) {
+      z80_trace_size = strtol(value.addr, NULL, 0);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".coverage");
+  if (XrmGetResource(x_db, option, "Xtrs.Coverage", &type, &value)) {
+      z80_coverage_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".coveragedata");
+  if (XrmGetResource(x_db, option, "Xtrs.Coveragedata", &type, &value)) {
+    if (strcmp(value.addr,"on") == 0) {
+      z80_coverage_data = True;
+    } else if (strcmp(value.addr,"off") == 0) {
+      z80_coverage_data = False;
+    }
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".run");
+  if (XrmGetResource(x_db, option, "Xtrs.Run", &type, &value)) {
+      trs_run_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".runexit");
+  if (XrmGetResource(x_db, option, "Xtrs.Runexit", &type, &value)) {
+    if (strcmp(value.addr,"on") == 0) {
+      trs_run_exit = True;
+    } else if (strcmp(value.addr,"off") == 0) {
+      trs_run_exit = False;
+    }
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".gdb");
+  if (XrmGetResource(x_db, option, "Xtrs.Gdb", &type, &value)) {
+      z80_gdb_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".record");
+  if (XrmGetResource(x_db, option, "Xtrs.Record", &type, &value)) {
+      trs_record_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".replay");
+  if (XrmGetResource(x_db, option, "Xtrs.Replay", &type, &value)) {
+      trs_replay_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".statsinterval");
+  if (XrmGetResource(x_db, option, "Xtrs.Statsinterval", &type, &value)) {
+      trs_stats_interval = strtol(value.addr, NULL, 0);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".screenlog");
+  if (XrmGetResource(x_db, option, "Xtrs.Screenlog", &type, &value)) {
+      trs_screentext_name = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".screenmatch");
+  if (XrmGetResource(x_db, option, "Xtrs.Screenmatch", &type, &value)) {
+      trs_screentext_match = strdup(value.addr);
+  }
+
+  (void) sprintf(option, "%s%s", program_name, ".screenmatchaction");
+  if (XrmGetResource(x_db, option, "Xtrs.Screenmatchaction", &type, &value)) {
+      trs_screentext_action = strdup(value.addr);
+  }
+
   (void) sprintf(option, "%s%s", program_name, ".switches");
   if (XrmGetResource(x_db, option, "Xtrs.serial", &type, &value)) {
       trs_uart_switches = strtol(value.addr, NULL, 0);
@@ -610,7 +843,7 @@ restore_repeat(void)
   }
 }
 
-void trs_fix_size (Window window, int width, int height)
+void trs_fix_size (Display *display, Window window, int width, int height)
 {
   XSizeHints sizehints;
 
@@ -847,6 +1080,23 @@ void trs_screen_init(void)
     resize = (trs_model == 3);
   }
 
+  (void) sprintf(option, "%s%s", program_name, ".renderthread");
+  if (XrmGetResource(x_db, option, "Xtrs.Renderthread", &type, &value)) {
+    if (strcmp(value.addr,"on") == 0) {
+      render_thread = 1;
+    } else if (strcmp(value.addr,"off") == 0) {
+      render_thread = 0;
+    }
+  }
+  if (render_thread) {
+    rdisplay = XOpenDisplay(DisplayString(display));
+    if (rdisplay == NULL) {
+      fatal("unable to open display for render thread");
+    }
+  } else {
+    rdisplay = display;
+  }
+
   clear_key_queue();		/* init the key queue */
 
   /* setup root window, and gc */
@@ -860,29 +1110,29 @@ void trs_screen_init(void)
   background = back_pixel;
   gcvals.graphics_exposures = False;
 
-  gc = XCreateGC(display, root_window, GCGraphicsExposures, &gcvals);
-  XSetForeground(display, gc, fore_pixel);
-  XSetBackground(display, gc, back_pixel);
+  gc = XCreateGC(rdisplay, root_window, GCGraphicsExposures, &gcvals);
+  XSetForeground(rdisplay, gc, fore_pixel);
+  XSetBackground(rdisplay, gc, back_pixel);
 
-  gc_inv = XCreateGC(display, root_window, GCGraphicsExposures, &gcvals);
-  XSetForeground(display, gc_inv, back_pixel);
-  XSetBackground(display, gc_inv, fore_pixel);
+  gc_inv = XCreateGC(rdisplay, root_window, GCGraphicsExposures, &gcvals);
+  XSetForeground(rdisplay, gc_inv, back_pixel);
+  XSetBackground(rdisplay, gc_inv, fore_pixel);
 
-  gc_xor = XCreateGC(display, root_window, GCGraphicsExposures, &gcvals);
-  XSetForeground(display, gc_xor, back_pixel^fore_pixel);
-  XSetBackground(display, gc_xor, 0);
-  XSetFunction(display, gc_xor, GXxor);
+  gc_xor = XCreateGC(rdisplay, root_window, GCGraphicsExposures, &gcvals);
+  XSetForeground(rdisplay, gc_xor, back_pixel^fore_pixel);
+  XSetBackground(rdisplay, gc_xor, 0);
+  XSetFunction(rdisplay, gc_xor, GXxor);
 
   if (usefont) {
-    if ((myfont = XLoadQueryFont(display,fontname)) == NULL) {
+    if ((myfont = XLoadQueryFont(rdisplay,fontname)) == NULL) {
       fatal("can't open font %s!\n", fontname);
     }
-    if ((mywidefont = XLoadQueryFont(display,widefontname)) == NULL) {
+    if ((mywidefont = XLoadQueryFont(rdisplay,widefontname)) == NULL) {
       fatal("can't open font %s!", widefontname);
     }
     curfont = myfont;
-    XSetFont(display,gc,myfont->fid);
-    XSetFont(display,gc_inv,myfont->fid);
+    XSetFont(rdisplay,gc,myfont->fid);
+    XSetFont(rdisplay,gc_inv,myfont->fid);
     cur_char_width =  myfont->max_bounds.width;
     cur_char_height = myfont->ascent + myfont->descent;
   }
@@ -910,7 +1160,7 @@ void trs_screen_init(void)
 #if XDEBUG
     debug("XCreateSimpleWindow(%d, %d)\n", OrigWidth, OrigHeight);
 #endif /*XDEBUG*/
-  trs_fix_size(window, OrigWidth, OrigHeight);
+  trs_fix_size(display, window, OrigWidth, OrigHeight);
   XStoreName(display,window,title);
   XSelectInput(display, window, EVENT_MASK);
   XSetWMProtocols(display, window, &wm_delete_window, 1);
@@ -925,9 +1175,25 @@ void trs_screen_init(void)
   }
 
   XMapWindow(display, window);
+  XSync(display, False);
   bitmap_init(foreground, background);
   screen_init();
-  XClearWindow(display,window);
+  XClearWindow(rdisplay,window);
+  window_width = OrigWidth;
+  window_height = OrigHeight;
+
+  if (render_thread) {
+    pthread_t thread;
+    sigset_t all, old;
+
+    /* Leave signals to the emulator thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    if (pthread_create(&thread, NULL, render_main, NULL) != 0) {
+      fatal("unable to start render thread");
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+  }
 }
 
 KeySym last_key[256];
@@ -940,7 +1206,8 @@ KeySym last_key[256];
  *
  *   If wait is false we definitely don't want to block for events.
  *
- * Handle interrupt-driven uart input here too.
+ * Waiting is done in trs_timer_wait(), which also wakes up for the
+ * next heartbeat and for serial input.
  */
 void trs_get_event(int wait)
 {
@@ -966,18 +1233,17 @@ void trs_get_event(int wait)
   enum enter_leave_t { UNDEF, ENTER, LEAVE };
   static enum enter_leave_t enter_leave;
 
-  if (trs_model > 1) {
-    (void)trs_uart_check_avail();
-  }
-
-  if (wait) {
-    pause();
+  trs_stats.display_polls++;
+  trs_screen_publish();
+  if (wait && !XPending(display)) {
+    trs_timer_wait(ConnectionNumber(display));
     trs_paused = 1;
   }
 
   do {
     if (XCheckTypedEvent(display, ClientMessage, &event)) trs_exit();
     if (!XCheckMaskEvent(display, ~0, &event)) return;
+    trs_stats.display_events++;
 
     switch(event.type) {
     case Expose:
@@ -1055,9 +1321,9 @@ void trs_get_event(int wait)
 	break;
       case XK_F10:
 	if ((event.xkey.state & ShiftMask) == ShiftMask)
-	  trs_reset(1);
+	  trs_user_reset(1);
 	else
-	  trs_reset(0);
+	  trs_user_reset(0);
 	key = 0;
 	trs_skip_next_kbwait();
 	break;
@@ -1129,12 +1395,7 @@ void trs_screen_expanded(int flag)
   int bit = flag ? EXPANDED : 0;
   if ((currentmode ^ bit) & EXPANDED) {
     currentmode ^= EXPANDED;
-    if (usefont) {
-      curfont = (flag ? mywidefont : myfont);
-      XSetFont(display,gc,curfont->fid);
-      XSetFont(display,gc_inv,curfont->fid);
-    }
-    XClearWindow(display,window);
+    clear_pending = 1;
     trs_screen_refresh();
   }
 }
@@ -1147,7 +1408,7 @@ void trs_screen_inverse(int flag)
     currentmode ^= INVERSE;
     for (i = 0; i < screen_chars; i++) {
       if (trs_screen[i] & 0x80)
-	trs_screen_write_char(i, trs_screen[i]);
+	mark_char(i);
     }
   }
 }
@@ -1160,7 +1421,7 @@ void trs_screen_alternate(int flag)
     currentmode ^= ALTERNATE;
     for (i = 0; i < screen_chars; i++) {
       if (trs_screen[i] >= 0xc0)
-	trs_screen_write_char(i, trs_screen[i]);
+	mark_char(i);
     }
   }
 }
@@ -1180,16 +1441,14 @@ void trs_screen_640x240(int flag)
   }
   screen_chars = row_chars * col_chars;
   if (resize) {
+    /* The render thread resizes the window */
     OrigWidth = cur_char_width * row_chars + 2 * border_width;
     OrigHeight = cur_char_height * col_chars + 2 * border_width;
     left_margin = border_width;
     top_margin = border_width;
-    trs_fix_size(window, OrigWidth, OrigHeight);
-    XResizeWindow(display, window, OrigWidth, OrigHeight);
-    XClearWindow(display,window);
-    XFlush(display);
+    clear_pending = 1;
 #if XDEBUG
-    debug("XResizeWindow(%d, %d)\n", OrigWidth, OrigHeight);
+    debug("resize(%d, %d)\n", OrigWidth, OrigHeight);
 #endif /*XDEBUG*/
   } else {
     left_margin = cur_char_width * (80 - row_chars)/2 + border_width;
@@ -1200,7 +1459,7 @@ void trs_screen_640x240(int flag)
 		    cur_char_height * col_chars)/2 + border_width;
     }
     if (left_margin > border_width || top_margin > border_width) {
-      XClearWindow(display,window);
+      clear_pending = 1;
     }
   }
   trs_screen_refresh();
@@ -1247,23 +1506,23 @@ boxes_init(int foreground, int background, int width, int height, int expanded)
 
   for (graphics_char = 0; graphics_char < 64; ++graphics_char) {
     trs_box[expanded][graphics_char] =
-      XCreatePixmap(display, window, width, height,
-		    DefaultDepth(display, screen));
+      XCreatePixmap(rdisplay, window, width, height,
+		    DefaultDepth(rdisplay, screen));
 
     /* Clear everything */
-    XSetForeground(display, gc, background);
-    XFillRectangle(display, trs_box[expanded][graphics_char],
+    XSetForeground(rdisplay, gc, background);
+    XFillRectangle(rdisplay, trs_box[expanded][graphics_char],
 		   gc, 0, 0, width, height);
 
     /* Set the bits */
-    XSetForeground(display, gc, foreground);
+    XSetForeground(rdisplay, gc, foreground);
 
     for (bit = 0, p = 0; bit < 6; ++bit) {
       if (graphics_char & (1 << bit)) {
 	cur_bits[p++] = bits[bit];
       }
     }
-    XFillRectangles(display, trs_box[expanded][graphics_char],
+    XFillRectangles(rdisplay, trs_box[expanded][graphics_char],
 		    gc, cur_bits, p);
   }
 }
@@ -1351,12 +1610,12 @@ void bitmap_init(unsigned long foreground, unsigned long background)
 	
     for (i = 0; i < MAXCHARS; i++) {
       trs_char[0][i] =
-	XCreateBitmapFromDataScale(display,window,
+	XCreateBitmapFromDataScale(rdisplay,window,
 				   trs_char_data[trs_charset][i],
 				   TRS_CHAR_WIDTH,TRS_CHAR_HEIGHT,
 				   scale_x,scale_y);
       trs_char[1][i] =
-	XCreateBitmapFromDataScale(display,window,
+	XCreateBitmapFromDataScale(rdisplay,window,
 				   trs_char_data[trs_charset][i],
 				   TRS_CHAR_WIDTH,TRS_CHAR_HEIGHT,
 				   scale_x*2,scale_y);
@@ -1369,89 +1628,191 @@ void bitmap_init(unsigned long foreground, unsigned long background)
 }
 
 void trs_screen_refresh(void)
+{
+  trs_stats.display_refreshes++;
+  refresh_pending = 1;
+  screen_changed = 1;
+}
+
+void trs_screen_write_char(int position, int char_index)
+{
+  if (trs_screen[position] != (unsigned char) char_index) {
+    trs_screen[position] = char_index;
+    mark_char(position);
+  }
+  if (position < screen_chars) {
+    trs_stats.display_chars++;
+  }
+}
+
+ /* Copy lines 1 through col_chars-1 to lines 0 through col_chars-2.
+    Doesn't need to clear line col_chars-1. */
+void trs_screen_scroll(void)
+{
+  int i = 0;
+
+  for (i = row_chars; i < screen_chars; i++) {
+    if (trs_screen[i-row_chars] != trs_screen[i]) {
+      trs_screen[i-row_chars] = trs_screen[i];
+      mark_char(i-row_chars);
+    }
+  }
+}
+
+/* The text screen as the CPU thread last left it, for trs_screentext */
+const unsigned char *trs_screen_contents(int *rows_out, int *cols_out,
+					 int *mode)
+{
+  *rows_out = row_chars;
+  *cols_out = col_chars;
+  *mode = currentmode;
+  return trs_screen;
+}
+
+/* Hand the screen state to the render thread as a new frame, unless
+   nothing has changed or it has not taken the last frame yet. */
+static void
+trs_screen_publish(void)
+{
+  VideoFrame *f;
+  int i;
+
+  if (!screen_changed && !grafyx_changed) return;
+  if (__atomic_load_n(&frame_ready, __ATOMIC_ACQUIRE) & FRAME_NEW) return;
+
+  f = &frames[frame_back];
+  memcpy(f->screen, trs_screen, sizeof(trs_screen));
+  memcpy(f->dirty, screen_dirty, sizeof(screen_dirty));
+  memset(screen_dirty, 0, sizeof(screen_dirty));
+  f->grafyx_changed = grafyx_changed;
+  if (grafyx_changed) {
+    /* Copy only the changed bytes; 32 of them never span two rows */
+    for (i = 0; i < G_DIRTY_WORDS; i++) {
+      f->grafyx_dirty[i] = grafyx_dirty[i];
+      if (grafyx_dirty[i]) {
+	memcpy(&f->grafyx[0][0] + i*32, &grafyx_unscaled[0][0] + i*32, 32);
+	grafyx_dirty[i] = 0;
+      }
+    }
+  }
+  if (hrg_enable) memcpy(f->hrg, hrg_screen, HRG_MEMSIZE);
+  f->refresh = refresh_pending;
+  f->clear = clear_pending;
+  f->mode = currentmode;
+  f->row_chars = row_chars;
+  f->col_chars = col_chars;
+  f->screen_chars = screen_chars;
+  f->char_height = cur_char_height;
+  f->left_margin = left_margin;
+  f->top_margin = top_margin;
+  f->width = OrigWidth;
+  f->height = OrigHeight;
+  f->grafyx_enable = grafyx_enable;
+  f->grafyx_overlay = grafyx_overlay;
+  f->grafyx_xoffset = grafyx_xoffset;
+  f->grafyx_yoffset = grafyx_yoffset;
+  f->hrg_enable = hrg_enable;
+  screen_changed = grafyx_changed = refresh_pending = clear_pending = 0;
+
+  frame_back = __atomic_exchange_n(&frame_ready, frame_back | FRAME_NEW,
+				   __ATOMIC_ACQ_REL);
+  if (render_thread) {
+    pthread_mutex_lock(&frame_lock);
+    pthread_cond_signal(&frame_cond);
+    pthread_mutex_unlock(&frame_lock);
+  } else {
+    trs_screen_render();
+  }
+}
+
+/* Redraw the whole screen from the current frame. */
+static void
+draw_refresh(void)
 {
   int i, srcx, srcy, dunx, duny;
 
 #if XDEBUG
-  debug("trs_screen_refresh\n");
+  debug("draw_refresh\n");
 #endif
-  if (grafyx_enable && !grafyx_overlay) {
-    srcx = cur_char_width * grafyx_xoffset;
-    srcy = scale_y * grafyx_yoffset;
-    XPutImage(display, window, gc, &image,
+  if (vf->grafyx_enable && !vf->grafyx_overlay) {
+    srcx = cur_char_width * vf->grafyx_xoffset;
+    srcy = scale_y * vf->grafyx_yoffset;
+    XPutImage(rdisplay, window, gc, &image,
 	      srcx, srcy,
-	      left_margin, top_margin,
-	      cur_char_width*row_chars,
-	      cur_char_height*col_chars);
+	      vf->left_margin, vf->top_margin,
+	      cur_char_width*vf->row_chars,
+	      vf->char_height*vf->col_chars);
     /* Draw wrapped portions if any */
     dunx = image.width - srcx;
-    if (dunx < cur_char_width*row_chars) {
-      XPutImage(display, window, gc, &image,
+    if (dunx < cur_char_width*vf->row_chars) {
+      XPutImage(rdisplay, window, gc, &image,
 		0, srcy,
-		left_margin + dunx, top_margin,
-		cur_char_width*row_chars - dunx,
-		cur_char_height*col_chars);
+		vf->left_margin + dunx, vf->top_margin,
+		cur_char_width*vf->row_chars - dunx,
+		vf->char_height*vf->col_chars);
     }
     duny = image.height - srcy;
-    if (duny < cur_char_height*col_chars) {
-      XPutImage(display, window, gc, &image,
+    if (duny < vf->char_height*vf->col_chars) {
+      XPutImage(rdisplay, window, gc, &image,
 		srcx, 0,
-		left_margin, top_margin + duny,
-		cur_char_width*row_chars,
-		cur_char_height*col_chars - duny);
-      if (dunx < cur_char_width*row_chars) {
-	XPutImage(display, window, gc, &image,
+		vf->left_margin, vf->top_margin + duny,
+		cur_char_width*vf->row_chars,
+		vf->char_height*vf->col_chars - duny);
+      if (dunx < cur_char_width*vf->row_chars) {
+	XPutImage(rdisplay, window, gc, &image,
 		  0, 0,
-		  left_margin + dunx, top_margin + duny,
-		  cur_char_width*row_chars - dunx,
-		  cur_char_height*col_chars - duny);
+		  vf->left_margin + dunx, vf->top_margin + duny,
+		  cur_char_width*vf->row_chars - dunx,
+		  vf->char_height*vf->col_chars - duny);
       }
     }
   } else {
-    for (i = 0; i < screen_chars; i++) {
-      trs_screen_write_char(i, trs_screen[i]);
+    for (i = 0; i < vf->screen_chars; i++) {
+      draw_char(i);
     }
   }
 }
 
-void trs_screen_write_char(int position, int char_index)
+/* Draw one character cell of the current frame. */
+static void
+draw_char(int position)
 {
   int row,col,destx,desty;
   int plane;
+  int char_index = vf->screen[position];
   char temp_char;
 
-  trs_screen[position] = char_index;
-  if (position >= screen_chars) {
+  if (position >= vf->screen_chars) {
     return;
   }
-  if ((currentmode & EXPANDED) && (position & 1)) {
+  if ((vf->mode & EXPANDED) && (position & 1)) {
     return;
   }
-  if (grafyx_enable && !grafyx_overlay) {
+  if (vf->grafyx_enable && !vf->grafyx_overlay) {
     return;
   }
-  row = position / row_chars;
-  col = position - (row * row_chars);
-  destx = col * cur_char_width + left_margin;
-  desty = row * cur_char_height + top_margin;
+  row = position / vf->row_chars;
+  col = position - (row * vf->row_chars);
+  destx = col * cur_char_width + vf->left_margin;
+  desty = row * vf->char_height + vf->top_margin;
 
   if (trs_model == 1 && char_index >= 0xc0) {
     /* On Model I, 0xc0-0xff is another copy of 0x80-0xbf */
     char_index -= 0x40;
   }
-  if (char_index >= 0x80 && char_index <= 0xbf && !(currentmode & INVERSE)) {
+  if (char_index >= 0x80 && char_index <= 0xbf && !(vf->mode & INVERSE)) {
     /* Use graphics character bitmap instead of font */
-    switch (currentmode & EXPANDED) {
+    switch (vf->mode & EXPANDED) {
     case NORMAL:
-      XCopyArea(display,
+      XCopyArea(rdisplay,
 		trs_box[0][char_index-0x80],window,gc,0,0,
-		cur_char_width,cur_char_height,destx,desty);
+		cur_char_width,vf->char_height,destx,desty);
       break;
     case EXPANDED:
       /* use expanded graphics character bitmap instead of font */
-      XCopyArea(display,
+      XCopyArea(rdisplay,
 		trs_box[1][char_index-0x80],window,gc,0,0,
-		cur_char_width*2,cur_char_height,destx,desty);
+		cur_char_width*2,vf->char_height,destx,desty);
       break;
     } 
   } else if (usefont) {
@@ -1464,115 +1825,207 @@ void trs_screen_write_char(int position, int char_index)
       if (char_index < 0x20) char_index += 0x40;
     }
     if (trs_model > 1 && char_index >= 0xc0 &&
-	(currentmode & (ALTERNATE+INVERSE)) == 0) {
+	(vf->mode & (ALTERNATE+INVERSE)) == 0) {
       char_index -= 0x40;
     }
     desty += curfont->ascent;
-    if (currentmode & INVERSE) {
+    if (vf->mode & INVERSE) {
       temp_char = (char)(char_index & 0x7f);
-      XDrawImageString(display, window,
+      XDrawImageString(rdisplay, window,
 		       (char_index & 0x80) ? gc_inv : gc,
 		       destx, desty, &temp_char, 1);
     } else {
       temp_char = (char)char_index;
-      XDrawImageString(display, window, gc,
+      XDrawImageString(rdisplay, window, gc,
 		       destx, desty, &temp_char, 1);
     }
   } else {
     /* Draw character using a builtin bitmap */
     if (trs_model > 1 && char_index >= 0xc0 &&
-	(currentmode & (ALTERNATE+INVERSE)) == 0) {
+	(vf->mode & (ALTERNATE+INVERSE)) == 0) {
       char_index -= 0x40;
     }
     plane = 1;
-    switch (currentmode & ~ALTERNATE) {
+    switch (vf->mode & ~ALTERNATE) {
     case NORMAL:
-      XCopyPlane(display,trs_char[0][char_index],
+      XCopyPlane(rdisplay,trs_char[0][char_index],
 		 window,gc,0,0,cur_char_width,
-		 cur_char_height,destx,desty,plane);
+		 vf->char_height,destx,desty,plane);
       break;
     case EXPANDED:
-      XCopyPlane(display,trs_char[1][char_index],
+      XCopyPlane(rdisplay,trs_char[1][char_index],
 		 window,gc,0,0,cur_char_width*2,
-		 cur_char_height,destx,desty,plane);
+		 vf->char_height,destx,desty,plane);
       break;
     case INVERSE:
-      XCopyPlane(display,trs_char[0][char_index & 0x7f],window,
+      XCopyPlane(rdisplay,trs_char[0][char_index & 0x7f],window,
 		 (char_index & 0x80) ? gc_inv : gc,
-		 0,0,cur_char_width,cur_char_height,destx,desty,plane);
+		 0,0,cur_char_width,vf->char_height,destx,desty,plane);
       break;
     case EXPANDED+INVERSE:
-      XCopyPlane(display,trs_char[1][char_index & 0x7f],window,
+      XCopyPlane(rdisplay,trs_char[1][char_index & 0x7f],window,
 		 (char_index & 0x80) ? gc_inv : gc,
-		 0,0,cur_char_width*2,cur_char_height,destx,desty,plane);
+		 0,0,cur_char_width*2,vf->char_height,destx,desty,plane);
       break;
     }
   }
-  if (grafyx_enable) {
-    /* assert(grafyx_overlay); */
+  if (vf->grafyx_enable) {
+    /* assert(vf->grafyx_overlay); */
     int srcx, srcy, duny;
-    srcx = ((col+grafyx_xoffset) % G_XSIZE)*cur_char_width;
-    srcy = (row*cur_char_height + grafyx_yoffset*scale_y)
+    srcx = ((col+vf->grafyx_xoffset) % G_XSIZE)*cur_char_width;
+    srcy = (row*vf->char_height + vf->grafyx_yoffset*scale_y)
 	   % (G_YSIZE*scale_y); 
-    XPutImage(display, window, gc_xor, &image, srcx, srcy,
-	      destx, desty, cur_char_width, cur_char_height);
+    XPutImage(rdisplay, window, gc_xor, &image, srcx, srcy,
+	      destx, desty, cur_char_width, vf->char_height);
     /* Draw wrapped portion if any */
     duny = image.height - srcy;
-    if (duny < cur_char_height) {
-      XPutImage(display, window, gc_xor, &image,
+    if (duny < vf->char_height) {
+      XPutImage(rdisplay, window, gc_xor, &image,
 		srcx, 0,
 		destx, desty + duny,
-		cur_char_width, cur_char_height - duny);
+		cur_char_width, vf->char_height - duny);
     }
   }
-  if (hrg_enable) {
+  if (vf->hrg_enable) {
     hrg_update_char(position);
   }
 }
 
- /* Copy lines 1 through col_chars-1 to lines 0 through col_chars-2.
-    Doesn't need to clear line col_chars-1. */
-void trs_screen_scroll(void)
+/* Draw the latest frame, if there is a new one, and flush. */
+static void
+trs_screen_render(void)
 {
-  int i = 0;
+  XFontStruct *font;
+  unsigned int bits;
+  int i, j;
 
-  for (i = row_chars; i < screen_chars; i++)
-    trs_screen[i-row_chars] = trs_screen[i];
+  if (!(__atomic_load_n(&frame_ready, __ATOMIC_ACQUIRE) & FRAME_NEW)) return;
+  frame_front = __atomic_exchange_n(&frame_ready, frame_front,
+				    __ATOMIC_ACQ_REL) & ~FRAME_NEW;
+  vf = &frames[frame_front];
 
-  if (grafyx_enable) {
-    if (grafyx_overlay) {
-      trs_screen_refresh();
+  if (vf->width != window_width || vf->height != window_height) {
+    window_width = vf->width;
+    window_height = vf->height;
+    trs_fix_size(rdisplay, window, window_width, window_height);
+    XResizeWindow(rdisplay, window, window_width, window_height);
+#if XDEBUG
+    debug("XResizeWindow(%d, %d)\n", window_width, window_height);
+#endif /*XDEBUG*/
+  }
+  if (usefont) {
+    font = (vf->mode & EXPANDED) ? mywidefont : myfont;
+    if (font != curfont) {
+      curfont = font;
+      XSetFont(rdisplay,gc,curfont->fid);
+      XSetFont(rdisplay,gc_inv,curfont->fid);
     }
-  } else if (hrg_enable) {
-    trs_screen_refresh();
+  }
+  if (vf->clear) {
+    XClearWindow(rdisplay,window);
+  }
+
+  /* Graphics first, so that redrawn characters overlay the new image */
+  if (vf->grafyx_changed) {
+    for (i = 0; i < G_DIRTY_WORDS; i++) {
+      for (bits = vf->grafyx_dirty[i], j = i*32; bits; bits >>= 1, j++) {
+	if (bits & 1) {
+	  draw_grafyx_byte(j % G_XSIZE, j / G_XSIZE, !vf->refresh);
+	}
+      }
+    }
+  }
+  if (vf->refresh) {
+    draw_refresh();
   } else {
-    XCopyArea(display,window,window,gc,
-	      left_margin,cur_char_height+top_margin,
-	      (cur_char_width*row_chars),(cur_char_height*col_chars),
-	      left_margin,top_margin);
+    for (i = 0; i < 2048 / 32; i++) {
+      for (bits = vf->dirty[i], j = i*32; bits; bits >>= 1, j++) {
+	if ((bits & 1) && j < vf->screen_chars) draw_char(j);
+      }
+    }
+  }
+  XFlush(rdisplay);
+}
+
+static void *
+render_main(void *arg)
+{
+  struct timespec frame = { 0, 1000000000L / RENDER_HZ };
+
+  for (;;) {
+    pthread_mutex_lock(&frame_lock);
+    while (!(__atomic_load_n(&frame_ready, __ATOMIC_ACQUIRE) & FRAME_NEW)) {
+      pthread_cond_wait(&frame_cond, &frame_lock);
+    }
+    pthread_mutex_unlock(&frame_lock);
+    trs_screen_render();
+    /* Let changes collect into the next frame */
+    nanosleep(&frame, NULL);
+  }
+  return NULL;
+}
+
+static void grafyx_alloc(void)
+{
+  int i;
+
+  if (grafyx != NULL) return;
+  grafyx_unscaled = calloc(G_YSIZE, sizeof(grafyx_unscaled[0]));
+  grafyx_dirty = calloc(G_DIRTY_WORDS, sizeof(grafyx_dirty[0]));
+  grafyx = calloc(image.height, image.bytes_per_line);
+  if (grafyx_unscaled == NULL || grafyx_dirty == NULL || grafyx == NULL) {
+    fatal("out of memory for graphics screen");
+  }
+  for (i = 0; i < 3; i++) {
+    frames[i].grafyx = calloc(G_YSIZE, sizeof(grafyx_unscaled[0]));
+    frames[i].grafyx_dirty = calloc(G_DIRTY_WORDS, sizeof(grafyx_dirty[0]));
+    if (frames[i].grafyx == NULL || frames[i].grafyx_dirty == NULL) {
+      fatal("out of memory for graphics screen");
+    }
   }
+  image.data = grafyx;
+  trs_stats.mem_bytes[STATS_MEM_GRAPHICS] +=
+    4 * (G_YSIZE * sizeof(grafyx_unscaled[0]) +
+	 G_DIRTY_WORDS * sizeof(grafyx_dirty[0])) +
+    image.height * image.bytes_per_line;
 }
 
 void grafyx_write_byte(int x, int y, char byte)
+{
+  int bit = y*G_XSIZE + x;
+
+  trs_stats.display_graphics++;
+  grafyx_alloc();
+  if (grafyx_unscaled[y][x] != (unsigned char) byte) {
+    grafyx_unscaled[y][x] = byte;
+    grafyx_dirty[bit >> 5] |= 1U << (bit & 31);
+    grafyx_changed = 1;
+  }
+}
+
+/* Scale graphics byte (x, y) of the current frame into the image,
+   and draw it if it is on the screen and draw is true. */
+static void
+draw_grafyx_byte(int x, int y, int draw)
 {
   int i, j;
+  unsigned char byte = vf->grafyx[y][x];
   char exp[MAX_SCALE] = { 0 };
-  int screen_x = ((x - grafyx_xoffset + G_XSIZE) % G_XSIZE);
-  int screen_y = ((y - grafyx_yoffset + G_YSIZE) % G_YSIZE);
-  int on_screen = screen_x < row_chars &&
-    screen_y < col_chars*cur_char_height/scale_y;
+  int screen_x = ((x - vf->grafyx_xoffset + G_XSIZE) % G_XSIZE);
+  int screen_y = ((y - vf->grafyx_yoffset + G_YSIZE) % G_YSIZE);
+  int on_screen = draw && vf->grafyx_enable && screen_x < vf->row_chars &&
+    screen_y < vf->col_chars*vf->char_height/scale_y;
 
-  if (grafyx_enable && grafyx_overlay && on_screen) {
+  if (on_screen && vf->grafyx_overlay) {
     /* Erase old byte, preserving text */
-    XPutImage(display, window, gc_xor, &image,
+    XPutImage(rdisplay, window, gc_xor, &image,
 	      x*cur_char_width, y*scale_y,
-	      left_margin + screen_x*cur_char_width,
-	      top_margin + screen_y*scale_y,
+	      vf->left_margin + screen_x*cur_char_width,
+	      vf->top_margin + screen_y*scale_y,
 	      cur_char_width, scale_y);
   }
 
-  /* Save new byte in local memory */
-  grafyx_unscaled[y][x] = byte;
+  /* Scale new byte into the image */
   switch (scale_x) {
   case 1:
     exp[0] = byte;
@@ -1606,19 +2059,19 @@ void grafyx_write_byte(int x, int y, char byte)
     }
   }
 
-  if (grafyx_enable && on_screen) {
+  if (on_screen) {
     /* Draw new byte */
-    if (grafyx_overlay) {
-      XPutImage(display, window, gc_xor, &image,
+    if (vf->grafyx_overlay) {
+      XPutImage(rdisplay, window, gc_xor, &image,
 		x*cur_char_width, y*scale_y,
-		left_margin + screen_x*cur_char_width,
-		top_margin + screen_y*scale_y,
+		vf->left_margin + screen_x*cur_char_width,
+		vf->top_margin + screen_y*scale_y,
 		cur_char_width, scale_y);
     } else {
-      XPutImage(display, window, gc, &image,
+      XPutImage(rdisplay, window, gc, &image,
 		x*cur_char_width, y*scale_y,
-		left_margin + screen_x*cur_char_width,
-		top_margin + screen_y*scale_y,
+		vf->left_margin + screen_x*cur_char_width,
+		vf->top_margin + screen_y*scale_y,
 		cur_char_width, scale_y);
     }
   }
@@ -1655,7 +2108,9 @@ void grafyx_write_data(int value)
 
 int grafyx_read_data(void)
 {
-  int value = grafyx_unscaled[grafyx_y][grafyx_x % G_XSIZE];
+  int value = 0;
+
+  if (grafyx_unscaled) value = grafyx_unscaled[grafyx_y][grafyx_x % G_XSIZE];
   if (!(grafyx_mode & G_XNOCLKR)) {
     if (grafyx_mode & G_XDEC) {
       grafyx_x--;
@@ -1679,6 +2134,7 @@ void grafyx_write_mode(int value)
   unsigned char old_overlay = grafyx_overlay;
 
   grafyx_enable = value & G_ENABLE;
+  if (grafyx_enable) grafyx_alloc();
   if (grafyx_microlabs) {
     grafyx_overlay = (value & G_UL_NOTEXT) == 0;
   }
@@ -1739,6 +2195,7 @@ void grafyx_m3_write_mode(int value)
 {
   int enable = (value & G3_ENABLE) != 0;
   int changed = (enable != grafyx_enable);
+  if (enable) grafyx_alloc();
   grafyx_enable = enable;
   grafyx_overlay = enable;
   grafyx_mode = value;
@@ -1763,7 +2220,7 @@ unsigned char grafyx_m3_read_byte(int position)
   if (grafyx_microlabs && (grafyx_mode & G3_COORD)) {
     int x = (position % 64);
     int y = (position / 64) * 12 + grafyx_y;
-    return grafyx_unscaled[y][x];
+    return grafyx_unscaled ? grafyx_unscaled[y][x] : 0;
   } else {
     return trs_screen[position];
   }
@@ -1837,6 +2294,22 @@ hrg_init(void)
 	  cur_char_width, cur_char_height);
 }
 
+/* Allocate the HRG memory when it is first used. */
+static void
+hrg_alloc(void)
+{
+  int i;
+
+  if (hrg_screen != NULL) return;
+  hrg_screen = calloc(HRG_MEMSIZE, 1);
+  if (hrg_screen == NULL) fatal("out of memory for HRG screen");
+  for (i = 0; i < 3; i++) {
+    frames[i].hrg = malloc(HRG_MEMSIZE);
+    if (frames[i].hrg == NULL) fatal("out of memory for HRG screen");
+  }
+  trs_stats.mem_bytes[STATS_MEM_GRAPHICS] += 4 * HRG_MEMSIZE;
+}
+
 /* Switch HRG on (1) or off (0). */
 void
 hrg_onoff(int enable)
@@ -1849,6 +2322,7 @@ hrg_onoff(int enable)
     hrg_init();
     init = 1;
   }
+  if (enable) hrg_alloc();
   hrg_enable = enable;
   trs_screen_refresh();
 }
@@ -1865,86 +2339,19 @@ void
 hrg_write_data(int data)
 {
   int old_data;
-  int position, line;
-  int bits0, bits1;
 
   if (hrg_addr >= HRG_MEMSIZE) return; /* nonexistent address */
+  hrg_alloc();
   old_data = hrg_screen[hrg_addr];
   hrg_screen[hrg_addr] = data;
 
   if (!hrg_enable) return;
-  if ((currentmode & EXPANDED) && (hrg_addr & 1)) return;
-  if ((data &= 0x3f) == (old_data &= 0x3f)) return;
-
-  position = hrg_addr & 0x3ff;	/* bits 0-9: "PRINT @" screen position */
-  line = hrg_addr >> 10;	/* vertical offset inside character cell */
-  bits0 = ~data & old_data;	/* pattern to clear */
-  bits1 = data & ~old_data;	/* pattern to set */
-
-  if (bits0 == 0
-      || trs_screen[position] == 0x20
-      || trs_screen[position] == 0x80
-      /*|| (trs_screen[position] < 0x80 && line >= 8 && !usefont)*/
-      ) {
-    /* Only additional bits set, or blank text character.
-       No need for update of text. */
-    int destx = (position % row_chars) * cur_char_width + left_margin;
-    int desty = (position / row_chars) * cur_char_height + top_margin
-      + hrg_pixel_y[line];
-    int *x = hrg_pixel_x[(currentmode&EXPANDED)!=0];
-    int *w = hrg_pixel_width[(currentmode&EXPANDED)!=0];
-    int h = hrg_pixel_height[line];
-    XRectangle rect0[3];    /* 6 bits => max. 3 groups of adjacent "0" bits */
-    XRectangle rect1[3];
-    int n0 = 0;
-    int n1 = 0;
-    int flag = 0;
-    int j, b;
-
-    /* Compute arrays of rectangles to clear and to set. */
-    for (j = 0, b = 1; j < 6; j++, b <<= 1) {
-      if (bits0 & b) {
-	if (flag >= 0) {	/* Start new rectangle. */
-	  rect0[n0].x = destx + x[j];
-	  rect0[n0].y = desty;
-	  rect0[n0].width = w[j];
-	  rect0[n0].height = h;
-	  n0++;
-	  flag = -1;
-	}
-	else {			/* Increase width of rectangle. */
-	  rect0[n0-1].width += w[j];
-	}
-      }
-      else if (bits1 & b) {
-	if (flag <= 0) {
-	  rect1[n1].x = destx + x[j];
-	  rect1[n1].y = desty;
-	  rect1[n1].width = w[j];
-	  rect1[n1].height = h;
-	  n1++;
-	  flag = 1;
-	}
-	else {
-	  rect1[n1-1].width += w[j];
-	}
-      }
-      else {
-	flag = 0;
-      }
-    }
-    if (n0 != 0) XFillRectangles(display, window, gc_inv, rect0, n0);
-    if (n1 != 0) XFillRectangles(display, window, gc,     rect1, n1);
-  }
-  else {
-    /* Unfortunately, HRG1B combines text and graphics with an
-       (inclusive) OR. Thus, in the general case, we cannot erase
-       the old graphics byte without losing the text information.
-       Call trs_screen_write_char to restore the text character
-       (erasing the graphics). This function will in turn call
-       hrg_update_char and restore 6*12 graphics pixels. Sigh. */
-    trs_screen_write_char(position, trs_screen[position]);
-  }
+  if ((data & 0x3f) == (old_data & 0x3f)) return;
+
+  /* HRG1B combines text and graphics with an (inclusive) OR, so the
+     whole character cell is redrawn.  Bits 0-9 of the address are its
+     "PRINT @" screen position. */
+  mark_char(hrg_addr & 0x3ff);
 }
 
 /* Read byte from HRG memory. */
@@ -1952,18 +2359,18 @@ int
 hrg_read_data(void)
 {
   if (hrg_addr >= HRG_MEMSIZE) return 0xff; /* nonexistent address */
-  return hrg_screen[hrg_addr];
+  return hrg_screen ? hrg_screen[hrg_addr] : 0;
 }
 
-/* Update graphics at given screen position.
-   Called by trs_screen_write_char. */
+/* Update graphics at given screen position of the current frame.
+   Called by draw_char. */
 static void
 hrg_update_char(int position)
 {
-  int destx = (position % row_chars) * cur_char_width + left_margin;
-  int desty = (position / row_chars) * cur_char_height + top_margin;
-  int *x = hrg_pixel_x[(currentmode&EXPANDED)!=0];
-  int *w = hrg_pixel_width[(currentmode&EXPANDED)!=0];
+  int destx = (position % vf->row_chars) * cur_char_width + vf->left_margin;
+  int desty = (position / vf->row_chars) * vf->char_height + vf->top_margin;
+  int *x = hrg_pixel_x[(vf->mode&EXPANDED)!=0];
+  int *w = hrg_pixel_width[(vf->mode&EXPANDED)!=0];
   XRectangle rect[3*12];
   int byte;
   int prev_byte = 0;
@@ -1973,7 +2380,7 @@ hrg_update_char(int position)
 
   /* Compute array of rectangles. */
   for (i = 0; i < 12; i++) {
-    if ((byte = hrg_screen[position+(i<<10)] & 0x3f) == 0) {
+    if ((byte = vf->hrg[position+(i<<10)] & 0x3f) == 0) {
     }
     else if (byte != prev_byte) {
       np = n;
@@ -2002,7 +2409,7 @@ hrg_update_char(int position)
     prev_byte = byte;
   }
   if (n != 0)
-    XFillRectangles(display, window, gc, rect, n);
+    XFillRectangles(rdisplay, window, gc, rect, n);
 }
 
 
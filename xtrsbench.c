@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Benchmark the emulator on fixed guest workloads.
+ *
+ * Usage: xtrsbench [-j] [-n scale] [workload...]
+ * Runs each workload (all by default) on a headless Model 4 built
+ * from libxtrs, and prints one tab-separated line per workload: the
+ * Z80 instructions and T-states executed, host seconds, emulated MIPS
+ * and clock rate, host nanoseconds per instruction, and the process's
+ * peak resident set size so far.  Lines starting with # are comments.
+ *
+ * Flags: -j        run with -jit
+ *        -n scale  multiply each workload's iteration count by scale
+ *
+ * The workloads run from RAM with interrupts off and need no ROM
+ * beyond the built-in one.  Each ends with emt_misc(1), which exits.
+ *   alu     16-bit add and logic loop: instruction decode and ALU
+ *   ldir    16K fill and 12K copy with LDIR: plain memory access
+ *   video   fill the text screen: memory-mapped video path
+ *   grafyx  redraw the whole Grafyx screen with OTIR: port I/O
+ *   disk    read each sector of a 40-track JV3 image through the FDC
+ *           and write it back, polling DRQ
+ */
+
+#define _XOPEN_SOURCE 500 /* unistd.h: getopt(), optarg, optind, opterr;
+			     stdlib.h: mkstemp() */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "libxtrs.h"
+#include "trs_stats.h"
+
+#define ARGS "jn:"
+
+#define LOAD_ADDR	0x8000
+#define COUNT_OFFSET	5	/* every program starts di; ld sp,0; ld bc,count */
+
+#define DISK_TRACKS	40
+#define DISK_SECTORS	18
+#define JV3_HEADER	(34*256)	/* sector ids, then write-protect byte */
+
+static const Uchar bench_alu[] = {
+  0xf3,			/*         di */
+  0x31, 0x00, 0x00,	/*         ld sp,0 */
+  0x01, 0x00, 0x00,	/*         ld bc,count */
+  0xc5,			/* outer:  push bc */
+  0x06, 0x00,		/*         ld b,0 */
+  0x21, 0x00, 0x00,	/*         ld hl,0 */
+  0x11, 0x01, 0x00,	/*         ld de,1 */
+  0x19,			/* inner:  add hl,de */
+  0x7d,			/*         ld a,l */
+  0xac,			/*         xor h */
+  0x0f,			/*         rrca */
+  0x5f,			/*         ld e,a */
+  0x14,			/*         inc d */
+  0x10, 0xf8,		/*         djnz inner */
+  0xc1,			/*         pop bc */
+  0x0b,			/*         dec bc */
+  0x78,			/*         ld a,b */
+  0xb1,			/*         or c */
+  0x20, 0xe9,		/*         jr nz,outer */
+  0x3e, 0x01,		/*         ld a,1 */
+  0xed, 0x3c,		/*         emt_misc ; exit */
+};
+
+static const Uchar bench_ldir[] = {
+  0xf3,			/*         di */
+  0x31, 0x00, 0x00,	/*         ld sp,0 */
+  0x01, 0x00, 0x00,	/*         ld bc,count */
+  0xc5,			/* outer:  push bc */
+  0x21, 0x00, 0x40,	/*         ld hl,4000h */
+  0x71,			/*         ld (hl),c */
+  0x11, 0x01, 0x40,	/*         ld de,4001h */
+  0x01, 0xff, 0x3f,	/*         ld bc,3fffh */
+  0xed, 0xb0,		/*         ldir */
+  0x21, 0x00, 0x40,	/*         ld hl,4000h */
+  0x11, 0x00, 0xc0,	/*         ld de,0c000h */
+  0x01, 0x00, 0x30,	/*         ld bc,3000h */
+  0xed, 0xb0,		/*         ldir */
+  0xc1,			/*         pop bc */
+  0x0b,			/*         dec bc */
+  0x78,			/*         ld a,b */
+  0xb1,			/*         or c */
+  0x20, 0xe2,		/*         jr nz,outer */
+  0x3e, 0x01,		/*         ld a,1 */
+  0xed, 0x3c,		/*         emt_misc ; exit */
+};
+
+static const Uchar bench_video[] = {
+  0xf3,			/*         di */
+  0x31, 0x00, 0x00,	/*         ld sp,0 */
+  0x01, 0x00, 0x00,	/*         ld bc,count */
+  0xc5,			/* outer:  push bc */
+  0x21, 0x00, 0x3c,	/*         ld hl,3c00h */
+  0x79,			/*         ld a,c */
+  0x77,			/* vloop:  ld (hl),a */
+  0x23,			/*         inc hl */
+  0x3c,			/*         inc a */
+  0xcb, 0x74,		/*         bit 6,h */
+  0x28, 0xf9,		/*         jr z,vloop */
+  0xc1,			/*         pop bc */
+  0x0b,			/*         dec bc */
+  0x78,			/*         ld a,b */
+  0xb1,			/*         or c */
+  0x20, 0xee,		/*         jr nz,outer */
+  0x3e, 0x01,		/*         ld a,1 */
+  0xed, 0x3c,		/*         emt_misc ; exit */
+};
+
+static const Uchar bench_grafyx[] = {
+  0xf3,			/*         di */
+  0x31, 0x00, 0x00,	/*         ld sp,0 */
+  0x01, 0x00, 0x00,	/*         ld bc,count */
+  0x3e, 0x81,		/*         ld a,81h */
+  0xd3, 0x83,		/*         out (83h),a ; enable, no y clock */
+  0xc5,			/* outer:  push bc */
+  0x16, 0x00,		/*         ld d,0 */
+  0x7a,			/* row:    ld a,d */
+  0xd3, 0x81,		/*         out (81h),a */
+  0xaf,			/*         xor a */
+  0xd3, 0x80,		/*         out (80h),a */
+  0x21, 0x00, 0x40,	/*         ld hl,4000h */
+  0x01, 0x82, 0x50,	/*         ld bc,5082h */
+  0xed, 0xb3,		/*         otir */
+  0x14,			/*         inc d */
+  0x7a,			/*         ld a,d */
+  0xfe, 0xf0,		/*         cp 240 */
+  0x20, 0xec,		/*         jr nz,row */
+  0xc1,			/*         pop bc */
+  0x0b,			/*         dec bc */
+  0x78,			/*         ld a,b */
+  0xb1,			/*         or c */
+  0x20, 0xe3,		/*         jr nz,outer */
+  0x3e, 0x01,		/*         ld a,1 */
+  0xed, 0x3c,		/*         emt_misc ; exit */
+};
+
+static const Uchar bench_disk[] = {
+  0xf3,			/*         di */
+  0x31, 0x00, 0x00,	/*         ld sp,0 */
+  0x01, 0x00, 0x00,	/*         ld bc,count */
+  0x3e, 0x81,		/*         ld a,81h */
+  0xd3, 0xf4,		/*         out (0f4h),a ; drive 0, MFM */
+  0xaf,			/*         xor a */
+  0xd3, 0xf0,		/*         out (0f0h),a ; restore */
+  0xcd, 0x6f, 0x80,	/*         call wait */
+  0xc5,			/* outer:  push bc */
+  0x1e, 0x00,		/*         ld e,0 */
+  0x7b,			/* trk:    ld a,e */
+  0xd3, 0xf3,		/*         out (0f3h),a */
+  0x3e, 0x10,		/*         ld a,10h */
+  0xd3, 0xf0,		/*         out (0f0h),a ; seek */
+  0xcd, 0x6f, 0x80,	/*         call wait */
+  0x16, 0x00,		/*         ld d,0 */
+  0x3e, 0x81,		/* sec:    ld a,81h */
+  0xd3, 0xf4,		/*         out (0f4h),a */
+  0x7a,			/*         ld a,d */
+  0xd3, 0xf2,		/*         out (0f2h),a */
+  0x3e, 0x80,		/*         ld a,80h */
+  0xd3, 0xf0,		/*         out (0f0h),a ; read sector */
+  0x21, 0x00, 0x40,	/*         ld hl,4000h */
+  0xdb, 0xf0,		/* rd:     in a,(0f0h) */
+  0xcb, 0x4f,		/*         bit 1,a ; DRQ */
+  0x28, 0x06,		/*         jr z,nodrq */
+  0xdb, 0xf3,		/*         in a,(0f3h) */
+  0x77,			/*         ld (hl),a */
+  0x23,			/*         inc hl */
+  0x18, 0xf4,		/*         jr rd */
+  0xcb, 0x47,		/* nodrq:  bit 0,a ; busy */
+  0x20, 0xf0,		/*         jr nz,rd */
+  0x3e, 0x81,		/*         ld a,81h */
+  0xd3, 0xf4,		/*         out (0f4h),a */
+  0x3e, 0xa0,		/*         ld a,0a0h */
+  0xd3, 0xf0,		/*         out (0f0h),a ; write sector */
+  0x21, 0x00, 0x40,	/*         ld hl,4000h */
+  0xdb, 0xf0,		/* wr:     in a,(0f0h) */
+  0xcb, 0x4f,		/*         bit 1,a ; DRQ */
+  0x28, 0x06,		/*         jr z,nodrqw */
+  0x7e,			/*         ld a,(hl) */
+  0xd3, 0xf3,		/*         out (0f3h),a */
+  0x23,			/*         inc hl */
+  0x18, 0xf4,		/*         jr wr */
+  0xcb, 0x47,		/* nodrqw: bit 0,a ; busy */
+  0x20, 0xf0,		/*         jr nz,wr */
+  0x14,			/*         inc d */
+  0x7a,			/*         ld a,d */
+  0xfe, 0x12,		/*         cp 18 */
+  0x20, 0xc1,		/*         jr nz,sec */
+  0x1c,			/*         inc e */
+  0x7b,			/*         ld a,e */
+  0xfe, 0x28,		/*         cp 40 */
+  0x20, 0xaf,		/*         jr nz,trk */
+  0xc1,			/*         pop bc */
+  0x0b,			/*         dec bc */
+  0x78,			/*         ld a,b */
+  0xb1,			/*         or c */
+  0x20, 0xa6,		/*         jr nz,outer */
+  0x3e, 0x01,		/*         ld a,1 */
+  0xed, 0x3c,		/*         emt_misc ; exit */
+  0xdb, 0xf0,		/* wait:   in a,(0f0h) */
+  0xcb, 0x47,		/*         bit 0,a */
+  0x20, 0xfa,		/*         jr nz,wait */
+  0xc9,			/*         ret */
+};
+
+static struct workload {
+  const char *name;
+  const Uchar *code;
+  int size;
+  int count;
+} workloads[] = {
+  { "alu",    bench_alu,    sizeof(bench_alu),    20000 },
+  { "ldir",   bench_ldir,   sizeof(bench_ldir),   300 },
+  { "video",  bench_video,  sizeof(bench_video),  5000 },
+  { "grafyx", bench_grafyx, sizeof(bench_grafyx), 1000 },
+  { "disk",   bench_disk,   sizeof(bench_disk),   20 },
+};
+#define NWORKLOADS ((int) (sizeof(workloads) / sizeof(workloads[0])))
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Write a double density JV3 image with DISK_TRACKS full tracks */
+static int make_disk(char *name)
+{
+  FILE *f;
+  int fd, track, sector, i;
+
+  fd = mkstemp(name);
+  if (fd < 0 || (f = fdopen(fd, "wb")) == NULL) {
+    perror(name);
+    return -1;
+  }
+  for (track = 0; track < DISK_TRACKS; track++) {
+    for (sector = 0; sector < DISK_SECTORS; sector++) {
+      putc(track, f);
+      putc(sector, f);
+      putc(0x80, f);		/* double density, 256 bytes */
+    }
+  }
+  for (i = DISK_TRACKS * DISK_SECTORS * 3; i < JV3_HEADER; i++) {
+    putc(0xff, f);		/* free ids; last byte: writable */
+  }
+  for (i = 0; i < DISK_TRACKS * DISK_SECTORS * 256; i++) {
+    putc(i * 7 + (i >> 8), f);
+  }
+  if (fclose(f) != 0) {
+    perror(name);
+    return -1;
+  }
+  return 0;
+}
+
+static int run(struct workload *w, int scale)
+{
+  unsigned long insns;
+  tstate_t t;
+  double start, secs;
+  struct rusage ru;
+  int i, count, ret;
+
+  xtrs_reset(1);
+  for (i = 0; i < w->size; i++) {
+    xtrs_write_mem(LOAD_ADDR + i, w->code[i]);
+  }
+  count = w->count * scale;
+  if (count > 0xffff) count = 0xffff;
+  xtrs_write_mem(LOAD_ADDR + COUNT_OFFSET, count & 0xff);
+  xtrs_write_mem(LOAD_ADDR + COUNT_OFFSET + 1, count >> 8);
+  xtrs_set_reg(XTRS_REG_PC, LOAD_ADDR);
+  xtrs_set_reg(XTRS_REG_IFF1, 0);
+  xtrs_set_reg(XTRS_REG_IFF2, 0);
+
+  insns = trs_stats.instructions;
+  t = xtrs_tstates();
+  start = now();
+  do {
+    ret = xtrs_run_for(1000000000);
+  } while (ret == XTRS_RUN_DONE);
+  secs = now() - start;
+  insns = trs_stats.instructions - insns;
+  t = xtrs_tstates() - t;
+  if (ret != XTRS_RUN_EXIT) {
+    fprintf(stderr, "%s: stopped at pc 0x%04x\n", w->name,
+	    xtrs_get_reg(XTRS_REG_PC));
+    return -1;
+  }
+
+  getrusage(RUSAGE_SELF, &ru);
+  printf("%s\t%s\t%lu\t%llu\t%.3f\t%.2f\t%.2f\t%.2f\t%ld\n",
+	 w->name, z80_jit_enabled ? "on" : "off", insns,
+	 (unsigned long long) t, secs,
+	 secs > 0 ? insns / secs / 1000000.0 : 0.0,
+	 secs > 0 ? t / secs / 1000000.0 : 0.0,
+	 insns ? secs * 1000000000.0 / insns : 0.0,
+	 (long) ru.ru_maxrss);
+  fflush(stdout);
+  return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+  char disk[] = "/tmp/xtrsbenchXXXXXX";
+  int jit = 0, scale = 1, status = 0;
+  int c, errflg = 0, i, j;
+
+  optarg = NULL;
+  while (!errflg && (c = getopt(argc, argv, ARGS)) != -1) {
+    switch (c) {
+    case 'j':
+      jit = 1;
+      break;
+    case 'n':
+      scale = strtol(optarg, NULL, 0);
+      if (scale < 1) errflg++;
+      break;
+    default:
+      errflg++;
+      break;
+    }
+  }
+  for (i = optind; i < argc && !errflg; i++) {
+    for (j = 0; j < NWORKLOADS; j++) {
+      if (strcmp(argv[i], workloads[j].name) == 0) break;
+    }
+    if (j == NWORKLOADS) errflg++;
+  }
+  if (errflg) {
+    fprintf(stderr, "Usage: %s [-j] [-n scale] [workload...]\n", argv[0]);
+    fprintf(stderr, "Workloads:");
+    for (j = 0; j < NWORKLOADS; j++) {
+      fprintf(stderr, " %s", workloads[j].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+  }
+
+  if (make_disk(disk) < 0) exit(1);
+  xtrs_create(4, NULL);
+  z80_jit_enabled = jit;
+  if (xtrs_attach_disk(0, disk) < 0) {
+    fprintf(stderr, "%s: can't attach %s\n", argv[0], disk);
+    unlink(disk);
+    exit(1);
+  }
+
+  printf("#workload\tjit\tinstructions\ttstates\tseconds\tmips\tmhz\t"
+	 "ns_per_insn\tmaxrss_kb\n");
+  for (j = 0; j < NWORKLOADS; j++) {
+    if (optind < argc) {
+      for (i = optind; i < argc; i++) {
+	if (strcmp(argv[i], workloads[j].name) == 0) break;
+      }
+      if (i == argc) continue;
+    }
+    if (run(&workloads[j], scale) < 0) status = 1;
+  }
+
+  unlink(disk);
+  return status;
+}
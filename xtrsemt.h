@@ -87,3 +87,4 @@ extern int /*emt_closedisk*/ emt_dkclose(/* int fd */);
 #define EMT_MISC_SET_VOLUME       19
 #define EMT_MISC_QUERY_TRUEDAM    20
 #define EMT_MISC_SET_TRUEDAM      21
+#define EMT_MISC_EXIT_STATUS      26
@@ -61,8 +61,11 @@
 #include "z80.h"
 #include "trs.h"
 #include "trs_imp_exp.h"
-#include <stdlib.h>  /* for rand() */
-#include <time.h>    /* for time() */
+#include "trs_stats.h"
+#include "trs_screentext.h"
+#include "z80_trace.h"
+#include "z80_coverage.h"
+#include "trs_replay.h"
 
 /*
  * Keep Saber quiet.
@@ -1193,7 +1196,7 @@ static void do_ind(void)
       CLEAR_ZERO();
 
     SET_SUBTRACT();
-    T_COUNT(15);
+    T_COUNT(16);
 }
 
 static void do_indr(void)
@@ -1204,7 +1207,7 @@ static void do_indr(void)
 	mem_write(REG_HL, z80_in(REG_C));
 	REG_HL--;
 	REG_B--;
-	T_COUNT(20);
+	T_COUNT(21);
     } while(REG_B != 0);
     T_COUNT(-5);
 
@@ -1231,7 +1234,7 @@ static void do_ini(void)
       CLEAR_ZERO();
 
     SET_SUBTRACT();
-    T_COUNT(15);
+    T_COUNT(16);
 }
 
 static void do_inir(void)
@@ -1242,7 +1245,7 @@ static void do_inir(void)
 	mem_write(REG_HL, z80_in(REG_C));
 	REG_HL++;
 	REG_B--;
-	T_COUNT(20);
+	T_COUNT(21);
     } while(REG_B != 0);
     T_COUNT(-5);
 
@@ -1299,7 +1302,7 @@ static void do_outd(void)
       CLEAR_ZERO();
 
     SET_SUBTRACT();
-    T_COUNT(15);
+    T_COUNT(16);
 }
 
 static void do_outdr(void)
@@ -1310,7 +1313,7 @@ static void do_outdr(void)
 	z80_out(REG_C, mem_read(REG_HL));
 	REG_HL--;
 	REG_B--;
-	T_COUNT(20);
+	T_COUNT(21);
     } while(REG_B != 0);
     T_COUNT(-5);
 
@@ -1337,7 +1340,7 @@ static void do_outi(void)
       CLEAR_ZERO();
 
     SET_SUBTRACT();
-    T_COUNT(15);
+    T_COUNT(16);
 }
 
 static void do_outir(void)
@@ -1348,7 +1351,7 @@ static void do_outir(void)
 	z80_out(REG_C, mem_read(REG_HL));
 	REG_HL++;
 	REG_B--;
-	T_COUNT(20);
+	T_COUNT(21);
     } while(REG_B != 0);
     T_COUNT(-5);
 
@@ -1429,6 +1432,23 @@ static void do_nmi(void)
     T_COUNT(11);
 }
 
+/*
+ * Flag and arithmetic routines for code generated by the dynamic
+ * translator (z80_jit.c), so that it computes flags exactly as the
+ * interpreter does.
+ */
+void (*const z80_jit_alu_ops[8])(int value) = {
+    do_add_byte, do_adc_byte, do_sub_byte, do_sbc_byte,
+    do_and_byte, do_xor_byte, do_or_byte, do_cp
+};
+void (*const z80_jit_inc_dec_flags[2])(int value) = {
+    do_flags_inc_byte, do_flags_dec_byte
+};
+void (*const z80_jit_acc_ops[5])(void) = {
+    do_rlca, do_rrca, do_rla, do_rra, do_daa
+};
+void (*const z80_jit_add_hl)(int value) = do_add_word;
+
 /*
  * Extended instructions which have 0xCB as the first byte:
  */
@@ -2719,6 +2739,13 @@ static void do_indexed_instruction(Ushort *ixp)
 }
 
 
+/*
+ * If set, called for each emulator trap (ED28 through ED3F) before the
+ * built-in handling.  A nonzero return means the hook has emulated the
+ * trap itself, so the built-in handling is skipped.
+ */
+int (*trs_emt_hook)(int opcode) = NULL;
+
 /*
  * Extended instructions which have 0xED as the first byte:
  */
@@ -2730,6 +2757,11 @@ static int do_ED_instruction(void)
     instruction = mem_read(REG_PC++);
     REG_R++;
 
+    if (trs_emt_hook && instruction >= 0x28 && instruction <= 0x3f &&
+	trs_emt_hook(instruction)) {
+	return 0;
+    }
+
     switch(instruction)
     {
       case 0x4A:	/* adc hl, bc */
@@ -2773,28 +2805,28 @@ static int do_ED_instruction(void)
 	break;
 
       case 0x78:	/* in a, (c) */
-	REG_A = in_with_flags(REG_C);  T_COUNT(11);
+	REG_A = in_with_flags(REG_C);  T_COUNT(12);
 	break;
       case 0x40:	/* in b, (c) */
-	REG_B = in_with_flags(REG_C);  T_COUNT(11);
+	REG_B = in_with_flags(REG_C);  T_COUNT(12);
 	break;
       case 0x48:	/* in c, (c) */
-	REG_C = in_with_flags(REG_C);  T_COUNT(11);
+	REG_C = in_with_flags(REG_C);  T_COUNT(12);
 	break;
       case 0x50:	/* in d, (c) */
-	REG_D = in_with_flags(REG_C);  T_COUNT(11);
+	REG_D = in_with_flags(REG_C);  T_COUNT(12);
 	break;
       case 0x58:	/* in e, (c) */
-	REG_E = in_with_flags(REG_C);  T_COUNT(11);
+	REG_E = in_with_flags(REG_C);  T_COUNT(12);
 	break;
       case 0x60:	/* in h, (c) */
-	REG_H = in_with_flags(REG_C);  T_COUNT(11);
+	REG_H = in_with_flags(REG_C);  T_COUNT(12);
 	break;
       case 0x68:	/* in l, (c) */
-	REG_L = in_with_flags(REG_C);  T_COUNT(11);
+	REG_L = in_with_flags(REG_C);  T_COUNT(12);
 	break;
       case 0x70:	/* in (c) [undocumented] */
-	(void) in_with_flags(REG_C);  T_COUNT(11);
+	(void) in_with_flags(REG_C);  T_COUNT(12);
 	break;
 
       case 0xAA:	/* ind */
@@ -3068,12 +3100,20 @@ static int do_ED_instruction(void)
     return debug;
 }
 
-volatile int x_poll_count = 0;
+int x_poll_count = 0;
 #define X_POLL_INTERVAL 10000
+static tstate_t x_poll_tstate; /* poll again by this T-state count */
 
 int trs_continuous;
 volatile int dummy;
 
+/*
+ * Nonzero for each page that holds a ROM routine the emulator can
+ * perform itself; see trs_cassette_hook().  Translated blocks never
+ * run in these pages, as with debugger traps.
+ */
+Uchar z80_hook_pages[256];
+
 int z80_run(int continuous)
      /*
       * -1 = single-step and disallow interrupts
@@ -3085,25 +3125,66 @@ int z80_run(int continuous)
     Ushort address; /* generic temps */
     int ret = 0;
     int i;
+    int prof_pc = 0, prof_sp = 0;
+    tstate_t prof_t = 0;
     trs_continuous = continuous;
 
     /* loop to do a z80 instruction */
     do {
         /* We need to poll for X events periodically.  That also
-	   flushes output to the X server. */
-	if (x_poll_count <= 0) {
+	   flushes output to the X server.  Poll at least every half
+	   heartbeat of emulated time, too, so that no ticks are lost
+	   when running at real speed. */
+	if (x_poll_count <= 0 ||
+	    z80_state.t_count - x_poll_tstate < TSTATE_T_MID) {
 	    x_poll_count = X_POLL_INTERVAL;
+	    x_poll_tstate = z80_state.t_count + trs_timer_poll();
 	    trs_get_event(FALSE);
+	    if (trs_stats_dump_due) trs_stats_dump();
+	    if (trs_screentext_active) trs_screentext_poll();
+	    if (z80_gdb_fd >= 0) z80_gdb_poll();
 	} else {
 	    x_poll_count--;
 	}
+	/* Emulated-time timer and replayed input */
+	if (z80_state.replay &&
+	    (z80_state.t_count - z80_state.replay < TSTATE_T_MID)) {
+	    trs_replay_event();
+	}
         /* Speed control */
         if ((i = (z80_state.delay + z80_state.keydelay))) {
 	  while (--i) dummy = i;
 	}
+	else if (z80_jit_enabled && !z80_profile_enabled &&
+		 !z80_trace_enabled && !z80_coverage_enabled &&
+		 !debug_trap_pages[REG_PC >> 8] &&
+		 !z80_hook_pages[REG_PC >> 8] &&
+		 trs_continuous > 0 && (i = z80_jit_run()) > 0) {
+	    /* Ran a block of translated code */
+	    x_poll_count -= i - 1;
+	    trs_stats.instructions += i;
+	    instruction = 0;
+	    goto translated;
+	}
+
+	/* ROM routine emulated in one step, including its return */
+	if (z80_hook_pages[REG_PC >> 8] && trs_cassette_hook()) {
+	    trs_stats.instructions++;
+	    instruction = 0;
+	    goto translated;
+	}
+
+	if (z80_trace_enabled) z80_trace_insn();
+	if (z80_coverage_enabled) COVERAGE_MARK(z80_coverage_exec, REG_PC);
+	if (z80_profile_enabled) {
+	    prof_pc = REG_PC;
+	    prof_sp = REG_SP;
+	    prof_t = z80_state.t_count;
+	}
 
 	instruction = mem_read(REG_PC++);
 	REG_R++;
+	trs_stats.instructions++;
 	
 	switch(instruction)
 	{
@@ -3542,7 +3623,7 @@ int z80_run(int continuous)
 
 	  case 0xDB:	/* in a, (port) */
 	    REG_A = z80_in(mem_read(REG_PC++));
-	    T_COUNT(10);
+	    T_COUNT(11);
 	    break;
 	    
 	  case 0x3C:	/* inc a */
@@ -4387,6 +4468,11 @@ int z80_run(int continuous)
 	    error("unsupported instruction");
 	}
 
+	if (z80_profile_enabled) {
+	    z80_profile_insn(prof_pc, prof_t, prof_sp, instruction);
+	}
+
+      translated:
 	/* Event scheduler */
 	if (z80_state.sched &&
 	    (z80_state.sched - z80_state.t_count > TSTATE_T_MID)) {
@@ -4394,6 +4480,13 @@ int z80_run(int continuous)
 	  trs_do_event();	    
 	}
 
+	/* Run limit */
+	if (z80_state.stop &&
+	    (z80_state.stop - z80_state.t_count > TSTATE_T_MID)) {
+	  z80_state.stop = 0;
+	  if (trs_continuous > 0) trs_continuous = 0;
+	}
+
 	/* Check for an interrupt */
 	if (trs_continuous >= 0)
         {
@@ -4406,6 +4499,7 @@ int z80_run(int continuous)
 		}
 	        do_nmi();
 	        z80_state.nmi_seen = TRUE;
+		if (z80_profile_enabled) z80_profile_call(REG_PC);
                 if (trs_model == 1) {
 		  /* Simulate releasing the pushbutton here; ugh. */
 		  trs_reset_button_interrupt(0);
@@ -4420,8 +4514,16 @@ int z80_run(int continuous)
 		    REG_PC++;
 		}
 	        do_int();
+		if (z80_profile_enabled) z80_profile_call(REG_PC);
 	    }
 	}
+
+	/* Stop at debugger traps.  Translated blocks never run in a
+	   page that has traps, nor cross into another page. */
+	if (debug_trap_pages[REG_PC >> 8] && debug_traps[REG_PC] &&
+	    trs_continuous > 0) {
+	    trs_continuous = 0;
+	}
     } while (trs_continuous > 0);
     return ret;
 }
@@ -4440,7 +4542,5 @@ void z80_reset(void)
     z80_state.interrupt_mode = 0;
     z80_state.irq = z80_state.nmi = FALSE;
     z80_state.sched = 0;
-
-    srand(time(NULL));  /* Seed the RNG, for reading the refresh register */
 }
 
@@ -148,6 +148,16 @@ struct z80_state_struct
     /* Simple event scheduler.  If nonzero, when t_count passes sched,
      * trs_do_event() is called and sched is set to zero. */
     tstate_t sched;
+
+    /* Run limit.  If nonzero, when t_count passes stop, z80_run()
+     * returns at the end of the current instruction and stop is set
+     * to zero. */
+    tstate_t stop;
+
+    /* Input clock for -record and -replay.  If nonzero, when t_count
+     * reaches replay, z80_run() calls trs_replay_event() before the
+     * next instruction. */
+    tstate_t replay;
 };
 
 #define Z80_ADDRESS_LIMIT	(1 << 16)
@@ -256,9 +266,14 @@ extern void mem_write_rom(int address, int value);
 extern int mem_read_word(int address);
 extern void mem_write_word(int address, int value);
 Uchar *mem_pointer(int address, int writing);
+Uchar *mem_plain_page(int address, int writing);
+extern int mem_bank_number(int address);
+extern int mem_read_bank(int bank, int address);
+extern void mem_write_bank(int bank, int address, int value);
 extern int mem_block_transfer(Ushort dest, Ushort source, int direction,
 			      Ushort count);
 extern int load_hex(FILE *file); /* returns highest address loaded + 1 */
+extern int mem_load_hex(FILE *file);
 extern void debug(const char *fmt, ...);
 extern void error(const char *fmt, ...);
 extern void warning(const char *fmt, ...);
@@ -266,7 +281,49 @@ extern void fatal(const char *fmt, ...);
 extern void z80_out(int port, int value);
 extern int z80_in(int port);
 extern int disassemble(unsigned short pc);
+extern int disassemble_to(FILE *fp, unsigned short pc,
+			  int (*read)(int address));
 extern void debug_init(void);
 extern void debug_shell(void);
+extern Uchar debug_traps[];
+extern int debug_trap_pages[256];
+#define DEBUG_GDB_FLAG    0x80	/* in debug_traps[] */
+extern Uchar z80_hook_pages[256];	/* pages with emulated ROM routines */
+#define DEBUG_WATCH_READ  1
+#define DEBUG_WATCH_WRITE 2
+#define DEBUG_WATCH_PORT  4
+extern Uchar debug_watch_pages[256];
+extern Uchar debug_watch_ports[256];
+extern int debug_watch_armed;
+extern int debug_watch_hit_what;
+extern int debug_watch_hit_address;
+extern void debug_watch_hit(int what, int address, int value);
+extern void debug_set_watch(int start, int end, int what);
+extern void debug_clear_watch(int start, int end, int what);
+
+/* GDB remote protocol stub (z80_gdb.c) */
+extern char *z80_gdb_name;
+extern int z80_gdb_fd;
+extern void z80_gdb_init(void);
+extern void z80_gdb_poll(void);
+extern int z80_gdb_stop(void);
+
+/* Dynamic translator (z80_jit.c) */
+extern int z80_jit_enabled;
+extern Uchar z80_jit_code_page[256];
+extern int z80_jit_run(void);
+extern void z80_jit_invalidate(int address);
+extern void z80_jit_remap(void);
+extern void z80_jit_flush(void);
+
+/* Execution profiler (z80_profile.c) */
+#define MEM_BANK_ROM 4		/* Model 4/4P ROM; 0-3 are 32K RAM banks */
+#define MEM_BANKS 5
+extern int z80_profile_enabled;
+extern void z80_profile_init(const char *report, const char *symbols);
+extern void z80_profile_insn(int pc, tstate_t start, int sp,
+			     int instruction);
+extern void z80_profile_call(int target);
+extern void z80_profile_report(FILE *fp);
 
 #endif
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * z80_coverage.c -- guest code coverage.
+ *
+ * When coverage is enabled (-coverage), z80_run() sets a bit for the
+ * address of each instruction it executes, and with -coveragedata
+ * mem_read() and mem_write() set bits for each address they access
+ * (instruction fetches included).  Translated code is not marked, so
+ * coverage turns off -jit.
+ * The bitmaps are flat 64K arrays kept separately for each memory
+ * bank (see mem_bank_number()).  The z80_coverage_* tables point at
+ * the bitmap for each 256-byte page in the current memory map, so
+ * marking is a single OR; the tables are rebuilt whenever the map
+ * changes.
+ *
+ * The bitmaps are written to the -coverage file when xtrs exits, with
+ * the contents of each page that had code executed, so that covdump
+ * can disassemble it.
+ *
+ * File format:
+ *   header:   "XTRSCOV1", 1-byte trs_model, 1-byte flags (COV_FLAG_*),
+ *             6 bytes reserved
+ *   sections: 1-byte kind (COV_*), 1-byte bank, COV_MASK_BYTES bitmap
+ *             of the pages present, then for each page present in
+ *             ascending order, COV_PAGE_BITS bytes of bitmap (bit n of
+ *             byte i is address i*8+n in the page) or, for COV_CODE,
+ *             the 256 bytes of memory
+ * Pages with no bits set are omitted, and sections with no pages.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "z80.h"
+#include "trs.h"
+#include "z80_coverage.h"
+
+int z80_coverage_enabled = FALSE;
+int z80_coverage_data_enabled = FALSE;
+int z80_coverage_data = FALSE;		/* -coveragedata */
+char *z80_coverage_name = NULL;		/* -coverage file */
+
+Uchar *z80_coverage_exec[COV_PAGES];
+Uchar *z80_coverage_read[COV_PAGES];
+Uchar *z80_coverage_write[COV_PAGES];
+
+/* One 8K bitmap per bank for each of COV_EXEC, COV_READ, COV_WRITE */
+static Uchar *cov_maps[COV_CODE][MEM_BANKS];
+
+static int cov_page_used(const Uchar *map, int page)
+{
+  int i;
+
+  for (i = 0; i < COV_PAGE_BITS; i++) {
+    if (map[page * COV_PAGE_BITS + i]) return TRUE;
+  }
+  return FALSE;
+}
+
+static void cov_write_section(FILE *fp, int kind, int bank)
+{
+  const Uchar *map = cov_maps[kind == COV_CODE ? COV_EXEC : kind][bank];
+  Uchar mask[COV_MASK_BYTES];
+  Uchar code[256];
+  int page, i, any = FALSE;
+
+  memset(mask, 0, sizeof(mask));
+  for (page = 0; page < COV_PAGES; page++) {
+    if (cov_page_used(map, page)) {
+      mask[page >> 3] |= 1 << (page & 7);
+      any = TRUE;
+    }
+  }
+  if (!any) return;
+
+  putc(kind, fp);
+  putc(bank, fp);
+  fwrite(mask, 1, sizeof(mask), fp);
+  for (page = 0; page < COV_PAGES; page++) {
+    if (!(mask[page >> 3] & (1 << (page & 7)))) continue;
+    if (kind == COV_CODE) {
+      for (i = 0; i < 256; i++) {
+	code[i] = mem_read_bank(bank, (page << 8) + i);
+      }
+      fwrite(code, 1, sizeof(code), fp);
+    } else {
+      fwrite(map + page * COV_PAGE_BITS, 1, COV_PAGE_BITS, fp);
+    }
+  }
+}
+
+static void cov_save(void)
+{
+  Uchar header[COV_HEADER];
+  FILE *fp;
+  int kind, bank;
+
+  fp = fopen(z80_coverage_name, "wb");
+  if (fp == NULL) {
+    error("can't write coverage file %s: %s", z80_coverage_name,
+	  strerror(errno));
+    return;
+  }
+  memset(header, 0, sizeof(header));
+  memcpy(header, COV_MAGIC, 8);
+  header[8] = trs_model;
+  header[9] = z80_coverage_data_enabled ? COV_FLAG_DATA : 0;
+  fwrite(header, 1, sizeof(header), fp);
+
+  for (kind = 0; kind < COV_KINDS; kind++) {
+    if ((kind == COV_READ || kind == COV_WRITE) &&
+	!z80_coverage_data_enabled) {
+      continue;
+    }
+    for (bank = 0; bank < MEM_BANKS; bank++) {
+      cov_write_section(fp, kind, bank);
+    }
+  }
+  if (ferror(fp) | fclose(fp)) {
+    error("can't write coverage file %s: %s", z80_coverage_name,
+	  strerror(errno));
+  }
+}
+
+/*
+ * Point the page tables at the bitmaps of the banks now mapped.
+ * Called whenever the memory map changes.
+ */
+void z80_coverage_remap(void)
+{
+  int page, bank;
+
+  if (!z80_coverage_enabled) return;
+  for (page = 0; page < COV_PAGES; page++) {
+    bank = mem_bank_number(page << 8);
+    z80_coverage_exec[page] = cov_maps[COV_EXEC][bank] + page * COV_PAGE_BITS;
+    if (z80_coverage_data_enabled) {
+      z80_coverage_read[page] =
+	cov_maps[COV_READ][bank] + page * COV_PAGE_BITS;
+      z80_coverage_write[page] =
+	cov_maps[COV_WRITE][bank] + page * COV_PAGE_BITS;
+    }
+  }
+}
+
+/*
+ * Allocate the bitmaps if z80_coverage_name was set by the -coverage
+ * option.  Called from trs_init() after mem_init().
+ */
+void z80_coverage_init(void)
+{
+  int kind, bank;
+
+  if (z80_coverage_name == NULL) return;
+  for (kind = 0; kind < COV_CODE; kind++) {
+    if (kind != COV_EXEC && !z80_coverage_data) continue;
+    for (bank = 0; bank < MEM_BANKS; bank++) {
+      cov_maps[kind][bank] =
+	(Uchar *) calloc(COV_PAGES, COV_PAGE_BITS);
+      if (cov_maps[kind][bank] == NULL) fatal("out of memory for coverage");
+    }
+  }
+  atexit(cov_save);
+  z80_coverage_enabled = TRUE;
+  z80_coverage_data_enabled = z80_coverage_data;
+  z80_coverage_remap();
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Guest code coverage (z80_coverage.c) and its file format, shared
+ * with the covdump program.
+ */
+
+#ifndef _Z80_COVERAGE_H
+#define _Z80_COVERAGE_H
+
+#define COV_MAGIC	"XTRSCOV1"
+#define COV_HEADER	16	/* magic, trs_model, flags, 6 reserved */
+#define COV_FLAG_DATA	1	/* file has COV_READ and COV_WRITE sections */
+
+/* Section kinds */
+#define COV_EXEC	0	/* instruction addresses executed */
+#define COV_READ	1	/* addresses read */
+#define COV_WRITE	2	/* addresses written */
+#define COV_CODE	3	/* memory contents of pages with COV_EXEC bits */
+#define COV_KINDS	4
+
+#define COV_PAGES	256
+#define COV_PAGE_BITS	32	/* bytes of bitmap per 256-byte page */
+#define COV_MASK_BYTES	(COV_PAGES / 8)
+
+extern int z80_coverage_enabled;
+extern int z80_coverage_data_enabled;
+extern int z80_coverage_data;
+extern char *z80_coverage_name;
+
+/* Bitmap of each 256-byte page in the current memory map */
+extern Uchar *z80_coverage_exec[COV_PAGES];
+extern Uchar *z80_coverage_read[COV_PAGES];
+extern Uchar *z80_coverage_write[COV_PAGES];
+
+#define COVERAGE_MARK(map, address) \
+  ((map)[((address) >> 8) & 0xff][((address) & 0xff) >> 3] |= \
+   1 << ((address) & 7))
+
+extern void z80_coverage_init(void);
+extern void z80_coverage_remap(void);
+
+#endif /*_Z80_COVERAGE_H*/
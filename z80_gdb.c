@@ -0,0 +1,612 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * z80_gdb.c -- GDB remote serial protocol stub.
+ *
+ * With -gdb, xtrs listens on a local TCP port (or a Unix socket, if
+ * the name contains a slash) for gdb's "target remote".  While no
+ * client is attached, z80_run() only makes a nonblocking accept()
+ * each time it polls for X events.
+ *
+ * Once attached, the emulator stops and z80_gdb_stop() serves gdb's
+ * requests until it continues or steps.  Breakpoints are set in
+ * debug_traps[] and watchpoints in the debugger's trap table, so
+ * z80_run() checks them itself and the emulator runs at full speed
+ * between hits.  A ^C from gdb is noticed at the next X poll.
+ *
+ * Registers are in the order of gdb's z80 target: AF BC DE HL SP PC
+ * IX IY AF' BC' DE' HL' IR.  Memory addresses 0-0xffff go through
+ * the current memory map.  Address (bank + 1) * 0x10000 + offset
+ * reads the memory bank numbered as by mem_bank_number() directly,
+ * so bank 4 (0x50000) is the Model 4/4P ROM.
+ */
+
+#define _XOPEN_SOURCE 600 /* strdup() */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "z80.h"
+#include "trs.h"
+
+#define GDB_PACKET	4096	/* largest packet, including framing */
+#define GDB_WATCHES	64
+
+char *z80_gdb_name = NULL;	/* -gdb port or socket */
+int z80_gdb_fd = -1;		/* listening socket */
+
+static int gdb_client = -1;
+static int gdb_running;		/* client is waiting for a stop reply */
+static volatile int gdb_interrupted;
+static char gdb_buf[GDB_PACKET];
+
+/* gdb watchpoints, to tell watch, rwatch, and awatch hits apart */
+static struct {
+  int type;			/* Z packet type: 2, 3, or 4 */
+  int start, end;
+} gdb_watches[GDB_WATCHES];
+static int gdb_num_watches;
+
+static int hex_digit(int c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* Parse hex digits at *p, advancing *p past them */
+static unsigned long get_hex(const char **p)
+{
+  unsigned long v = 0;
+  int d;
+
+  while ((d = hex_digit(**p)) >= 0) {
+    v = (v << 4) | d;
+    (*p)++;
+  }
+  return v;
+}
+
+static char *put_hex(char *p, int value, int bytes)
+{
+  static const char digits[] = "0123456789abcdef";
+
+  while (bytes--) {
+    *p++ = digits[(value >> 4) & 0xf];
+    *p++ = digits[value & 0xf];
+    value >>= 8;		/* registers go little-endian */
+  }
+  *p = '\0';
+  return p;
+}
+
+/*
+ * Packet I/O.  The client socket is blocking; the emulator stands
+ * still while we serve requests, as in debug_shell().
+ */
+
+static int gdb_getc(void)
+{
+  unsigned char c;
+  ssize_t n;
+
+  do {
+    n = read(gdb_client, &c, 1);
+  } while (n < 0 && errno == EINTR);
+  return n == 1 ? c : -1;
+}
+
+static int gdb_write(const char *p, size_t n)
+{
+  ssize_t w;
+
+  while (n > 0) {
+    w = send(gdb_client, p, n, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += w;
+    n -= w;
+  }
+  return 0;
+}
+
+static int gdb_put_packet(const char *data)
+{
+  char trailer[4];
+  unsigned char sum = 0;
+  const char *p;
+  int c;
+
+  for (p = data; *p; p++) sum += (unsigned char) *p;
+  put_hex(trailer + 1, sum, 1);
+  trailer[0] = '#';
+  do {
+    if (gdb_write("$", 1) < 0 || gdb_write(data, strlen(data)) < 0 ||
+	gdb_write(trailer, 3) < 0) {
+      return -1;
+    }
+    c = gdb_getc();
+  } while (c == '-');
+  return c == '+' ? 0 : -1;
+}
+
+/* Read a packet into gdb_buf; returns its length, or -1 if closed */
+static int gdb_get_packet(void)
+{
+  unsigned char sum;
+  int c, n, check;
+
+  for (;;) {
+    do {
+      c = gdb_getc();
+      if (c < 0) return -1;
+    } while (c != '$');
+
+    sum = 0;
+    n = 0;
+    while ((c = gdb_getc()) >= 0 && c != '#') {
+      if (n < GDB_PACKET - 1) gdb_buf[n++] = c;
+      sum += c;
+    }
+    if (c < 0) return -1;
+    gdb_buf[n] = '\0';
+    c = hex_digit(gdb_getc());
+    check = hex_digit(gdb_getc());
+    if (c >= 0 && check >= 0 && ((c << 4) | check) == sum) {
+      if (gdb_write("+", 1) < 0) return -1;
+      return n;
+    }
+    if (gdb_write("-", 1) < 0) return -1;
+  }
+}
+
+/*
+ * Registers
+ */
+
+#define GDB_NUM_REGS 13
+
+static int gdb_get_reg(int n)
+{
+  switch (n) {
+  case 0: return REG_AF;
+  case 1: return REG_BC;
+  case 2: return REG_DE;
+  case 3: return REG_HL;
+  case 4: return REG_SP;
+  case 5: return REG_PC;
+  case 6: return REG_IX;
+  case 7: return REG_IY;
+  case 8: return REG_AF_PRIME;
+  case 9: return REG_BC_PRIME;
+  case 10: return REG_DE_PRIME;
+  case 11: return REG_HL_PRIME;
+  case 12: return (REG_I << 8) | (REG_R & 0x7f) | REG_R7;
+  }
+  return 0;
+}
+
+static void gdb_set_reg(int n, int v)
+{
+  switch (n) {
+  case 0: REG_AF = v; break;
+  case 1: REG_BC = v; break;
+  case 2: REG_DE = v; break;
+  case 3: REG_HL = v; break;
+  case 4: REG_SP = v; break;
+  case 5: REG_PC = v; break;
+  case 6: REG_IX = v; break;
+  case 7: REG_IY = v; break;
+  case 8: REG_AF_PRIME = v; break;
+  case 9: REG_BC_PRIME = v; break;
+  case 10: REG_DE_PRIME = v; break;
+  case 11: REG_HL_PRIME = v; break;
+  case 12:
+    REG_I = v >> 8;
+    REG_R = v & 0x7f;
+    REG_R7 = v & 0x80;
+    break;
+  }
+}
+
+/* Registers are sent as 16-bit little-endian values */
+static int gdb_reg_value(const char **p)
+{
+  int lo = get_hex(p);	/* exactly 4 digits, read as one number */
+  return ((lo & 0xff) << 8) | ((lo >> 8) & 0xff);
+}
+
+/*
+ * Memory
+ */
+
+static int gdb_read_byte(unsigned long address)
+{
+  int bank;
+
+  if (address < 0x10000) return mem_read(address);
+  bank = (address >> 16) - 1;
+  if (bank >= MEM_BANKS) return -1;
+  if (trs_model < 4 && bank != 0 && bank != MEM_BANK_ROM) return -1;
+  return mem_read_bank(bank, address);
+}
+
+static int gdb_write_byte(unsigned long address, int value)
+{
+  int bank;
+
+  if (address < 0x10000) {
+    mem_write(address, value);
+    return 0;
+  }
+  bank = (address >> 16) - 1;
+  if (bank >= MEM_BANK_ROM) return -1;
+  if (trs_model < 4 && bank != 0) return -1;
+  mem_write_bank(bank, address, value);
+  return 1;
+}
+
+/*
+ * Breakpoints and watchpoints
+ */
+
+static void gdb_break(int address, int set)
+{
+  address &= 0xffff;
+  if (set && !(debug_traps[address] & DEBUG_GDB_FLAG)) {
+    debug_traps[address] |= DEBUG_GDB_FLAG;
+    debug_trap_pages[address >> 8]++;
+  } else if (!set && (debug_traps[address] & DEBUG_GDB_FLAG)) {
+    debug_traps[address] &= ~DEBUG_GDB_FLAG;
+    debug_trap_pages[address >> 8]--;
+  }
+}
+
+static int gdb_watch(int type, int start, int end, int set)
+{
+  int i;
+
+  if (set) {
+    if (gdb_num_watches == GDB_WATCHES) return -1;
+    gdb_watches[gdb_num_watches].type = type;
+    gdb_watches[gdb_num_watches].start = start;
+    gdb_watches[gdb_num_watches].end = end;
+    gdb_num_watches++;
+    if (type != 3) debug_set_watch(start, end, DEBUG_WATCH_WRITE);
+    if (type != 2) debug_set_watch(start, end, DEBUG_WATCH_READ);
+    return 0;
+  }
+  for (i = 0; i < gdb_num_watches; i++) {
+    if (gdb_watches[i].type == type && gdb_watches[i].start == start &&
+	gdb_watches[i].end == end) {
+      gdb_watches[i] = gdb_watches[--gdb_num_watches];
+      if (type != 3) debug_clear_watch(start, end, DEBUG_WATCH_WRITE);
+      if (type != 2) debug_clear_watch(start, end, DEBUG_WATCH_READ);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void gdb_clear_all(void)
+{
+  int a;
+
+  for (a = 0; a < 0x10000; a++) gdb_break(a, FALSE);
+  while (gdb_num_watches > 0) {
+    gdb_watch(gdb_watches[0].type, gdb_watches[0].start,
+	      gdb_watches[0].end, FALSE);
+  }
+}
+
+static void gdb_close(void)
+{
+  gdb_clear_all();
+  close(gdb_client);
+  gdb_client = -1;
+  gdb_running = FALSE;
+}
+
+/* Report why the emulator stopped */
+static int gdb_stop_reply(void)
+{
+  static const char *kinds[] = { "watch", "rwatch", "awatch" };
+  char reply[32];
+  int i, type;
+
+  if (gdb_interrupted) {
+    gdb_interrupted = FALSE;
+    return gdb_put_packet("S02");
+  }
+  if (debug_watch_hit_what) {
+    type = (debug_watch_hit_what & DEBUG_WATCH_READ) ? 3 : 2;
+    for (i = 0; i < gdb_num_watches; i++) {
+      if (debug_watch_hit_address >= gdb_watches[i].start &&
+	  debug_watch_hit_address <= gdb_watches[i].end &&
+	  (gdb_watches[i].type == type || gdb_watches[i].type == 4)) {
+	type = gdb_watches[i].type;
+	break;
+      }
+    }
+    sprintf(reply, "T05%s:%04x;", kinds[type - 2], debug_watch_hit_address);
+    debug_watch_hit_what = 0;
+    return gdb_put_packet(reply);
+  }
+  return gdb_put_packet("S05");
+}
+
+/*
+ * Serve requests until gdb continues the emulator.  Returns FALSE if
+ * the client went away.
+ */
+static int gdb_serve(void)
+{
+  char reply[GDB_PACKET];
+  const char *p;
+  char *q;
+  unsigned long address, length, i;
+  int n, v, type, flush;
+
+  for (;;) {
+    if (gdb_get_packet() < 0) return FALSE;
+    p = gdb_buf + 1;
+    reply[0] = '\0';
+
+    switch (gdb_buf[0]) {
+    case '?':
+      strcpy(reply, "S05");
+      break;
+
+    case 'g':
+      for (q = reply, n = 0; n < GDB_NUM_REGS; n++) {
+	q = put_hex(q, gdb_get_reg(n), 2);
+      }
+      break;
+
+    case 'G':
+      for (n = 0; n < GDB_NUM_REGS && strlen(p) >= 4; n++) {
+	char digits[5];
+	const char *d = digits;
+	memcpy(digits, p, 4);
+	digits[4] = '\0';
+	gdb_set_reg(n, gdb_reg_value(&d));
+	p += 4;
+      }
+      strcpy(reply, "OK");
+      break;
+
+    case 'p':
+      n = get_hex(&p);
+      if (n < GDB_NUM_REGS) put_hex(reply, gdb_get_reg(n), 2);
+      else strcpy(reply, "E01");
+      break;
+
+    case 'P':
+      n = get_hex(&p);
+      if (*p++ == '=' && n < GDB_NUM_REGS) {
+	gdb_set_reg(n, gdb_reg_value(&p));
+	strcpy(reply, "OK");
+      } else {
+	strcpy(reply, "E01");
+      }
+      break;
+
+    case 'm':
+      address = get_hex(&p);
+      length = (*p++ == ',') ? get_hex(&p) : 0;
+      if (length > (sizeof(reply) - 1) / 2) length = (sizeof(reply) - 1) / 2;
+      for (q = reply, i = 0; i < length; i++) {
+	v = gdb_read_byte(address + i);
+	if (v < 0) break;
+	q = put_hex(q, v, 1);
+      }
+      if (i == 0 && length > 0) strcpy(reply, "E01");
+      break;
+
+    case 'M':
+      address = get_hex(&p);
+      length = (*p++ == ',') ? get_hex(&p) : 0;
+      if (*p++ != ':') {
+	strcpy(reply, "E01");
+	break;
+      }
+      flush = FALSE;
+      for (i = 0; i < length; i++) {
+	if (hex_digit(p[0]) < 0 || hex_digit(p[1]) < 0) break;
+	v = (hex_digit(p[0]) << 4) | hex_digit(p[1]);
+	p += 2;
+	n = gdb_write_byte(address + i, v);
+	if (n < 0) break;
+	flush |= n;
+      }
+      if (flush) z80_jit_flush();
+      strcpy(reply, i == length ? "OK" : "E01");
+      break;
+
+    case 'c':
+      if (*p) REG_PC = get_hex(&p);
+      gdb_running = TRUE;
+      return TRUE;
+
+    case 's':
+      if (*p) REG_PC = get_hex(&p);
+      z80_run(0);
+      strcpy(reply, "S05");
+      break;
+
+    case 'Z':
+    case 'z':
+      type = get_hex(&p);
+      address = (*p++ == ',') ? get_hex(&p) : 0;
+      length = (*p++ == ',') ? get_hex(&p) : 1;
+      if (length == 0) length = 1;
+      if (type == 0 || type == 1) {
+	gdb_break(address, gdb_buf[0] == 'Z');
+	strcpy(reply, "OK");
+      } else if (type >= 2 && type <= 4 && address + length <= 0x10000) {
+	strcpy(reply, gdb_watch(type, address, address + length - 1,
+				gdb_buf[0] == 'Z') == 0 ? "OK" : "E01");
+      }
+      break;
+
+    case 'D':
+      gdb_put_packet("OK");
+      gdb_close();
+      return FALSE;
+
+    case 'k':
+      gdb_close();
+      trs_exit();
+      return FALSE;
+
+    case 'H':
+      strcpy(reply, "OK");
+      break;
+
+    case 'q':
+      if (strncmp(gdb_buf, "qSupported", 10) == 0) {
+	sprintf(reply, "PacketSize=%x", GDB_PACKET - 8);
+      } else if (strcmp(gdb_buf, "qAttached") == 0) {
+	strcpy(reply, "1");
+      }
+      break;
+
+    default:
+      /* Not supported; empty reply */
+      break;
+    }
+    if (gdb_put_packet(reply) < 0) return FALSE;
+  }
+}
+
+/*
+ * Called from z80_run() at each X poll: accept a client, or notice
+ * its ^C.  Either stops the emulator.
+ */
+void z80_gdb_poll(void)
+{
+  unsigned char c;
+  int fd, one = 1;
+  ssize_t n;
+
+  if (gdb_client < 0) {
+    fd = accept(z80_gdb_fd, NULL, NULL);
+    if (fd < 0) return;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    gdb_client = fd;
+    gdb_running = FALSE;
+    if (trs_continuous > 0) trs_continuous = 0;
+    return;
+  }
+  if (!gdb_running) return;
+  n = recv(gdb_client, &c, 1, MSG_DONTWAIT);
+  if (n == 1 && c == 0x03) {
+    gdb_interrupted = TRUE;
+    if (trs_continuous > 0) trs_continuous = 0;
+  } else if (n == 0) {
+    /* Client went away while running */
+    gdb_close();
+  }
+}
+
+/*
+ * Called after z80_run() returns.  If gdb is attached, report the stop
+ * and serve gdb until it resumes the emulator, then return TRUE.
+ * Return FALSE if gdb is not attached, so the caller enters the zbx
+ * debugger as before.
+ */
+int z80_gdb_stop(void)
+{
+  int ok;
+
+  if (gdb_client < 0) return FALSE;
+  debug_watch_armed = FALSE;
+
+  ok = !gdb_running || gdb_stop_reply() == 0;
+  gdb_running = FALSE;
+  if (ok) ok = gdb_serve();
+
+  if (!ok && gdb_client >= 0) gdb_close();
+  debug_watch_hit_what = 0;
+  debug_watch_armed = TRUE;
+  return TRUE;
+}
+
+/*
+ * Open the -gdb socket.  Called from trs_init() after the options are
+ * parsed.
+ */
+void z80_gdb_init(void)
+{
+  struct sockaddr_in in;
+  struct sockaddr_un un;
+  struct stat st;
+  int fd, one = 1;
+
+  if (z80_gdb_name == NULL) return;
+  if (strchr(z80_gdb_name, '/')) {
+    /* Remove a stale socket left by an earlier run, but nothing else */
+    if (lstat(z80_gdb_name, &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+	fatal("can't use %s as gdb socket: file exists", z80_gdb_name);
+      }
+      unlink(z80_gdb_name);
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, z80_gdb_name, sizeof(un.sun_path) - 1);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &un, sizeof(un)) < 0) {
+      fatal("can't bind gdb socket %s: %s", z80_gdb_name, strerror(errno));
+    }
+  } else {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons(atoi(z80_gdb_name));
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (struct sockaddr *) &in, sizeof(in)) < 0) {
+      fatal("can't bind gdb port %s: %s", z80_gdb_name, strerror(errno));
+    }
+  }
+  if (listen(fd, 1) < 0) {
+    fatal("can't listen for gdb: %s", strerror(errno));
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  z80_gdb_fd = fd;
+}
@@ -0,0 +1,918 @@
+/* 
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * z80_jit.c -- dynamic translation of Z80 code to x86-64 code.
+ *
+ * When the translator is enabled (-jit), z80_run() calls z80_jit_run()
+ * before each instruction it would interpret.  After a Z80 address has
+ * been reached JIT_THRESHOLD times, the basic block starting there is
+ * translated to native code, and later visits run the native code.
+ *
+ * Only a subset of the unprefixed instructions is translated: loads,
+ * 8-bit arithmetic and logic, 16-bit increments and adds, exchanges,
+ * stack operations, jumps, calls, and returns.  Flags are computed by
+ * calling the same routines the interpreter uses.  A block ends just
+ * before any other instruction (I/O, EI, DI, HALT, and all prefixed
+ * instructions, including the ED block operations and emulator traps),
+ * and the interpreter executes it.
+ *
+ * Translated code loads and stores memory directly only in pages
+ * where mem_read() or mem_write() would simply do the same in the
+ * current memory map.  Any other access (memory-mapped I/O, video)
+ * makes the block exit to the interpreter just before the instruction,
+ * so devices see exactly the T-state count they would without the
+ * translator.
+ *
+ * A block accounts for the exact T-states and refresh register
+ * increments of the instructions it executed.  It is entered only when
+ * it cannot run past the next scheduled event, the run limit, or the
+ * input clock, and not when an interrupt is pending, so events and
+ * interrupts happen at the same instruction boundaries as in the
+ * interpreter.
+ *
+ * Self-modifying code: z80_jit_code_page[] marks each 256-byte page
+ * that holds translated code.  Translated code never stores into those
+ * pages directly; mem_write() calls z80_jit_invalidate() when it
+ * writes one, which discards the translations in the page.  A change
+ * of memory map discards the translations in every page whose contents
+ * moved.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "z80.h"
+#include "trs.h"
+#include "trs_stats.h"
+
+int z80_jit_enabled = FALSE;
+Uchar z80_jit_code_page[256];
+
+#if defined(__x86_64__)
+
+#define JIT_THRESHOLD   16     /* visits before an address is translated */
+#define JIT_MAX_INSNS   64     /* instructions per block */
+#define JIT_MAX_RUN     2048   /* instructions per call, when looping */
+#define JIT_MAX_BLOCKS  16384
+#define JIT_CODE_SIZE   (4 * 1024 * 1024)
+#define JIT_BLOCK_SPACE 32768  /* native code bytes per block, worst case */
+#define JIT_THRASH      8      /* invalidations before a page is left alone */
+
+typedef int (*jit_func)(struct z80_state_struct *state);
+
+struct jit_block {
+  jit_func code;
+  int max_t;         /* most T-states one pass through the block takes */
+};
+
+/* Marks an address where translation failed */
+static struct jit_block jit_none;
+
+/* jit_lookup, jit_heat, and jit_blocks are allocated with jit_code,
+   the first time translation is tried */
+static struct jit_block **jit_lookup;
+static Uchar *jit_heat;
+static Uchar jit_page_thrash[256];
+static struct jit_block *jit_blocks;
+#define JIT_TABLE_BYTES \
+  (Z80_ADDRESS_LIMIT * (sizeof(struct jit_block *) + sizeof(Uchar)) + \
+   JIT_MAX_BLOCKS * sizeof(struct jit_block))
+static int jit_nblocks = 0;
+static Uchar *jit_code = NULL, *jit_next;
+
+/* Host addresses of plain memory pages: [0..255] for reading,
+   [256..511] for writing, NULL where the page is not plain. */
+static Uchar *jit_pages[512];
+static int jit_map_valid = FALSE;
+
+extern void (*const z80_jit_alu_ops[8])(int value);
+extern void (*const z80_jit_inc_dec_flags[2])(int value);
+extern void (*const z80_jit_acc_ops[5])(void);
+extern void (*const z80_jit_add_hl)(int value);
+
+/*
+ * Word access for translated code.  jit_read_word returns -1 and
+ * jit_write_word returns FALSE without changing anything if either
+ * byte is not in plain memory.
+ */
+static int jit_read_word(int address)
+{
+  int next = (address + 1) & 0xffff;
+  Uchar *lo = jit_pages[address >> 8];
+  Uchar *hi = jit_pages[next >> 8];
+
+  if (lo == NULL || hi == NULL) return -1;
+  return lo[address & 0xff] | (hi[next & 0xff] << 8);
+}
+
+static int jit_write_word(int address, int value)
+{
+  int next = (address + 1) & 0xffff;
+  Uchar *lo = jit_pages[256 + (address >> 8)];
+  Uchar *hi = jit_pages[256 + (next >> 8)];
+
+  if (lo == NULL || hi == NULL) return FALSE;
+  lo[address & 0xff] = value;
+  hi[next & 0xff] = value >> 8;
+  return TRUE;
+}
+
+static void jit_clear_page(int page)
+{
+  memset(&jit_lookup[page << 8], 0, 256 * sizeof(jit_lookup[0]));
+  z80_jit_code_page[page] = 0;
+}
+
+void z80_jit_invalidate(int address)
+{
+  int page = (address >> 8) & 0xff;
+
+  if (!z80_jit_code_page[page]) return;
+  jit_clear_page(page);
+  if (jit_page_thrash[page] < JIT_THRASH) jit_page_thrash[page]++;
+  jit_pages[256 + page] = mem_plain_page(page << 8, 1);
+}
+
+void z80_jit_remap(void)
+{
+  jit_map_valid = FALSE;
+}
+
+void z80_jit_flush(void)
+{
+  int page;
+
+  for (page = 0; page < 256; page++) {
+    if (z80_jit_code_page[page] || jit_page_thrash[page]) {
+      jit_clear_page(page);
+      jit_page_thrash[page] = 0;
+    }
+  }
+  jit_nblocks = 0;
+  jit_next = jit_code;
+  jit_map_valid = FALSE;
+}
+
+static void jit_update_map(void)
+{
+  int page;
+  Uchar *rd;
+
+  for (page = 0; page < 256; page++) {
+    rd = mem_plain_page(page << 8, 0);
+    if (rd != jit_pages[page]) {
+      /* Different memory is mapped here now */
+      jit_clear_page(page);
+      jit_pages[page] = rd;
+    }
+    jit_pages[256 + page] =
+      z80_jit_code_page[page] ? NULL : mem_plain_page(page << 8, 1);
+  }
+  jit_map_valid = TRUE;
+}
+
+/*
+ * Code generation.  Translated code keeps the address of z80_state in
+ * rbx, the address of jit_pages in r12, and the count of instructions
+ * executed so far in r15d, which is also its return value.
+ */
+
+#define OFF(field) ((int) offsetof(struct z80_state_struct, field))
+
+static Uchar *cp;         /* next byte of code */
+static Uchar *epilogue;
+
+/* Offsets of 8-bit registers in Z80 encoding order; (HL) is -1 */
+static const int reg8[8] = {
+  OFF(bc.byte.high), OFF(bc.byte.low), OFF(de.byte.high), OFF(de.byte.low),
+  OFF(hl.byte.high), OFF(hl.byte.low), -1, OFF(af.byte.high)
+};
+/* Register pairs as encoded in ld rr,nn (with SP) and push (with AF) */
+static const int reg16_sp[4] = { OFF(bc), OFF(de), OFF(hl), OFF(sp) };
+static const int reg16_af[4] = { OFF(bc), OFF(de), OFF(hl), OFF(af) };
+/* Flag masks for conditions nz/z, nc/c, po/pe, p/m */
+static const int cond_mask[4] = {
+  ZERO_MASK, CARRY_MASK, PARITY_MASK, SIGN_MASK
+};
+
+/* Exits to a known Z80 address: taken branches, the end of the block,
+   and fallbacks to the interpreter.  Their code goes after the body. */
+#define MAX_EXITS (JIT_MAX_INSNS * 3 + 1)
+static struct {
+  Uchar *patch;          /* rel32 to point at the exit code */
+  Ushort pc;             /* Z80 address to continue at */
+  int t;                 /* T-states executed on this path */
+  int n;                 /* instructions executed on this path */
+} exits[MAX_EXITS];
+static int nexits;
+static int max_t;
+
+#define CC_B  0x2
+#define CC_AE 0x3
+#define CC_Z  0x4
+#define CC_NZ 0x5
+#define CC_S  0x8
+#define CC_LE 0xe
+
+static void emit1(int b)
+{
+  *cp++ = b;
+}
+
+/* Emit n bytes given as arguments */
+static void emit(int n, ...)
+{
+  va_list args;
+  va_start(args, n);
+  while (n-- > 0) emit1(va_arg(args, int));
+  va_end(args);
+}
+
+static void emit4(int v)
+{
+  memcpy(cp, &v, 4);
+  cp += 4;
+}
+
+static void emit8(void *p)
+{
+  memcpy(cp, &p, 8);
+  cp += 8;
+}
+
+/* Instruction with a [rbx+disp32] operand; prefix < 0 for none */
+static void emit_rbx(int prefix, int op, int reg, int disp)
+{
+  if (prefix >= 0) emit1(prefix);
+  emit1(op);
+  emit1(0x80 | (reg << 3) | 3);
+  emit4(disp);
+}
+
+/* Two-byte opcode 0f xx with a [rbx+disp32] operand */
+static void emit_rbx_0f(int op, int reg, int disp)
+{
+  emit_rbx(0x0f, op, reg, disp);
+}
+
+/* Jump (cc < 0) or conditional jump with rel32; returns rel32 address */
+static Uchar *emit_jump(int cc)
+{
+  if (cc < 0) {
+    emit1(0xe9);
+  } else {
+    emit(2, 0x0f, 0x80 | cc);
+  }
+  emit4(0);
+  return cp - 4;
+}
+
+static void patch(Uchar *p, Uchar *target)
+{
+  int rel = target - (p + 4);
+  memcpy(p, &rel, 4);
+}
+
+static void ld8_eax(int off)   { emit_rbx_0f(0xb6, 0, off); }
+static void ld8_esi(int off)   { emit_rbx_0f(0xb6, 6, off); }
+static void ld8_edi(int off)   { emit_rbx_0f(0xb6, 7, off); }
+static void ld16_eax(int off)  { emit_rbx_0f(0xb7, 0, off); }
+static void ld16_ecx(int off)  { emit_rbx_0f(0xb7, 1, off); }
+static void ld16_esi(int off)  { emit_rbx_0f(0xb7, 6, off); }
+static void ld16_edi(int off)  { emit_rbx_0f(0xb7, 7, off); }
+static void st8_al(int off)    { emit_rbx(-1, 0x88, 0, off); }
+static void st16_ax(int off)   { emit_rbx(0x66, 0x89, 0, off); }
+static void st16_cx(int off)   { emit_rbx(0x66, 0x89, 1, off); }
+
+static void st8_imm(int off, int value)
+{
+  emit_rbx(-1, 0xc6, 0, off);
+  emit1(value);
+}
+
+static void st16_imm(int off, int value)
+{
+  emit_rbx(0x66, 0xc7, 0, off);
+  emit(2, value & 0xff, (value >> 8) & 0xff);
+}
+
+/* mov r32, imm32; reg 0 = eax, 6 = esi, 7 = edi */
+static void mov_imm(int reg, int value)
+{
+  emit1(0xb8 + reg);
+  emit4(value);
+}
+
+static void call(void *fn)
+{
+  emit(2, 0x48, 0xb8);             /* mov rax, fn */
+  emit8(fn);
+  emit(2, 0xff, 0xd0);             /* call rax */
+}
+
+/* Add the T-states and instruction count of a path to the state */
+static void commit(int t, int n)
+{
+  if (t) {
+    emit_rbx(0x48, 0x81, 0, OFF(t_count));    /* add qword, imm32 */
+    emit4(t);
+  }
+  if (n) {
+    emit_rbx(-1, 0x80, 0, OFF(r));            /* add byte, imm8 */
+    emit1(n);
+    emit(4, 0x41, 0x83, 0xc7, n);             /* add r15d, n */
+  }
+}
+
+static void add_exit(Uchar *p, int pc, int t, int n)
+{
+  exits[nexits].patch = p;
+  exits[nexits].pc = pc;
+  exits[nexits].t = t;
+  exits[nexits].n = n;
+  nexits++;
+  if (t > max_t) max_t = t;
+}
+
+/* Leave the block, continuing at the address in ax */
+static void exit_dynamic(int t, int n)
+{
+  st16_ax(OFF(pc));
+  commit(t, n);
+  if (t > max_t) max_t = t;
+  patch(emit_jump(-1), epilogue);
+}
+
+/* Address in eax; loads the byte into eax, or exits to pc */
+static void mem_read8(int pc, int t, int n)
+{
+  emit(2, 0x89, 0xc1);                 /* mov ecx, eax */
+  emit(3, 0xc1, 0xe9, 0x08);           /* shr ecx, 8 */
+  emit(4, 0x49, 0x8b, 0x14, 0xcc);     /* mov rdx, [r12+rcx*8] */
+  emit(3, 0x48, 0x85, 0xd2);           /* test rdx, rdx */
+  add_exit(emit_jump(CC_Z), pc, t, n);
+  emit(3, 0x0f, 0xb6, 0xc0);           /* movzx eax, al */
+  emit(4, 0x0f, 0xb6, 0x04, 0x02);     /* movzx eax, byte [rdx+rax] */
+}
+
+/* Address in eax, value in esi; stores the byte, or exits to pc */
+static void mem_write8(int pc, int t, int n)
+{
+  emit(2, 0x89, 0xc1);                 /* mov ecx, eax */
+  emit(3, 0xc1, 0xe9, 0x08);           /* shr ecx, 8 */
+  emit(4, 0x49, 0x8b, 0x94, 0xcc);     /* mov rdx, [r12+rcx*8+2048] */
+  emit4(256 * sizeof(Uchar *));
+  emit(3, 0x48, 0x85, 0xd2);           /* test rdx, rdx */
+  add_exit(emit_jump(CC_Z), pc, t, n);
+  emit(3, 0x0f, 0xb6, 0xc0);           /* movzx eax, al */
+  emit(4, 0x40, 0x88, 0x34, 0x02);     /* mov [rdx+rax], sil */
+}
+
+/* Pushes the word in esi, or exits to pc */
+static void push_esi(int pc, int t, int n)
+{
+  ld16_eax(OFF(sp));
+  emit(3, 0x83, 0xe8, 0x02);           /* sub eax, 2 */
+  emit(3, 0x0f, 0xb7, 0xf8);           /* movzx edi, ax */
+  call((void *) jit_write_word);
+  emit(2, 0x85, 0xc0);                 /* test eax, eax */
+  add_exit(emit_jump(CC_Z), pc, t, n);
+  emit_rbx(0x66, 0x83, 5, OFF(sp));    /* sub word sp, 2 */
+  emit1(2);
+}
+
+/* Pops a word into eax, or exits to pc */
+static void pop_eax(int pc, int t, int n)
+{
+  ld16_edi(OFF(sp));
+  call((void *) jit_read_word);
+  emit(2, 0x85, 0xc0);                 /* test eax, eax */
+  add_exit(emit_jump(CC_S), pc, t, n);
+  emit_rbx(0x66, 0x83, 0, OFF(sp));    /* add word sp, 2 */
+  emit1(2);
+}
+
+/* Tests Z80 condition cc (0-7); returns the jcc that jumps if it holds */
+static int test_cond(int cc)
+{
+  emit_rbx(-1, 0xf6, 0, OFF(af.byte.low));    /* test byte F, imm8 */
+  emit1(cond_mask[cc >> 1]);
+  return (cc & 1) ? CC_NZ : CC_Z;
+}
+
+static void swap16(int off1, int off2)
+{
+  ld16_eax(off1);
+  ld16_ecx(off2);
+  st16_cx(off1);
+  st16_ax(off2);
+}
+
+/*
+ * Code for a branch back to the start of the block.  Loop without
+ * returning to z80_run() unless the next pass could reach an event,
+ * the run limit, or the input clock, an interrupt is pending, the
+ * emulator is stopping, or the block has run for a while.
+ */
+static void loop_back(Uchar *top, Ushort start)
+{
+  static const int limit[3] = { OFF(sched), OFF(stop), OFF(replay) };
+  Uchar *out[12], *skip;
+  int nout = 0, i;
+
+  emit(3, 0x41, 0x81, 0xff);                  /* cmp r15d, imm32 */
+  emit4(JIT_MAX_RUN);
+  out[nout++] = emit_jump(CC_AE);
+
+  for (i = 0; i < 3; i++) {
+    emit_rbx(0x48, 0x8b, 0, limit[i]);        /* mov rax, limit */
+    emit(3, 0x48, 0x85, 0xc0);                /* test rax, rax */
+    skip = emit_jump(CC_Z);
+    emit_rbx(0x48, 0x2b, 0, OFF(t_count));    /* sub rax, t_count */
+    out[nout++] = emit_jump(CC_S);
+    emit(2, 0x48, 0x3d);                      /* cmp rax, imm32 */
+    emit4(max_t);
+    out[nout++] = emit_jump(CC_B);
+    patch(skip, cp);
+  }
+
+  emit_rbx(-1, 0x8b, 0, OFF(nmi));            /* mov eax, nmi */
+  emit(2, 0x85, 0xc0);                        /* test eax, eax */
+  skip = emit_jump(CC_Z);
+  emit_rbx(-1, 0x8b, 0, OFF(nmi_seen));
+  emit(2, 0x85, 0xc0);
+  out[nout++] = emit_jump(CC_Z);
+  patch(skip, cp);
+
+  emit_rbx(-1, 0x8b, 0, OFF(irq));            /* mov eax, irq */
+  emit(2, 0x85, 0xc0);
+  skip = emit_jump(CC_Z);
+  emit_rbx(-1, 0x80, 7, OFF(iff1));           /* cmp byte iff1, 0 */
+  emit1(0);
+  out[nout++] = emit_jump(CC_NZ);
+  patch(skip, cp);
+
+  emit(2, 0x48, 0xb8);                        /* mov rax, &trs_continuous */
+  emit8((void *) &trs_continuous);
+  emit(3, 0x83, 0x38, 0x00);                  /* cmp dword [rax], 0 */
+  out[nout++] = emit_jump(CC_LE);
+
+  patch(emit_jump(-1), top);
+  for (i = 0; i < nout; i++) patch(out[i], cp);
+  st16_imm(OFF(pc), start);
+  patch(emit_jump(-1), epilogue);
+}
+
+/*
+ * Translate the block starting at start.  Returns &jit_none if the
+ * first instruction cannot be translated.
+ */
+static struct jit_block *jit_translate(Ushort start)
+{
+  int page = start >> 8;
+  Uchar *mem = jit_pages[page];
+  Uchar *entry, *top;
+  int pc = start, t = 0, n = 0, done = FALSE;
+  int op, len, r, i, cc;
+  struct jit_block *b;
+
+  if (mem == NULL || jit_page_thrash[page] >= JIT_THRASH) {
+    return &jit_none;
+  }
+  if (jit_nblocks >= JIT_MAX_BLOCKS ||
+      jit_next + JIT_BLOCK_SPACE > jit_code + JIT_CODE_SIZE) {
+    z80_jit_flush();
+    jit_update_map();
+    mem = jit_pages[page];
+  }
+
+  /* Common return path first, then the entry point */
+  cp = jit_next;
+  epilogue = cp;
+  emit(3, 0x44, 0x89, 0xf8);           /* mov eax, r15d */
+  emit(2, 0x41, 0x5f);                 /* pop r15 */
+  emit(2, 0x41, 0x5c);                 /* pop r12 */
+  emit(2, 0x5b, 0xc3);                 /* pop rbx; ret */
+  entry = cp;
+  emit1(0x53);                         /* push rbx */
+  emit(2, 0x41, 0x54);                 /* push r12 */
+  emit(2, 0x41, 0x57);                 /* push r15 */
+  emit(3, 0x48, 0x89, 0xfb);           /* mov rbx, rdi */
+  emit(2, 0x49, 0xbc);                 /* mov r12, jit_pages */
+  emit8((void *) jit_pages);
+  emit(3, 0x45, 0x31, 0xff);           /* xor r15d, r15d */
+  top = cp;
+  nexits = 0;
+  max_t = 0;
+
+  while (!done && n < JIT_MAX_INSNS) {
+    if ((pc >> 8) != page) break;   /* stay within the page */
+    op = mem[pc & 0xff];
+    /* Length of the instruction */
+    switch (op) {
+      case 0x01: case 0x11: case 0x21: case 0x31:
+      case 0x22: case 0x2a: case 0x32: case 0x3a:
+      case 0xc2: case 0xc3: case 0xca: case 0xcd:
+      case 0xd2: case 0xda: case 0xe2: case 0xea: case 0xf2: case 0xfa:
+      case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+      case 0xe4: case 0xec: case 0xf4: case 0xfc:
+	len = 3;
+	break;
+      case 0x06: case 0x0e: case 0x16: case 0x1e:
+      case 0x26: case 0x2e: case 0x36: case 0x3e:
+      case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+      case 0xc6: case 0xce: case 0xd6: case 0xde:
+      case 0xe6: case 0xee: case 0xf6: case 0xfe:
+	len = 2;
+	break;
+      default:
+	len = 1;
+	break;
+    }
+    if ((pc & 0xff) + len > 0x100) break;
+
+#define IMM8   (mem[(pc & 0xff) + 1])
+#define IMM16  (mem[(pc & 0xff) + 1] | (mem[(pc & 0xff) + 2] << 8))
+#define NEXT   ((pc + len) & 0xffff)
+#define REL    ((NEXT + (signed char) IMM8) & 0xffff)
+
+    if (op >= 0x40 && op < 0x80 && op != 0x76) {
+      /* ld r, r' */
+      int dst = (op >> 3) & 7, src = op & 7;
+      if (src == 6) {
+	ld16_eax(OFF(hl));
+	mem_read8(pc, t, n);
+	st8_al(reg8[dst]);
+	t += 7;
+      } else if (dst == 6) {
+	ld8_esi(reg8[src]);
+	ld16_eax(OFF(hl));
+	mem_write8(pc, t, n);
+	t += 7;
+      } else {
+	if (dst != src) {
+	  ld8_eax(reg8[src]);
+	  st8_al(reg8[dst]);
+	}
+	t += 4;
+      }
+    } else if (op >= 0x80 && op < 0xc0) {
+      /* add, adc, sub, sbc, and, xor, or, cp with a register or (hl) */
+      if ((op & 7) == 6) {
+	ld16_eax(OFF(hl));
+	mem_read8(pc, t, n);
+	emit(2, 0x89, 0xc7);           /* mov edi, eax */
+	t += 7;
+      } else {
+	ld8_edi(reg8[op & 7]);
+	t += 4;
+      }
+      call((void *) z80_jit_alu_ops[(op >> 3) & 7]);
+    } else if ((op & 0xc7) == 0xc6) {
+      /* alu op with an immediate value */
+      mov_imm(7, IMM8);
+      call((void *) z80_jit_alu_ops[(op >> 3) & 7]);
+      t += 7;
+    } else if ((op & 0xc7) == 0x06) {
+      /* ld r, value */
+      r = (op >> 3) & 7;
+      if (r == 6) {
+	mov_imm(6, IMM8);
+	ld16_eax(OFF(hl));
+	mem_write8(pc, t, n);
+	t += 10;
+      } else {
+	st8_imm(reg8[r], IMM8);
+	t += 7;
+      }
+    } else if ((op & 0xc6) == 0x04) {
+      /* inc r, dec r */
+      int dec = op & 1;
+      r = (op >> 3) & 7;
+      if (r == 6) {
+	ld16_eax(OFF(hl));
+	mem_read8(pc, t, n);
+	emit(2, 0xfe, dec ? 0xc8 : 0xc0);      /* dec al / inc al */
+	emit(3, 0x0f, 0xb6, 0xf0);             /* movzx esi, al */
+	ld16_eax(OFF(hl));
+	mem_write8(pc, t, n);
+	emit(2, 0x89, 0xf7);                   /* mov edi, esi */
+	t += 11;
+      } else {
+	emit_rbx(-1, 0xfe, dec, reg8[r]);      /* inc/dec byte */
+	ld8_edi(reg8[r]);
+	t += 4;
+      }
+      call((void *) z80_jit_inc_dec_flags[dec]);
+    } else if ((op & 0xcf) == 0x01) {
+      /* ld rr, value */
+      st16_imm(reg16_sp[op >> 4], IMM16);
+      t += 10;
+    } else if ((op & 0xc7) == 0x03) {
+      /* inc rr, dec rr */
+      emit_rbx(0x66, 0xff, (op >> 3) & 1, reg16_sp[(op >> 4) & 3]);
+      t += 6;
+    } else if ((op & 0xcf) == 0x09) {
+      /* add hl, rr */
+      ld16_edi(reg16_sp[op >> 4]);
+      call((void *) z80_jit_add_hl);
+      t += 11;
+    } else if ((op & 0xcf) == 0xc5) {
+      /* push rr */
+      ld16_esi(reg16_af[(op >> 4) & 3]);
+      push_esi(pc, t, n);
+      t += 11;
+    } else if ((op & 0xcf) == 0xc1) {
+      /* pop rr */
+      pop_eax(pc, t, n);
+      st16_ax(reg16_af[(op >> 4) & 3]);
+      t += 10;
+    } else if ((op & 0xc7) == 0xc2) {
+      /* jp cc, address */
+      cc = test_cond((op >> 3) & 7);
+      add_exit(emit_jump(cc), IMM16, t + 10, n + 1);
+      t += 10;
+    } else if ((op & 0xc7) == 0xc4) {
+      /* call cc, address */
+      Uchar *skip;
+      cc = test_cond((op >> 3) & 7);
+      skip = emit_jump(cc ^ 1);
+      mov_imm(6, NEXT);
+      push_esi(pc, t, n);
+      add_exit(emit_jump(-1), IMM16, t + 17, n + 1);
+      patch(skip, cp);
+      t += 10;
+    } else if ((op & 0xc7) == 0xc0) {
+      /* ret cc */
+      Uchar *skip;
+      cc = test_cond((op >> 3) & 7);
+      skip = emit_jump(cc ^ 1);
+      pop_eax(pc, t, n);
+      exit_dynamic(t + 11, n + 1);
+      patch(skip, cp);
+      t += 5;
+    } else if ((op & 0xc7) == 0xc7) {
+      /* rst */
+      mov_imm(6, NEXT);
+      push_esi(pc, t, n);
+      add_exit(emit_jump(-1), op & 0x38, t + 11, n + 1);
+      done = TRUE;
+    } else {
+      switch (op) {
+	case 0x00:	/* nop */
+	  t += 4;
+	  break;
+	case 0x02:	/* ld (bc), a */
+	case 0x12:	/* ld (de), a */
+	  ld8_esi(OFF(af.byte.high));
+	  ld16_eax(op == 0x02 ? OFF(bc) : OFF(de));
+	  mem_write8(pc, t, n);
+	  t += 7;
+	  break;
+	case 0x0a:	/* ld a, (bc) */
+	case 0x1a:	/* ld a, (de) */
+	  ld16_eax(op == 0x0a ? OFF(bc) : OFF(de));
+	  mem_read8(pc, t, n);
+	  st8_al(OFF(af.byte.high));
+	  t += 7;
+	  break;
+	case 0x32:	/* ld (address), a */
+	  ld8_esi(OFF(af.byte.high));
+	  mov_imm(0, IMM16);
+	  mem_write8(pc, t, n);
+	  t += 13;
+	  break;
+	case 0x3a:	/* ld a, (address) */
+	  mov_imm(0, IMM16);
+	  mem_read8(pc, t, n);
+	  st8_al(OFF(af.byte.high));
+	  t += 13;
+	  break;
+	case 0x22:	/* ld (address), hl */
+	  mov_imm(7, IMM16);
+	  ld16_esi(OFF(hl));
+	  call((void *) jit_write_word);
+	  emit(2, 0x85, 0xc0);         /* test eax, eax */
+	  add_exit(emit_jump(CC_Z), pc, t, n);
+	  t += 16;
+	  break;
+	case 0x2a:	/* ld hl, (address) */
+	  mov_imm(7, IMM16);
+	  call((void *) jit_read_word);
+	  emit(2, 0x85, 0xc0);         /* test eax, eax */
+	  add_exit(emit_jump(CC_S), pc, t, n);
+	  st16_ax(OFF(hl));
+	  t += 16;
+	  break;
+	case 0x07:	/* rlca */
+	case 0x0f:	/* rrca */
+	case 0x17:	/* rla */
+	case 0x1f:	/* rra */
+	case 0x27:	/* daa */
+	  call((void *) z80_jit_acc_ops[op >> 3]);
+	  t += 4;
+	  break;
+	case 0x08:	/* ex af, af' */
+	  swap16(OFF(af), OFF(af_prime));
+	  t += 4;
+	  break;
+	case 0xd9:	/* exx */
+	  swap16(OFF(bc), OFF(bc_prime));
+	  swap16(OFF(de), OFF(de_prime));
+	  swap16(OFF(hl), OFF(hl_prime));
+	  t += 4;
+	  break;
+	case 0xeb:	/* ex de, hl */
+	  swap16(OFF(de), OFF(hl));
+	  t += 4;
+	  break;
+	case 0x10:	/* djnz offset */
+	  emit_rbx(-1, 0xfe, 1, OFF(bc.byte.high));   /* dec byte B */
+	  add_exit(emit_jump(CC_NZ), REL, t + 13, n + 1);
+	  t += 8;
+	  break;
+	case 0x18:	/* jr offset */
+	  add_exit(emit_jump(-1), REL, t + 12, n + 1);
+	  done = TRUE;
+	  break;
+	case 0x20:	/* jr nz, offset */
+	case 0x28:	/* jr z, offset */
+	case 0x30:	/* jr nc, offset */
+	case 0x38:	/* jr c, offset */
+	  cc = test_cond((op >> 3) & 3);
+	  add_exit(emit_jump(cc), REL, t + 12, n + 1);
+	  t += 7;
+	  break;
+	case 0xc3:	/* jp address */
+	  add_exit(emit_jump(-1), IMM16, t + 10, n + 1);
+	  done = TRUE;
+	  break;
+	case 0xcd:	/* call address */
+	  mov_imm(6, NEXT);
+	  push_esi(pc, t, n);
+	  add_exit(emit_jump(-1), IMM16, t + 17, n + 1);
+	  done = TRUE;
+	  break;
+	case 0xc9:	/* ret */
+	  pop_eax(pc, t, n);
+	  exit_dynamic(t + 10, n + 1);
+	  done = TRUE;
+	  break;
+	case 0xe9:	/* jp (hl) */
+	  ld16_eax(OFF(hl));
+	  exit_dynamic(t + 4, n + 1);
+	  done = TRUE;
+	  break;
+	default:
+	  /* Not translated; the interpreter takes over here */
+	  len = 0;
+	  break;
+      }
+      if (len == 0) break;
+    }
+    n++;
+    if (!done) pc = NEXT;
+  }
+
+  if (n == 0) {
+    /* Nothing translated; no code kept */
+    return &jit_none;
+  }
+  if (!done) {
+    /* Fell off the end of the block */
+    add_exit(emit_jump(-1), pc, t, n);
+  }
+
+  /* Exit code */
+  for (i = 0; i < nexits; i++) {
+    patch(exits[i].patch, cp);
+    commit(exits[i].t, exits[i].n);
+    if (exits[i].pc == start && exits[i].n > 0) {
+      loop_back(top, start);
+    } else {
+      st16_imm(OFF(pc), exits[i].pc);
+      patch(emit_jump(-1), epilogue);
+    }
+  }
+
+  jit_next = cp;
+  trs_stats.mem_bytes[STATS_MEM_JIT] = JIT_TABLE_BYTES + (jit_next - jit_code);
+  b = &jit_blocks[jit_nblocks++];
+  b->code = (jit_func) entry;
+  b->max_t = max_t;
+  z80_jit_code_page[page] = 1;
+  jit_pages[256 + page] = NULL;
+  return b;
+}
+
+/*
+ * Run translated code for the block at PC, if there is one and it is
+ * safe to do so.  Returns the number of instructions executed, or 0
+ * if the interpreter should execute the next instruction.
+ */
+int z80_jit_run(void)
+{
+  struct jit_block *b;
+  Ushort pc = REG_PC;
+  tstate_t d;
+
+  if (jit_code == NULL) {
+    jit_lookup = calloc(Z80_ADDRESS_LIMIT, sizeof(jit_lookup[0]));
+    jit_heat = calloc(Z80_ADDRESS_LIMIT, sizeof(jit_heat[0]));
+    jit_blocks = calloc(JIT_MAX_BLOCKS, sizeof(jit_blocks[0]));
+    jit_code = mmap(NULL, JIT_CODE_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (jit_lookup == NULL || jit_heat == NULL || jit_blocks == NULL ||
+	jit_code == MAP_FAILED) {
+      free(jit_lookup);
+      free(jit_heat);
+      free(jit_blocks);
+      if (jit_code != MAP_FAILED) munmap(jit_code, JIT_CODE_SIZE);
+      jit_code = NULL;
+      warning("cannot allocate memory for translated code; -jit ignored");
+      z80_jit_enabled = FALSE;
+      return 0;
+    }
+    jit_next = jit_code;
+  }
+  if (!jit_map_valid) jit_update_map();
+
+  b = jit_lookup[pc];
+  if (b == NULL) {
+    if (++jit_heat[pc] < JIT_THRESHOLD) return 0;
+    jit_heat[pc] = 0;
+    b = jit_lookup[pc] = jit_translate(pc);
+    if (b == &jit_none && jit_pages[pc >> 8] != NULL &&
+	jit_page_thrash[pc >> 8] < JIT_THRASH) {
+      /* Try again if the page changes */
+      z80_jit_code_page[pc >> 8] = 1;
+      jit_pages[256 + (pc >> 8)] = NULL;
+    }
+  }
+  if (b == &jit_none) return 0;
+
+  /* Don't run past an event, the run limit, the input clock, or a
+     pending interrupt */
+  if (z80_state.nmi && !z80_state.nmi_seen) return 0;
+  if (z80_state.irq && z80_state.iff1) return 0;
+  if (z80_state.sched) {
+    d = z80_state.sched - z80_state.t_count;
+    if (d < (tstate_t) b->max_t || d > TSTATE_T_MID) return 0;
+  }
+  if (z80_state.stop) {
+    d = z80_state.stop - z80_state.t_count;
+    if (d < (tstate_t) b->max_t || d > TSTATE_T_MID) return 0;
+  }
+  if (z80_state.replay) {
+    d = z80_state.replay - z80_state.t_count;
+    if (d < (tstate_t) b->max_t || d > TSTATE_T_MID) return 0;
+  }
+  return b->code(&z80_state);
+}
+
+#else /* !__x86_64__ */
+
+int z80_jit_run(void)
+{
+  warning("-jit is supported only on x86-64; ignored");
+  z80_jit_enabled = FALSE;
+  return 0;
+}
+
+void z80_jit_invalidate(int address)
+{
+}
+
+void z80_jit_remap(void)
+{
+}
+
+void z80_jit_flush(void)
+{
+}
+
+#endif
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * z80_profile.c -- execution profiler for emulated Z80 code.
+ *
+ * When profiling is enabled (-profile), z80_run() calls
+ * z80_profile_insn() after each instruction.  It counts executions
+ * and T-states per instruction address, in flat 64K arrays kept
+ * separately for each memory bank (see mem_bank_number()).
+ *
+ * Calls are tracked with a shadow stack.  A CALL or RST that pushes
+ * its return address, or an interrupt, starts a frame; the frame ends
+ * when the stack pointer rises above the return address, which covers
+ * RET as well as code that discards its return address.  Each call
+ * target is charged the T-states spent inside its frames (inclusive
+ * time, counted once for recursive calls).
+ *
+ * The report is written to the -profile file when xtrs exits and each
+ * time it receives SIGUSR2.
+ */
+
+#define _XOPEN_SOURCE 500 /* signal.h: sigaction(); string.h: strdup() */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include "z80.h"
+#include "trs.h"
+
+#define PROF_STACK	256	/* deepest call nesting tracked */
+#define PROF_INSN_LINES	200	/* instructions listed in the report */
+#define PROF_CALL_LINES	100	/* call targets listed in the report */
+#define PROF_SYM_RANGE	0x100	/* farthest address labeled sym+offset */
+
+int z80_profile_enabled = FALSE;
+
+struct prof_bank {
+  unsigned long count[Z80_ADDRESS_LIMIT];	/* executions */
+  tstate_t tstates[Z80_ADDRESS_LIMIT];		/* T-states */
+  unsigned long calls[Z80_ADDRESS_LIMIT];	/* calls to this address */
+  tstate_t inclusive[Z80_ADDRESS_LIMIT];	/* T-states inside calls */
+};
+
+struct prof_frame {
+  Ushort sp;		/* where the return address was pushed */
+  Ushort target;
+  int bank;
+  tstate_t start;
+};
+
+struct prof_symbol {
+  int address;
+  char *name;
+};
+
+static struct prof_bank *prof_banks[MEM_BANKS];
+static struct prof_frame prof_stack[PROF_STACK];
+static int prof_depth;
+static unsigned long prof_total_count;
+static tstate_t prof_total_tstates;
+static char *prof_report_file;
+static volatile sig_atomic_t prof_dump_requested;
+
+static struct prof_symbol *prof_symbols;
+static int prof_num_symbols;
+
+static struct prof_bank *prof_get_bank(int bank)
+{
+  if (prof_banks[bank] == NULL) {
+    prof_banks[bank] = (struct prof_bank *) calloc(1, sizeof(struct prof_bank));
+    if (prof_banks[bank] == NULL) fatal("out of memory for profile");
+  }
+  return prof_banks[bank];
+}
+
+static void prof_push(int target)
+{
+  int bank = mem_bank_number(target);
+
+  prof_get_bank(bank)->calls[target]++;
+  if (prof_depth < PROF_STACK) {
+    prof_stack[prof_depth].sp = REG_SP;
+    prof_stack[prof_depth].target = target;
+    prof_stack[prof_depth].bank = bank;
+    prof_stack[prof_depth].start = z80_state.t_count;
+    prof_depth++;
+  }
+}
+
+static void prof_pop(void)
+{
+  struct prof_frame *f = &prof_stack[--prof_depth];
+  int i;
+
+  /* Charge an outer frame only, so recursion isn't counted twice */
+  for (i = 0; i < prof_depth; i++) {
+    if (prof_stack[i].target == f->target && prof_stack[i].bank == f->bank) {
+      return;
+    }
+  }
+  prof_banks[f->bank]->inclusive[f->target] += z80_state.t_count - f->start;
+}
+
+static void prof_write(void)
+{
+  FILE *fp = fopen(prof_report_file, "w");
+  if (fp == NULL) {
+    error("can't write profile %s: %s", prof_report_file, strerror(errno));
+    return;
+  }
+  z80_profile_report(fp);
+  fclose(fp);
+}
+
+static void prof_signal(int sig)
+{
+  prof_dump_requested = TRUE;
+}
+
+/*
+ * Account for the instruction that started at pc with the given
+ * T-state count and stack pointer; instruction is its first byte.
+ */
+void z80_profile_insn(int pc, tstate_t start, int sp, int instruction)
+{
+  struct prof_bank *b = prof_get_bank(mem_bank_number(pc));
+  tstate_t t = z80_state.t_count - start;
+
+  b->count[pc]++;
+  b->tstates[pc] += t;
+  prof_total_count++;
+  prof_total_tstates += t;
+
+  while (prof_depth > 0 && REG_SP > prof_stack[prof_depth - 1].sp) {
+    prof_pop();
+  }
+  /* CALL, CALL cc, or RST that pushed its return address */
+  if ((instruction == 0xcd || (instruction & 0xc7) == 0xc4 ||
+       (instruction & 0xc7) == 0xc7) && REG_SP == ((sp - 2) & 0xffff)) {
+    prof_push(REG_PC);
+  }
+
+  if (prof_dump_requested) {
+    prof_dump_requested = FALSE;
+    prof_write();
+  }
+}
+
+/* An interrupt pushed the PC and jumped to target */
+void z80_profile_call(int target)
+{
+  prof_push(target);
+}
+
+/*
+ * Symbol files have one symbol per line, as "address name",
+ * "name address", or "name equ address".  A leading number is taken
+ * as the address.  Addresses are hex, optionally written as $xxxx,
+ * 0xxxxx, or xxxxh.  Lines starting with ; or # are ignored.
+ */
+static int prof_parse_address(const char *s, int *address)
+{
+  char *end;
+  long v;
+
+  if (*s == '$') s++;
+  if (!isxdigit((unsigned char)*s)) return FALSE;
+  v = strtol(s, &end, 16);
+  if ((*end == 'h' || *end == 'H') && end[1] == '\0') end++;
+  if (*end != '\0' || v < 0 || v > 0xffff) return FALSE;
+  *address = v;
+  return TRUE;
+}
+
+static int prof_symbol_compare(const void *a, const void *b)
+{
+  return ((const struct prof_symbol *) a)->address -
+    ((const struct prof_symbol *) b)->address;
+}
+
+static void prof_load_symbols(const char *filename)
+{
+  FILE *f = fopen(filename, "r");
+  char line[256], t1[128], t2[128], t3[128];
+  char *name;
+  int address, n, size = 0;
+
+  if (f == NULL) {
+    error("can't read symbol file %s: %s", filename, strerror(errno));
+    return;
+  }
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == ';' || line[0] == '#') continue;
+    n = sscanf(line, "%127s %127s %127s", t1, t2, t3);
+    if (n == 3 && (strcasecmp(t2, "equ") == 0 || strcmp(t2, "=") == 0) &&
+	prof_parse_address(t3, &address)) {
+      name = t1;
+    } else if (n == 2 && prof_parse_address(t1, &address)) {
+      name = t2;
+    } else if (n == 2 && prof_parse_address(t2, &address)) {
+      name = t1;
+    } else {
+      continue;
+    }
+    n = strlen(name);
+    if (n > 1 && name[n - 1] == ':') name[n - 1] = '\0';
+    if (prof_num_symbols == size) {
+      size = size ? size * 2 : 256;
+      prof_symbols = (struct prof_symbol *)
+	realloc(prof_symbols, size * sizeof(struct prof_symbol));
+      if (prof_symbols == NULL) fatal("out of memory for symbols");
+    }
+    prof_symbols[prof_num_symbols].address = address;
+    prof_symbols[prof_num_symbols].name = strdup(name);
+    prof_num_symbols++;
+  }
+  fclose(f);
+  qsort(prof_symbols, prof_num_symbols, sizeof(struct prof_symbol),
+	prof_symbol_compare);
+}
+
+/* Format the symbol at or just below address into buf, or "" */
+static char *prof_symbol(int address, char *buf)
+{
+  int lo = 0, hi = prof_num_symbols - 1, mid;
+  struct prof_symbol *s = NULL;
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    if (prof_symbols[mid].address <= address) {
+      s = &prof_symbols[mid];
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  if (s == NULL || address - s->address >= PROF_SYM_RANGE) {
+    buf[0] = '\0';
+  } else if (address == s->address) {
+    sprintf(buf, "%.40s", s->name);
+  } else {
+    sprintf(buf, "%.40s+%x", s->name, address - s->address);
+  }
+  return buf;
+}
+
+void z80_profile_init(const char *report, const char *symbols)
+{
+  struct sigaction sa;
+
+  if (report == NULL) return;
+  prof_report_file = strdup(report);
+  if (symbols != NULL) prof_load_symbols(symbols);
+
+  sa.sa_handler = prof_signal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGUSR2, &sa, NULL);
+  atexit(prof_write);
+
+  z80_profile_enabled = TRUE;
+}
+
+/*
+ * Report
+ */
+
+struct prof_entry {
+  tstate_t tstates;
+  unsigned long count;
+  int bank;
+  int address;
+};
+
+static int prof_entry_compare(const void *a, const void *b)
+{
+  const struct prof_entry *x = a, *y = b;
+  if (x->tstates != y->tstates) return x->tstates < y->tstates ? 1 : -1;
+  if (x->bank != y->bank) return x->bank - y->bank;
+  return x->address - y->address;
+}
+
+static int prof_read_bank;
+
+static int prof_read(int address)
+{
+  return mem_read_bank(prof_read_bank, address);
+}
+
+static double prof_percent(tstate_t t)
+{
+  return prof_total_tstates ? 100.0 * t / prof_total_tstates : 0.0;
+}
+
+static const char *prof_bank_name(int bank)
+{
+  static const char *names[MEM_BANKS] = { "0", "1", "2", "3", "rom" };
+  return names[bank];
+}
+
+/* Collect the nonzero entries of one array pair, sorted */
+static struct prof_entry *prof_collect(int calls, int *n)
+{
+  struct prof_entry *e;
+  struct prof_bank *b;
+  int bank, a, i = 0, size = 0;
+
+  for (bank = 0; bank < MEM_BANKS; bank++) {
+    if ((b = prof_banks[bank]) == NULL) continue;
+    for (a = 0; a < Z80_ADDRESS_LIMIT; a++) {
+      if ((calls ? b->calls[a] : b->count[a]) != 0) size++;
+    }
+  }
+  e = (struct prof_entry *) malloc((size + 1) * sizeof(struct prof_entry));
+  if (e == NULL) fatal("out of memory for profile report");
+  for (bank = 0; bank < MEM_BANKS; bank++) {
+    if ((b = prof_banks[bank]) == NULL) continue;
+    for (a = 0; a < Z80_ADDRESS_LIMIT; a++) {
+      if (calls ? b->calls[a] == 0 : b->count[a] == 0) continue;
+      e[i].tstates = calls ? b->inclusive[a] : b->tstates[a];
+      e[i].count = calls ? b->calls[a] : b->count[a];
+      e[i].bank = bank;
+      e[i].address = a;
+      i++;
+    }
+  }
+  qsort(e, size, sizeof(struct prof_entry), prof_entry_compare);
+  *n = size;
+  return e;
+}
+
+void z80_profile_report(FILE *fp)
+{
+  struct prof_entry *e;
+  char sym[64];
+  int i, n;
+
+  fprintf(fp, "xtrs profile: %lu instructions, %llu T-states\n",
+	  prof_total_count, (unsigned long long) prof_total_tstates);
+
+  e = prof_collect(FALSE, &n);
+  fprintf(fp, "\nInstructions by T-states (%d addresses):\n", n);
+  fprintf(fp, "%14s %6s %12s %4s %-20s %s\n",
+	  "T-states", "%", "count", "bank", "symbol", "instruction");
+  for (i = 0; i < n && i < PROF_INSN_LINES; i++) {
+    fprintf(fp, "%14llu %6.2f %12lu %4s %-20s ",
+	    (unsigned long long) e[i].tstates, prof_percent(e[i].tstates),
+	    e[i].count, prof_bank_name(e[i].bank),
+	    prof_symbol(e[i].address, sym));
+    prof_read_bank = e[i].bank;
+    disassemble_to(fp, e[i].address, prof_read);
+  }
+  free(e);
+
+  e = prof_collect(TRUE, &n);
+  fprintf(fp, "\nCall targets by inclusive T-states (%d addresses):\n", n);
+  fprintf(fp, "%14s %6s %12s %4s %-20s %s\n",
+	  "T-states", "%", "calls", "bank", "symbol", "address");
+  for (i = 0; i < n && i < PROF_CALL_LINES; i++) {
+    fprintf(fp, "%14llu %6.2f %12lu %4s %-20s %04x\n",
+	    (unsigned long long) e[i].tstates, prof_percent(e[i].tstates),
+	    e[i].count, prof_bank_name(e[i].bank),
+	    prof_symbol(e[i].address, sym), e[i].address);
+  }
+  free(e);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * z80_trace.c -- binary instruction trace.
+ *
+ * When tracing is enabled (-trace), z80_run() calls z80_trace_insn()
+ * before each instruction.  It stores the PC, the next four bytes of
+ * code, AF, BC, DE, HL, SP, and the T-state count in a ring holding
+ * the last -tracesize instructions.  Nothing is formatted while the
+ * emulator runs; the ring is written to the -trace file when the
+ * debugger stops, when xtrs receives SIGUSR2, or when xtrs itself
+ * crashes, and the tracedump program decodes it.
+ *
+ * File format, all numbers little-endian:
+ *   header:  "XTRSTRC1", 4-byte record count, 2-byte record size,
+ *            1-byte trs_model, 1 byte reserved
+ *   records: oldest first, TRACE_RECORD bytes each, laid out as
+ *            the TRACE_* offsets in z80_trace.h
+ */
+
+#define _XOPEN_SOURCE 500 /* signal.h: sigaction(); string.h: strdup() */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "z80.h"
+#include "trs.h"
+#include "z80_trace.h"
+
+int z80_trace_enabled = FALSE;
+char *z80_trace_name = NULL;		/* -trace file */
+int z80_trace_size = 65536;		/* -tracesize, in instructions */
+
+static Uchar *trace_ring;
+static unsigned int trace_next;		/* record to fill next */
+static unsigned int trace_count;	/* valid records, up to size */
+static volatile sig_atomic_t trace_dump_requested;
+static struct sigaction trace_old_usr2;
+
+static void put16(Uchar *p, int v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+void z80_trace_insn(void)
+{
+  Uchar *r = trace_ring + trace_next * TRACE_RECORD;
+  int pc = REG_PC;
+  int bank = mem_bank_number(pc);
+  tstate_t t = z80_state.t_count;
+  int i;
+
+  put16(r + TRACE_PC, pc);
+  if ((pc & 0x7fff) <= 0x7ffc) {
+    for (i = 0; i < 4; i++) {
+      r[TRACE_OP + i] = mem_read_bank(bank, pc + i);
+    }
+  } else {
+    /* Instruction may straddle a 32K bank boundary */
+    for (i = 0; i < 4; i++) {
+      r[TRACE_OP + i] = mem_read_bank(mem_bank_number(pc + i), pc + i);
+    }
+  }
+  put16(r + TRACE_AF, REG_AF);
+  put16(r + TRACE_BC, REG_BC);
+  put16(r + TRACE_DE, REG_DE);
+  put16(r + TRACE_HL, REG_HL);
+  put16(r + TRACE_SP, REG_SP);
+  for (i = 0; i < 8; i++) {
+    r[TRACE_T + i] = t;
+    t >>= 8;
+  }
+
+  if (++trace_next == (unsigned int) z80_trace_size) trace_next = 0;
+  if (trace_count < (unsigned int) z80_trace_size) trace_count++;
+
+  if (trace_dump_requested) {
+    trace_dump_requested = FALSE;
+    z80_trace_dump();
+  }
+}
+
+static int trace_write(int fd, const Uchar *p, size_t n)
+{
+  ssize_t w;
+
+  while (n > 0) {
+    w = write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += w;
+    n -= w;
+  }
+  return 0;
+}
+
+/*
+ * Write the ring to the -trace file.  Uses only async-signal-safe
+ * calls, so that the crash handler can use it too.
+ */
+static int trace_save(void)
+{
+  Uchar header[TRACE_HEADER];
+  unsigned int first;
+  int fd, ok;
+
+  if (trace_ring == NULL) return -1;
+  fd = open(z80_trace_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) return -1;
+
+  memcpy(header, TRACE_MAGIC, 8);
+  put16(header + 8, trace_count);
+  put16(header + 10, trace_count >> 16);
+  put16(header + 12, TRACE_RECORD);
+  header[14] = trs_model;
+  header[15] = 0;
+
+  first = trace_count < (unsigned int) z80_trace_size ? 0 : trace_next;
+  ok = trace_write(fd, header, TRACE_HEADER) == 0 &&
+    trace_write(fd, trace_ring + first * TRACE_RECORD,
+		(trace_count - first) * TRACE_RECORD) == 0 &&
+    trace_write(fd, trace_ring, first * TRACE_RECORD) == 0;
+  close(fd);
+  return ok ? 0 : -1;
+}
+
+void z80_trace_dump(void)
+{
+  if (!z80_trace_enabled) return;
+  if (trace_save() < 0) {
+    error("can't write trace file %s: %s", z80_trace_name, strerror(errno));
+  }
+}
+
+static void trace_signal(int sig)
+{
+  trace_dump_requested = TRUE;
+  if (trace_old_usr2.sa_handler != SIG_DFL &&
+      trace_old_usr2.sa_handler != SIG_IGN) {
+    trace_old_usr2.sa_handler(sig);
+  }
+}
+
+/* xtrs itself crashed; save what led up to it and die as before */
+static void trace_crash(int sig)
+{
+  trace_save();
+  raise(sig);
+}
+
+/*
+ * Allocate the ring if z80_trace_name was set by the -trace option.
+ * Called from trs_init() after the options are parsed.
+ */
+void z80_trace_init(void)
+{
+  static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL,
+				       SIGABRT };
+  struct sigaction sa;
+  int i;
+
+  if (z80_trace_name == NULL) return;
+  if (z80_trace_size <= 0) z80_trace_size = 65536;
+  trace_ring = (Uchar *) malloc((size_t) z80_trace_size * TRACE_RECORD);
+  if (trace_ring == NULL) fatal("out of memory for trace buffer");
+
+  sa.sa_handler = trace_signal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGUSR2, &sa, &trace_old_usr2);
+
+  sa.sa_handler = trace_crash;
+  sa.sa_flags = SA_RESETHAND;
+  for (i = 0; i < (int) (sizeof(crash_signals) / sizeof(int)); i++) {
+    sigaction(crash_signals[i], &sa, NULL);
+  }
+
+  z80_trace_enabled = TRUE;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Binary instruction trace (z80_trace.c) and its file format, shared
+ * with the tracedump program.
+ */
+
+#ifndef _Z80_TRACE_H
+#define _Z80_TRACE_H
+
+#define TRACE_MAGIC	"XTRSTRC1"
+#define TRACE_HEADER	16	/* magic, count, record size, model */
+
+/* Offsets of the fields in each record */
+#define TRACE_PC	0	/* 2 bytes */
+#define TRACE_OP	2	/* 4 bytes of code at PC */
+#define TRACE_AF	6
+#define TRACE_BC	8
+#define TRACE_DE	10
+#define TRACE_HL	12
+#define TRACE_SP	14
+#define TRACE_T		16	/* 8-byte T-state count */
+#define TRACE_RECORD	24
+
+extern int z80_trace_enabled;
+extern char *z80_trace_name;
+extern int z80_trace_size;
+
+extern void z80_trace_init(void);
+extern void z80_trace_insn(void);
+extern void z80_trace_dump(void);
+
+#endif /*_Z80_TRACE_H*/
@@ -0,0 +1,666 @@
+/*
+ * Copyright (c) 2026, Timothy P. Mann
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Stand-alone test driver for the Z80 core.
+ *
+ * Usage: z80test [-j] program.com...
+ *        z80test -t
+ *        z80test -d [count]
+ *
+ * Links z80.o (and the translator) against a flat 64K of RAM with no
+ * TRS-80 devices: ports read as FFh, writes go nowhere, and the
+ * emulator traps are no-ops.
+ *
+ * With program arguments, runs each as a CP/M .COM file (loaded at
+ * 100h) with BDOS console output (functions 2 and 9) trapped to
+ * stdout, until it jumps to 0.  This is how the ZEXDOC and ZEXALL
+ * instruction exercisers are run; they are not distributed with
+ * xtrs.  After each program, reports the instructions and T-states
+ * executed and the throughput.  -j runs with the translator on.
+ *
+ * With -t, single-steps every opcode from two register states chosen
+ * so that each conditional jump, call, return and repeat goes both
+ * ways, and compares the T-states charged against the reference
+ * tables below.  Prints each mismatch and exits with status 1 if
+ * there were any.  Opcodes xtrs uses as emulator traps (ED28-ED3F) and
+ * the undefined ED opcodes it reports as errors are not checked.  With
+ * FASTMEM, the repeating block instructions run to completion in one
+ * step and so show up as mismatches.
+ *
+ * With -d, tests the translator against the interpreter.  Each of
+ * count tests (default 20000) fills memory and the registers with
+ * pseudo-random values, puts a run of mostly translatable opcodes at
+ * 1000h, and runs one call of z80_jit_run() there.  It then restores
+ * the starting state and single-steps the interpreter through the same
+ * number of instructions.  Registers, flags, the refresh register,
+ * memory and T-states must all come out the same.  Prints each
+ * mismatch and exits with status 1 if there were any.
+ */
+
+#define _XOPEN_SOURCE 500 /* unistd.h: getopt(), optarg, optind, opterr */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "z80.h"
+#include "trs.h"
+#include "trs_stats.h"
+#include "trs_screentext.h"
+#include "trs_replay.h"
+#include "z80_trace.h"
+#include "z80_coverage.h"
+
+#define ARGS "jtd"
+
+#define ADDRESS_SPACE	(0x10000)
+
+#define BDOS		0x0005
+#define BDOS_TRAP	0xfe00	/* BDOS entry jumps here */
+#define TPA		0x0100
+
+#define CODE		0x1000	/* where -t puts each instruction */
+#define DATA		0x3000	/* HL, IX and IY point here */
+#define STACK		0x4000
+#define RETURN		0x2000	/* return address on the stack */
+#define OPERAND		0x10	/* displacement and immediate bytes */
+
+#define DIFF_TESTS	20000	/* default -d count */
+#define DIFF_CODE	64	/* bytes of random code at CODE */
+
+/*
+ * Reference T-states.  For conditional instructions the entry is the
+ * taken (or repeating) time; cond_times gives the other.
+ */
+static const int main_times[256] = {
+  /* 0 */  4, 10,  7,  6,  4,  4,  7,  4,   4, 11,  7,  6,  4,  4,  7,  4,
+  /* 1 */ 13, 10,  7,  6,  4,  4,  7,  4,  12, 11,  7,  6,  4,  4,  7,  4,
+  /* 2 */ 12, 10, 16,  6,  4,  4,  7,  4,  12, 11, 16,  6,  4,  4,  7,  4,
+  /* 3 */ 12, 10, 13,  6, 11, 11, 10,  4,  12, 11, 13,  6,  4,  4,  7,  4,
+  /* 4 */  4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* 5 */  4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* 6 */  4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* 7 */  7,  7,  7,  7,  7,  7,  4,  7,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* 8 */  4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* 9 */  4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* A */  4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* B */  4,  4,  4,  4,  4,  4,  7,  4,   4,  4,  4,  4,  4,  4,  7,  4,
+  /* C */ 11, 10, 10, 10, 17, 11,  7, 11,  11, 10, 10,  0, 17, 17,  7, 11,
+  /* D */ 11, 10, 10, 11, 17, 11,  7, 11,  11,  4, 10, 11, 17,  0,  7, 11,
+  /* E */ 11, 10, 10, 19, 17, 11,  7, 11,  11,  4, 10,  4, 17,  0,  7, 11,
+  /* F */ 11, 10, 10,  4, 17, 11,  7, 11,  11,  6, 10,  4, 17,  0,  7, 11,
+};
+
+/* 0 = not checked */
+static const int ed_times[256] = {
+  /* 0 */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* 1 */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* 2 */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* 3 */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* 4 */ 12, 12, 15, 20,  8, 14,  8,  9,  12, 12, 15, 20,  8, 14,  0,  9,
+  /* 5 */ 12, 12, 15, 20,  8, 14,  8,  9,  12, 12, 15, 20,  8, 14,  8,  9,
+  /* 6 */ 12, 12, 15, 20,  8, 14,  8, 18,  12, 12, 15, 20,  8, 14,  0, 18,
+  /* 7 */ 12, 12, 15, 20,  8, 14,  8,  0,  12, 12, 15, 20,  8, 14,  8,  0,
+  /* 8 */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* 9 */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* A */ 16, 16, 16, 16,  0,  0,  0,  0,  16, 16, 16, 16,  0,  0,  0,  0,
+  /* B */ 21, 21, 21, 21,  0,  0,  0,  0,  21, 21, 21, 21,  0,  0,  0,  0,
+  /* C */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* D */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* E */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* F */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+/* DD and FD; 0 = prefix ignored, so 4 plus the unprefixed time */
+static const int index_times[256] = {
+  /* 0 */  0,  0,  0,  0,  0,  0,  0,  0,   0, 15,  0,  0,  0,  0,  0,  0,
+  /* 1 */  0,  0,  0,  0,  0,  0,  0,  0,   0, 15,  0,  0,  0,  0,  0,  0,
+  /* 2 */  0, 14, 20, 10,  8,  8, 11,  0,   0, 15, 20, 10,  8,  8, 11,  0,
+  /* 3 */  0,  0,  0,  0, 23, 23, 19,  0,   0, 15,  0,  0,  0,  0,  0,  0,
+  /* 4 */  0,  0,  0,  0,  8,  8, 19,  0,   0,  0,  0,  0,  8,  8, 19,  0,
+  /* 5 */  0,  0,  0,  0,  8,  8, 19,  0,   0,  0,  0,  0,  8,  8, 19,  0,
+  /* 6 */  8,  8,  8,  8,  8,  8, 19,  8,   8,  8,  8,  8,  8,  8, 19,  8,
+  /* 7 */ 19, 19, 19, 19, 19, 19,  0, 19,   0,  0,  0,  0,  8,  8, 19,  0,
+  /* 8 */  0,  0,  0,  0,  8,  8, 19,  0,   0,  0,  0,  0,  8,  8, 19,  0,
+  /* 9 */  0,  0,  0,  0,  8,  8, 19,  0,   0,  0,  0,  0,  8,  8, 19,  0,
+  /* A */  0,  0,  0,  0,  8,  8, 19,  0,   0,  0,  0,  0,  8,  8, 19,  0,
+  /* B */  0,  0,  0,  0,  8,  8, 19,  0,   0,  0,  0,  0,  8,  8, 19,  0,
+  /* C */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* D */  0,  0,  0,  0,  0,  0,  0,  0,   0,  0,  0,  0,  0,  0,  0,  0,
+  /* E */  0, 14,  0, 23,  0, 15,  0,  0,   0,  8,  0,  0,  0,  0,  0,  0,
+  /* F */  0,  0,  0,  0,  0,  0,  0,  0,   0, 10,  0,  0,  0,  0,  0,  0,
+};
+
+#define CB_TIME(op)	(((op) & 0xc0) == 0x40 ? (((op) & 7) == 6 ? 12 : 8) \
+			 : (((op) & 7) == 6 ? 15 : 8))
+#define INDEX_CB_TIME(op) (((op) & 0xc0) == 0x40 ? 20 : 23)
+
+/* Time when not taken; the instruction length tells which way it went */
+static const struct {
+  int ed;
+  int op;
+  int length;
+  int time;
+} cond_times[] = {
+  { 0, 0x10, 2,  8 },				/* djnz */
+  { 0, 0x20, 2,  7 }, { 0, 0x28, 2,  7 },	/* jr cc */
+  { 0, 0x30, 2,  7 }, { 0, 0x38, 2,  7 },
+  { 0, 0xc0, 1,  5 }, { 0, 0xc8, 1,  5 },	/* ret cc */
+  { 0, 0xd0, 1,  5 }, { 0, 0xd8, 1,  5 },
+  { 0, 0xe0, 1,  5 }, { 0, 0xe8, 1,  5 },
+  { 0, 0xf0, 1,  5 }, { 0, 0xf8, 1,  5 },
+  { 0, 0xc4, 3, 10 }, { 0, 0xcc, 3, 10 },	/* call cc */
+  { 0, 0xd4, 3, 10 }, { 0, 0xdc, 3, 10 },
+  { 0, 0xe4, 3, 10 }, { 0, 0xec, 3, 10 },
+  { 0, 0xf4, 3, 10 }, { 0, 0xfc, 3, 10 },
+  { 1, 0xb0, 2, 16 }, { 1, 0xb1, 2, 16 },	/* block repeats */
+  { 1, 0xb2, 2, 16 }, { 1, 0xb3, 2, 16 },
+  { 1, 0xb8, 2, 16 }, { 1, 0xb9, 2, 16 },
+  { 1, 0xba, 2, 16 }, { 1, 0xbb, 2, 16 },
+};
+#define COND_TIMES ((int) (sizeof(cond_times) / sizeof(cond_times[0])))
+
+static Uchar ram[ADDRESS_SPACE];
+static int mismatches;
+
+/* -d: memory and CPU state before the test and after the translator */
+static Uchar diff_ram[2][ADDRESS_SPACE];
+static struct z80_state_struct diff_state[2];
+static unsigned long diff_seed = 1;
+
+/* What z80.o and z80_jit.o need from the rest of xtrs */
+char *program_name;
+int trs_model = 3;
+Uchar debug_traps[ADDRESS_SPACE];
+int debug_trap_pages[256];
+struct trs_stats trs_stats;
+volatile int trs_stats_dump_due;
+int trs_screentext_active;
+int z80_gdb_fd = -1;
+int z80_profile_enabled = FALSE;
+int z80_trace_enabled = FALSE;
+int z80_coverage_enabled = FALSE;
+Uchar *z80_coverage_exec[COV_PAGES];
+
+int mem_read(int address)
+{
+    return ram[address & 0xffff];
+}
+
+void mem_write(int address, int value)
+{
+    address &= 0xffff;
+    ram[address] = value;
+    if (z80_jit_code_page[address >> 8]) z80_jit_invalidate(address);
+}
+
+int mem_read_word(int address)
+{
+    return mem_read(address) | (mem_read(address + 1) << 8);
+}
+
+void mem_write_word(int address, int value)
+{
+    mem_write(address, value & 0xff);
+    mem_write(address + 1, value >> 8);
+}
+
+Uchar *mem_plain_page(int address, int writing)
+{
+    return &ram[address & 0xff00];
+}
+
+#ifdef FASTMEM
+Uchar *mem_pointer(int address, int writing)
+{
+    return &ram[address & 0xffff];
+}
+
+int mem_block_transfer(Ushort dest, Ushort source, int direction,
+		       Ushort count)
+{
+    int ret;
+
+    do {
+	mem_write(dest, ret = mem_read(source));
+	dest += direction;
+	source += direction;
+    } while (--count);
+    return ret;
+}
+#endif
+
+int z80_in(int port)
+{
+    return 0xff;
+}
+
+void z80_out(int port, int value)
+{
+}
+
+void trs_get_event(int wait) { }
+tstate_t trs_timer_poll(void) { return TSTATE_T_MID; }
+void trs_do_event(void) { z80_state.sched = 0; }
+trs_event_func trs_event_scheduled(void) { return NULL; }
+void trs_reset(int poweron) { }
+void trs_reset_button_interrupt(int state) { }
+void trs_replay_event(void) { z80_state.replay = 0; }
+void trs_stats_dump(void) { trs_stats_dump_due = FALSE; }
+void trs_screentext_poll(void) { }
+void z80_gdb_poll(void) { }
+void z80_trace_insn(void) { }
+void z80_profile_insn(int pc, tstate_t start, int sp, int instruction) { }
+void z80_profile_call(int target) { }
+
+void do_emt_system() { }
+void do_emt_getddir() { }
+void do_emt_setddir() { }
+void do_emt_mouse() { }
+void do_emt_open() { }
+void do_emt_close() { }
+void do_emt_read() { }
+void do_emt_write() { }
+void do_emt_lseek() { }
+void do_emt_strerror() { }
+void do_emt_time() { }
+void do_emt_opendir() { }
+void do_emt_closedir() { }
+void do_emt_readdir() { }
+void do_emt_chdir() { }
+void do_emt_getcwd() { }
+void do_emt_misc() { }
+int trs_cassette_hook(void) { return 0; }
+void do_emt_ftruncate() { }
+void do_emt_opendisk() { }
+void do_emt_closedisk() { }
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void set_trap(int address)
+{
+    debug_traps[address] = 1;
+    debug_trap_pages[address >> 8] = 1;
+}
+
+/* Run a CP/M program; returns 0 if it loaded */
+static int run_com(const char *name)
+{
+    FILE *f;
+    size_t len;
+    int i;
+    tstate_t t;
+    double secs;
+
+    memset(ram, 0, sizeof(ram));
+    f = fopen(name, "rb");
+    if (f == NULL) {
+	perror(name);
+	return -1;
+    }
+    len = fread(&ram[TPA], 1, BDOS_TRAP - TPA, f);
+    fclose(f);
+    if (len == 0) {
+	error("%s: empty file", name);
+	return -1;
+    }
+    z80_jit_flush();
+
+    /* Warm boot at 0 ends the run; BDOS at 5 jumps to a RET we trap */
+    ram[BDOS] = 0xc3;
+    ram[BDOS + 1] = BDOS_TRAP & 0xff;
+    ram[BDOS + 2] = BDOS_TRAP >> 8;
+    ram[BDOS_TRAP] = 0xc9;
+    set_trap(0);
+    set_trap(BDOS_TRAP);
+
+    z80_reset();
+    REG_PC = TPA;
+    REG_SP = BDOS_TRAP - 2;
+    mem_write_word(REG_SP, 0);		/* return to warm boot */
+
+    memset(&trs_stats, 0, sizeof(trs_stats));
+    t = z80_state.t_count;
+    secs = now();
+    for (;;) {
+	z80_run(1);
+	if (REG_PC == 0) break;
+	if (REG_PC != BDOS_TRAP) continue;
+	switch (REG_C) {
+	  case 2:
+	    putchar(REG_E);
+	    break;
+	  case 9:
+	    for (i = REG_DE; ram[i] != '$'; i = (i + 1) & 0xffff) {
+		putchar(ram[i]);
+	    }
+	    break;
+	}
+	fflush(stdout);
+    }
+    secs = now() - secs;
+    t = z80_state.t_count - t;
+
+    printf("\n%s: %lu instructions, %llu T-states, %.3f seconds, "
+	   "%.3f MIPS, %.3f MHz\n", name, trs_stats.instructions,
+	   (unsigned long long) t, secs,
+	   secs > 0 ? trs_stats.instructions / secs / 1e6 : 0.0,
+	   secs > 0 ? t / secs / 1e6 : 0.0);
+    return 0;
+}
+
+static int not_taken(int ed, int op, int start)
+{
+    int i;
+
+    for (i = 0; i < COND_TIMES; i++) {
+	if (cond_times[i].ed == ed && cond_times[i].op == op &&
+	    REG_PC == ((start + cond_times[i].length) & 0xffff)) {
+	    return cond_times[i].time;
+	}
+    }
+    return 0;
+}
+
+/*
+ * Single-step the instruction in code[] from each register state and
+ * check its time.  ed and op identify it in cond_times.
+ */
+static void time_insn(const Uchar *code, int len, int expected,
+		      int ed, int op)
+{
+    int state, start, want, i;
+    tstate_t t;
+
+    for (state = 0; state < 2; state++) {
+	memset(ram, 0, sizeof(ram));
+	memcpy(&ram[CODE], code, len);
+	ram[CODE + len] = OPERAND;
+	ram[CODE + len + 1] = RETURN >> 8;
+	ram[STACK] = RETURN & 0xff;
+	ram[STACK + 1] = RETURN >> 8;
+
+	z80_reset();
+	REG_PC = CODE;
+	REG_SP = STACK;
+	REG_A = 0x55;
+	/* F clear, then set, flips every condition; B=1 stops djnz,
+	   inir etc., but BC=0101h repeats ldir etc., and vice versa */
+	REG_F = state ? 0xff : 0x00;
+	REG_BC = state ? 0x0001 : 0x0101;
+	REG_DE = RETURN + 0x100;
+	REG_HL = REG_IX = REG_IY = DATA;
+
+	t = z80_state.t_count;
+	z80_run(0);
+	start = CODE;
+	if ((code[0] == 0xdd || code[0] == 0xfd) && REG_PC == CODE + 1) {
+	    /* Prefix ignored; the instruction is stepped on its own */
+	    start = CODE + 1;
+	    z80_run(0);
+	}
+	t = z80_state.t_count - t;
+
+	want = not_taken(ed, op, start);
+	if (want) {
+	    want += expected - (ed ? ed_times[op] : main_times[op]);
+	} else {
+	    want = expected;
+	}
+	if (t != (tstate_t) want) {
+	    for (i = 0; i < len; i++) printf("%02X ", code[i]);
+	    printf("%*s(F=%02X): expected %d, got %d\n", 3 * (4 - len), "",
+		   state ? 0xff : 0x00, want, (int) t);
+	    mismatches++;
+	    return;
+	}
+    }
+}
+
+static int check_timing(void)
+{
+    Uchar code[4];
+    int op, prefix;
+
+    for (op = 0; op < 256; op++) {
+	if (!main_times[op]) continue;
+	code[0] = op;
+	time_insn(code, 1, main_times[op], 0, op);
+    }
+    for (op = 0; op < 256; op++) {
+	code[0] = 0xcb;
+	code[1] = op;
+	time_insn(code, 2, CB_TIME(op), 0, -1);
+    }
+    for (op = 0; op < 256; op++) {
+	if (!ed_times[op]) continue;
+	code[0] = 0xed;
+	code[1] = op;
+	time_insn(code, 2, ed_times[op], 1, op);
+    }
+    for (prefix = 0xdd; prefix <= 0xfd; prefix += 0x20) {
+	for (op = 0; op < 256; op++) {
+	    code[0] = prefix;
+	    code[1] = op;
+	    if (op == 0xcb || op == 0xdd || op == 0xed || op == 0xfd) {
+		continue;
+	    } else if (index_times[op]) {
+		time_insn(code, 2, index_times[op], 0, -1);
+	    } else {
+		time_insn(code, 2, 4 + main_times[op], 0, op);
+	    }
+	}
+	for (op = 0; op < 256; op++) {
+	    code[0] = prefix;
+	    code[1] = 0xcb;
+	    code[2] = OPERAND;
+	    code[3] = op;
+	    time_insn(code, 4, INDEX_CB_TIME(op), 0, -1);
+	}
+    }
+    printf("%d timing mismatch%s\n", mismatches, mismatches == 1 ? "" : "es");
+    return mismatches ? 1 : 0;
+}
+
+/* Pseudo-random numbers, the same on every host */
+static int diff_random(void)
+{
+    diff_seed = diff_seed * 1103515245 + 12345;
+    return (diff_seed >> 16) & 0x7fff;
+}
+
+/* Opcodes that end a translated block; used only now and then */
+static int diff_block_end(int op)
+{
+    switch (op) {
+      case 0x76: case 0xcb: case 0xd3: case 0xdb:
+      case 0xdd: case 0xed: case 0xf3: case 0xfb: case 0xfd:
+	return TRUE;
+    }
+    return FALSE;
+}
+
+/* Print where the translator and interpreter disagree */
+static void diff_report(int test, int count)
+{
+    static const struct {
+	const char *name;
+	size_t offset;
+    } regs[] = {
+	{ "AF", offsetof(struct z80_state_struct, af) },
+	{ "BC", offsetof(struct z80_state_struct, bc) },
+	{ "DE", offsetof(struct z80_state_struct, de) },
+	{ "HL", offsetof(struct z80_state_struct, hl) },
+	{ "IX", offsetof(struct z80_state_struct, ix) },
+	{ "IY", offsetof(struct z80_state_struct, iy) },
+	{ "SP", offsetof(struct z80_state_struct, sp) },
+	{ "PC", offsetof(struct z80_state_struct, pc) },
+	{ "AF'", offsetof(struct z80_state_struct, af_prime) },
+	{ "BC'", offsetof(struct z80_state_struct, bc_prime) },
+	{ "DE'", offsetof(struct z80_state_struct, de_prime) },
+	{ "HL'", offsetof(struct z80_state_struct, hl_prime) },
+    };
+    const struct z80_state_struct *j = &diff_state[1];
+    int i, diffs = 0;
+
+    for (i = 0; i < (int) (sizeof(regs) / sizeof(regs[0])); i++) {
+	int jv = ((const wordregister *)
+		  ((const char *) j + regs[i].offset))->word;
+	int iv = ((const wordregister *)
+		  ((const char *) &z80_state + regs[i].offset))->word;
+	if (jv != iv) {
+	    printf(" %s %04X/%04X", regs[i].name, jv, iv);
+	    diffs++;
+	}
+    }
+    if (j->r != z80_state.r || j->r7 != z80_state.r7) {
+	printf(" R %02X/%02X", (j->r & 0x7f) | j->r7,
+	       (z80_state.r & 0x7f) | z80_state.r7);
+	diffs++;
+    }
+    if (j->t_count != z80_state.t_count) {
+	printf(" T %llu/%llu", (unsigned long long) j->t_count,
+	       (unsigned long long) z80_state.t_count);
+	diffs++;
+    }
+    for (i = 0; i < ADDRESS_SPACE; i++) {
+	if (diff_ram[1][i] != ram[i]) {
+	    printf(" (%04X) %02X/%02X", i, diff_ram[1][i], ram[i]);
+	    diffs++;
+	    break;
+	}
+    }
+    if (diffs == 0) return;
+
+    printf("  [translated/interpreted]\n");
+    printf("test %d, %d instructions from", test, count);
+    for (i = 0; i < 8; i++) printf(" %02X", diff_ram[0][CODE + i]);
+    printf(" ...\n");
+    mismatches++;
+}
+
+static int check_translator(int tests)
+{
+    int test, i, op, count;
+    unsigned long insns = 0;
+
+    z80_jit_enabled = TRUE;
+    for (test = 0; test < tests; test++) {
+	for (i = 0; i < ADDRESS_SPACE; i++) ram[i] = diff_random();
+	for (i = 0; i < DIFF_CODE; i++) {
+	    do {
+		op = diff_random() & 0xff;
+	    } while (diff_block_end(op) && diff_random() % 16 != 0);
+	    ram[CODE + i] = op;
+	}
+	z80_jit_flush();
+
+	z80_reset();
+	REG_AF = diff_random() << 1; REG_BC = diff_random() << 1;
+	REG_DE = diff_random() << 1; REG_HL = diff_random() << 1;
+	REG_IX = diff_random() << 1; REG_IY = diff_random() << 1;
+	REG_SP = diff_random() << 1;
+	REG_AF_PRIME = diff_random(); REG_BC_PRIME = diff_random();
+	REG_DE_PRIME = diff_random(); REG_HL_PRIME = diff_random();
+	REG_R = diff_random();
+	REG_PC = CODE;
+	memcpy(diff_ram[0], ram, ADDRESS_SPACE);
+	diff_state[0] = z80_state;
+
+	/* Visit until translated; some blocks cannot be */
+	for (i = 0, count = 0; i <= 32 && count == 0; i++) {
+	    count = z80_jit_run();
+	}
+	if (!z80_jit_enabled) {
+	    printf("translator not available on this host\n");
+	    return 0;
+	}
+	if (count == 0) continue;
+	memcpy(diff_ram[1], ram, ADDRESS_SPACE);
+	diff_state[1] = z80_state;
+
+	memcpy(ram, diff_ram[0], ADDRESS_SPACE);
+	z80_jit_flush();
+	z80_state = diff_state[0];
+	for (i = 0; i < count; i++) z80_run(0);
+	insns += count;
+	diff_report(test, count);
+    }
+    printf("%d tests, %lu instructions, %d mismatch%s\n", tests, insns,
+	   mismatches, mismatches == 1 ? "" : "es");
+    return mismatches ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int c, timing = FALSE, diff = FALSE, status = 0;
+
+    program_name = argv[0];
+    opterr = 0;
+    while ((c = getopt(argc, argv, ARGS)) != -1) {
+	switch (c) {
+	  case 'j':
+	    z80_jit_enabled = TRUE;
+	    break;
+	  case 't':
+	    timing = TRUE;
+	    break;
+	  case 'd':
+	    diff = TRUE;
+	    break;
+	  default:
+	    fprintf(stderr, "Usage: %s [-j] program.com...\n"
+		    "       %s -t\n"
+		    "       %s -d [count]\n",
+		    program_name, program_name, program_name);
+	    return 2;
+	}
+    }
+
+    if (timing) {
+	z80_jit_enabled = FALSE;
+	return check_timing();
+    }
+    if (diff) {
+	return check_translator(optind < argc ? atoi(argv[optind]) :
+				DIFF_TESTS);
+    }
+    if (optind == argc) {
+	fprintf(stderr, "%s: no programs to run\n", program_name);
+	return 2;
+    }
+    for (; optind < argc; optind++) {
+	if (run_com(argv[optind]) != 0) status = 1;
+    }
+    return status;
+}